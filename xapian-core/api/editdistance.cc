@@ -8,9 +8,15 @@
  *  and David Roach, Acxiom Corporation
  *
  *  http://berghel.net/publications/asm/asm.php
+ *
+ *  EditDistanceCalculator uses the bit-vector algorithm from:
+ *
+ *  "A Bit-Vector Algorithm for Computing Levenshtein and Damerau Edit
+ *  Distances" by Heikki Hyyrö, Nordic Journal of Computing 10 (2003)
  */
 /* Copyright (C) 2003 Richard Boulton
  * Copyright (C) 2007,2008,2009 Olly Betts
+ * Copyright (C) 2026 The Xapian contributors
  *
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -213,3 +219,65 @@ edit_distance_unsigned(const unsigned * ptr1, int len1,
 {
     return seqcmp_editdist<unsigned>(ptr1, len1, ptr2, len2, max_distance);
 }
+
+EditDistanceCalculator::EditDistanceCalculator(const unsigned * ptr, int len)
+    : target(ptr, ptr + len)
+{
+    if (len > MAX_BITPARALLEL_LEN) return;
+
+    fill(peq_mask, peq_mask + PEQ_SLOTS, uint8(0));
+    for (int j = 0; j != len; ++j) {
+	unsigned ch = ptr[j];
+	unsigned i = peq_slot(ch);
+	while (peq_mask[i] && peq_char[i] != ch) {
+	    i = (i + 1) & (PEQ_SLOTS - 1);
+	}
+	peq_char[i] = ch;
+	peq_mask[i] |= uint8(1) << j;
+    }
+}
+
+int
+EditDistanceCalculator::operator()(const unsigned * ptr, int len,
+				   int max_distance) const
+{
+    int m = int(target.size());
+    if (m > MAX_BITPARALLEL_LEN) {
+	return edit_distance_unsigned(&target[0], m, ptr, len, max_distance);
+    }
+    if (m == 0) return len;
+
+    // Bit j of each vector describes row j + 1 of the dynamic programming
+    // matrix, which has a row for each character of the target and a column
+    // for each character of the candidate.  vp and vn flag where the
+    // vertical difference between a cell and the one above it is +1 and -1
+    // in the current column; d0 flags where the diagonal difference is 0.
+    // Bits above row m may hold junk, but carries and shifts only move
+    // upwards so it never affects the rows we care about.
+    const uint8 last_row = uint8(1) << (m - 1);
+    uint8 vp = ~uint8(0);
+    uint8 vn = 0;
+    uint8 d0 = 0;
+    uint8 pm_prev = 0;
+    int distance = m;
+    for (int i = 0; i != len; ++i) {
+	uint8 pm = get_peq(ptr[i]);
+	// Cells where a transposition gives a zero diagonal difference.
+	uint8 tr = ((~d0 & pm) << 1) & pm_prev;
+	d0 = (((pm & vp) + vp) ^ vp) | pm | vn | tr;
+	uint8 hp = vn | ~(d0 | vp);
+	uint8 hn = d0 & vp;
+	if (hp & last_row) {
+	    ++distance;
+	} else if (hn & last_row) {
+	    --distance;
+	}
+	// The distance can fall by at most one per remaining character.
+	if (distance - (len - i - 1) > max_distance) return distance;
+	uint8 x = (hp << 1) | 1;
+	vn = x & d0;
+	vp = (hn << 1) | ~(x | d0);
+	pm_prev = pm;
+    }
+    return distance;
+}
@@ -3,6 +3,7 @@
  */
 /* Copyright (C) 2003 Richard Boulton
  * Copyright (C) 2007,2008 Olly Betts
+ * Copyright (C) 2026 The Xapian contributors
  *
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -22,6 +23,10 @@
 #ifndef XAPIAN_INCLUDED_EDITDISTANCE_H
 #define XAPIAN_INCLUDED_EDITDISTANCE_H
 
+#include "internaltypes.h"
+
+#include <vector>
+
 /** Calculate the edit distance between two sequences.
  *
  *  Edit distance is defined as the minimum number of edit operations
@@ -49,4 +54,75 @@ int edit_distance_unsigned(const unsigned* ptr1, int len1,
 			   const unsigned* ptr2, int len2,
 			   int max_distance);
 
+/** Calculate the edit distance from one sequence to many others.
+ *
+ *  The edit distance is as for edit_distance_unsigned(), but the target
+ *  sequence is preprocessed once so each candidate can be checked cheaply.
+ *
+ *  If the target is at most MAX_BITPARALLEL_LEN characters long, the
+ *  bit-parallel algorithm of Myers, as extended by Hyyrö to handle
+ *  transpositions, is used.  This takes a handful of word operations per
+ *  character of the candidate, and doesn't allocate any memory.  Longer
+ *  targets fall back to edit_distance_unsigned().
+ */
+class EditDistanceCalculator {
+    /// Don't allow assignment.
+    void operator=(const EditDistanceCalculator &);
+
+    /// Don't allow copying.
+    EditDistanceCalculator(const EditDistanceCalculator &);
+
+    /** Number of slots in the table of character match bitmaps.
+     *
+     *  Must be a power of two greater than MAX_BITPARALLEL_LEN.
+     */
+    static const unsigned PEQ_SLOTS = 128;
+
+    /// The target sequence.
+    std::vector<unsigned> target;
+
+    /** Characters in the target, hashed by peq_slot().
+     *
+     *  Only meaningful where the corresponding entry in peq_mask is
+     *  non-zero.
+     */
+    unsigned peq_char[PEQ_SLOTS];
+
+    /// Bitmap of the positions in the target at which each character occurs.
+    uint8 peq_mask[PEQ_SLOTS];
+
+    static unsigned peq_slot(unsigned ch) {
+	return ((ch * 0x9e3779b1u) >> 25) & (PEQ_SLOTS - 1);
+    }
+
+    /// Return bitmap of the positions in the target at which ch occurs.
+    uint8 get_peq(unsigned ch) const {
+	unsigned i = peq_slot(ch);
+	while (peq_mask[i]) {
+	    if (peq_char[i] == ch) return peq_mask[i];
+	    i = (i + 1) & (PEQ_SLOTS - 1);
+	}
+	return 0;
+    }
+
+  public:
+    /// The longest target the bit-parallel algorithm handles.
+    static const int MAX_BITPARALLEL_LEN = 64;
+
+    /** Constructor.
+     *
+     *  @param ptr  A pointer to the start of the target sequence.
+     *  @param len  The length of the target sequence.
+     */
+    EditDistanceCalculator(const unsigned * ptr, int len);
+
+    /** Calculate the edit distance from the target to a candidate.
+     *
+     *  @param ptr	    A pointer to the start of the candidate sequence.
+     *  @param len	    The length of the candidate sequence.
+     *  @param max_distance As for edit_distance_unsigned().
+     */
+    int operator()(const unsigned * ptr, int len, int max_distance) const;
+};
+
 #endif // XAPIAN_INCLUDED_EDITDISTANCE_H
@@ -324,7 +324,8 @@ ValueCountMatchSpy::top_values_begin(size_t maxvalues) const
 
 MatchSpy *
 ValueCountMatchSpy::clone() const {
-    Assert(internal.get());
+    // The default-constructed object in a Registry has no internals.
+    if (!internal.get()) return new ValueCountMatchSpy();
     return new ValueCountMatchSpy(internal->slot);
 }
 
@@ -4,6 +4,7 @@
  * Copyright 2001,2002 Ananova Ltd
  * Copyright 2002,2003,2004,2005,2006,2007,2008,2009,2010,2011,2013,2014 Olly Betts
  * Copyright 2006,2008 Lemur Consulting Ltd
+ * Copyright 2026 The Xapian contributors
  *
  * This program is free software; you can redistribute it and/or
  * modify it under the terms of the GNU General Public License as
@@ -39,13 +40,19 @@
 #include "backends/multi/multi_termlist.h"
 #include "backends/multivaluelist.h"
 #include "backends/database.h"
+#ifdef XAPIAN_HAS_GLASS_BACKEND
+# include "backends/glass/glass_blockcache.h"
+#endif
 #include "editdistance.h"
 #include "expand/ortermlist.h"
 #include "noreturn.h"
+#include "vectortermlist.h"
 
 #include <algorithm>
 #include <cstdlib> // For abs().
 #include <cstring>
+#include <set>
+#include <utility>
 #include <vector>
 
 using namespace std;
@@ -560,24 +567,36 @@ Database::get_spelling_suggestion(const string &word,
 {
     LOGCALL(API, string, "Database::get_spelling_suggestion", word | max_edit_distance);
     if (word.size() <= 1) return string();
-    AutoPtr<TermList> merger;
+    // Sub-databases with a spelling index can give us a short list of
+    // candidates directly - others give us the words sharing trigrams with
+    // word, which we filter by how many they share.
+    AutoPtr<TermList> candidates;
+    AutoPtr<TermList> trigrams;
     for (size_t i = 0; i < internal.size(); ++i) {
-	TermList * tl = internal[i]->open_spelling_termlist(word);
+	AutoPtr<TermList> * merger = &candidates;
+	TermList * tl =
+	    internal[i]->open_spelling_candidates(word, max_edit_distance);
+	if (!tl) {
+	    merger = &trigrams;
+	    tl = internal[i]->open_spelling_termlist(word);
+	}
 	LOGLINE(SPELLING, "Sub db " << i << " tl = " << (void*)tl);
 	if (tl) {
-	    if (merger.get()) {
-		merger.reset(new OrTermList(merger.release(), tl));
+	    if (merger->get()) {
+		merger->reset(new OrTermList(merger->release(), tl));
 	    } else {
-		merger.reset(tl);
+		merger->reset(tl);
 	    }
 	}
     }
-    if (!merger.get()) RETURN(string());
+    if (!candidates.get() && !trigrams.get()) RETURN(string());
 
     // Convert word to UTF-32.
     // Extra brackets needed to avoid this being misparsed as a function
     // prototype.
     vector<unsigned> utf32_word((Utf8Iterator(word)), Utf8Iterator());
+    EditDistanceCalculator edit_distance(&utf32_word[0],
+					 int(utf32_word.size()));
 
     vector<unsigned> utf32_term;
 
@@ -586,18 +605,26 @@ Database::get_spelling_suggestion(const string &word,
     int edist_best = max_edit_distance;
     Xapian::doccount freq_best = 0;
     Xapian::doccount freq_exact = 0;
-    while (true) {
-	TermList *ret = merger->next();
-	if (ret) merger.reset(ret);
-
-	if (merger->at_end()) break;
-
-	string term = merger->get_termname();
-	Xapian::termcount score = merger->get_wdf();
-
-	LOGLINE(SPELLING, "Term \"" << term << "\" ngram score " << score);
-	if (score + TRIGRAM_SCORE_THRESHOLD >= best) {
-	    if (score > best) best = score;
+    for (int pass = 0; pass != 2; ++pass) {
+	bool use_trigrams = (pass == 1);
+	AutoPtr<TermList> & merger = use_trigrams ? trigrams : candidates;
+	if (!merger.get()) continue;
+	while (true) {
+	    TermList *ret = merger->next();
+	    if (ret) merger.reset(ret);
+
+	    if (merger->at_end()) break;
+
+	    string term = merger->get_termname();
+
+	    if (use_trigrams) {
+		Xapian::termcount score = merger->get_wdf();
+		LOGLINE(SPELLING, "Term \"" << term << "\" ngram score " << score);
+		if (score + TRIGRAM_SCORE_THRESHOLD < best) continue;
+		if (score > best) best = score;
+	    } else {
+		LOGLINE(SPELLING, "Candidate term \"" << term << "\"");
+	    }
 
 	    // There's no point considering a word where the difference
 	    // in length is greater than the smallest number of edits we've
@@ -625,11 +652,8 @@ Database::get_spelling_suggestion(const string &word,
 		continue;
 	    }
 
-	    int edist = edit_distance_unsigned(&utf32_term[0],
-					       int(utf32_term.size()),
-					       &utf32_word[0],
-					       int(utf32_word.size()),
-					       edist_best);
+	    int edist = edit_distance(&utf32_term[0], int(utf32_term.size()),
+				      edist_best);
 	    LOGLINE(SPELLING, "Edit distance " << edist);
 
 	    if (edist <= edist_best) {
@@ -661,6 +685,68 @@ Database::get_spelling_suggestion(const string &word,
     RETURN(result);
 }
 
+/// Order (termfreq, term) pairs most frequent first, then by term.
+static bool
+more_frequent(const pair<Xapian::doccount, string> & a,
+	      const pair<Xapian::doccount, string> & b)
+{
+    if (a.first != b.first) return a.first > b.first;
+    return a.second < b.second;
+}
+
+TermIterator
+Database::get_completions(const string & prefix, Xapian::termcount n) const
+{
+    LOGCALL(API, TermIterator, "Database::get_completions", prefix | n);
+    if (internal.size() == 1)
+	RETURN(TermIterator(internal[0]->open_completions(prefix, n)));
+
+    // Rank the best completions from each database by their combined
+    // frequency.  A term which isn't among those from a database is no more
+    // frequent there than the last of them, so if we have n candidates more
+    // frequent than the sum of these bounds, they must be the best overall.
+    set<string> candidates;
+    Xapian::doccount bound = 0;
+    for (size_t i = 0; i < internal.size(); ++i) {
+	AutoPtr<TermList> tl(internal[i]->open_completions(prefix, n));
+	Xapian::termcount count = 0;
+	string last;
+	while (true) {
+	    tl->next();
+	    if (tl->at_end())
+		break;
+	    last = tl->get_termname();
+	    candidates.insert(last);
+	    ++count;
+	}
+	if (n && count == n) {
+	    Xapian::doccount tf;
+	    internal[i]->get_freqs(last, &tf, NULL);
+	    bound += tf;
+	}
+    }
+    vector<pair<Xapian::doccount, string>> ranked;
+    set<string>::const_iterator i;
+    for (i = candidates.begin(); i != candidates.end(); ++i) {
+	ranked.push_back(make_pair(get_termfreq(*i), *i));
+    }
+    sort(ranked.begin(), ranked.end(), more_frequent);
+    if (n && ranked.size() >= n) {
+	if (ranked[n - 1].first <= bound) {
+	    // We can't tell from the candidates, so look at every term.
+	    TermList * tl = new MultiAllTermsList(internal, prefix);
+	    RETURN(TermIterator(Database::Internal::most_frequent_terms(tl, n)));
+	}
+	ranked.resize(n);
+    }
+    vector<string> terms;
+    vector<pair<Xapian::doccount, string>>::const_iterator j;
+    for (j = ranked.begin(); j != ranked.end(); ++j) {
+	terms.push_back(j->second);
+    }
+    RETURN(TermIterator(new VectorTermList(terms.begin(), terms.end())));
+}
+
 TermIterator
 Database::spellings_begin() const
 {
@@ -750,6 +836,45 @@ Database::get_uuid() const
     RETURN(uuid);
 }
 
+void
+Database::set_block_cache_size(size_t max_size)
+{
+    LOGCALL_STATIC_VOID(API, "Database::set_block_cache_size", max_size);
+#ifdef XAPIAN_HAS_GLASS_BACKEND
+    GlassBlockCache::get_instance().set_max_size(max_size);
+#else
+    (void)max_size;
+#endif
+}
+
+size_t
+Database::get_block_cache_size()
+{
+    LOGCALL_STATIC(API, size_t, "Database::get_block_cache_size", NO_ARGS);
+#ifdef XAPIAN_HAS_GLASS_BACKEND
+    RETURN(GlassBlockCache::get_instance().get_max_size());
+#else
+    RETURN(0);
+#endif
+}
+
+void
+Database::get_block_cache_stats(unsigned long & hits,
+				unsigned long & misses,
+				size_t & used)
+{
+    LOGCALL_STATIC_VOID(API, "Database::get_block_cache_stats", NO_ARGS);
+#ifdef XAPIAN_HAS_GLASS_BACKEND
+    GlassBlockCache & cache = GlassBlockCache::get_instance();
+    hits = cache.get_hits();
+    misses = cache.get_misses();
+    used = cache.get_size();
+#else
+    hits = misses = 0;
+    used = 0;
+#endif
+}
+
 ///////////////////////////////////////////////////////////////////////////
 
 WritableDatabase::WritableDatabase() : Database()
@@ -995,6 +1120,17 @@ WritableDatabase::set_metadata(const string & key, const string & value)
     internal[0]->set_metadata(key, value);
 }
 
+void
+WritableDatabase::set_flush_memory(size_t bytes)
+{
+    LOGCALL_VOID(API, "WritableDatabase::set_flush_memory", bytes);
+    size_t n_dbs = internal.size();
+    if (rare(n_dbs == 0))
+	no_subdatabases();
+    for (size_t i = 0; i != n_dbs; ++i)
+	internal[i]->set_flush_memory(bytes);
+}
+
 string
 WritableDatabase::get_description() const
 {
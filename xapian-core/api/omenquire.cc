@@ -293,6 +293,13 @@ MSet::get_max_attained() const
     return internal->max_attained;
 }
 
+bool
+MSet::is_partial() const
+{
+    Assert(internal.get() != 0);
+    return internal->partial;
+}
+
 string
 MSet::snippet(const string & text,
 	      size_t length,
@@ -593,7 +600,8 @@ Enquire::Internal::Internal(const Database &db_)
   : db(db_), query(), collapse_key(Xapian::BAD_VALUENO), collapse_max(0),
     order(Enquire::ASCENDING), percent_cutoff(0), weight_cutoff(0),
     sort_key(Xapian::BAD_VALUENO), sort_by(REL), sort_value_forward(true),
-    sorter(0), time_limit(0.0), weight(0),
+    sorter(0), time_limit(0.0), parallel_shards(0), remote_timeout(0.0),
+    remote_prefetch(0), weight(0),
     eweightname("trad"), expand_k(1.0)
 {
     if (db.internal.empty()) {
@@ -649,7 +657,8 @@ Enquire::Internal::get_mset(Xapian::doccount first, Xapian::doccount maxitems,
 		       collapse_max, collapse_key,
 		       percent_cutoff, weight_cutoff,
 		       order, sort_key, sort_by, sort_value_forward,
-		       time_limit, *(stats.get()), weight, spies,
+		       time_limit, parallel_shards, remote_timeout,
+		       remote_prefetch, *(stats.get()), weight, spies,
 		       (sorter.get() != NULL),
 		       (mdecider != NULL));
     // Run query and put results into supplied Xapian::MSet object.
@@ -1006,6 +1015,24 @@ Enquire::set_time_limit(double time_limit)
     internal->time_limit = time_limit;
 }
 
+void
+Enquire::set_parallel_shards(unsigned n_threads)
+{
+    internal->parallel_shards = n_threads;
+}
+
+void
+Enquire::set_remote_timeout(double remote_timeout)
+{
+    internal->remote_timeout = remote_timeout;
+}
+
+void
+Enquire::set_remote_prefetch(Xapian::doccount n_docs)
+{
+    internal->remote_prefetch = n_docs;
+}
+
 MSet
 Enquire::get_mset(Xapian::doccount first, Xapian::doccount maxitems,
 		  Xapian::doccount check_at_least, const RSet *rset,
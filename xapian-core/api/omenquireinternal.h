@@ -153,6 +153,15 @@ class Enquire::Internal : public Xapian::Internal::intrusive_base {
 
 	double time_limit;
 
+	/// Maximum number of threads to match sub-databases with.
+	unsigned parallel_shards;
+
+	/// Seconds to wait for remote sub-databases to return results.
+	double remote_timeout;
+
+	/// Number of top documents remote sub-databases send with results.
+	Xapian::doccount remote_prefetch;
+
 	/** The weight to use for this query.
 	 *
 	 *  This is mutable so that the default BM25Weight object can be
@@ -250,6 +259,9 @@ class MSet::Internal : public Xapian::Internal::intrusive_base {
 
 	double max_attained;
 
+	/// Were any remote sub-databases dropped from the match?
+	bool partial;
+
 	Internal()
 		: percent_factor(0),
 		  stats(NULL),
@@ -261,7 +273,8 @@ class MSet::Internal : public Xapian::Internal::intrusive_base {
 		  uncollapsed_estimated(0),
 		  uncollapsed_upper_bound(0),
 		  max_possible(0),
-		  max_attained(0) {}
+		  max_attained(0),
+		  partial(false) {}
 
 	/// Note: destroys parameter items.
 	Internal(Xapian::doccount firstitem_,
@@ -285,7 +298,8 @@ class MSet::Internal : public Xapian::Internal::intrusive_base {
 		  uncollapsed_estimated(uncollapsed_estimated_),
 		  uncollapsed_upper_bound(uncollapsed_upper_bound_),
 		  max_possible(max_possible_),
-		  max_attained(max_attained_) {
+		  max_attained(max_attained_),
+		  partial(false) {
 	    std::swap(items, items_);
 	}
 
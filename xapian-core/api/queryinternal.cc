@@ -157,9 +157,6 @@ class OrContext : public Context {
     void select_elite_set(QueryOptimiser * qopt,
 			  size_t set_size, size_t out_of);
 
-    /// Select the set_size postlists with the highest term frequency.
-    void select_most_frequent(QueryOptimiser * qopt, size_t set_size);
-
     PostList * postlist(QueryOptimiser* qopt);
     PostList * postlist_max(QueryOptimiser* qopt);
 };
@@ -187,25 +184,6 @@ OrContext::select_elite_set(QueryOptimiser * qopt,
     pls.resize(pls.size() - out_of + set_size);
 }
 
-void
-OrContext::select_most_frequent(QueryOptimiser * qopt, size_t set_size)
-{
-    vector<PostList*>::iterator begin = pls.begin();
-    nth_element(begin, begin + set_size - 1, pls.end(),
-		ComparePostListTermFreqAscending());
-    const PostList * hint_pl = qopt->get_hint_postlist();
-    for_each(begin + set_size, pls.end(),
-	[&qopt, &hint_pl](const PostList * p) {
-	    if (rare(p == hint_pl)) {
-		qopt->take_hint_ownership();
-		hint_pl = NULL;
-	    } else {
-		delete p;
-	    }
-	});
-    pls.resize(set_size);
-}
-
 PostList *
 OrContext::postlist(QueryOptimiser* qopt)
 {
@@ -923,40 +901,46 @@ QueryWildcard::postlist(QueryOptimiser * qopt, double factor) const
 	or_factor = factor;
     }
     OrContext ctx(0);
-    AutoPtr<TermList> t(qopt->db.open_allterms(pattern));
-    Xapian::termcount expansions_left = max_expansion;
-    // If there's no expansion limit, set expansions_left to the maximum
-    // value Xapian::termcount can hold.
-    if (expansions_left == 0)
-	--expansions_left;
-    while (true) {
-	t->next();
-	if (t->at_end())
-	    break;
-	if (max_type < Xapian::Query::WILDCARD_LIMIT_MOST_FREQUENT) {
-	    if (expansions_left-- == 0) {
-		if (max_type == Xapian::Query::WILDCARD_LIMIT_FIRST)
-		    break;
-		string msg("Wildcard ");
-		msg += pattern;
-		msg += "* expands to more than ";
-		msg += str(max_expansion);
-		msg += " terms";
-		throw Xapian::WildcardError(msg);
+    if (max_type == Xapian::Query::WILDCARD_LIMIT_MOST_FREQUENT &&
+	max_expansion != 0) {
+	// Ask the database for the most frequent terms, so we only open
+	// posting lists for (and register for stats) the terms we actually
+	// use.  Backends with precomputed completions can answer this without
+	// looking at every term with the prefix.
+	AutoPtr<TermList> t(qopt->db.open_completions(pattern, max_expansion));
+	while (true) {
+	    t->next();
+	    if (t->at_end())
+		break;
+	    const string & term = t->get_termname();
+	    ctx.add_postlist(qopt->open_lazy_post_list(term, 1, or_factor));
+	}
+    } else {
+	AutoPtr<TermList> t(qopt->db.open_allterms(pattern));
+	Xapian::termcount expansions_left = max_expansion;
+	// If there's no expansion limit, set expansions_left to the maximum
+	// value Xapian::termcount can hold.
+	if (expansions_left == 0)
+	    --expansions_left;
+	while (true) {
+	    t->next();
+	    if (t->at_end())
+		break;
+	    if (max_type < Xapian::Query::WILDCARD_LIMIT_MOST_FREQUENT) {
+		if (expansions_left-- == 0) {
+		    if (max_type == Xapian::Query::WILDCARD_LIMIT_FIRST)
+			break;
+		    string msg("Wildcard ");
+		    msg += pattern;
+		    msg += "* expands to more than ";
+		    msg += str(max_expansion);
+		    msg += " terms";
+		    throw Xapian::WildcardError(msg);
+		}
 	    }
+	    const string & term = t->get_termname();
+	    ctx.add_postlist(qopt->open_lazy_post_list(term, 1, or_factor));
 	}
-	const string & term = t->get_termname();
-	ctx.add_postlist(qopt->open_lazy_post_list(term, 1, or_factor));
-    }
-
-    if (max_type == Xapian::Query::WILDCARD_LIMIT_MOST_FREQUENT) {
-	// FIXME: open_lazy_post_list() results in the term getting registered
-	// for stats, so we still incur an avoidable cost from the full
-	// expansion size of the wildcard, which is most likely to be visible
-	// with the remote backend.  Perhaps we should split creating the lazy
-	// postlist from registering the term for stats.
-	if (ctx.size() > max_expansion)
-	    ctx.select_most_frequent(qopt, max_expansion);
     }
 
     if (factor != 0.0) {
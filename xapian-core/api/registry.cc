@@ -70,6 +70,10 @@ class Xapian::Registry::Internal : public Xapian::Internal::intrusive_base {
 
   public:
     Internal();
+
+    /// Copy the registered objects from @a other.
+    Internal(const Internal & other);
+
     ~Internal();
 };
 
@@ -106,6 +110,23 @@ register_object(map<string, T*> & registry, const T & obj)
     r.first->second = clone;
 }
  
+template<class T>
+static inline void
+clone_objects(map<string, T*> & registry, const map<string, T*> & other)
+{
+    typename map<string, T*>::const_iterator i;
+    for (i = other.begin(); i != other.end(); ++i) {
+	T * clone = NULL;
+	if (i->second) {
+	    clone = i->second->clone();
+	    if (rare(!clone)) {
+		throw Xapian::InvalidOperationError("Unable to copy registry - clone() method returned NULL");
+	    }
+	}
+	registry[i->first] = clone;
+    }
+}
+
 template<class T>
 static inline const T *
 lookup_object(map<string, T*> registry, const string & name)
@@ -124,6 +145,23 @@ Registry::Internal::Internal()
     add_defaults();
 }
 
+Registry::Internal::Internal(const Internal & other)
+    : Xapian::Internal::intrusive_base()
+{
+    try {
+	clone_objects(wtschemes, other.wtschemes);
+	clone_objects(postingsources, other.postingsources);
+	clone_objects(matchspies, other.matchspies);
+	clone_objects(lat_long_metrics, other.lat_long_metrics);
+    } catch (...) {
+	clear_weighting_schemes();
+	clear_posting_sources();
+	clear_match_spies();
+	clear_lat_long_metrics();
+	throw;
+    }
+}
+
 Registry::Internal::~Internal()
 {
     clear_weighting_schemes();
@@ -240,6 +278,12 @@ Registry::Registry()
     LOGCALL_CTOR(API, "Registry", NO_ARGS);
 }
 
+Registry::Registry(Registry::Internal * internal_)
+	: internal(internal_)
+{
+    LOGCALL_CTOR(API, "Registry", internal_);
+}
+
 Registry::~Registry()
 {
     LOGCALL_DTOR(API, "Registry");
@@ -250,6 +294,13 @@ Registry::~Registry()
     // compiler tries to generate a default destructor.
 }
 
+Registry
+Registry::clone_internals() const
+{
+    LOGCALL(API, Xapian::Registry, "Xapian::Registry::clone_internals", NO_ARGS);
+    RETURN(Registry(new Registry::Internal(*internal)));
+}
+
 void
 Registry::register_weighting_scheme(const Xapian::Weight &wt)
 {
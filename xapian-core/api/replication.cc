@@ -3,6 +3,7 @@
  */
 /* Copyright (C) 2008 Lemur Consulting Ltd
  * Copyright (C) 2008,2009,2010,2011,2012,2013,2014,2015,2016 Olly Betts
+ * Copyright (C) 2026 The Xapian contributors
  *
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -32,10 +33,14 @@
 #include "backends/database.h"
 #include "backends/databasereplicator.h"
 #include "debuglog.h"
+#include "fd.h"
 #include "filetests.h"
 #include "fileutils.h"
+#include "internaltypes.h"
 #include "io_utils.h"
 #include "omassert.h"
+#include "pack.h"
+#include "posixy_wrapper.h"
 #include "realtime.h"
 #include "net/remoteconnection.h"
 #include "noreturn.h"
@@ -43,13 +48,20 @@
 #include "safeerrno.h"
 #include "safesysstat.h"
 #include "safeunistd.h"
+#include "sha1.h"
 #include "net/length.h"
 #include "str.h"
 #include "unicode/description_append.h"
 
 #include "autoptr.h"
+#include <algorithm>
+#include <cstring>
 #include <fstream>
+#include <map>
+#include <mutex>
 #include <string>
+#include <utility>
+#include <vector>
 
 using namespace std;
 using namespace Xapian;
@@ -72,6 +84,16 @@ DatabaseMaster::write_changesets_to_fd(int fd,
 				       ReplicationInfo * info) const
 {
     LOGCALL_VOID(REPLICA, "DatabaseMaster::write_changesets_to_fd", fd | start_revision | info);
+    write_changesets_to_fd(fd, start_revision, info, false);
+}
+
+void
+DatabaseMaster::write_changesets_to_fd(int fd,
+				       const string & start_revision,
+				       ReplicationInfo * info,
+				       bool copy_in_parts) const
+{
+    LOGCALL_VOID(REPLICA, "DatabaseMaster::write_changesets_to_fd", fd | start_revision | info | copy_in_parts);
     if (info != NULL)
 	info->clear();
     Database db;
@@ -107,7 +129,28 @@ DatabaseMaster::write_changesets_to_fd(int fd,
 	revision.assign(ptr, end - ptr);
     }
 
-    db.internal[0]->write_changesets_to_fd(fd, revision, need_whole_db, info);
+    db.internal[0]->write_changesets_to_fd(fd, revision, need_whole_db, info,
+					   copy_in_parts);
+}
+
+void
+DatabaseMaster::write_file_part_to_fd(int fd, const string & request) const
+{
+    LOGCALL_VOID(REPLICA, "DatabaseMaster::write_file_part_to_fd", fd | request);
+    Database db;
+    try {
+	db = Database(path);
+    } catch (const Xapian::DatabaseError & e) {
+	RemoteConnection conn(-1, fd);
+	conn.send_message(REPL_REPLY_FAIL,
+			  "Can't open database: " + e.get_msg(),
+			  0.0);
+	return;
+    }
+    if (db.internal.size() != 1) {
+	throw Xapian::InvalidOperationError("DatabaseMaster needs to be pointed at exactly one subdatabase");
+    }
+    db.internal[0]->write_file_part_to_fd(fd, request);
 }
 
 string
@@ -172,6 +215,45 @@ class DatabaseReplica::Internal : public Xapian::Internal::intrusive_base {
     /// The remote connection we're using.
     RemoteConnection * conn;
 
+    /** The blocks the replica needs to make a copy of the master.
+     *
+     *  This is appended to the revision, and is set from the block
+     *  checksums the master sent.  Empty if no checksums are pending.
+     */
+    string needed_blocks;
+
+    /// The revision of the live database which needed_blocks applies to.
+    string needed_blocks_revision;
+
+    /// The number of times block checksums have been received in a row.
+    unsigned delta_rounds;
+
+    /** Whether block checksums have been received since the revision was
+     *  last asked for.
+     */
+    mutable bool checksums_pending;
+
+    /// The DatabaseReplica this is the internals of.
+    DatabaseReplica * replica;
+
+    /// The object to fetch the parts of a database copy with (or NULL).
+    ReplicaPartFetcher * part_fetcher;
+
+    /// Protects the members below, which are used by several threads.
+    mutex parts_mutex;
+
+    /** The length of each file part of the current copy not yet applied.
+     *
+     *  Keyed by the file name and offset of the part.
+     */
+    map<pair<string, uint8>, size_t> parts_pending;
+
+    /** The revisions of the master when it sent each part of the copy.
+     *
+     *  The copy can't be made live until it reaches all of these.
+     */
+    vector<string> part_revisions;
+
     /** Update the stub database which points to a single database.
      *
      *  The stub database file is created at a separate path, and then
@@ -187,6 +269,27 @@ class DatabaseReplica::Internal : public Xapian::Internal::intrusive_base {
      */
     void apply_db_copy(double end_time);
 
+    /** Compare block checksums from the connection with the live database.
+     *
+     *  Sets needed_blocks to the blocks which differ.
+     */
+    void apply_block_checksums(double end_time);
+
+    /** Create a file in a DB copy from REPL_REPLY_DB_FILEDELTA messages.
+     *
+     *  Blocks which aren't sent are copied from the live database's copy of
+     *  the file.
+     */
+    void apply_file_delta(const string & filename, const string & filepath,
+			  double end_time);
+
+    /** Fetch the files in a DB copy listed in a REPL_REPLY_DB_FILEPARTS
+     *  message from the connection.
+     *
+     *  The parts are fetched with part_fetcher.
+     */
+    void apply_file_parts(const string & offline_path, double end_time);
+
     /** Check that a message type is as expected.
      *
      *  Throws a NetworkError if the type is not the expected one.
@@ -210,17 +313,28 @@ class DatabaseReplica::Internal : public Xapian::Internal::intrusive_base {
 
   public:
     /// Open a new DatabaseReplica::Internal for the specified path.
-    Internal(const string & path_);
+    Internal(const string & path_, DatabaseReplica * replica_);
 
     /// Destructor.
     ~Internal() { delete conn; }
 
     /// Get a string describing the current revision of the replica.
-    string get_revision_info() const;
+    string get_revision_info(bool block_deltas) const;
+
+    /// Check if the master sent block checksums instead of a copy.
+    bool delta_copy_pending() const { return checksums_pending; }
 
     /// Set the file descriptor to read changesets from.
     void set_read_fd(int fd);
 
+    /// Set the object to fetch the parts of a database copy with.
+    void set_part_fetcher(ReplicaPartFetcher * fetcher) {
+	part_fetcher = fetcher;
+    }
+
+    /// Apply a part of a file of a database copy.
+    void apply_file_part_from_fd(int fd);
+
     /// Read and apply the next changeset.
     bool apply_next_changeset(ReplicationInfo * info,
 			      double reader_close_time);
@@ -229,10 +343,12 @@ class DatabaseReplica::Internal : public Xapian::Internal::intrusive_base {
     string get_description() const { return path; }
 };
 
+ReplicaPartFetcher::~ReplicaPartFetcher() { }
+
 // Methods of DatabaseReplica
 
 DatabaseReplica::DatabaseReplica(const string & path)
-	: internal(new DatabaseReplica::Internal(path))
+	: internal(new DatabaseReplica::Internal(path, this))
 {
     LOGCALL_CTOR(REPLICA, "DatabaseReplica", path);
 }
@@ -247,7 +363,21 @@ string
 DatabaseReplica::get_revision_info() const
 {
     LOGCALL(REPLICA, string, "DatabaseReplica::get_revision_info", NO_ARGS);
-    RETURN(internal->get_revision_info());
+    RETURN(internal->get_revision_info(false));
+}
+
+string
+DatabaseReplica::get_revision_info(bool block_deltas) const
+{
+    LOGCALL(REPLICA, string, "DatabaseReplica::get_revision_info", block_deltas);
+    RETURN(internal->get_revision_info(block_deltas));
+}
+
+bool
+DatabaseReplica::delta_copy_pending() const
+{
+    LOGCALL(REPLICA, bool, "DatabaseReplica::delta_copy_pending", NO_ARGS);
+    RETURN(internal->delta_copy_pending());
 }
 
 void
@@ -257,6 +387,20 @@ DatabaseReplica::set_read_fd(int fd)
     internal->set_read_fd(fd);
 }
 
+void
+DatabaseReplica::set_part_fetcher(ReplicaPartFetcher * fetcher)
+{
+    LOGCALL_VOID(REPLICA, "DatabaseReplica::set_part_fetcher", fetcher);
+    internal->set_part_fetcher(fetcher);
+}
+
+void
+DatabaseReplica::apply_file_part_from_fd(int fd)
+{
+    LOGCALL_VOID(REPLICA, "DatabaseReplica::apply_file_part_from_fd", fd);
+    internal->apply_file_part_from_fd(fd);
+}
+
 bool
 DatabaseReplica::apply_next_changeset(ReplicationInfo * info,
 				      double reader_close_time)
@@ -297,10 +441,12 @@ DatabaseReplica::Internal::update_stub_database() const
     }
 }
 
-DatabaseReplica::Internal::Internal(const string & path_)
+DatabaseReplica::Internal::Internal(const string & path_,
+				    DatabaseReplica * replica_)
 	: path(path_), live_id(0), live_db(), have_offline_db(false),
 	  need_copy_next(false), offline_revision(), offline_needed_revision(),
-	  last_live_changeset_time(), conn(NULL)
+	  last_live_changeset_time(), conn(NULL), delta_rounds(0),
+	  checksums_pending(false), replica(replica_), part_fetcher(NULL)
 {
     LOGCALL_CTOR(REPLICA, "DatabaseReplica::Internal", path_);
 #if !defined XAPIAN_HAS_CHERT_BACKEND && !defined XAPIAN_HAS_GLASS_BACKEND
@@ -348,9 +494,9 @@ DatabaseReplica::Internal::Internal(const string & path_)
 }
 
 string
-DatabaseReplica::Internal::get_revision_info() const
+DatabaseReplica::Internal::get_revision_info(bool block_deltas) const
 {
-    LOGCALL(REPLICA, string, "DatabaseReplica::Internal::get_revision_info", NO_ARGS);
+    LOGCALL(REPLICA, string, "DatabaseReplica::Internal::get_revision_info", block_deltas);
     if (live_db.internal.empty())
 	live_db = WritableDatabase(get_replica_path(live_id), Xapian::DB_OPEN);
     if (live_db.internal.size() != 1)
@@ -362,6 +508,16 @@ DatabaseReplica::Internal::get_revision_info() const
     string buf = encode_length(uuid.size());
     buf += uuid;
     buf += (live_db.internal[0])->get_revision_info();
+    checksums_pending = false;
+    if (block_deltas && delta_rounds < MAX_DELTA_CHECKSUM_ROUNDS) {
+	// The list of blocks we need is only valid if the live database
+	// hasn't changed since we compared the checksums.
+	if (!needed_blocks.empty() && needed_blocks_revision == buf) {
+	    buf += needed_blocks;
+	} else {
+	    buf += REPL_DELTA_CAPABLE;
+	}
+    }
     RETURN(buf);
 }
 
@@ -373,11 +529,102 @@ DatabaseReplica::Internal::remove_offline_db()
     have_offline_db = false;
 }
 
+void
+DatabaseReplica::Internal::apply_block_checksums(double end_time)
+{
+    string buf;
+    int type = conn->get_message(buf, end_time);
+    check_message_type(type, REPL_REPLY_DB_CHECKSUMS);
+    // The master's UUID and revision, which it checks are still current when
+    // we ask for the blocks.
+    needed_blocks = REPL_DELTA_BLOCKS_NEEDED;
+    needed_blocks += buf;
+    needed_blocks_revision = get_revision_info(false);
+    ++delta_rounds;
+    checksums_pending = true;
+
+    string live_path = get_replica_path(live_id);
+    live_path += '/';
+    string block, checksum;
+    while (conn->sniff_next_message_type(end_time) == REPL_REPLY_DB_FILENAME) {
+	string filename;
+	type = conn->get_message(filename, end_time);
+	check_message_type(type, REPL_REPLY_DB_FILENAME);
+	if (filename.find("..") != string::npos) {
+	    throw NetworkError("Filename in database contains '..'");
+	}
+
+	string filepath = live_path + filename;
+	FD fd_live(posixy_open(filepath.c_str(), O_RDONLY | O_CLOEXEC));
+	bool live_eof = (fd_live == -1);
+	unsigned blocksize = 0;
+	// Runs of the number of blocks we have followed by the number we
+	// need.  Any blocks after these are needed too.
+	string runs;
+	size_t have = 0, need = 0;
+	while (conn->sniff_next_message_type(end_time) ==
+	       REPL_REPLY_DB_BLOCKCHECKSUMS) {
+	    type = conn->get_message(buf, end_time);
+	    check_message_type(type, REPL_REPLY_DB_BLOCKCHECKSUMS);
+	    const char * ptr = buf.data();
+	    const char * end = ptr + buf.size();
+	    unsigned msg_blocksize;
+	    if (!unpack_uint(&ptr, end, &msg_blocksize) ||
+		msg_blocksize < 2048 || msg_blocksize > 65536 ||
+		(msg_blocksize & (msg_blocksize - 1)) ||
+		(blocksize && msg_blocksize != blocksize) ||
+		(end - ptr) % SHA1_DIGEST_SIZE != 0) {
+		throw NetworkError("Invalid block checksums");
+	    }
+	    blocksize = msg_blocksize;
+	    block.resize(blocksize);
+	    for ( ; ptr != end; ptr += SHA1_DIGEST_SIZE) {
+		bool same = false;
+		if (!live_eof) {
+		    if (io_read(fd_live, &block[0], blocksize) == blocksize) {
+			checksum.resize(0);
+			append_sha1(checksum, block.data(), blocksize);
+			same = (memcmp(checksum.data(), ptr,
+				       SHA1_DIGEST_SIZE) == 0);
+		    } else {
+			live_eof = true;
+		    }
+		}
+		if (!same) {
+		    ++need;
+		    continue;
+		}
+		if (need) {
+		    pack_uint(runs, have);
+		    pack_uint(runs, need);
+		    have = need = 0;
+		}
+		++have;
+	    }
+	}
+	if (have) {
+	    pack_uint(runs, have);
+	    pack_uint(runs, need);
+	}
+	// If we have none of the file's blocks, it's just sent in full.
+	if (!runs.empty()) {
+	    pack_string(needed_blocks, filename);
+	    pack_uint(needed_blocks, blocksize);
+	    pack_string(needed_blocks, runs);
+	}
+    }
+}
+
 void
 DatabaseReplica::Internal::apply_db_copy(double end_time)
 {
+    // The live database is about to be replaced, so any list of the blocks
+    // we need from the master is finished with.
+    needed_blocks.resize(0);
+    delta_rounds = 0;
     have_offline_db = true;
     last_live_changeset_time = 0;
+    part_revisions.clear();
     string offline_path = get_replica_path(live_id ^ 1);
     // If there's already an offline database, discard it.  This happens if one
     // copy of the database was sent, but further updates were needed before it
@@ -410,6 +657,10 @@ DatabaseReplica::Internal::apply_db_copy(double end_time)
 	    return;
 	if (type == REPL_REPLY_DB_FOOTER)
 	    break;
+	if (type == REPL_REPLY_DB_FILEPARTS) {
+	    apply_file_parts(offline_path, end_time);
+	    continue;
+	}
 
 	type = conn->get_message(filename, end_time);
 	check_message_type(type, REPL_REPLY_DB_FILENAME);
@@ -425,6 +676,10 @@ DatabaseReplica::Internal::apply_db_copy(double end_time)
 	    return;
 
 	string filepath = offline_path + "/" + filename;
+	if (type == REPL_REPLY_DB_FILEDELTA) {
+	    apply_file_delta(filename, filepath, end_time);
+	    continue;
+	}
 	type = conn->receive_file(filepath, end_time);
 	if (type < 0)
 	    throw_connection_closed_unexpectedly();
@@ -433,6 +688,187 @@ DatabaseReplica::Internal::apply_db_copy(double end_time)
     int type = conn->get_message(offline_needed_revision, end_time);
     check_message_type(type, REPL_REPLY_DB_FOOTER);
     need_copy_next = false;
+
+    if (!part_revisions.empty()) {
+	// The parts may contain blocks from later revisions than the footer
+	// says the copy needs to reach.
+	AutoPtr<DatabaseReplicator> replicator(
+		DatabaseReplicator::open(offline_path));
+	for (const string & rev : part_revisions) {
+	    if (!replicator->check_revision_at_least(offline_needed_revision,
+						     rev)) {
+		offline_needed_revision = rev;
+	    }
+	}
+	part_revisions.clear();
+    }
+}
+
+void
+DatabaseReplica::Internal::apply_file_parts(const string & offline_path,
+					    double end_time)
+{
+    string buf;
+    int type = conn->get_message(buf, end_time);
+    check_message_type(type, REPL_REPLY_DB_FILEPARTS);
+    if (!part_fetcher) {
+	throw Xapian::InvalidOperationError("Database copy sent in parts, but "
+					    "no ReplicaPartFetcher was set");
+    }
+    size_t part_size = part_fetcher->get_part_size();
+    if (part_size == 0) {
+	throw Xapian::InvalidArgumentError("Part size must be non-zero");
+    }
+
+    vector<string> requests;
+    const char * ptr = buf.data();
+    const char * end = ptr + buf.size();
+    while (ptr != end) {
+	string filename;
+	uint8 size;
+	if (!unpack_string(&ptr, end, filename) ||
+	    !unpack_uint(&ptr, end, &size)) {
+	    throw NetworkError("Invalid file parts message");
+	}
+	if (filename.find("..") != string::npos) {
+	    throw NetworkError("Filename in database contains '..'");
+	}
+
+	// Create the file here, as an empty file has no parts.
+	string filepath = offline_path + "/" + filename;
+	FD fd(posixy_open(filepath.c_str(),
+			  O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666));
+	if (fd == -1)
+	    throw Xapian::DatabaseError("Couldn't open file for writing: " +
+					filepath, errno);
+
+	for (uint8 offset = 0; offset < size; offset += part_size) {
+	    size_t length = size_t(min(uint8(part_size), size - offset));
+	    string request;
+	    pack_string(request, offline_uuid);
+	    pack_string(request, filename);
+	    pack_uint(request, offset);
+	    pack_uint(request, length);
+	    requests.push_back(request);
+	    parts_pending[make_pair(filename, offset)] = length;
+	}
+    }
+
+    try {
+	part_fetcher->fetch_parts(*replica, requests);
+    } catch (...) {
+	parts_pending.clear();
+	throw;
+    }
+    if (!parts_pending.empty()) {
+	parts_pending.clear();
+	throw NetworkError("Not all parts of the database copy were fetched");
+    }
+}
+
+void
+DatabaseReplica::Internal::apply_file_part_from_fd(int fd)
+{
+    string buf;
+    int type;
+    {
+	// Parts are only sent in response to a request, so nothing after the
+	// part can be read from fd here.
+	RemoteConnection part_conn(fd, -1);
+	type = part_conn.get_message(buf, 0.0);
+    }
+    if (type == REPL_REPLY_FAIL)
+	throw NetworkError("Unable to fully synchronise: " + buf);
+    check_message_type(type, REPL_REPLY_DB_FILEPART);
+
+    string revision, filename;
+    uint8 offset;
+    const char * ptr = buf.data();
+    const char * end = ptr + buf.size();
+    if (!unpack_string(&ptr, end, revision) ||
+	!unpack_string(&ptr, end, filename) ||
+	!unpack_uint(&ptr, end, &offset)) {
+	throw NetworkError("Invalid file part");
+    }
+    size_t length = end - ptr;
+    {
+	lock_guard<mutex> lock(parts_mutex);
+	auto i = parts_pending.find(make_pair(filename, offset));
+	// The part is shorter than asked for if the file has been truncated
+	// since the copy started.
+	if (i == parts_pending.end() || i->second < length) {
+	    throw NetworkError("Unexpected file part");
+	}
+	parts_pending.erase(i);
+	part_revisions.push_back(revision);
+    }
+
+    string filepath = get_replica_path(live_id ^ 1);
+    filepath += '/';
+    filepath += filename;
+    FD fd_file(posixy_open(filepath.c_str(), O_WRONLY | O_CLOEXEC));
+    if (fd_file == -1)
+	throw Xapian::DatabaseError("Couldn't open file for writing: " +
+				    filepath, errno);
+    if (length)
+	io_write_block(fd_file, ptr, length, 0, off_t(offset));
+}
+
+void
+DatabaseReplica::Internal::apply_file_delta(const string & filename,
+					    const string & filepath,
+					    double end_time)
+{
+    FD fd(posixy_open(filepath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666));
+    if (fd == -1)
+	throw Xapian::DatabaseError("Couldn't open file for writing: " +
+				    filepath, errno);
+    // The unchanged blocks come from the live database, which is what the
+    // checksums we sent were calculated from.
+    string live_path = get_replica_path(live_id);
+    live_path += '/';
+    live_path += filename;
+    FD fd_live(posixy_open(live_path.c_str(), O_RDONLY | O_CLOEXEC));
+    int open_errno = errno;
+
+    string buf;
+    string block;
+    off_t block_number = 0;
+    while (conn->sniff_next_message_type(end_time) == REPL_REPLY_DB_FILEDELTA) {
+	int type = conn->get_message(buf, end_time);
+	check_message_type(type, REPL_REPLY_DB_FILEDELTA);
+	const char * ptr = buf.data();
+	const char * end = ptr + buf.size();
+	unsigned blocksize;
+	if (!unpack_uint(&ptr, end, &blocksize) ||
+	    blocksize < 2048 || blocksize > 65536 ||
+	    (blocksize & (blocksize - 1))) {
+	    throw NetworkError("Invalid blocksize in file delta");
+	}
+	block.resize(blocksize);
+	while (ptr != end) {
+	    size_t same, changed;
+	    if (!unpack_uint(&ptr, end, &same) ||
+		!unpack_uint(&ptr, end, &changed) ||
+		size_t(end - ptr) / blocksize < changed) {
+		throw NetworkError("Invalid file delta");
+	    }
+	    if (same && fd_live == -1) {
+		throw Xapian::DatabaseError("Couldn't open file for reading: " +
+					    live_path, open_errno);
+	    }
+	    while (same--) {
+		io_read_block(fd_live, &block[0], blocksize, block_number);
+		io_write_block(fd, block.data(), blocksize, block_number);
+		++block_number;
+	    }
+	    while (changed--) {
+		io_write_block(fd, ptr, blocksize, block_number);
+		ptr += blocksize;
+		++block_number;
+	    }
+	}
+    }
 }
 
 void
@@ -507,6 +943,11 @@ DatabaseReplica::Internal::apply_next_changeset(ReplicationInfo * info,
 		check_message_type(type, REPL_REPLY_END_OF_CHANGES);
 		RETURN(false);
 	    }
+	    case REPL_REPLY_DB_CHECKSUMS:
+		// The master needs to send a copy of the database, but sent
+		// checksums of its blocks first.
+		apply_block_checksums(0.0);
+		break;
 	    case REPL_REPLY_DB_HEADER:
 		// Apply the copy - remove offline db in case of any error.
 		try {
@@ -568,6 +1009,8 @@ DatabaseReplica::Internal::apply_next_changeset(ReplicationInfo * info,
 			replicator->apply_changeset_from_conn(*conn, 0.0, true);
 		    }
 		    last_live_changeset_time = RealTime::now();
+		    needed_blocks.resize(0);
+		    delta_rounds = 0;
 
 		    if (info != NULL) {
 			++(info->changeset_count);
@@ -3,6 +3,7 @@
  */
 /* Copyright 2008 Lemur Consulting Ltd
  * Copyright 2008,2011,2015,2016 Olly Betts
+ * Copyright 2026 The Xapian contributors
  *
  * This program is free software; you can redistribute it and/or
  * modify it under the terms of the GNU General Public License as
@@ -26,6 +27,7 @@
 #include "xapian/visibility.h"
 
 #include <string>
+#include <vector>
 
 namespace Xapian {
 
@@ -102,10 +104,76 @@ class XAPIAN_VISIBILITY_DEFAULT DatabaseMaster {
 				const std::string & start_revision,
 				ReplicationInfo * info) const;
 
+    /** Write a set of changesets, with any copy sent as file parts.
+     *
+     *  As write_changesets_to_fd() above, except that if @a copy_in_parts
+     *  is true, the table files of a copy of the database are listed rather
+     *  than sent, and the replica fetches each part of them with
+     *  write_file_part_to_fd() (which it can do over several connections at
+     *  once - see ReplicaPartFetcher).  Backends which don't support this
+     *  send the files as usual.
+     */
+    void write_changesets_to_fd(int fd,
+				const std::string & start_revision,
+				ReplicationInfo * info,
+				bool copy_in_parts) const;
+
+    /** Write part of a file of a copy of the database.
+     *
+     *  @param fd	An open file descriptor to write the part to.
+     *  @param request	The request for the part, as passed to
+     *			ReplicaPartFetcher::fetch_parts().
+     */
+    void write_file_part_to_fd(int fd, const std::string & request) const;
+
     /// Return a string describing this object.
     std::string get_description() const;
 };
 
+class DatabaseReplica;
+
+/** Fetches the parts of the files of a database copy for a replica.
+ *
+ *  A master asked to send a copy in parts lists the table files instead of
+ *  sending them, and the replica passes requests for the parts of them to
+ *  fetch_parts().  Fetching parts concurrently means a full copy isn't
+ *  limited by how fast a single connection can transfer it.
+ */
+class XAPIAN_VISIBILITY_DEFAULT ReplicaPartFetcher {
+    /// The size of each part in bytes.
+    size_t part_size;
+
+  public:
+    /** Constructor.
+     *
+     *  @param part_size_	The size of each part to request in bytes.
+     */
+    explicit ReplicaPartFetcher(size_t part_size_ = 16 * 1024 * 1024)
+	: part_size(part_size_) { }
+
+    /// Destructor.
+    virtual ~ReplicaPartFetcher();
+
+    /// Get the size of each part in bytes.
+    size_t get_part_size() const { return part_size; }
+
+    /** Fetch parts of the files of a database copy.
+     *
+     *  For each request, DatabaseMaster::write_file_part_to_fd() should be
+     *  called with it on the master, and what that writes passed to
+     *  @a replica's apply_file_part_from_fd().  The requests can be handled
+     *  in any order, and apply_file_part_from_fd() can be called from
+     *  several threads at once, but must not still be running when this
+     *  method returns.  Any exception thrown is propagated from
+     *  DatabaseReplica::apply_next_changeset().
+     *
+     *  @param replica	The replica to apply the parts to.
+     *  @param requests	The requests for the parts.
+     */
+    virtual void fetch_parts(DatabaseReplica & replica,
+			     const std::vector<std::string> & requests) = 0;
+};
+
 /** Access to a database replica, for applying replication to it.
  *
  *  Warning: the replication interface is currently experimental, and is liable
@@ -151,6 +219,30 @@ class XAPIAN_VISIBILITY_DEFAULT DatabaseReplica {
      */
     std::string get_revision_info() const;
 
+    /** Get a string describing the current revision of the replica.
+     *
+     *  @param block_deltas	If true, the master is told that the replica
+     *				can make a copy of the database from the
+     *				blocks which differ from its own (if the
+     *				backend supports this).  If the master then
+     *				needs to send a full copy, it sends checksums
+     *				of its blocks instead, and
+     *				delta_copy_pending() returns true once these
+     *				have been applied - ask the master for
+     *				updates again to be sent just the blocks
+     *				which differ.
+     */
+    std::string get_revision_info(bool block_deltas) const;
+
+    /** Check if the master sent block checksums instead of a full copy.
+     *
+     *  This is only ever true after get_revision_info(true) was used to ask
+     *  for updates.  If it is, ask the master for updates again, using
+     *  get_revision_info(true), and it will send the full copy as the blocks
+     *  which differ from the replica's.
+     */
+    bool delta_copy_pending() const;
+
     /** Set the file descriptor to read changesets from.
      *
      *  This will be remembered in the DatabaseReplica, but the caller is still
@@ -160,6 +252,25 @@ class XAPIAN_VISIBILITY_DEFAULT DatabaseReplica {
      */
     void set_read_fd(int fd);
 
+    /** Set the object to fetch the parts of a database copy with.
+     *
+     *  This is needed if the master is asked to send copies in parts.  The
+     *  object isn't owned by the DatabaseReplica, and must remain valid
+     *  while changesets are applied.
+     *
+     *  @param fetcher	The fetcher to use, or NULL for none.
+     */
+    void set_part_fetcher(ReplicaPartFetcher * fetcher);
+
+    /** Apply a part of a file of a database copy.
+     *
+     *  This should only be called by a ReplicaPartFetcher, while parts are
+     *  being fetched.  It can be called from several threads at once.
+     *
+     *  @param fd	The file descriptor to read the part from.
+     */
+    void apply_file_part_from_fd(int fd);
+
     /** Read and apply the next changeset.
      *
      *  If no changesets are found on the file descriptor, returns false
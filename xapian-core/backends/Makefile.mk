@@ -7,6 +7,7 @@ noinst_HEADERS +=\
 	backends/databasereplicator.h\
 	backends/document.h\
 	backends/flint_lock.h\
+	backends/flushpolicy.h\
 	backends/multivaluelist.h\
 	backends/positionlist.h\
 	backends/prefix_compressed_strings.h\
@@ -34,12 +35,14 @@ endif
 if BUILD_BACKEND_CHERT
 lib_src +=\
         backends/contiguousalldocspostlist.cc\
-	backends/flint_lock.cc
+	backends/flint_lock.cc\
+	backends/flushpolicy.cc
 else
 if BUILD_BACKEND_GLASS
 lib_src +=\
         backends/contiguousalldocspostlist.cc\
-	backends/flint_lock.cc
+	backends/flint_lock.cc\
+	backends/flushpolicy.cc
 endif
 endif
 
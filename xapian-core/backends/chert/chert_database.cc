@@ -567,7 +567,8 @@ void
 ChertDatabase::write_changesets_to_fd(int fd,
 				      const string & revision,
 				      bool need_whole_db,
-				      ReplicationInfo * info)
+				      ReplicationInfo * info,
+				      bool)
 {
     LOGCALL_VOID(DB, "ChertDatabase::write_changesets_to_fd", fd | revision | need_whole_db | info);
 
@@ -1052,18 +1053,12 @@ ChertWritableDatabase::ChertWritableDatabase(const string &dir, int action,
 	  freq_deltas(),
 	  doclens(),
 	  mod_plists(),
+	  changes_size(0),
 	  change_count(0),
-	  flush_threshold(0),
 	  modify_shortcut_document(NULL),
 	  modify_shortcut_docid(0)
 {
     LOGCALL_CTOR(DB, "ChertWritableDatabase", dir | action | block_size);
-
-    const char *p = getenv("XAPIAN_FLUSH_THRESHOLD");
-    if (p)
-	flush_threshold = atoi(p);
-    if (flush_threshold == 0)
-	flush_threshold = 10000;
 }
 
 ChertWritableDatabase::~ChertWritableDatabase()
@@ -1072,6 +1067,30 @@ ChertWritableDatabase::~ChertWritableDatabase()
     dtor_called();
 }
 
+size_t
+ChertWritableDatabase::get_memory_used() const
+{
+    return changes_size +
+	doclens.size() * map_node_size<Xapian::docid, Xapian::termcount>() +
+	value_manager.get_memory_used();
+}
+
+void
+ChertWritableDatabase::possibly_flush()
+{
+    if (flush_policy.should_flush(change_count, get_memory_used())) {
+	flush_postlist_changes();
+	if (!transaction_active()) apply();
+    }
+}
+
+void
+ChertWritableDatabase::set_flush_memory(size_t bytes)
+{
+    LOGCALL_VOID(DB, "ChertWritableDatabase::set_flush_memory", bytes);
+    flush_policy.set_memory_limit(bytes);
+}
+
 void
 ChertWritableDatabase::commit()
 {
@@ -1090,6 +1109,7 @@ ChertWritableDatabase::flush_postlist_changes() const
     freq_deltas.clear();
     doclens.clear();
     mod_plists.clear();
+    changes_size = 0;
     change_count = 0;
 }
 
@@ -1111,6 +1131,14 @@ ChertWritableDatabase::apply()
     ChertDatabase::apply();
 }
 
+/// Approximate memory used by an empty entry for @a tname in mod_plists.
+static inline size_t
+mod_plist_size(const string & tname)
+{
+    typedef map<docid, pair<char, termcount> > plist;
+    return map_node_size<string, plist>() + tname.size();
+}
+
 void
 ChertWritableDatabase::add_freq_delta(const string & tname,
 				      Xapian::termcount_diff tf_delta,
@@ -1120,6 +1148,8 @@ ChertWritableDatabase::add_freq_delta(const string & tname,
     i = freq_deltas.find(tname);
     if (i == freq_deltas.end()) {
 	freq_deltas.insert(make_pair(tname, make_pair(tf_delta, cf_delta)));
+	typedef pair<termcount_diff, termcount_diff> deltas;
+	changes_size += map_node_size<string, deltas>() + tname.size();
     } else {
 	i->second.first += tf_delta;
 	i->second.second += cf_delta;
@@ -1137,8 +1167,13 @@ ChertWritableDatabase::insert_mod_plist(Xapian::docid did,
     if (j == mod_plists.end()) {
 	map<docid, pair<char, termcount> > m;
 	j = mod_plists.insert(make_pair(tname, m)).first;
+	changes_size += mod_plist_size(tname);
+    }
+    if (j->second.insert(make_pair(did, make_pair('A', wdf))).second) {
+	changes_size += map_node_size<docid, pair<char, termcount> >();
+    } else {
+	j->second[did] = make_pair('A', wdf);
     }
-    j->second[did] = make_pair('A', wdf);
 }
 
 void
@@ -1153,12 +1188,14 @@ ChertWritableDatabase::update_mod_plist(Xapian::docid did,
     if (j == mod_plists.end()) {
 	map<docid, pair<char, termcount> > m;
 	j = mod_plists.insert(make_pair(tname, m)).first;
+	changes_size += mod_plist_size(tname);
     }
 
     map<docid, pair<char, termcount> >::iterator k;
     k = j->second.find(did);
     if (k == j->second.end()) {
 	j->second.insert(make_pair(did, make_pair(type, wdf)));
+	changes_size += map_node_size<docid, pair<char, termcount> >();
     } else {
 	if (type == 'A') {
 	    // Adding an entry which has already been deleted.
@@ -1235,20 +1272,8 @@ ChertWritableDatabase::add_document_(Xapian::docid did,
 	throw;
     }
 
-    // FIXME: this should be done by checking memory usage, not the number of
-    // changes.
-    // We could also look at:
-    // * mod_plists.size()
-    // * doclens.size()
-    // * freq_deltas.size()
-    //
-    // cout << "+++ mod_plists.size() " << mod_plists.size() <<
-    //     ", doclens.size() " << doclens.size() <<
-    //	   ", freq_deltas.size() " << freq_deltas.size() << endl;
-    if (++change_count >= flush_threshold) {
-	flush_postlist_changes();
-	if (!transaction_active()) apply();
-    }
+    ++change_count;
+    possibly_flush();
 
     RETURN(did);
 }
@@ -1311,10 +1336,8 @@ ChertWritableDatabase::delete_document(Xapian::docid did)
 	throw;
     }
 
-    if (++change_count >= flush_threshold) {
-	flush_postlist_changes();
-	if (!transaction_active()) apply();
-    }
+    ++change_count;
+    possibly_flush();
 }
 
 void
@@ -1486,10 +1509,8 @@ ChertWritableDatabase::replace_document(Xapian::docid did,
 	throw;
     }
 
-    if (++change_count >= flush_threshold) {
-	flush_postlist_changes();
-	if (!transaction_active()) apply();
-    }
+    ++change_count;
+    possibly_flush();
 }
 
 Xapian::Document::Internal *
@@ -1633,6 +1654,7 @@ ChertWritableDatabase::cancel()
     freq_deltas.clear();
     doclens.clear();
     mod_plists.clear();
+    changes_size = 0;
     value_stats.clear();
     change_count = 0;
 }
@@ -38,6 +38,7 @@
 #include "chert_version.h"
 #include "../flint_lock.h"
 #include "chert_types.h"
+#include "backends/flushpolicy.h"
 #include "backends/valuestats.h"
 
 #include "noreturn.h"
@@ -299,7 +300,8 @@ class ChertDatabase : public Xapian::Database::Internal {
 	void write_changesets_to_fd(int fd,
 				    const string & start_revision,
 				    bool need_whole_db,
-				    Xapian::ReplicationInfo * info);
+				    Xapian::ReplicationInfo * info,
+				    bool copy_in_parts);
 	string get_revision_info() const;
 	string get_uuid() const;
 
@@ -341,6 +343,9 @@ class ChertWritableDatabase : public ChertDatabase {
 	mutable map<string, map<Xapian::docid,
 				pair<char, Xapian::termcount> > > mod_plists;
 
+	/// Approximate memory used by freq_deltas and mod_plists.
+	mutable size_t changes_size;
+
 	mutable map<Xapian::valueno, ValueStats> value_stats;
 
 	/** The number of documents added, deleted, or replaced since the last
@@ -348,8 +353,8 @@ class ChertWritableDatabase : public ChertDatabase {
 	 */
 	mutable Xapian::doccount change_count;
 
-	/// If change_count reaches this threshold we automatically flush.
-	Xapian::doccount flush_threshold;
+	/// Decides when we automatically flush.
+	FlushPolicy flush_policy;
 
 	/** A pointer to the last document which was returned by
 	 *  open_document(), or NULL if there is no such valid document.  This
@@ -366,6 +371,12 @@ class ChertWritableDatabase : public ChertDatabase {
 	/// Flush any unflushed postlist changes, but don't commit them.
 	void flush_postlist_changes() const;
 
+	/// Approximate memory used to buffer changes.
+	size_t get_memory_used() const;
+
+	/// Flush and apply changes if the flush policy says we should.
+	void possibly_flush();
+
 	/// Close all the tables permanently.
 	void close();
 
@@ -478,6 +489,7 @@ class ChertWritableDatabase : public ChertDatabase {
 
 	void set_metadata(const string & key, const string & value);
 	void invalidate_doc_object(Xapian::Document::Internal * obj) const;
+	void set_flush_memory(size_t bytes);
 	//@}
 };
 
@@ -132,23 +132,34 @@ void
 ChertValueManager::add_value(Xapian::docid did, Xapian::valueno slot,
 			     const string & val)
 {
-    map<Xapian::valueno, map<Xapian::docid, string> >::iterator i;
-    i = changes.find(slot);
-    if (i == changes.end()) {
-	i = changes.insert(make_pair(slot, map<Xapian::docid, string>())).first;
-    }
-    i->second[did] = val;
+    set_change(did, slot, val);
 }
 
 void
 ChertValueManager::remove_value(Xapian::docid did, Xapian::valueno slot)
 {
-    map<Xapian::valueno, map<Xapian::docid, string> >::iterator i;
+    set_change(did, slot, string());
+}
+
+void
+ChertValueManager::set_change(Xapian::docid did, Xapian::valueno slot,
+			      const string & val)
+{
+    typedef map<Xapian::docid, string> slot_map;
+    map<Xapian::valueno, slot_map>::iterator i;
     i = changes.find(slot);
     if (i == changes.end()) {
-	i = changes.insert(make_pair(slot, map<Xapian::docid, string>())).first;
+	i = changes.insert(make_pair(slot, slot_map())).first;
+	changes_size += map_node_size<Xapian::valueno, slot_map>();
+    }
+    pair<slot_map::iterator, bool> j = i->second.insert(make_pair(did, val));
+    if (j.second) {
+	changes_size += map_node_size<Xapian::docid, string>();
+    } else {
+	changes_size -= j.first->second.size();
+	j.first->second = val;
     }
-    i->second[did] = string();
+    changes_size += val.size();
 }
 
 Xapian::docid
@@ -346,6 +357,7 @@ ChertValueManager::merge_changes()
 	    }
 	}
 	changes.clear();
+	changes_size = 0;
     }
 }
 
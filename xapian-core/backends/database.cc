@@ -28,11 +28,17 @@
 #include "xapian/error.h"
 
 #include "api/leafpostlist.h"
+#include "api/termlist.h"
+#include "api/vectortermlist.h"
+#include "autoptr.h"
 #include "omassert.h"
 #include "slowvaluelist.h"
 
 #include <algorithm>
+#include <queue>
 #include <string>
+#include <utility>
+#include <vector>
 
 using namespace std;
 using Xapian::Internal::intrusive_ptr;
@@ -130,6 +136,12 @@ Database::Internal::cancel()
     Assert(false);
 }
 
+void
+Database::Internal::set_flush_memory(size_t)
+{
+    // Backends which don't buffer changes don't need to do anything.
+}
+
 void
 Database::Internal::begin_transaction(bool flushed)
 {
@@ -231,6 +243,59 @@ Database::Internal::open_value_list(Xapian::valueno slot) const
     return new SlowValueList(this, slot);
 }
 
+/** Comparison functor which orders (termfreq, term) pairs by descending
+ *  termfreq, and then ascending term.
+ */
+struct CompareTermFreqDescending {
+    typedef pair<Xapian::doccount, string> value_type;
+
+    bool operator()(const value_type & a, const value_type & b) const {
+	if (a.first != b.first) return a.first > b.first;
+	return a.second < b.second;
+    }
+};
+
+TermList *
+Database::Internal::most_frequent_terms(TermList * terms, Xapian::termcount n)
+{
+    AutoPtr<TermList> t(terms);
+    // Keep the best n terms in a heap, with the least frequent on top.
+    priority_queue<pair<Xapian::doccount, string>,
+		   vector<pair<Xapian::doccount, string>>,
+		   CompareTermFreqDescending> best;
+    while (n) {
+	TermList * ret = t->next();
+	if (ret) t.reset(ret);
+	if (t->at_end())
+	    break;
+	Xapian::doccount tf = t->get_termfreq();
+	if (best.size() == n) {
+	    if (tf < best.top().first)
+		continue;
+	    string term = t->get_termname();
+	    if (tf == best.top().first && term > best.top().second)
+		continue;
+	    best.pop();
+	    best.push(make_pair(tf, term));
+	} else {
+	    best.push(make_pair(tf, t->get_termname()));
+	}
+    }
+    vector<string> result(best.size());
+    while (!best.empty()) {
+	result[best.size() - 1] = best.top().second;
+	best.pop();
+    }
+    return new VectorTermList(result.begin(), result.end());
+}
+
+TermList *
+Database::Internal::open_completions(const string & prefix,
+				     Xapian::termcount n) const
+{
+    return most_frequent_terms(open_allterms(prefix), n);
+}
+
 TermList *
 Database::Internal::open_spelling_termlist(const string &) const
 {
@@ -240,6 +305,14 @@ Database::Internal::open_spelling_termlist(const string &) const
     return NULL;
 }
 
+TermList *
+Database::Internal::open_spelling_candidates(const string &, unsigned) const
+{
+    // Only implemented for some database backends - others fall back to
+    // the trigram termlist.
+    return NULL;
+}
+
 TermList *
 Database::Internal::open_spelling_wordlist() const
 {
@@ -350,11 +423,18 @@ Database::Internal::collect_document(Xapian::docid did) const
 }
 
 void
-Database::Internal::write_changesets_to_fd(int, const string &, bool, ReplicationInfo *)
+Database::Internal::write_changesets_to_fd(int, const string &, bool,
+					   ReplicationInfo *, bool)
 {
     throw Xapian::UnimplementedError("This backend doesn't provide changesets");
 }
 
+void
+Database::Internal::write_file_part_to_fd(int, const string &)
+{
+    throw Xapian::UnimplementedError("This backend doesn't provide database copies in parts");
+}
+
 string
 Database::Internal::get_revision_info() const
 {
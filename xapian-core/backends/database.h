@@ -264,6 +264,36 @@ class Database::Internal : public Xapian::Internal::intrusive_base {
 	 */
 	virtual TermList * open_allterms(const string & prefix) const = 0;
 
+	/** Open a list of the most frequent terms with a given prefix.
+	 *
+	 *  The terms are returned in the same order as most_frequent_terms()
+	 *  uses.
+	 *
+	 *  The default implementation looks at every term with the prefix.
+	 *  Backends which store precomputed completions can avoid this.
+	 *
+	 *  @param prefix The prefix to restrict the terms to.
+	 *  @param n      The maximum number of terms to return.
+	 *  @return       A pointer to the newly created term list.
+	 *                This object must be deleted by the caller after
+	 *                use.
+	 */
+	virtual TermList * open_completions(const string & prefix,
+					    Xapian::termcount n) const;
+
+	/** Select the most frequent terms from a termlist.
+	 *
+	 *  The terms are returned most frequent first, with terms with the
+	 *  same frequency in ascending order.
+	 *
+	 *  @param terms  The termlist to select from, which is deleted by
+	 *                this method.
+	 *  @param n      The maximum number of terms to select.
+	 *  @return       A termlist of the selected terms.
+	 */
+	static TermList * most_frequent_terms(TermList * terms,
+					      Xapian::termcount n);
+
 	/** Open a position list for the given term in the given document.
 	 *
 	 *  @param did    The document id for which a position list is being
@@ -304,6 +334,19 @@ class Database::Internal : public Xapian::Internal::intrusive_base {
 	 */
 	virtual TermList * open_spelling_termlist(const string & word) const;
 
+	/** Return the spelling targets within an edit distance of @a word.
+	 *
+	 *  The returned list may contain words which are further away, so the
+	 *  edit distance still needs to be checked.
+	 *
+	 *  If the backend has no index able to answer this for
+	 *  @a max_edit_distance, returns NULL and the caller should use
+	 *  open_spelling_termlist() instead.
+	 */
+	virtual TermList *
+	open_spelling_candidates(const string & word,
+				 unsigned max_edit_distance) const;
+
 	/** Return a termlist which returns the words which are spelling
 	 *  correction targets.
 	 *
@@ -413,6 +456,12 @@ class Database::Internal : public Xapian::Internal::intrusive_base {
 	/** Cancel pending modifications to the database. */
 	virtual void cancel();
 
+	/** Set how much memory may be used to buffer changes.
+	 *
+	 *  See WritableDatabase::set_flush_memory() for more information.
+	 */
+	virtual void set_flush_memory(size_t bytes);
+
 	/** Begin a transaction.
 	 *
 	 *  See WritableDatabase::begin_transaction() for more information.
@@ -482,11 +531,22 @@ class Database::Internal : public Xapian::Internal::intrusive_base {
 	 *
 	 *  This call may reopen the database, leaving it pointing to a more
 	 *  recent version of the database.
+	 *
+	 *  If @a copy_in_parts is true, a backend which supports it lists the
+	 *  table files of a database copy for the replica to fetch with
+	 *  write_file_part_to_fd() rather than sending them.
 	 */
 	virtual void write_changesets_to_fd(int fd,
 					    const std::string & start_revision,
 					    bool need_whole_db,
-					    Xapian::ReplicationInfo * info);
+					    Xapian::ReplicationInfo * info,
+					    bool copy_in_parts);
+
+	/** Write part of a file of a database copy to a file descriptor.
+	 *
+	 *  @param request	The replica's request for the part.
+	 */
+	virtual void write_file_part_to_fd(int fd, const std::string & request);
 
 	/// Get a string describing the current revision of the database.
 	virtual string get_revision_info() const;
@@ -36,8 +36,8 @@ Remote::open(const string &host, unsigned int port, useconds_t timeout_,
 	     useconds_t connect_timeout)
 {
     LOGCALL_STATIC(API, Database, "Remote::open", host | port | timeout_ | connect_timeout);
-    RETURN(Database(new RemoteTcpClient(host, port, timeout_ * 1e-3,
-					connect_timeout * 1e-3, false, 0)));
+    RETURN(Database(RemoteTcpClient::open(host, port, timeout_ * 1e-3,
+					  connect_timeout * 1e-3)));
 }
 
 WritableDatabase
@@ -0,0 +1,67 @@
+/** @file flushpolicy.cc
+ * @brief Decide when buffered changes to a database should be flushed.
+ */
+/* Copyright (C) 2026 The Xapian contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include <config.h>
+
+#include "flushpolicy.h"
+
+#include <cstdlib>
+
+using namespace std;
+
+/// Parse a size in bytes with an optional K, M or G suffix.
+static size_t
+parse_size(const char * p)
+{
+    char * end;
+    unsigned long long n = strtoull(p, &end, 10);
+    switch (*end) {
+	case 'G': case 'g':
+	    n <<= 10;
+	    // Fall through.
+	case 'M': case 'm':
+	    n <<= 10;
+	    // Fall through.
+	case 'K': case 'k':
+	    n <<= 10;
+	    break;
+    }
+    return size_t(n);
+}
+
+FlushPolicy::FlushPolicy()
+    : threshold(0), memory_limit(0), threshold_set(false)
+{
+    const char *p = getenv("XAPIAN_FLUSH_THRESHOLD");
+    if (p)
+	threshold = atoi(p);
+    threshold_set = (threshold != 0);
+
+    p = getenv("XAPIAN_FLUSH_MEMORY");
+    set_memory_limit(p ? parse_size(p) : 0);
+}
+
+void
+FlushPolicy::set_memory_limit(size_t bytes)
+{
+    memory_limit = bytes;
+    if (!threshold_set)
+	threshold = memory_limit ? 0 : DEFAULT_THRESHOLD;
+}
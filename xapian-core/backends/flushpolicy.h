@@ -0,0 +1,88 @@
+/** @file flushpolicy.h
+ * @brief Decide when buffered changes to a database should be flushed.
+ */
+/* Copyright (C) 2026 The Xapian contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef XAPIAN_INCLUDED_FLUSHPOLICY_H
+#define XAPIAN_INCLUDED_FLUSHPOLICY_H
+
+#include "xapian/types.h"
+
+#include <cstddef>
+#include <utility>
+
+/** Approximate memory used by a node of a std::map.
+ *
+ *  This is the size of the stored key/value pair plus the node's pointers,
+ *  colour and allocator overhead.  It doesn't include any heap data owned by
+ *  the key or value (e.g. the contents of a std::string).
+ */
+template<typename K, typename V>
+inline size_t
+map_node_size()
+{
+    return sizeof(std::pair<const K, V>) + 4 * sizeof(void*);
+}
+
+/** Decide when a writable database should flush its buffered changes.
+ *
+ *  Changes are flushed once either the number of changed documents reaches
+ *  a threshold (XAPIAN_FLUSH_THRESHOLD, default 10000), or the approximate
+ *  memory used to buffer them reaches a limit (XAPIAN_FLUSH_MEMORY, which
+ *  accepts a K, M or G suffix, or WritableDatabase::set_flush_memory()).
+ *
+ *  If a memory limit is set, the default document count threshold isn't
+ *  used, but an explicitly set XAPIAN_FLUSH_THRESHOLD still is.
+ */
+class FlushPolicy {
+    /// Flush when this many documents have changed (0 for no limit).
+    Xapian::doccount threshold;
+
+    /// Flush when this many bytes are used to buffer changes (0 for no limit).
+    size_t memory_limit;
+
+    /// True if XAPIAN_FLUSH_THRESHOLD was set.
+    bool threshold_set;
+
+    /// Default value for threshold.
+    static const Xapian::doccount DEFAULT_THRESHOLD = 10000;
+
+  public:
+    /// Construct, reading XAPIAN_FLUSH_THRESHOLD and XAPIAN_FLUSH_MEMORY.
+    FlushPolicy();
+
+    /** Set the memory limit.
+     *
+     *  @param bytes	The limit in bytes, or 0 to only flush based on the
+     *			number of changed documents.
+     */
+    void set_memory_limit(size_t bytes);
+
+    /** Check if changes should be flushed.
+     *
+     *  @param change_count	The number of documents changed since the
+     *				last flush.
+     *  @param memory_used	Approximate bytes used to buffer changes.
+     */
+    bool should_flush(Xapian::doccount change_count, size_t memory_used) const {
+	if (threshold && change_count >= threshold) return true;
+	return memory_limit && memory_used >= memory_limit;
+    }
+};
+
+#endif // XAPIAN_INCLUDED_FLUSHPOLICY_H
@@ -5,8 +5,10 @@ if BUILD_BACKEND_GLASS
 noinst_HEADERS +=\
 	backends/glass/glass_alldocspostlist.h\
 	backends/glass/glass_alltermslist.h\
+	backends/glass/glass_blockcache.h\
 	backends/glass/glass_changes.h\
 	backends/glass/glass_check.h\
+	backends/glass/glass_completions.h\
 	backends/glass/glass_cursor.h\
 	backends/glass/glass_database.h\
 	backends/glass/glass_databasereplicator.h\
@@ -18,6 +20,7 @@ noinst_HEADERS +=\
 	backends/glass/glass_inverter.h\
 	backends/glass/glass_lazytable.h\
 	backends/glass/glass_metadata.h\
+	backends/glass/glass_packedchunk.h\
 	backends/glass/glass_positionlist.h\
 	backends/glass/glass_postlist.h\
 	backends/glass/glass_replicate_internal.h\
@@ -25,6 +28,7 @@ noinst_HEADERS +=\
 	backends/glass/glass_spellingwordslist.h\
 	backends/glass/glass_synonym.h\
 	backends/glass/glass_table.h\
+	backends/glass/glass_termdict.h\
 	backends/glass/glass_termlist.h\
 	backends/glass/glass_termlisttable.h\
 	backends/glass/glass_valuelist.h\
@@ -34,9 +38,11 @@ noinst_HEADERS +=\
 lib_src +=\
 	backends/glass/glass_alldocspostlist.cc\
 	backends/glass/glass_alltermslist.cc\
+	backends/glass/glass_blockcache.cc\
 	backends/glass/glass_changes.cc\
 	backends/glass/glass_check.cc\
 	backends/glass/glass_compact.cc\
+	backends/glass/glass_completions.cc\
 	backends/glass/glass_cursor.cc\
 	backends/glass/glass_database.cc\
 	backends/glass/glass_databasereplicator.cc\
@@ -45,12 +51,14 @@ lib_src +=\
 	backends/glass/glass_freelist.cc\
 	backends/glass/glass_inverter.cc\
 	backends/glass/glass_metadata.cc\
+	backends/glass/glass_packedchunk.cc\
 	backends/glass/glass_positionlist.cc\
 	backends/glass/glass_postlist.cc\
 	backends/glass/glass_spelling.cc\
 	backends/glass/glass_spellingwordslist.cc\
 	backends/glass/glass_synonym.cc\
 	backends/glass/glass_table.cc\
+	backends/glass/glass_termdict.cc\
 	backends/glass/glass_termlist.cc\
 	backends/glass/glass_termlisttable.cc\
 	backends/glass/glass_valuelist.cc\
@@ -0,0 +1,147 @@
+/** @file glass_blockcache.cc
+ * @brief Process-wide cache of blocks read from glass tables
+ */
+/* Copyright (C) 2026 The Xapian contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include <config.h>
+
+#include "glass_blockcache.h"
+
+#include "safesysstat.h"
+
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+
+bool
+GlassBlockCache::FileId::init(int fd, off_t offset_, const char * uuid_)
+{
+    if (!uuid_) return false;
+    struct stat sb;
+    if (fstat(fd, &sb) < 0) return false;
+    // On platforms without inode numbers (e.g. Microsoft Windows), st_ino is
+    // always 0 so we can't tell files apart.
+    if (sb.st_ino == 0) return false;
+    dev = sb.st_dev;
+    ino = sb.st_ino;
+    offset = offset_;
+    memcpy(uuid, uuid_, sizeof(uuid));
+    return true;
+}
+
+size_t
+GlassBlockCache::KeyHash::operator()(const Key & key) const
+{
+    // Mix the fields with the multiplier from the 64-bit FNV hash.
+    size_t h = size_t(key.file.ino);
+    h = h * 1099511628211ull + size_t(key.file.dev);
+    h = h * 1099511628211ull + size_t(key.file.offset);
+    h = h * 1099511628211ull + key.revision;
+    h = h * 1099511628211ull + key.block;
+    return h ^ (h >> 29);
+}
+
+void
+GlassBlockCache::Shard::trim(size_t limit)
+{
+    while (size > limit && !lru.empty()) {
+	const Entry & entry = lru.back();
+	size -= entry.data.size() + ENTRY_OVERHEAD;
+	index.erase(entry.key);
+	lru.pop_back();
+    }
+}
+
+GlassBlockCache::GlassBlockCache()
+    : max_size(0), hits(0), misses(0)
+{
+    const char * p = getenv("XAPIAN_GLASS_BLOCK_CACHE_SIZE");
+    if (p)
+	max_size = strtoul(p, NULL, 10);
+}
+
+GlassBlockCache &
+GlassBlockCache::get_instance()
+{
+    // Initialisation of a function-local static is thread-safe in C++11.
+    static GlassBlockCache instance;
+    return instance;
+}
+
+bool
+GlassBlockCache::lookup(const Key & key, byte * p, unsigned block_size)
+{
+    Shard & shard = get_shard(key);
+    {
+	lock_guard<mutex> lock(shard.mutex);
+	auto i = shard.index.find(key);
+	if (i != shard.index.end() && i->second->data.size() == block_size) {
+	    // Move to the front of the LRU list.
+	    shard.lru.splice(shard.lru.begin(), shard.lru, i->second);
+	    memcpy(p, i->second->data.data(), block_size);
+	    ++hits;
+	    return true;
+	}
+    }
+    ++misses;
+    return false;
+}
+
+void
+GlassBlockCache::insert(const Key & key, const byte * p, unsigned block_size)
+{
+    size_t limit = max_size / SHARDS;
+    if (block_size + ENTRY_OVERHEAD > limit) return;
+
+    Shard & shard = get_shard(key);
+    lock_guard<mutex> lock(shard.mutex);
+    auto i = shard.index.find(key);
+    if (i != shard.index.end()) {
+	// Another thread read the same block at the same time.
+	shard.lru.splice(shard.lru.begin(), shard.lru, i->second);
+	return;
+    }
+    shard.lru.emplace_front(key, p, block_size);
+    shard.index.insert(make_pair(key, shard.lru.begin()));
+    shard.size += block_size + ENTRY_OVERHEAD;
+    shard.trim(limit);
+}
+
+void
+GlassBlockCache::set_max_size(size_t max_size_)
+{
+    max_size = max_size_;
+    size_t limit = max_size_ / SHARDS;
+    for (auto && shard : shards) {
+	lock_guard<mutex> lock(shard.mutex);
+	shard.trim(limit);
+    }
+}
+
+size_t
+GlassBlockCache::get_size()
+{
+    size_t total = 0;
+    for (auto && shard : shards) {
+	lock_guard<mutex> lock(shard.mutex);
+	total += shard.size;
+    }
+    return total;
+}
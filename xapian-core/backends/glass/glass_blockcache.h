@@ -0,0 +1,210 @@
+/** @file glass_blockcache.h
+ * @brief Process-wide cache of blocks read from glass tables
+ */
+/* Copyright (C) 2026 The Xapian contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef XAPIAN_INCLUDED_GLASS_BLOCKCACHE_H
+#define XAPIAN_INCLUDED_GLASS_BLOCKCACHE_H
+
+#include "internaltypes.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <sys/types.h>
+
+/** Cache of blocks read from glass tables, shared by a whole process.
+ *
+ *  Blocks are cached by the file they were read from, the offset of the
+ *  table in that file (non-zero for a single-file database), the UUID of
+ *  the database, the revision the table was opened at, and the block number.  A glass table never
+ *  modifies a block which is part of a committed revision, so a block read
+ *  by a reader at revision R is valid for every other reader of that file at
+ *  revision R, which means read-only Database objects opened on the same
+ *  database can share the interior (and hot leaf) blocks of each B-tree.
+ *
+ *  Writable tables don't use the cache, since their blocks can change in
+ *  place before being committed.
+ *
+ *  The cache is split into a number of shards, each with its own lock and
+ *  LRU list, to reduce contention between threads.  It is disabled unless a
+ *  memory limit is set, either with Xapian::Database::set_block_cache_size()
+ *  (which calls set_max_size()) or by setting XAPIAN_GLASS_BLOCK_CACHE_SIZE
+ *  in the environment to the size in bytes.  The counters are available to
+ *  users via Xapian::Database::get_block_cache_stats().
+ */
+class GlassBlockCache {
+  public:
+    /// Identifies the table a block was read from.
+    struct FileId {
+	dev_t dev;
+	ino_t ino;
+	off_t offset;
+	char uuid[16];
+
+	FileId() : dev(0), ino(0), offset(0) {
+	    std::memset(uuid, 0, sizeof(uuid));
+	}
+
+	/** Initialise from an open file descriptor.
+	 *
+	 *  The database's UUID is included so that a deleted database's inode
+	 *  being reused for a new one doesn't result in stale blocks being
+	 *  returned.
+	 *
+	 *  @param fd	  The table's file descriptor.
+	 *  @param offset_ Offset of the table in the file.
+	 *  @param uuid_  The database's UUID (16 bytes), or NULL if not known.
+	 *
+	 *  @return true if the file could be identified; false if not (in
+	 *	    which case the cache shouldn't be used for it).
+	 */
+	bool init(int fd, off_t offset_, const char * uuid_);
+
+	bool operator==(const FileId & o) const {
+	    return dev == o.dev && ino == o.ino && offset == o.offset &&
+		   std::memcmp(uuid, o.uuid, sizeof(uuid)) == 0;
+	}
+    };
+
+    /// Key for a cached block.
+    struct Key {
+	FileId file;
+	uint4 revision;
+	uint4 block;
+
+	Key(const FileId & file_, uint4 revision_, uint4 block_)
+	    : file(file_), revision(revision_), block(block_) { }
+
+	bool operator==(const Key & o) const {
+	    return block == o.block && revision == o.revision && file == o.file;
+	}
+    };
+
+  private:
+    struct KeyHash {
+	size_t operator()(const Key & key) const;
+    };
+
+    /// Number of independently locked shards.
+    enum { SHARDS = 16 };
+
+    /// Overhead per cached block to count towards the memory limit.
+    enum { ENTRY_OVERHEAD = 96 };
+
+    struct Entry {
+	Key key;
+	std::string data;
+
+	Entry(const Key & key_, const byte * p, unsigned block_size)
+	    : key(key_), data(reinterpret_cast<const char *>(p), block_size) { }
+    };
+
+    struct Shard {
+	std::mutex mutex;
+
+	/// Entries, most recently used first.
+	std::list<Entry> lru;
+
+	std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index;
+
+	/// Bytes used by this shard.
+	size_t size;
+
+	Shard() : size(0) { }
+
+	/// Discard least recently used entries until size <= limit.
+	void trim(size_t limit);
+    };
+
+    Shard shards[SHARDS];
+
+    /// Memory limit for the whole cache in bytes (0 means disabled).
+    std::atomic<size_t> max_size;
+
+    std::atomic<unsigned long> hits, misses;
+
+    Shard & get_shard(const Key & key) {
+	return shards[KeyHash()(key) % SHARDS];
+    }
+
+    /// Don't allow copying.
+    GlassBlockCache(const GlassBlockCache &);
+
+    /// Don't allow assignment.
+    void operator=(const GlassBlockCache &);
+
+  public:
+    /// Construct with the limit from XAPIAN_GLASS_BLOCK_CACHE_SIZE.
+    GlassBlockCache();
+
+    /// Get the process-wide cache.
+    static GlassBlockCache & get_instance();
+
+    /// Is the cache enabled?
+    bool enabled() const { return max_size.load(std::memory_order_relaxed); }
+
+    /** Look up a block.
+     *
+     *  @param key	  The block to look for.
+     *  @param p	  Buffer to copy the block into if found.
+     *  @param block_size Size of the block.
+     *
+     *  @return true if the block was in the cache.
+     */
+    bool lookup(const Key & key, byte * p, unsigned block_size);
+
+    /** Add a block to the cache.
+     *
+     *  Least recently used blocks are discarded as required to keep within
+     *  the memory limit.
+     */
+    void insert(const Key & key, const byte * p, unsigned block_size);
+
+    /** Set the memory limit in bytes.
+     *
+     *  Setting a limit of 0 disables the cache and frees all cached blocks.
+     */
+    void set_max_size(size_t max_size_);
+
+    /// Get the memory limit in bytes.
+    size_t get_max_size() const { return max_size; }
+
+    /// Get the total memory used by cached blocks (including overheads).
+    size_t get_size();
+
+    /// Number of successful lookups.
+    unsigned long get_hits() const { return hits; }
+
+    /// Number of unsuccessful lookups.
+    unsigned long get_misses() const { return misses; }
+
+    /// Reset the hit and miss counters to zero.
+    void reset_stats() {
+	hits = 0;
+	misses = 0;
+    }
+};
+
+#endif // XAPIAN_INCLUDED_GLASS_BLOCKCACHE_H
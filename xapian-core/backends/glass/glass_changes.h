@@ -23,6 +23,7 @@
 #define XAPIAN_INCLUDED_GLASS_CHANGES_H
 
 #include "glass_defs.h"
+#include <mutex>
 #include <string>
 
 class GlassChanges {
@@ -46,6 +47,9 @@ class GlassChanges {
      */
     glass_revision_number_t oldest_changeset;
 
+    /// Serialises writes from tables being committed in parallel.
+    std::mutex write_mutex;
+
   public:
     GlassChanges(const std::string & db_dir)
 	: changes_fd(-1),
@@ -64,6 +68,17 @@ class GlassChanges {
 	write_block(s.data(), s.size());
     }
 
+    /** Write a block from a table, preceded by its header.
+     *
+     *  Tables may be committed in parallel, so this ensures the header and
+     *  block from one table aren't interleaved with those from another.
+     */
+    void write_block(const std::string & header, const char * p, size_t len) {
+	std::lock_guard<std::mutex> lock(write_mutex);
+	write_block(header);
+	write_block(p, len);
+    }
+
     void set_oldest_changeset(glass_revision_number_t rev) {
 	oldest_changeset = rev;
     }
@@ -2,6 +2,7 @@
  * @brief Compact a glass database, or merge and compact several.
  */
 /* Copyright (C) 2004,2005,2006,2007,2008,2009,2010,2011,2012,2013,2014,2015 Olly Betts
+ * Copyright (C) 2026 The Xapian contributors
  *
  * This program is free software; you can redistribute it and/or
  * modify it under the terms of the GNU General Public License as
@@ -35,10 +36,14 @@
 #include "safeerrno.h"
 
 #include "backends/flint_lock.h"
+#include "glass_completions.h"
 #include "glass_database.h"
 #include "glass_defs.h"
+#include "glass_packedchunk.h"
+#include "glass_postlist.h"
 #include "glass_table.h"
 #include "glass_cursor.h"
+#include "glass_termdict.h"
 #include "glass_version.h"
 #include "filetests.h"
 #include "internaltypes.h"
@@ -94,7 +99,14 @@ class PostlistCursor : private GlassCursor {
     }
 
     bool next() {
-	if (!GlassCursor::next()) return false;
+	// The term dictionary and completions are merged separately by
+	// merge_termdicts(), and merge_postlists() adds the packed postlists
+	// marker if the output needs it.
+	do {
+	    if (!GlassCursor::next()) return false;
+	} while (Glass::is_termdict_key(current_key) ||
+		 Glass::is_completions_key(current_key) ||
+		 current_key == Glass::make_packed_postlists_key());
 	// We put all chunks into the non-initial chunk form here, then fix up
 	// the first chunk for each term in the merged database as we merge.
 	read_tag();
@@ -186,13 +198,90 @@ encode_valuestats(Xapian::doccount freq,
     return value;
 }
 
+class TermDictCursorGt {
+  public:
+    /** Return true if and only if a's term is strictly greater than b's term.
+     */
+    bool operator()(const Glass::TermDictCursor *a,
+		    const Glass::TermDictCursor *b) {
+	return a->reader.term > b->reader.term;
+    }
+};
+
+/** Merge the term dictionaries of the inputs, summing the frequencies.
+ *
+ *  If @a completions is true, also build the completions from the merged
+ *  dictionary.
+ */
+static void
+merge_termdicts(GlassTable * out,
+		vector<GlassTable*>::const_iterator b,
+		vector<GlassTable*>::const_iterator e,
+		bool completions)
+{
+    priority_queue<Glass::TermDictCursor *, vector<Glass::TermDictCursor *>,
+		   TermDictCursorGt> pq;
+    for ( ; b != e; ++b) {
+	GlassTable *in = *b;
+	if (in->empty()) continue;
+	Glass::TermDictCursor * cur = new Glass::TermDictCursor(in);
+	if (cur->next()) {
+	    pq.push(cur);
+	} else {
+	    delete cur;
+	}
+    }
+
+    Glass::add_termdict_marker(out);
+    Glass::TermDictWriter writer(out);
+    Glass::CompletionsBuilder builder(out, 1,
+				      Glass::COMPLETIONS_MAX_PREFIX_LEN);
+    while (!pq.empty()) {
+	Glass::TermDictCursor * cur = pq.top();
+	pq.pop();
+	string term = cur->reader.term;
+	Xapian::doccount tf = 0;
+	Xapian::termcount cf = 0;
+	while (true) {
+	    tf += cur->reader.termfreq;
+	    cf += cur->reader.collfreq;
+	    if (cur->next()) {
+		pq.push(cur);
+	    } else {
+		delete cur;
+	    }
+	    if (pq.empty() || pq.top()->reader.term != term) break;
+	    cur = pq.top();
+	    pq.pop();
+	}
+	writer.append(term, tf, cf);
+	if (completions) builder.add(term, tf);
+    }
+    writer.flush();
+    if (completions) {
+	builder.flush();
+	Glass::add_completions_marker(out);
+    }
+}
+
+/** Merge the postlist tables of the inputs.
+ *
+ *  If @a packed is true, or any input is marked to have packed chunks, all
+ *  the posting list chunks in the output are written packed.
+ */
 static void
 merge_postlists(Xapian::Compactor * compactor,
 		GlassTable * out, vector<Xapian::docid>::const_iterator offset,
 		vector<GlassTable*>::const_iterator b,
-		vector<GlassTable*>::const_iterator e)
+		vector<GlassTable*>::const_iterator e,
+		bool packed)
 {
     priority_queue<PostlistCursor *, vector<PostlistCursor *>, PostlistCursorGt> pq;
+    // The term dictionary is only kept if every input has one, since
+    // otherwise it would be incomplete.
+    bool keep_termdict = true;
+    bool keep_completions = true;
+    vector<GlassTable*>::const_iterator inputs_begin = b;
     for ( ; b != e; ++b, ++offset) {
 	GlassTable *in = *b;
 	if (in->empty()) {
@@ -200,6 +289,12 @@ merge_postlists(Xapian::Compactor * compactor,
 	    continue;
 	}
 
+	if (!in->key_exists(Glass::make_termdict_key()))
+	    keep_termdict = false;
+	if (!in->key_exists(Glass::make_completions_key()))
+	    keep_completions = false;
+	if (in->key_exists(Glass::make_packed_postlists_key()))
+	    packed = true;
 	pq.push(new PostlistCursor(in, *offset));
     }
 
@@ -256,6 +351,17 @@ merge_postlists(Xapian::Compactor * compactor,
 	}
     }
 
+    if (packed && !pq.empty()) {
+	// The marker sorts between the user metadata and the term dictionary.
+	Glass::add_packed_postlists_marker(out);
+    }
+
+    if (keep_termdict && !pq.empty()) {
+	// The term dictionary and completions keys sort between the user
+	// metadata and the value statistics.
+	merge_termdicts(out, inputs_begin, e, keep_completions);
+    }
+
     {
 	// Merge valuestats.
 	Xapian::doccount freq = 0;
@@ -350,8 +456,10 @@ merge_postlists(Xapian::Compactor * compactor,
 		pack_uint(first_tag, tf);
 		pack_uint(first_tag, cf);
 		pack_uint(first_tag, tags[0].first - 1);
+		// Set the is_last_chunk bit of each chunk's flags, leaving the
+		// is_packed_chunk bit alone.
 		string tag = tags[0].second;
-		tag[0] = (tags.size() == 1) ? '1' : '0';
+		tag[0] = char((tag[0] & ~1) | (tags.size() == 1 ? 1 : 0));
 		first_tag += tag;
 		out->add(last_key, first_tag);
 
@@ -367,7 +475,7 @@ merge_postlists(Xapian::Compactor * compactor,
 		i = tags.begin();
 		while (++i != tags.end()) {
 		    tag = i->second;
-		    tag[0] = (i + 1 == tags.end()) ? '1' : '0';
+		    tag[0] = char((tag[0] & ~1) | (i + 1 == tags.end() ? 1 : 0));
 		    out->add(pack_glass_postlist_key(term, i->first), tag);
 		}
 	    }
@@ -379,6 +487,8 @@ merge_postlists(Xapian::Compactor * compactor,
 	tf += cur->tf;
 	cf += cur->cf;
 	tags.push_back(make_pair(cur->firstdid, cur->tag));
+	if (packed)
+	    Glass::pack_postlist_chunk(tags.back().second, cur->firstdid);
 	if (cur->next()) {
 	    pq.push(cur);
 	} else {
@@ -403,15 +513,30 @@ struct CursorGt {
     }
 };
 
+/// Check if a spelling table contains any words.
+static bool
+has_spelling_words(const GlassTable * table)
+{
+    GlassCursor cursor(table);
+    cursor.find_entry_ge("W");
+    return !cursor.after_end() && cursor.current_key[0] == 'W';
+}
+
 static void
 merge_spellings(GlassTable * out,
 		vector<GlassTable*>::const_iterator b,
 		vector<GlassTable*>::const_iterator e)
 {
     priority_queue<MergeCursor *, vector<MergeCursor *>, CursorGt> pq;
+    // The deletion index (keys starting "D") is kept unless an input has
+    // words but no index, since the merged index would then be missing
+    // those words.  An input without any words has nothing to add to it.
+    bool keep_index = true;
     for ( ; b != e; ++b) {
 	GlassTable *in = *b;
 	if (!in->empty()) {
+	    if (keep_index && !in->key_exists("D") && has_spelling_words(in))
+		keep_index = false;
 	    pq.push(new MergeCursor(in));
 	}
     }
@@ -421,6 +546,15 @@ merge_spellings(GlassTable * out,
 	pq.pop();
 
 	string key = cur->current_key;
+	if (!keep_index && key[0] == 'D') {
+	    if (cur->next()) {
+		pq.push(cur);
+	    } else {
+		delete cur;
+	    }
+	    continue;
+	}
+
 	if (pq.empty() || pq.top()->current_key > key) {
 	    // No need to merge the tags, just copy the (possibly compressed)
 	    // tag value.
@@ -597,7 +731,8 @@ static void
 multimerge_postlists(Xapian::Compactor * compactor,
 		     GlassTable * out, const char * tmpdir,
 		     vector<GlassTable *> tmp,
-		     vector<Xapian::docid> off)
+		     vector<Xapian::docid> off,
+		     bool packed)
 {
     unsigned int c = 0;
     while (tmp.size() > 3) {
@@ -626,7 +761,7 @@ multimerge_postlists(Xapian::Compactor * compactor,
 	    tmptab->create_and_open(flags, root_info);
 
 	    merge_postlists(compactor, tmptab, off.begin() + i,
-			    tmp.begin() + i, tmp.begin() + j);
+			    tmp.begin() + i, tmp.begin() + j, packed);
 	    if (c > 0) {
 		for (unsigned int k = i; k < j; ++k) {
 		    unlink(tmp[k]->get_path().c_str());
@@ -643,7 +778,8 @@ multimerge_postlists(Xapian::Compactor * compactor,
 	swap(off, newoff);
 	++c;
     }
-    merge_postlists(compactor, out, off.begin(), tmp.begin(), tmp.end());
+    merge_postlists(compactor, out, off.begin(), tmp.begin(), tmp.end(),
+		    packed);
     if (c > 0) {
 	for (size_t k = 0; k < tmp.size(); ++k) {
 	    unlink(tmp[k]->get_path().c_str());
@@ -807,6 +943,7 @@ GlassDatabase::compact(Xapian::Compactor * compactor,
 
     bool single_file = (flags & Xapian::DBCOMPACT_SINGLE_FILE);
     bool multipass = (flags & Xapian::DBCOMPACT_MULTIPASS);
+    bool packed = (flags & Xapian::DBCOMPACT_PACKED_POSTLISTS);
     if (single_file) {
 	// FIXME: Support this combination - we need to put temporary files
 	// somewhere.
@@ -999,10 +1136,10 @@ GlassDatabase::compact(Xapian::Compactor * compactor,
 	    case Glass::POSTLIST: {
 		if (multipass && inputs.size() > 3) {
 		    multimerge_postlists(compactor, out, destdir,
-					 inputs, offset);
+					 inputs, offset, packed);
 		} else {
 		    merge_postlists(compactor, out, offset.begin(),
-				    inputs.begin(), inputs.end());
+				    inputs.begin(), inputs.end(), packed);
 		}
 		break;
 	    }
@@ -0,0 +1,150 @@
+/** @file glass_completions.cc
+ * @brief Precomputed prefix completions for a glass database.
+ */
+/* Copyright (C) 2026 The Xapian contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include <config.h>
+
+#include "glass_completions.h"
+
+#include "glass_table.h"
+
+#include "pack.h"
+
+#include "xapian/error.h"
+
+#include <algorithm>
+
+using namespace Glass;
+using namespace std;
+
+/// Order completions most frequent first, then by term.
+static bool
+better(const CompletionList::entry & a, const CompletionList::entry & b)
+{
+    if (a.first != b.first) return a.first > b.first;
+    return a.second < b.second;
+}
+
+void
+Glass::add_completions_marker(GlassTable * table)
+{
+    // The tag is a format version number.
+    string tag;
+    pack_uint(tag, 1u);
+    table->add(make_completions_key(), tag);
+}
+
+void
+CompletionList::unserialise(const string & tag)
+{
+    const char * p = tag.data();
+    const char * end = p + tag.size();
+    entries.clear();
+    if (!unpack_uint(&p, end, &cutoff)) {
+	throw Xapian::DatabaseCorruptError("Bad completions entry");
+    }
+    while (p != end) {
+	entries.push_back(entry());
+	if (!unpack_uint(&p, end, &entries.back().first) ||
+	    !unpack_string(&p, end, entries.back().second)) {
+	    throw Xapian::DatabaseCorruptError("Bad completions entry");
+	}
+    }
+}
+
+string
+CompletionList::serialise() const
+{
+    string tag;
+    pack_uint(tag, cutoff);
+    vector<entry>::const_iterator i;
+    for (i = entries.begin(); i != entries.end(); ++i) {
+	pack_uint(tag, i->first);
+	pack_string(tag, i->second);
+    }
+    return tag;
+}
+
+void
+CompletionList::add(const string & term, Xapian::doccount termfreq)
+{
+    // Terms not in the list may rank above a term which isn't more frequent
+    // than cutoff.
+    if (termfreq <= cutoff) return;
+    entry e(termfreq, term);
+    if (entries.size() == COMPLETIONS_MAX_STORED) {
+	if (!better(e, entries.back())) {
+	    cutoff = termfreq;
+	    return;
+	}
+	cutoff = entries.back().first;
+	entries.pop_back();
+    }
+    entries.insert(upper_bound(entries.begin(), entries.end(), e, better), e);
+}
+
+bool
+CompletionList::update(const string & term, Xapian::doccount termfreq)
+{
+    vector<entry>::iterator i;
+    for (i = entries.begin(); i != entries.end(); ++i) {
+	if (i->second == term) break;
+    }
+    if (i != entries.end()) {
+	entries.erase(i);
+    }
+    // If the term is no longer more frequent than cutoff, this drops it
+    // from the list, since it may rank below terms which aren't in it.
+    if (termfreq) add(term, termfreq);
+    return cutoff == 0 || entries.size() >= COMPLETIONS_PER_PREFIX;
+}
+
+void
+CompletionsBuilder::add(const string & term, Xapian::doccount termfreq)
+{
+    size_t len = min_len;
+    for (size_t i = 0; i != prefixes.size() && len <= term.size(); ++i) {
+	if (lists[i].entries.empty() ||
+	    term.compare(0, len, prefixes[i]) != 0) {
+	    flush(i);
+	    prefixes[i].assign(term, 0, len);
+	}
+	// The terms arrive in order, so this just adds the term if it ranks
+	// high enough.
+	(void)lists[i].update(term, termfreq);
+	++len;
+    }
+}
+
+void
+CompletionsBuilder::flush(size_t i)
+{
+    if (lists[i].entries.empty()) return;
+    table->add(make_completions_key(prefixes[i]), lists[i].serialise());
+    lists[i] = CompletionList();
+}
+
+void
+CompletionsBuilder::flush()
+{
+    for (size_t i = 0; i != lists.size(); ++i) {
+	flush(i);
+    }
+}
@@ -0,0 +1,163 @@
+/** @file glass_completions.h
+ * @brief Precomputed prefix completions for a glass database.
+ */
+/* Copyright (C) 2026 The Xapian contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef XAPIAN_INCLUDED_GLASS_COMPLETIONS_H
+#define XAPIAN_INCLUDED_GLASS_COMPLETIONS_H
+
+#include "xapian/types.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+class GlassTable;
+
+/* The completions live in the postlist table, in keys starting with "\0\xcc"
+ * (which sort after the term dictionary and before the value statistics).
+ * The key which is just that prefix marks that the completions are present.
+ * For each prefix of between 1 and COMPLETIONS_MAX_PREFIX_LEN bytes which
+ * any term starts with, the key is "\0\xcc" followed by the prefix.  The tag
+ * lists the most frequent terms with that prefix - either all of them, or at
+ * least COMPLETIONS_PER_PREFIX (in which case cutoff is non-zero):
+ *
+ *   pack_uint(cutoff)
+ *   for each completion, most frequent first:
+ *     pack_uint(termfreq)
+ *     pack_string(term)
+ *
+ * The completions are maintained from the changes to the term dictionary, so
+ * they are only present if it is.
+ */
+
+namespace Glass {
+
+/// Completions are stored for prefixes of up to this many bytes.
+const size_t COMPLETIONS_MAX_PREFIX_LEN = 4;
+
+/** The number of completions which can always be answered from the stored
+ *  list for a prefix.
+ *
+ *  This matches QueryParser's default limit on partial term expansion.
+ */
+const Xapian::termcount COMPLETIONS_PER_PREFIX = 100;
+
+/** The maximum number of completions stored for each prefix.
+ *
+ *  We store some extra completions so that terms can drop out of a list
+ *  without it needing to be rebuilt from the term dictionary each time.
+ */
+const Xapian::termcount COMPLETIONS_MAX_STORED = 150;
+
+/// Make the key for the completions of @a prefix.
+inline std::string
+make_completions_key(const std::string & prefix = std::string())
+{
+    std::string key("\0\xcc", 2);
+    key += prefix;
+    return key;
+}
+
+/// Is @a key part of the completions?
+inline bool
+is_completions_key(const std::string & key)
+{
+    return key.size() > 1 && key[0] == '\0' && key[1] == '\xcc';
+}
+
+/// Add the key which marks that @a table has completions.
+void add_completions_marker(GlassTable * table);
+
+/// The most frequent terms starting with a prefix.
+class CompletionList {
+    /// Add @a term, which isn't in the list.
+    void add(const std::string & term, Xapian::doccount termfreq);
+
+  public:
+    typedef std::pair<Xapian::doccount, std::string> entry;
+
+    /// The completions, most frequent first (and ties in term order).
+    std::vector<entry> entries;
+
+    /** An upper bound on the termfreq of the terms with this prefix which
+     *  aren't in @a entries.
+     *
+     *  This is 0 if there are no such terms.
+     */
+    Xapian::doccount cutoff;
+
+    CompletionList() : cutoff(0) { }
+
+    /// Set from the tag stored in the table.
+    void unserialise(const std::string & tag);
+
+    /// Return the tag to store in the table.
+    std::string serialise() const;
+
+    /** Update for the termfreq of @a term changing.
+     *
+     *  @param termfreq	The new termfreq (0 if the term has been removed).
+     *
+     *  @return false if the list no longer has enough entries, and needs to
+     *		be rebuilt from the term dictionary.
+     */
+    bool update(const std::string & term, Xapian::doccount termfreq);
+};
+
+/** Build completion lists from term dictionary entries.
+ *
+ *  The entries must be given in ascending term order.
+ */
+class CompletionsBuilder {
+    /// Don't allow assignment.
+    void operator=(const CompletionsBuilder &);
+
+    /// Don't allow copying.
+    CompletionsBuilder(const CompletionsBuilder &);
+
+    GlassTable * table;
+
+    /// The shortest prefix length to build lists for.
+    size_t min_len;
+
+    /// The prefix being built for each length from min_len upwards.
+    std::vector<std::string> prefixes;
+
+    /// The list being built for each entry in prefixes.
+    std::vector<CompletionList> lists;
+
+    /// Write the list being built for @a i, if there is one.
+    void flush(size_t i);
+
+  public:
+    /// Build lists for prefixes of @a min_len_ to @a max_len bytes.
+    CompletionsBuilder(GlassTable * table_, size_t min_len_, size_t max_len)
+	: table(table_), min_len(min_len_),
+	  prefixes(max_len - min_len_ + 1), lists(max_len - min_len_ + 1) { }
+
+    void add(const std::string & term, Xapian::doccount termfreq);
+
+    /// Write the lists still being built.
+    void flush();
+};
+
+}
+
+#endif // XAPIAN_INCLUDED_GLASS_COMPLETIONS_H
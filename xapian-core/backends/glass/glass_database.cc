@@ -36,6 +36,7 @@
 #include "backends/contiguousalldocspostlist.h"
 #include "glass_alldocspostlist.h"
 #include "glass_alltermslist.h"
+#include "glass_completions.h"
 #include "glass_defs.h"
 #include "glass_docdata.h"
 #include "glass_document.h"
@@ -45,6 +46,7 @@
 #include "glass_postlist.h"
 #include "glass_replicate_internal.h"
 #include "glass_spellingwordslist.h"
+#include "glass_termdict.h"
 #include "glass_termlist.h"
 #include "glass_valuelist.h"
 #include "glass_values.h"
@@ -54,7 +56,9 @@
 #include "pack.h"
 #include "net/remoteconnection.h"
 #include "api/replication.h"
+#include "api/vectortermlist.h"
 #include "replicationprotocol.h"
+#include "sha1.h"
 #include "net/length.h"
 #include "posixy_wrapper.h"
 #include "str.h"
@@ -63,17 +67,74 @@
 
 #include "safeerrno.h"
 #include "safesysstat.h"
+#include "safeunistd.h"
 #include <sys/types.h>
 
 #include <algorithm>
 #include "autoptr.h"
 #include <cstdlib>
+#include <exception>
+#include <functional>
+#include <initializer_list>
+#include <map>
 #include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
 
 using namespace std;
 using namespace Xapian;
 using Xapian::Internal::intrusive_ptr;
 
+/** Run independent tasks, in parallel if @a parallel is true.
+ *
+ *  If @a parallel is false, the tasks are run in turn by the calling thread,
+ *  and an exception from one stops the rest being run.
+ *
+ *  Otherwise the first task is run by the calling thread and each of the
+ *  others by a thread of its own (or by the calling thread if a thread can't
+ *  be created).  Once they've all finished, the first exception thrown by any
+ *  of them (in the order the tasks were given) is rethrown.
+ */
+static void
+run_tasks(bool parallel, initializer_list<function<void()>> tasks)
+{
+    if (!parallel) {
+	for (auto && task : tasks) {
+	    task();
+	}
+	return;
+    }
+
+    vector<exception_ptr> errors(tasks.size());
+    auto run = [](const function<void()> & task, exception_ptr & error) {
+	try {
+	    task();
+	} catch (...) {
+	    error = current_exception();
+	}
+    };
+
+    vector<thread> threads;
+    threads.reserve(tasks.size() - 1);
+    auto task = tasks.begin();
+    for (size_t i = 1; i != tasks.size(); ++i) {
+	try {
+	    threads.push_back(thread(run, cref(task[i]), ref(errors[i])));
+	} catch (const std::system_error &) {
+	    run(task[i], errors[i]);
+	}
+    }
+    run(task[0], errors[0]);
+    for (auto && t : threads) {
+	t.join();
+    }
+
+    for (auto && error : errors) {
+	if (error) rethrow_exception(error);
+    }
+}
+
 // The maximum safe term length is determined by the postlist.  There we
 // store the term using pack_string_preserving_sort() which takes the
 // length of the string plus an extra byte (assuming the string doesn't
@@ -97,15 +158,21 @@ GlassDatabase::GlassDatabase(const string &glass_dir, int flags,
 			     unsigned int block_size)
 	: db_dir(glass_dir),
 	  readonly(flags == Xapian::DB_READONLY_),
+	  parallel_commit(false),
 	  version_file(db_dir),
-	  postlist_table(db_dir, readonly),
+	  postlist_table(db_dir, readonly,
+			 !readonly && (flags & (Xapian::DB_TERM_DICTIONARY |
+						Xapian::DB_COMPLETIONS)),
+			 !readonly && (flags & Xapian::DB_COMPLETIONS),
+			 !readonly && (flags & Xapian::DB_PACKED_POSTLISTS)),
 	  position_table(db_dir, readonly),
 	  // Note: (Xapian::DB_READONLY_ & Xapian::DB_NO_TERMLIST) is true,
 	  // so opening to read we always permit the termlist to be missing.
 	  termlist_table(db_dir, readonly, (flags & Xapian::DB_NO_TERMLIST)),
 	  value_manager(&postlist_table, &termlist_table),
 	  synonym_table(db_dir, readonly),
-	  spelling_table(db_dir, readonly),
+	  spelling_table(db_dir, readonly,
+			 !readonly && (flags & Xapian::DB_SPELLING_INDEX)),
 	  docdata_table(db_dir, readonly),
 	  lock(db_dir),
 	  changes(db_dir)
@@ -165,6 +232,7 @@ GlassDatabase::GlassDatabase(const string &glass_dir, int flags,
 GlassDatabase::GlassDatabase(int fd)
 	: db_dir(),
 	  readonly(true),
+	  parallel_commit(false),
 	  version_file(fd),
 	  postlist_table(fd, version_file.get_offset(), readonly),
 	  position_table(fd, version_file.get_offset(), readonly),
@@ -237,12 +305,13 @@ GlassDatabase::open_tables(int flags)
 	RETURN(false);
     }
 
-    docdata_table.open(flags, version_file.get_root(Glass::DOCDATA), rev);
-    spelling_table.open(flags, version_file.get_root(Glass::SPELLING), rev);
-    synonym_table.open(flags, version_file.get_root(Glass::SYNONYM), rev);
-    termlist_table.open(flags, version_file.get_root(Glass::TERMLIST), rev);
-    position_table.open(flags, version_file.get_root(Glass::POSITION), rev);
-    postlist_table.open(flags, version_file.get_root(Glass::POSTLIST), rev);
+    const char * uuid = version_file.get_uuid();
+    docdata_table.open(flags, version_file.get_root(Glass::DOCDATA), rev, uuid);
+    spelling_table.open(flags, version_file.get_root(Glass::SPELLING), rev, uuid);
+    synonym_table.open(flags, version_file.get_root(Glass::SYNONYM), rev, uuid);
+    termlist_table.open(flags, version_file.get_root(Glass::TERMLIST), rev, uuid);
+    position_table.open(flags, version_file.get_root(Glass::POSITION), rev, uuid);
+    postlist_table.open(flags, version_file.get_root(Glass::POSTLIST), rev, uuid);
 
     Xapian::termcount swfub = version_file.get_spelling_wordfreq_upper_bound();
     spelling_table.set_wordfreq_upper_bound(swfub);
@@ -337,32 +406,76 @@ GlassDatabase::set_revision_number(int flags, glass_revision_number_t new_revisi
 	throw Xapian::DatabaseError(m);
     }
 
+    // This writes to both the postlist and termlist tables, so has to be
+    // done before they're committed.
     value_manager.merge_changes();
 
-    postlist_table.flush_db();
-    position_table.flush_db();
-    termlist_table.flush_db();
-    synonym_table.flush_db();
-    version_file.set_spelling_wordfreq_upper_bound(spelling_table.flush_db());
-    docdata_table.flush_db();
-
-    postlist_table.commit(new_revision, version_file.root_to_set(Glass::POSTLIST));
-    position_table.commit(new_revision, version_file.root_to_set(Glass::POSITION));
-    termlist_table.commit(new_revision, version_file.root_to_set(Glass::TERMLIST));
-    synonym_table.commit(new_revision, version_file.root_to_set(Glass::SYNONYM));
-    spelling_table.commit(new_revision, version_file.root_to_set(Glass::SPELLING));
-    docdata_table.commit(new_revision, version_file.root_to_set(Glass::DOCDATA));
+    // Each table is a separate file, so they can be flushed, committed and
+    // synced in parallel.  The new revision only becomes visible when the
+    // version file is written, which is done once all the tables are synced.
+    Xapian::termcount wordfreq_upper_bound = 0;
+    run_tasks(parallel_commit, {
+	[&]() {
+	    postlist_table.flush_db();
+	    postlist_table.commit(new_revision,
+				  version_file.root_to_set(Glass::POSTLIST));
+	},
+	[&]() {
+	    position_table.flush_db();
+	    position_table.commit(new_revision,
+				  version_file.root_to_set(Glass::POSITION));
+	},
+	[&]() {
+	    termlist_table.flush_db();
+	    termlist_table.commit(new_revision,
+				  version_file.root_to_set(Glass::TERMLIST));
+	},
+	[&]() {
+	    synonym_table.flush_db();
+	    synonym_table.commit(new_revision,
+				 version_file.root_to_set(Glass::SYNONYM));
+	},
+	[&]() {
+	    wordfreq_upper_bound = spelling_table.flush_db();
+	    spelling_table.commit(new_revision,
+				  version_file.root_to_set(Glass::SPELLING));
+	},
+	[&]() {
+	    docdata_table.flush_db();
+	    docdata_table.commit(new_revision,
+				 version_file.root_to_set(Glass::DOCDATA));
+	}
+    });
+    version_file.set_spelling_wordfreq_upper_bound(wordfreq_upper_bound);
 
     const string & tmpfile = version_file.write(new_revision, flags);
-    if (!postlist_table.sync() ||
-	!position_table.sync() ||
-	!termlist_table.sync() ||
-	!synonym_table.sync() ||
-	!spelling_table.sync() ||
-	!docdata_table.sync() ||
-	!version_file.sync(tmpfile, new_revision, flags)) {
+    // A failed sync throws, so it's reported in the same way whether or not
+    // the tables are synced in parallel (errno is per-thread, so it has to be
+    // read by the thread which did the sync).
+    auto sync = [](GlassTable & table) -> function<void()> {
+	return [&table]() {
+	    if (!table.sync())
+		throw Xapian::DatabaseError("Commit failed",
+					    errno ? errno : EIO);
+	};
+    };
+    try {
+	run_tasks(parallel_commit, {
+	    sync(postlist_table),
+	    sync(position_table),
+	    sync(termlist_table),
+	    sync(synonym_table),
+	    sync(spelling_table),
+	    sync(docdata_table)
+	});
+    } catch (...) {
+	(void)unlink(tmpfile.c_str());
+	throw;
+    }
+    if (!version_file.sync(tmpfile, new_revision, flags)) {
+	int err = errno;
 	(void)unlink(tmpfile.c_str());
-	throw Xapian::DatabaseError("Commit failed", errno);
+	throw Xapian::DatabaseError("Commit failed", err);
     }
 
     changes.commit(new_revision, flags);
@@ -427,10 +540,199 @@ GlassDatabase::get_database_write_lock(int flags, bool creating)
     }
 }
 
+/// The table files, in Glass::table_type order.
+static const char * const table_filenames[Glass::MAX_] = {
+    "postlist." GLASS_TABLE_EXTENSION,
+    "docdata." GLASS_TABLE_EXTENSION,
+    "termlist." GLASS_TABLE_EXTENSION,
+    "position." GLASS_TABLE_EXTENSION,
+    "spelling." GLASS_TABLE_EXTENSION,
+    "synonym." GLASS_TABLE_EXTENSION
+};
+
+/** Maximum size of a REPL_REPLY_DB_BLOCKCHECKSUMS or REPL_REPLY_DB_FILEDELTA
+ *  message.
+ *
+ *  A file is sent in as many such messages as are needed.
+ */
+const size_t MAX_BLOCK_MESSAGE_SIZE = 1024 * 1024;
+
 void
-GlassDatabase::send_whole_database(RemoteConnection & conn, double end_time)
+GlassDatabase::send_block_checksums(RemoteConnection & conn, double end_time)
 {
-    LOGCALL_VOID(DB, "GlassDatabase::send_whole_database", conn | end_time);
+    LOGCALL_VOID(DB, "GlassDatabase::send_block_checksums", conn | end_time);
+
+    // The replica sends this back with the blocks it needs, so we can check
+    // the database hasn't changed in the meantime.
+    string buf;
+    pack_string(buf, get_uuid());
+    pack_uint(buf, get_revision_number());
+    conn.send_message(REPL_REPLY_DB_CHECKSUMS, buf, end_time);
+
+    string filepath = db_dir;
+    filepath += '/';
+    string block;
+    for (unsigned i = 0; i != Glass::MAX_; ++i) {
+	const char * filename = table_filenames[i];
+	filepath.replace(db_dir.size() + 1, string::npos, filename);
+	FD fd(posixy_open(filepath.c_str(), O_RDONLY | O_CLOEXEC));
+	if (fd < 0)
+	    continue;
+	Glass::table_type table = static_cast<Glass::table_type>(i);
+	unsigned blocksize = version_file.get_root(table).get_blocksize();
+	block.resize(blocksize);
+	conn.send_message(REPL_REPLY_DB_FILENAME, filename, end_time);
+	string header;
+	pack_uint(header, blocksize);
+	string message = header;
+	size_t n;
+	while ((n = io_read(fd, &block[0], blocksize)) != 0) {
+	    // The file can be extended while we're reading it, so pad out a
+	    // partial final block - it won't match, so will get sent.
+	    fill(block.begin() + n, block.end(), '\0');
+	    append_sha1(message, block.data(), blocksize);
+	    if (message.size() >= MAX_BLOCK_MESSAGE_SIZE) {
+		conn.send_message(REPL_REPLY_DB_BLOCKCHECKSUMS, message,
+				  end_time);
+		message = header;
+	    }
+	}
+	if (message.size() > header.size())
+	    conn.send_message(REPL_REPLY_DB_BLOCKCHECKSUMS, message, end_time);
+    }
+}
+
+bool
+GlassDatabase::parse_needed_blocks(const string & request,
+				   map<string, pair<unsigned, string>> & needed) const
+{
+    LOGCALL(DB, bool, "GlassDatabase::parse_needed_blocks", request.size() | needed.size());
+    const char * ptr = request.data();
+    const char * end = ptr + request.size();
+    if (ptr == end || *ptr++ != REPL_DELTA_BLOCKS_NEEDED)
+	RETURN(false);
+
+    // If the database has changed since we sent the checksums, the replica
+    // needs to compare new ones.
+    string uuid;
+    glass_revision_number_t rev;
+    if (!unpack_string(&ptr, end, uuid) ||
+	!unpack_uint(&ptr, end, &rev) ||
+	uuid != get_uuid() ||
+	rev != get_revision_number()) {
+	RETURN(false);
+    }
+
+    while (ptr != end) {
+	string filename, runs;
+	unsigned blocksize;
+	if (!unpack_string(&ptr, end, filename) ||
+	    !unpack_uint(&ptr, end, &blocksize) ||
+	    !unpack_string(&ptr, end, runs) ||
+	    blocksize < 2048 || blocksize > 65536 ||
+	    (blocksize & (blocksize - 1))) {
+	    RETURN(false);
+	}
+	const char * p = runs.data();
+	const char * p_end = p + runs.size();
+	while (p != p_end) {
+	    size_t have, need;
+	    if (!unpack_uint(&p, p_end, &have) ||
+		!unpack_uint(&p, p_end, &need)) {
+		RETURN(false);
+	    }
+	}
+	auto & entry = needed[filename];
+	entry.first = blocksize;
+	swap(entry.second, runs);
+    }
+    RETURN(true);
+}
+
+/** Send a table file as the blocks which the replica needs.
+ *
+ *  @param runs	Pairs of the number of blocks the replica has and the number
+ *		it needs, as checked by parse_needed_blocks().  Any blocks
+ *		after these are needed too.
+ */
+static void
+send_file_delta(RemoteConnection & conn, int fd, unsigned blocksize,
+		const string & runs, double end_time)
+{
+    string header;
+    pack_uint(header, blocksize);
+    string message = header;
+    string block(blocksize, '\0');
+    // The current run of blocks the replica has followed by blocks it needs.
+    size_t same = 0, changed = 0;
+    string changed_data;
+    bool sent_any = false;
+    const char * p = runs.data();
+    const char * end = p + runs.size();
+    off_t block_number = 0;
+    bool at_eof = false;
+    while (!at_eof) {
+	size_t have = 0, need = size_t(-1);
+	if (p != end) {
+	    (void)unpack_uint(&p, end, &have);
+	    (void)unpack_uint(&p, end, &need);
+	}
+	if (have) {
+	    if (changed) {
+		pack_uint(message, same);
+		pack_uint(message, changed);
+		message += changed_data;
+		same = changed = 0;
+		changed_data.resize(0);
+	    }
+	    same += have;
+	    block_number += have;
+	    if (lseek(fd, block_number * blocksize, SEEK_SET) == off_t(-1)) {
+		throw Xapian::DatabaseError("Error seeking in table file",
+					    errno);
+	    }
+	}
+	while (need) {
+	    size_t n = io_read(fd, &block[0], blocksize);
+	    if (n == 0) {
+		at_eof = true;
+		break;
+	    }
+	    // The file can be extended while we're reading it, so pad out a
+	    // partial final block - the later revisions needed before the
+	    // copy can be made live will supply the real contents.
+	    fill(block.begin() + n, block.end(), '\0');
+	    ++changed;
+	    changed_data += block;
+	    ++block_number;
+	    --need;
+	    if (message.size() + changed_data.size() >= MAX_BLOCK_MESSAGE_SIZE) {
+		pack_uint(message, same);
+		pack_uint(message, changed);
+		message += changed_data;
+		same = changed = 0;
+		changed_data.resize(0);
+		conn.send_message(REPL_REPLY_DB_FILEDELTA, message, end_time);
+		message = header;
+		sent_any = true;
+	    }
+	}
+    }
+    if (same || changed) {
+	pack_uint(message, same);
+	pack_uint(message, changed);
+	message += changed_data;
+    }
+    if (message.size() > header.size() || !sent_any)
+	conn.send_message(REPL_REPLY_DB_FILEDELTA, message, end_time);
+}
+
+void
+GlassDatabase::send_whole_database(RemoteConnection & conn, double end_time,
+				   const map<string, pair<unsigned, string>> & needed,
+				   bool copy_in_parts)
+{
+    LOGCALL_VOID(DB, "GlassDatabase::send_whole_database", conn | end_time | needed.size() | copy_in_parts);
 
     // Send the current revision number in the header.
     string buf;
@@ -452,14 +754,38 @@ GlassDatabase::send_whole_database(RemoteConnection & conn, double end_time)
 	"iamglass\0";
     string filepath = db_dir;
     filepath += '/';
+    // The table files for the replica to fetch in parts, each as the (packed)
+    // file name and size.  These are listed before the version file is sent,
+    // which is last in the list.
+    string parts;
     const char * p = filenames;
     do {
 	size_t len = strlen(p);
+	bool last = (p[len + 1] == '\0');
+	if (last && !parts.empty())
+	    conn.send_message(REPL_REPLY_DB_FILEPARTS, parts, end_time);
 	filepath.replace(db_dir.size() + 1, string::npos, p, len);
 	FD fd(posixy_open(filepath.c_str(), O_RDONLY | O_CLOEXEC));
 	if (fd >= 0) {
-	    conn.send_message(REPL_REPLY_DB_FILENAME, string(p, len), end_time);
-	    conn.send_file(REPL_REPLY_DB_FILEDATA, fd, end_time);
+	    string filename(p, len);
+	    auto i = needed.find(filename);
+	    if (copy_in_parts && !last && i == needed.end()) {
+		struct stat statbuf;
+		if (fstat(fd, &statbuf) < 0) {
+		    throw Xapian::DatabaseError("Couldn't stat " + filepath,
+						errno);
+		}
+		pack_string(parts, filename);
+		pack_uint(parts, uint8(statbuf.st_size));
+	    } else {
+		conn.send_message(REPL_REPLY_DB_FILENAME, filename, end_time);
+		if (i != needed.end()) {
+		    send_file_delta(conn, fd, i->second.first,
+				    i->second.second, end_time);
+		} else {
+		    conn.send_file(REPL_REPLY_DB_FILEDATA, fd, end_time);
+		}
+	    }
 	}
 	p += len + 1;
     } while (*p);
@@ -469,9 +795,10 @@ void
 GlassDatabase::write_changesets_to_fd(int fd,
 				      const string & revision,
 				      bool need_whole_db,
-				      ReplicationInfo * info)
+				      ReplicationInfo * info,
+				      bool copy_in_parts)
 {
-    LOGCALL_VOID(DB, "GlassDatabase::write_changesets_to_fd", fd | revision | need_whole_db | info);
+    LOGCALL_VOID(DB, "GlassDatabase::write_changesets_to_fd", fd | revision | need_whole_db | info | copy_in_parts);
 
     int whole_db_copies_left = MAX_DB_COPIES_PER_CONVERSATION;
     glass_revision_number_t start_rev_num = 0;
@@ -481,8 +808,14 @@ GlassDatabase::write_changesets_to_fd(int fd,
 
     const char * rev_ptr = revision.data();
     const char * rev_end = rev_ptr + revision.size();
+    // The replica may have appended a request to be sent a copy as the
+    // blocks which differ from its live database.  This only applies to a
+    // copy sent before any other changes.
+    string delta_request;
     if (!unpack_uint(&rev_ptr, rev_end, &start_rev_num)) {
 	need_whole_db = true;
+    } else {
+	delta_request.assign(rev_ptr, rev_end - rev_ptr);
     }
 
     RemoteConnection conn(-1, fd, string());
@@ -495,6 +828,15 @@ GlassDatabase::write_changesets_to_fd(int fd,
     // risk of them disappearing while we're sending earlier ones.
     while (true) {
 	if (need_whole_db) {
+	    map<string, pair<unsigned, string>> needed;
+	    if (!delta_request.empty() &&
+		!parse_needed_blocks(delta_request, needed)) {
+		// Send checksums of our blocks instead of a copy, so the
+		// replica can ask again for just the blocks it needs.
+		send_block_checksums(conn, 0.0);
+		break;
+	    }
+
 	    // Decrease the counter of copies left to be sent, and fail
 	    // if we've already copied the database enough.  This ensures that
 	    // synchronisation attempts always terminate eventually.
@@ -510,7 +852,8 @@ GlassDatabase::write_changesets_to_fd(int fd,
 	    start_rev_num = get_revision_number();
 	    start_uuid = get_uuid();
 
-	    send_whole_database(conn, 0.0);
+	    send_whole_database(conn, 0.0, needed, copy_in_parts);
+	    delta_request.resize(0);
 	    if (info != NULL)
 		++(info->fullcopy_count);
 
@@ -574,6 +917,7 @@ GlassDatabase::write_changesets_to_fd(int fd,
 		}
 
 		conn.send_file(REPL_REPLY_CHANGESET, fd_changes, 0.0);
+		delta_request.resize(0);
 		start_rev_num = changeset_end_rev_num;
 		if (info != NULL) {
 		    ++(info->changeset_count);
@@ -590,6 +934,70 @@ GlassDatabase::write_changesets_to_fd(int fd,
     conn.send_message(REPL_REPLY_END_OF_CHANGES, string(), 0.0);
 }
 
+/** Maximum size of a part of a file which a replica can ask for.
+ *
+ *  The part is sent as a single message, so this limits the memory used.
+ */
+const size_t MAX_FILE_PART_SIZE = 64 * 1024 * 1024;
+
+void
+GlassDatabase::write_file_part_to_fd(int fd, const string & request)
+{
+    LOGCALL_VOID(DB, "GlassDatabase::write_file_part_to_fd", fd | request);
+
+    RemoteConnection conn(-1, fd, string());
+    string uuid, filename;
+    uint8 offset;
+    size_t length;
+    const char * ptr = request.data();
+    const char * end = ptr + request.size();
+    if (!unpack_string(&ptr, end, uuid) ||
+	!unpack_string(&ptr, end, filename) ||
+	!unpack_uint(&ptr, end, &offset) ||
+	!unpack_uint(&ptr, end, &length) ||
+	ptr != end ||
+	length > MAX_FILE_PART_SIZE ||
+	find_if(table_filenames, table_filenames + Glass::MAX_,
+		[&filename](const char * f) {
+		    return filename == f;
+		}) == table_filenames + Glass::MAX_) {
+	conn.send_message(REPL_REPLY_FAIL, "Invalid file part request", 0.0);
+	return;
+    }
+
+    string data(length, '\0');
+    if (uuid == get_uuid()) {
+	string filepath = db_dir;
+	filepath += '/';
+	filepath += filename;
+	FD fd_file(posixy_open(filepath.c_str(), O_RDONLY | O_CLOEXEC));
+	if (fd_file < 0) {
+	    throw Xapian::DatabaseError("Couldn't open " + filepath, errno);
+	}
+	if (lseek(fd_file, off_t(offset), SEEK_SET) == off_t(-1)) {
+	    throw Xapian::DatabaseError("Error seeking in table file", errno);
+	}
+	data.resize(io_read(fd_file, &data[0], length));
+	// Blocks read may be from revisions after the one the copy was made
+	// at, so the replica needs to reach the current revision before it
+	// makes the copy live.
+	reopen();
+    }
+    if (uuid != get_uuid()) {
+	// The database has been replaced since the copy was started.
+	conn.send_message(REPL_REPLY_FAIL, "Database changed during copy",
+			  0.0);
+	return;
+    }
+
+    string message;
+    pack_string(message, get_revision_info());
+    pack_string(message, filename);
+    pack_uint(message, offset);
+    message += data;
+    conn.send_message(REPL_REPLY_DB_FILEPART, message, 0.0);
+}
+
 void
 GlassDatabase::modifications_failed(glass_revision_number_t new_revision,
 				    const std::string & msg)
@@ -878,16 +1286,56 @@ TermList *
 GlassDatabase::open_allterms(const string & prefix) const
 {
     LOGCALL(DB, TermList *, "GlassDatabase::open_allterms", NO_ARGS);
+    if (postlist_table.has_termdict()) {
+	RETURN(new GlassTermDictAllTermsList(intrusive_ptr<const GlassDatabase>(this),
+					     prefix));
+    }
     RETURN(new GlassAllTermsList(intrusive_ptr<const GlassDatabase>(this),
 				 prefix));
 }
 
+TermList *
+GlassDatabase::open_completions(const string & prefix,
+				Xapian::termcount n) const
+{
+    LOGCALL(DB, TermList *, "GlassDatabase::open_completions", prefix | n);
+    if (prefix.empty() || prefix.size() > Glass::COMPLETIONS_MAX_PREFIX_LEN ||
+	!postlist_table.has_completions()) {
+	RETURN(Database::Internal::open_completions(prefix, n));
+    }
+
+    Glass::CompletionList completions;
+    string tag;
+    if (postlist_table.get_exact_entry(Glass::make_completions_key(prefix),
+				       tag)) {
+	completions.unserialise(tag);
+    }
+    if (completions.cutoff && completions.entries.size() < n) {
+	// The stored list is too short to answer this.
+	RETURN(Database::Internal::open_completions(prefix, n));
+    }
+    vector<string> terms;
+    vector<Glass::CompletionList::entry>::const_iterator i;
+    for (i = completions.entries.begin(); i != completions.entries.end(); ++i) {
+	if (terms.size() == n) break;
+	terms.push_back(i->second);
+    }
+    RETURN(new VectorTermList(terms.begin(), terms.end()));
+}
+
 TermList *
 GlassDatabase::open_spelling_termlist(const string & word) const
 {
     return spelling_table.open_termlist(word);
 }
 
+TermList *
+GlassDatabase::open_spelling_candidates(const string & word,
+					unsigned max_edit_distance) const
+{
+    return spelling_table.open_candidates(word, max_edit_distance);
+}
+
 TermList *
 GlassDatabase::open_spelling_wordlist() const
 {
@@ -990,17 +1438,15 @@ GlassWritableDatabase::GlassWritableDatabase(const string &dir, int flags,
 					       int block_size)
 	: GlassDatabase(dir, flags, block_size),
 	  change_count(0),
-	  flush_threshold(0),
+	  flushed_count(0),
+	  parallel_threshold(DEFAULT_PARALLEL_COMMIT_THRESHOLD),
 	  modify_shortcut_document(NULL),
 	  modify_shortcut_docid(0)
 {
     LOGCALL_CTOR(DB, "GlassWritableDatabase", dir | flags | block_size);
-
-    const char *p = getenv("XAPIAN_FLUSH_THRESHOLD");
+    const char * p = getenv("XAPIAN_PARALLEL_COMMIT_THRESHOLD");
     if (p)
-	flush_threshold = atoi(p);
-    if (flush_threshold == 0)
-	flush_threshold = 10000;
+	parallel_threshold = atoi(p);
 }
 
 GlassWritableDatabase::~GlassWritableDatabase()
@@ -1009,6 +1455,30 @@ GlassWritableDatabase::~GlassWritableDatabase()
     dtor_called();
 }
 
+size_t
+GlassWritableDatabase::get_memory_used() const
+{
+    // The termlist table writes through to its cursor's blocks, so doesn't
+    // buffer changes itself.
+    return inverter.get_memory_used() + value_manager.get_memory_used();
+}
+
+void
+GlassWritableDatabase::possibly_flush()
+{
+    if (flush_policy.should_flush(change_count, get_memory_used())) {
+	flush_postlist_changes();
+	if (!transaction_active()) apply();
+    }
+}
+
+void
+GlassWritableDatabase::set_flush_memory(size_t bytes)
+{
+    LOGCALL_VOID(DB, "GlassWritableDatabase::set_flush_memory", bytes);
+    flush_policy.set_memory_limit(bytes);
+}
+
 void
 GlassWritableDatabase::commit()
 {
@@ -1022,9 +1492,13 @@ void
 GlassWritableDatabase::flush_postlist_changes() const
 {
     version_file.set_oldest_changeset(changes.get_oldest_changeset());
-    inverter.flush(postlist_table);
-    inverter.flush_pos_lists(position_table);
+    // These update separate tables, so can be done in parallel.
+    run_tasks(use_parallel(change_count), {
+	[this]() { inverter.flush(postlist_table); },
+	[this]() { inverter.flush_pos_lists(position_table); }
+    });
 
+    flushed_count += change_count;
     change_count = 0;
 }
 
@@ -1043,6 +1517,9 @@ void
 GlassWritableDatabase::apply()
 {
     value_manager.set_value_stats(value_stats);
+    postlist_table.merge_termdict_changes();
+    parallel_commit = use_parallel(flushed_count + change_count);
+    flushed_count = 0;
     GlassDatabase::apply();
 }
 
@@ -1105,13 +1582,8 @@ GlassWritableDatabase::add_document_(Xapian::docid did,
 	throw;
     }
 
-    // FIXME: this should be done by checking memory usage, not the number of
-    // changes.  We could also look at the amount of data the inverter object
-    // currently holds.
-    if (++change_count >= flush_threshold) {
-	flush_postlist_changes();
-	if (!transaction_active()) apply();
-    }
+    ++change_count;
+    possibly_flush();
 
     RETURN(did);
 }
@@ -1177,10 +1649,8 @@ GlassWritableDatabase::delete_document(Xapian::docid did)
 	throw;
     }
 
-    if (++change_count >= flush_threshold) {
-	flush_postlist_changes();
-	if (!transaction_active()) apply();
-    }
+    ++change_count;
+    possibly_flush();
 }
 
 void
@@ -1337,10 +1807,8 @@ GlassWritableDatabase::replace_document(Xapian::docid did,
 	throw;
     }
 
-    if (++change_count >= flush_threshold) {
-	flush_postlist_changes();
-	if (!transaction_active()) apply();
-    }
+    ++change_count;
+    possibly_flush();
 }
 
 Xapian::Document::Internal *
@@ -1497,6 +1965,7 @@ GlassWritableDatabase::open_allterms(const string & prefix) const
 	// don't commit - there may be a transaction in progress).
 	inverter.flush_post_lists(postlist_table, prefix);
 	inverter.flush_pos_lists(position_table);
+	postlist_table.merge_termdict_changes();
 	if (prefix.empty()) {
 	    // We've flushed all the posting list changes, but the document
 	    // length and stats haven't been written, so set change_count to 1.
@@ -1507,6 +1976,22 @@ GlassWritableDatabase::open_allterms(const string & prefix) const
     RETURN(GlassDatabase::open_allterms(prefix));
 }
 
+TermList *
+GlassWritableDatabase::open_completions(const string & prefix,
+					Xapian::termcount n) const
+{
+    LOGCALL(DB, TermList *, "GlassWritableDatabase::open_completions", prefix | n);
+    if (change_count) {
+	// Flush changes for terms with the specified prefix, as for
+	// open_allterms().
+	inverter.flush_post_lists(postlist_table, prefix);
+	inverter.flush_pos_lists(position_table);
+	postlist_table.merge_termdict_changes();
+	if (prefix.empty()) change_count = 1;
+    }
+    RETURN(GlassDatabase::open_completions(prefix, n));
+}
+
 void
 GlassWritableDatabase::cancel()
 {
@@ -1514,6 +1999,7 @@ GlassWritableDatabase::cancel()
     inverter.clear();
     value_stats.clear();
     change_count = 0;
+    flushed_count = 0;
 }
 
 void
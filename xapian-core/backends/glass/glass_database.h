@@ -39,6 +39,7 @@
 #include "glass_version.h"
 #include "../flint_lock.h"
 #include "glass_defs.h"
+#include "backends/flushpolicy.h"
 #include "backends/valuestats.h"
 
 #include "noreturn.h"
@@ -60,6 +61,7 @@ class GlassDatabase : public Xapian::Database::Internal {
     friend class GlassTermList;
     friend class GlassPostList;
     friend class GlassAllTermsList;
+    friend class GlassTermDictAllTermsList;
     friend class GlassAllDocsPostList;
     private:
 	/** Directory to store databases in.
@@ -70,6 +72,14 @@ class GlassDatabase : public Xapian::Database::Internal {
 	 */
 	bool readonly;
 
+	/** Whether to flush, commit and sync the tables in parallel when
+	 *  setting the revision number.
+	 *
+	 *  Starting threads costs more than it saves for small commits, so
+	 *  GlassWritableDatabase only sets this for large ones.
+	 */
+	bool parallel_commit;
+
 	/** The file describing the Glass database.
 	 *  This file has information about the format of the database
 	 *  which can't easily be stored in any of the individual tables.
@@ -195,8 +205,37 @@ class GlassDatabase : public Xapian::Database::Internal {
 	void cancel();
 
 	/** Send a set of messages which transfer the whole database.
+	 *
+	 *  @param needed	The blocks the replica needs, by file name, as
+	 *			returned by parse_needed_blocks().  Files which are
+	 *			listed are sent as deltas, others in full.
+	 *  @param copy_in_parts	If true, the table files which aren't
+	 *				sent as deltas are listed in a
+	 *				REPL_REPLY_DB_FILEPARTS message instead,
+	 *				for the replica to fetch in parts.
+	 */
+	void send_whole_database(RemoteConnection & conn, double end_time,
+				 const std::map<string, std::pair<unsigned, string>> & needed,
+				 bool copy_in_parts);
+
+	/** Send checksums of the blocks of each table.
+	 *
+	 *  The replica compares these with its own blocks, and then asks for a
+	 *  copy of just the blocks which differ.
+	 */
+	void send_block_checksums(RemoteConnection & conn, double end_time);
+
+	/** Parse a replica's list of the blocks it needs.
+	 *
+	 *  @param request	The data the replica appended to its revision.
+	 *  @param needed	For each file listed, set to the block size and the
+	 *			runs of blocks the replica has and needs.
+	 *
+	 *  @return false if @a request isn't such a list, or the database has
+	 *	    changed since the checksums it was made from were sent.
 	 */
-	void send_whole_database(RemoteConnection & conn, double end_time);
+	bool parse_needed_blocks(const string & request,
+				 std::map<string, std::pair<unsigned, string>> & needed) const;
 
 	/** Get the revision stored in a changeset.
 	 */
@@ -270,8 +309,12 @@ class GlassDatabase : public Xapian::Database::Internal {
 	PositionList * open_position_list(Xapian::docid did, const string & term) const;
 	TermList * open_term_list(Xapian::docid did) const;
 	TermList * open_allterms(const string & prefix) const;
+	TermList * open_completions(const string & prefix,
+				    Xapian::termcount n) const;
 
 	TermList * open_spelling_termlist(const string & word) const;
+	TermList * open_spelling_candidates(const string & word,
+					    unsigned max_edit_distance) const;
 	TermList * open_spelling_wordlist() const;
 	Xapian::doccount get_spelling_frequency(const string & word) const;
 
@@ -283,7 +326,9 @@ class GlassDatabase : public Xapian::Database::Internal {
 	void write_changesets_to_fd(int fd,
 				    const string & start_revision,
 				    bool need_whole_db,
-				    Xapian::ReplicationInfo * info);
+				    Xapian::ReplicationInfo * info,
+				    bool copy_in_parts);
+	void write_file_part_to_fd(int fd, const string & request);
 	string get_revision_info() const;
 	string get_uuid() const;
 
@@ -329,8 +374,28 @@ class GlassWritableDatabase : public GlassDatabase {
 	 */
 	mutable Xapian::doccount change_count;
 
-	/// If change_count reaches this threshold we automatically flush.
-	Xapian::doccount flush_threshold;
+	/** The number of documents added, deleted, or replaced in flushes
+	 *  since the last commit.
+	 */
+	mutable Xapian::doccount flushed_count;
+
+	/** Commit in parallel if at least this many documents have changed.
+	 *
+	 *  Set from XAPIAN_PARALLEL_COMMIT_THRESHOLD, and 0 means never
+	 *  commit in parallel.
+	 */
+	Xapian::doccount parallel_threshold;
+
+	/// Default value for parallel_threshold.
+	static const Xapian::doccount DEFAULT_PARALLEL_COMMIT_THRESHOLD = 1000;
+
+	/// Should changes to @a count documents be written in parallel?
+	bool use_parallel(Xapian::doccount count) const {
+	    return parallel_threshold && count >= parallel_threshold;
+	}
+
+	/// Decides when we automatically flush.
+	FlushPolicy flush_policy;
 
 	/** A pointer to the last document which was returned by
 	 *  open_document(), or NULL if there is no such valid document.  This
@@ -347,6 +412,12 @@ class GlassWritableDatabase : public GlassDatabase {
 	/// Flush any unflushed postlist changes, but don't commit them.
 	void flush_postlist_changes() const;
 
+	/// Approximate memory used to buffer changes.
+	size_t get_memory_used() const;
+
+	/// Flush and apply changes if the flush policy says we should.
+	void possibly_flush();
+
 	/// Close all the tables permanently.
 	void close();
 
@@ -414,6 +485,8 @@ class GlassWritableDatabase : public GlassDatabase {
 	PositionList * open_position_list(Xapian::docid did, const string & term) const;
 	TermList * open_term_list(Xapian::docid did) const;
 	TermList * open_allterms(const string & prefix) const;
+	TermList * open_completions(const string & prefix,
+				    Xapian::termcount n) const;
 
 	void add_spelling(const string & word, Xapian::termcount freqinc) const;
 	void remove_spelling(const string & word, Xapian::termcount freqdec) const;
@@ -426,6 +499,7 @@ class GlassWritableDatabase : public GlassDatabase {
 
 	void set_metadata(const string & key, const string & value);
 	void invalidate_doc_object(Xapian::Document::Internal * obj) const;
+	void set_flush_memory(size_t bytes);
 	//@}
 
 	/** Return true if there are uncommitted changes. */
@@ -45,6 +45,13 @@
 #include "stringutils.h"
 
 #include <algorithm>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <system_error>
+#include <thread>
 
 XAPIAN_NORETURN(static void throw_connection_closed_unexpectedly());
 static void
@@ -64,10 +71,199 @@ static const char * dbnames =
 	"/spelling." GLASS_TABLE_EXTENSION "\0"
 	"/synonym." GLASS_TABLE_EXTENSION;
 
+/** Maximum number of bytes of blocks queued for each writer thread.
+ *
+ *  If the connection is faster than the disk, reading the changeset waits
+ *  for the writer to catch up once this much is queued.
+ */
+const size_t MAX_QUEUED_BYTES = 8 * 1024 * 1024;
+
+/** Writes changed blocks to table files on a thread of its own.
+ *
+ *  This allows the blocks for different tables to be written concurrently,
+ *  and the changeset to be read from the connection while they are.
+ */
+class GlassBlockWriter {
+    /// Don't allow assignment.
+    void operator=(const GlassBlockWriter &);
+
+    /// Don't allow copying.
+    GlassBlockWriter(const GlassBlockWriter &);
+
+    struct Block {
+	int fd;
+
+	uint4 block_number;
+
+	string data;
+
+	Block(int fd_, uint4 block_number_, const char * p, size_t len)
+	    : fd(fd_), block_number(block_number_), data(p, len) { }
+    };
+
+    mutex mut;
+
+    /// Signalled when a block is queued or written, or when finishing.
+    condition_variable cond;
+
+    /// Blocks waiting to be written.
+    deque<Block> queue;
+
+    /// Bytes of blocks queued or being written.
+    size_t queued_bytes;
+
+    /// Set once no more blocks will be queued.
+    bool finishing;
+
+    /// Any exception thrown while writing.
+    exception_ptr error;
+
+    /// The thread itself - this needs to be last so it's initialised last.
+    thread worker;
+
+    void run();
+
+  public:
+    /// Throws std::system_error if the thread can't be created.
+    GlassBlockWriter()
+	: queued_bytes(0), finishing(false),
+	  worker(&GlassBlockWriter::run, this) { }
+
+    /// Discard any queued blocks and stop the thread.
+    ~GlassBlockWriter() {
+	{
+	    lock_guard<mutex> lock(mut);
+	    queue.clear();
+	    finishing = true;
+	}
+	cond.notify_all();
+	if (worker.joinable()) worker.join();
+    }
+
+    /// Queue block @a block_number of @a fd to be written.
+    void write_block(int fd, const char * p, size_t len, uint4 block_number);
+
+    /// Write and sync all the queued blocks, then stop the thread.
+    void start_finish();
+
+    /** Wait for the thread to stop.
+     *
+     *  If writing failed, the exception is rethrown.
+     */
+    void wait();
+};
+
+void
+GlassBlockWriter::run()
+{
+    vector<int> written_fds;
+    unique_lock<mutex> lock(mut);
+    while (true) {
+	cond.wait(lock, [this] { return !queue.empty() || finishing; });
+	if (queue.empty())
+	    break;
+	Block block(std::move(queue.front()));
+	queue.pop_front();
+	lock.unlock();
+	exception_ptr e;
+	try {
+	    io_write_block(block.fd, block.data.data(), block.data.size(),
+			   block.block_number);
+	    if (find(written_fds.begin(), written_fds.end(), block.fd) ==
+		written_fds.end()) {
+		written_fds.push_back(block.fd);
+	    }
+	} catch (...) {
+	    e = current_exception();
+	}
+	lock.lock();
+	queued_bytes -= block.data.size();
+	if (e) {
+	    error = e;
+	    queue.clear();
+	    queued_bytes = 0;
+	    cond.notify_all();
+	    return;
+	}
+	cond.notify_all();
+    }
+    lock.unlock();
+
+    for (int fd : written_fds) {
+	io_sync(fd);
+    }
+}
+
+void
+GlassBlockWriter::write_block(int fd, const char * p, size_t len,
+			      uint4 block_number)
+{
+    {
+	unique_lock<mutex> lock(mut);
+	cond.wait(lock, [this] {
+	    return queued_bytes < MAX_QUEUED_BYTES || error;
+	});
+	if (error)
+	    rethrow_exception(error);
+	queue.emplace_back(fd, block_number, p, len);
+	queued_bytes += len;
+    }
+    cond.notify_all();
+}
+
+void
+GlassBlockWriter::start_finish()
+{
+    {
+	lock_guard<mutex> lock(mut);
+	finishing = true;
+    }
+    cond.notify_all();
+}
+
+void
+GlassBlockWriter::wait()
+{
+    worker.join();
+    if (error)
+	rethrow_exception(error);
+}
+
 GlassDatabaseReplicator::GlassDatabaseReplicator(const string & db_dir_)
-    : db_dir(db_dir_)
+    : db_dir(db_dir_), n_writers(1)
 {
     std::fill_n(fds, sizeof(fds) / sizeof(fds[0]), -1);
+    std::fill_n(unsynced_writes, Glass::MAX_, false);
+    const char * p = getenv("XAPIAN_REPLICATION_THREADS");
+    if (p) {
+	unsigned long n = strtoul(p, NULL, 10);
+	if (n > 1)
+	    n_writers = min(n, static_cast<unsigned long>(Glass::MAX_));
+    }
+    if (n_writers > 1)
+	writers.resize(n_writers);
+}
+
+void
+GlassDatabaseReplicator::finish_writers() const
+{
+    // Let all the writers finish (and sync) together before waiting for any.
+    for (GlassBlockWriter * writer : writers) {
+	if (writer) writer->start_finish();
+    }
+    exception_ptr error;
+    for (GlassBlockWriter * & writer : writers) {
+	if (!writer) continue;
+	try {
+	    writer->wait();
+	} catch (...) {
+	    if (!error) error = current_exception();
+	}
+	delete writer;
+	writer = NULL;
+    }
+    if (error)
+	rethrow_exception(error);
 }
 
 void
@@ -75,18 +271,24 @@ GlassDatabaseReplicator::commit() const
 {
     for (size_t i = 0; i != Glass::MAX_; ++i) {
 	int fd = fds[i];
-	if (fd >= 0) {
+	// Blocks written by a writer thread get synced by finish_writers().
+	if (fd >= 0 && unsynced_writes[i]) {
 	    io_sync(fd);
+	    unsynced_writes[i] = false;
 #if 0 // FIXME: close or keep open?
 	    close(fd);
 	    fds[i] = -1;
 #endif
 	}
     }
+    finish_writers();
 }
 
 GlassDatabaseReplicator::~GlassDatabaseReplicator()
 {
+    for (GlassBlockWriter * writer : writers) {
+	delete writer;
+    }
     for (size_t i = 0; i != Glass::MAX_; ++i) {
 	int fd = fds[i];
 	if (fd >= 0) {
@@ -210,7 +412,24 @@ GlassDatabaseReplicator::process_changeset_chunk_blocks(Glass::table_type table,
 	throw NetworkError("Unexpected end of changeset (4)");
     }
 
-    io_write_block(fd, buf.data(), changeset_blocksize, block_number);
+    GlassBlockWriter * writer = NULL;
+    if (n_writers > 1) {
+	GlassBlockWriter * & w = writers[table % n_writers];
+	if (!w) {
+	    try {
+		w = new GlassBlockWriter;
+	    } catch (const std::system_error &) {
+		// Write this table's blocks from this thread instead.
+	    }
+	}
+	writer = w;
+    }
+    if (writer) {
+	writer->write_block(fd, buf.data(), changeset_blocksize, block_number);
+    } else {
+	io_write_block(fd, buf.data(), changeset_blocksize, block_number);
+	unsynced_writes[table] = true;
+    }
     buf.erase(0, changeset_blocksize);
 }
 
@@ -308,7 +527,9 @@ GlassDatabaseReplicator::apply_changeset_from_conn(RemoteConnection & conn,
 	if (chunk_type == 0xff)
 	    break;
 	if (chunk_type == 0xfe) {
-	    // Version file.
+	    // Version file.  Make sure the blocks it refers to are on disk
+	    // before it's replaced.
+	    finish_writers();
 	    buf.erase(0, ptr - buf.data());
 	    process_changeset_chunk_version(buf, conn, end_time);
 	    continue;
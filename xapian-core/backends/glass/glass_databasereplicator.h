@@ -3,6 +3,7 @@
  */
 /* Copyright 2008 Lemur Consulting Ltd
  * Copyright 2009,2010,2011,2014 Olly Betts
+ * Copyright 2026 The Xapian contributors
  *
  * This program is free software; you can redistribute it and/or
  * modify it under the terms of the GNU General Public License as
@@ -26,6 +27,10 @@
 #include "backends/databasereplicator.h"
 #include "glass_defs.h"
 
+#include <vector>
+
+class GlassBlockWriter;
+
 class GlassDatabaseReplicator : public Xapian::DatabaseReplicator {
     private:
 	/** Path of database.
@@ -38,6 +43,32 @@ class GlassDatabaseReplicator : public Xapian::DatabaseReplicator {
 	 */
 	mutable int fds[Glass::MAX_];
 
+	/** Has each table had blocks written by this thread since it was
+	 *  last synced?
+	 *
+	 *  Blocks handed to a writer thread are synced by that thread, but a
+	 *  table can also be written serially (e.g. before its writer was
+	 *  created), so commit() syncs every table flagged here.
+	 */
+	mutable bool unsynced_writes[Glass::MAX_];
+
+	/** Number of threads to write changed blocks with.
+	 *
+	 *  If 1, blocks are written by the thread reading the changeset.
+	 *  Otherwise the blocks for table T are handed to writer
+	 *  T % n_writers, so blocks for different tables are written
+	 *  concurrently.  Set from XAPIAN_REPLICATION_THREADS.
+	 */
+	unsigned n_writers;
+
+	/** Threads writing changed blocks.
+	 *
+	 *  Entries are created on demand, and are NULL until then (or if a
+	 *  thread couldn't be created, in which case those tables are written
+	 *  to serially).
+	 */
+	mutable std::vector<GlassBlockWriter *> writers;
+
 	/** Process a chunk which holds a version file.
 	 */
 	void process_changeset_chunk_version(std::string & buf,
@@ -53,6 +84,13 @@ class GlassDatabaseReplicator : public Xapian::DatabaseReplicator {
 					    RemoteConnection & conn,
 					    double end_time) const;
 
+	/** Wait for the writer threads to write and sync their blocks.
+	 *
+	 *  The writers are then deleted.  If any writer failed, the first
+	 *  exception is rethrown.
+	 */
+	void finish_writers() const;
+
 	void commit() const;
 
     public:
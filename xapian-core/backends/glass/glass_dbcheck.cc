@@ -3,6 +3,7 @@
  */
 /* Copyright 1999,2000,2001 BrightStation PLC
  * Copyright 2002,2003,2004,2005,2006,2007,2008,2009,2010,2011,2012,2013,2014,2015,2016 Olly Betts
+ * Copyright 2026 The Xapian contributors
  *
  * This program is free software; you can redistribute it and/or
  * modify it under the terms of the GNU General Public License as
@@ -29,11 +30,15 @@
 #include "internaltypes.h"
 
 #include "glass_check.h"
+#include "glass_completions.h"
 #include "glass_cursor.h"
 #include "glass_defs.h"
+#include "glass_packedchunk.h"
 #include "glass_table.h"
+#include "glass_termdict.h"
 #include "glass_version.h"
 #include "pack.h"
+#include "stringutils.h"
 #include "backends/valuestats.h"
 
 #include <xapian.h>
@@ -51,6 +56,43 @@ is_user_metadata_key(const string & key)
     return key.size() > 1 && key[0] == '\0' && key[1] == '\xc0';
 }
 
+/** Read the flags at the start of a posting list chunk.
+ *
+ *  @return false if the flags are invalid.
+ */
+static bool
+read_chunk_flags(const char ** pos, const char * end,
+		 bool * is_last_chunk, bool * is_packed_chunk)
+{
+    if (*pos == end || (static_cast<unsigned char>(**pos) & ~3) != '0')
+	return false;
+    *is_last_chunk = (**pos & 1);
+    *is_packed_chunk = (**pos & 2);
+    ++*pos;
+    return true;
+}
+
+/** Convert the entries of a packed chunk to the original format.
+ *
+ *  This means the checks on the entries only need to handle one format.
+ *
+ *  @return false if the packed chunk is corrupt.
+ */
+static bool
+unpack_packed_chunk(const char * pos, const char * end,
+		    Xapian::docid first_did, string & entries)
+{
+    vector<Xapian::docid> dids;
+    vector<Xapian::termcount> wdfs;
+    if (!Glass::decode_packed_chunk(pos, end, first_did, dids, wdfs))
+	return false;
+    for (size_t i = 0; i != dids.size(); ++i) {
+	if (i) pack_uint(entries, dids[i] - dids[i - 1] - 1);
+	pack_uint(entries, wdfs[i]);
+    }
+    return true;
+}
+
 struct VStats : public ValueStats {
     Xapian::doccount freq_real;
 
@@ -124,6 +166,86 @@ check_glass_table(const char * tablename, const string &db_dir, int fd,
 		continue;
 	    }
 
+	    if (key == Glass::make_packed_postlists_key()) {
+		// Marker that new chunks are written packed.
+		continue;
+	    }
+
+	    if (Glass::is_termdict_key(key)) {
+		// Term dictionary marker or block.
+		if (key.size() == 2) continue;
+		cursor->read_tag();
+		Glass::TermDictBlockReader reader;
+		reader.init(cursor->current_tag);
+		string expect_first(key, 2);
+		bool first = true;
+		string prev;
+		try {
+		    while (reader.next()) {
+			if (first ? reader.term != expect_first
+				  : reader.term <= prev) {
+			    if (out)
+				*out << "Term dictionary block for '"
+				     << expect_first << "' out of order" << endl;
+			    ++errors;
+			    break;
+			}
+			if (reader.termfreq == 0) {
+			    if (out)
+				*out << "Term dictionary entry for '"
+				     << reader.term << "' has zero termfreq"
+				     << endl;
+			    ++errors;
+			}
+			first = false;
+			prev = reader.term;
+		    }
+		} catch (const Xapian::DatabaseCorruptError &) {
+		    if (out)
+			*out << "Term dictionary block for '" << expect_first
+			     << "' is corrupt" << endl;
+		    ++errors;
+		}
+		continue;
+	    }
+
+	    if (Glass::is_completions_key(key)) {
+		// Completions marker or list.
+		if (key.size() == 2) continue;
+		cursor->read_tag();
+		string prefix(key, 2);
+		Glass::CompletionList completions;
+		try {
+		    completions.unserialise(cursor->current_tag);
+		} catch (const Xapian::DatabaseCorruptError &) {
+		    if (out)
+			*out << "Completions for '" << prefix << "' are corrupt"
+			     << endl;
+		    ++errors;
+		    continue;
+		}
+		size_t n = completions.entries.size();
+		if (n == 0 || n > Glass::COMPLETIONS_MAX_STORED ||
+		    (completions.cutoff && n < Glass::COMPLETIONS_PER_PREFIX)) {
+		    if (out)
+			*out << "Completions for '" << prefix
+			     << "' have bad length " << n << endl;
+		    ++errors;
+		}
+		vector<Glass::CompletionList::entry>::const_iterator i;
+		for (i = completions.entries.begin();
+		     i != completions.entries.end(); ++i) {
+		    if (!startswith(i->second, prefix) ||
+			i->first < completions.cutoff) {
+			if (out)
+			    *out << "Bad completion '" << i->second
+				 << "' for '" << prefix << "'" << endl;
+			++errors;
+		    }
+		}
+		continue;
+	    }
+
 	    if (key.size() >= 2 && key[0] == '\0' && key[1] == '\xe0') {
 		// doclen chunk
 		const char * pos, * end;
@@ -168,8 +290,9 @@ check_glass_table(const char * tablename, const string &db_dir, int fd,
 		    }
 		}
 
-		bool is_last_chunk;
-		if (!unpack_bool(&pos, end, &is_last_chunk)) {
+		bool is_last_chunk, is_packed_chunk;
+		if (!read_chunk_flags(&pos, end,
+				      &is_last_chunk, &is_packed_chunk)) {
 		    if (out)
 			*out << "Failed to unpack last chunk flag for doclen" << endl;
 		    ++errors;
@@ -183,6 +306,25 @@ check_glass_table(const char * tablename, const string &db_dir, int fd,
 		    continue;
 		}
 		lastdid += did;
+		Xapian::termcount chunk_max_doclen;
+		if (!unpack_uint(&pos, end, &chunk_max_doclen)) {
+		    if (out)
+			*out << "Failed to unpack max doclen" << endl;
+		    ++errors;
+		    continue;
+		}
+		string unpacked;
+		if (is_packed_chunk) {
+		    if (!unpack_packed_chunk(pos, end, did, unpacked)) {
+			if (out)
+			    *out << "Packed doclen chunk is corrupt" << endl;
+			++errors;
+			continue;
+		    }
+		    pos = unpacked.data();
+		    end = pos + unpacked.size();
+		}
+		Xapian::termcount max_doclen = 0;
 		bool bad = false;
 		while (true) {
 		    Xapian::termcount doclen;
@@ -195,6 +337,7 @@ check_glass_table(const char * tablename, const string &db_dir, int fd,
 		    }
 
 		    ++num_doclens;
+		    if (doclen > max_doclen) max_doclen = doclen;
 
 		    if (did > db_last_docid) {
 			if (out)
@@ -243,6 +386,13 @@ check_glass_table(const char * tablename, const string &db_dir, int fd,
 		if (bad) {
 		    continue;
 		}
+		if (chunk_max_doclen != max_doclen) {
+		    if (out)
+			*out << "max doclen " << chunk_max_doclen << " in chunk "
+				"header != max doclen of entries " << max_doclen
+			     << endl;
+		    ++errors;
+		}
 		if (is_last_chunk) {
 		    if (did != lastdid) {
 			if (out)
@@ -497,8 +647,8 @@ check_glass_table(const char * tablename, const string &db_dir, int fd,
 		end = pos + cursor->current_tag.size();
 	    }
 
-	    bool is_last_chunk;
-	    if (!unpack_bool(&pos, end, &is_last_chunk)) {
+	    bool is_last_chunk, is_packed_chunk;
+	    if (!read_chunk_flags(&pos, end, &is_last_chunk, &is_packed_chunk)) {
 		if (out)
 		    *out << "Failed to unpack last chunk flag" << endl;
 		++errors;
@@ -512,6 +662,26 @@ check_glass_table(const char * tablename, const string &db_dir, int fd,
 		continue;
 	    }
 	    lastdid += did;
+	    Xapian::termcount chunk_max_wdf;
+	    if (!unpack_uint(&pos, end, &chunk_max_wdf)) {
+		if (out)
+		    *out << "Failed to unpack max wdf" << endl;
+		++errors;
+		continue;
+	    }
+	    string unpacked;
+	    if (is_packed_chunk) {
+		if (!unpack_packed_chunk(pos, end, did, unpacked)) {
+		    if (out)
+			*out << "Packed posting list chunk for term '" << term
+			     << "' is corrupt" << endl;
+		    ++errors;
+		    continue;
+		}
+		pos = unpacked.data();
+		end = pos + unpacked.size();
+	    }
+	    Xapian::termcount max_wdf = 0;
 	    bool bad = false;
 	    while (true) {
 		Xapian::termcount wdf;
@@ -524,6 +694,7 @@ check_glass_table(const char * tablename, const string &db_dir, int fd,
 		}
 		++tf;
 		cf += wdf;
+		if (wdf > max_wdf) max_wdf = wdf;
 
 		if (pos == end) break;
 
@@ -547,6 +718,12 @@ check_glass_table(const char * tablename, const string &db_dir, int fd,
 	    if (bad) {
 		continue;
 	    }
+	    if (chunk_max_wdf != max_wdf) {
+		if (out)
+		    *out << "max wdf " << chunk_max_wdf << " in chunk header "
+			    "!= max wdf of entries " << max_wdf << endl;
+		++errors;
+	    }
 	    if (is_last_chunk) {
 		if (tf != termfreq) {
 		    if (out)
@@ -27,11 +27,53 @@
 
 #include "api/termlist.h"
 
+#include <algorithm>
+#include <cstring>
 #include <map>
 #include <string>
 
 using namespace std;
 
+void
+Inverter::PostingChanges::sort()
+{
+    if (sorted) return;
+    typedef pair<Xapian::docid, Xapian::termcount> change;
+    stable_sort(pl_changes.begin(), pl_changes.end(),
+		[](const change & a, const change & b) {
+		    return a.first < b.first;
+		});
+    // Keep only the last change for each docid.
+    auto out = pl_changes.begin();
+    for (auto i = pl_changes.begin(); i != pl_changes.end(); ++i) {
+	auto next = i + 1;
+	if (next != pl_changes.end() && next->first == i->first) continue;
+	*out++ = *i;
+    }
+    pl_changes.erase(out, pl_changes.end());
+    sorted = true;
+}
+
+Inverter::TermRef
+Inverter::intern(const string & term)
+{
+    size_t len = term.size();
+    if (len > term_block_avail || term_blocks.empty()) {
+	// Terms are limited to a few hundred bytes by the backend, but allow
+	// for longer ones anyway.
+	size_t block_size = max(len, size_t(TERM_BLOCK_SIZE));
+	term_blocks.emplace_back(new char[block_size]);
+	term_block_next = term_blocks.back().get();
+	term_block_avail = block_size;
+	postlist_changes_size += block_size;
+    }
+    char * p = term_block_next;
+    memcpy(p, term.data(), len);
+    term_block_next += len;
+    term_block_avail -= len;
+    return TermRef(p, len);
+}
+
 void
 Inverter::store_positions(const GlassPositionListTable & position_table,
 			  Xapian::docid did,
@@ -50,6 +92,8 @@ Inverter::store_positions(const GlassPositionListTable & position_table,
 	    j = m.find(did);
 	    if (j != m.end()) {
 		// Update existing entry.
+		pos_changes_size -= j->second.size();
+		pos_changes_size += s.size();
 		swap(j->second, s);
 		return;
 	    }
@@ -96,8 +140,16 @@ Inverter::set_positionlist(Xapian::docid did,
 			   const string & term,
 			   const string & s)
 {
-    pos_changes.insert(make_pair(term, map<Xapian::docid, string>()))
-	.first->second[did] = s;
+    typedef map<Xapian::docid, string> pos_map;
+    auto i = pos_changes.insert(make_pair(term, pos_map()));
+    if (i.second)
+	pos_changes_size += map_node_size<string, pos_map>() + term.size();
+    auto j = i.first->second.insert(make_pair(did, string()));
+    if (j.second)
+	pos_changes_size += map_node_size<Xapian::docid, string>();
+    pos_changes_size -= j.first->second.size();
+    pos_changes_size += s.size();
+    j.first->second = s;
 }
 
 void
@@ -160,23 +212,27 @@ Inverter::flush_doclengths(GlassPostListTable & table)
 void
 Inverter::flush_post_list(GlassPostListTable & table, const string & term)
 {
-    map<string, PostingChanges>::iterator i;
-    i = postlist_changes.find(term);
+    map<TermRef, PostingChanges>::iterator i;
+    i = postlist_changes.find(TermRef(term));
     if (i == postlist_changes.end()) return;
 
-    // Flush buffered changes for just this term's postlist.
+    // Flush buffered changes for just this term's postlist.  The term's
+    // name stays in term_blocks until all the changes have been flushed.
+    i->second.sort();
     table.merge_changes(term, i->second);
+    postlist_changes_size -= i->second.get_memory_used();
     postlist_changes.erase(i);
 }
 
 void
 Inverter::flush_all_post_lists(GlassPostListTable & table)
 {
-    map<string, PostingChanges>::const_iterator i;
+    map<TermRef, PostingChanges>::iterator i;
     for (i = postlist_changes.begin(); i != postlist_changes.end(); ++i) {
-	table.merge_changes(i->first, i->second);
+	i->second.sort();
+	table.merge_changes(i->first.str(), i->second);
     }
-    postlist_changes.clear();
+    clear_postlist_changes();
 }
 
 void
@@ -185,12 +241,14 @@ Inverter::flush_post_lists(GlassPostListTable & table, const string & pfx)
     if (pfx.empty())
 	return flush_all_post_lists(table);
 
-    map<string, PostingChanges>::iterator i, begin, end;
-    begin = postlist_changes.lower_bound(pfx);
-    end = postlist_changes.upper_bound(pfx);
+    map<TermRef, PostingChanges>::iterator i, begin, end;
+    begin = postlist_changes.lower_bound(TermRef(pfx));
+    end = postlist_changes.upper_bound(TermRef(pfx));
 
     for (i = begin; i != end; ++i) {
-	table.merge_changes(i->first, i->second);
+	i->second.sort();
+	table.merge_changes(i->first.str(), i->second);
+	postlist_changes_size -= i->second.get_memory_used();
     }
 
     // Erase all the entries in one go, as that's:
@@ -223,4 +281,5 @@ Inverter::flush_pos_lists(GlassPositionListTable & table)
 	}
     }
     pos_changes.clear();
+    pos_changes_size = 0;
 }
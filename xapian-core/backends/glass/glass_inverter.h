@@ -23,10 +23,15 @@
 
 #include "xapian/types.h"
 
+#include <algorithm>
+#include <cstring>
 #include <map>
+#include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
+#include "backends/flushpolicy.h"
 #include "omassert.h"
 #include "str.h"
 #include "xapian/error.h"
@@ -45,6 +50,32 @@ const Xapian::termcount DELETED_POSTING = Xapian::termcount(-1);
 class Inverter {
     friend class GlassPostListTable;
 
+    /** Reference to a term name.
+     *
+     *  The term names used as keys in postlist_changes are stored in
+     *  term_blocks, which saves allocating a std::string for each one.
+     */
+    class TermRef {
+	const char * p;
+
+	size_t len;
+
+      public:
+	TermRef(const char * p_, size_t len_) : p(p_), len(len_) { }
+
+	explicit TermRef(const std::string & term)
+	    : p(term.data()), len(term.size()) { }
+
+	size_t size() const { return len; }
+
+	std::string str() const { return std::string(p, len); }
+
+	bool operator<(const TermRef & o) const {
+	    int r = std::memcmp(p, o.p, std::min(len, o.len));
+	    return r < 0 || (r == 0 && len < o.len);
+	}
+    };
+
     /// Class for storing the changes in frequencies for a term.
     class PostingChanges {
 	friend class GlassPostListTable;
@@ -55,30 +86,51 @@ class Inverter {
 	/// Change in collection frequency.
 	Xapian::termcount_diff cf_delta;
 
-	/// Changes to this term's postlist.
-	std::map<Xapian::docid, Xapian::termcount> pl_changes;
+	/** Changes to this term's postlist.
+	 *
+	 *  These are in the order they were made, which is usually ascending
+	 *  docid order.  If not, sort() must be called before they're used.
+	 */
+	std::vector<std::pair<Xapian::docid, Xapian::termcount>> pl_changes;
+
+	/// Are the entries in pl_changes in strictly ascending docid order?
+	bool sorted;
+
+	/// Set the new wdf for @a did.
+	void set(Xapian::docid did, Xapian::termcount wdf) {
+	    if (!pl_changes.empty()) {
+		Xapian::docid last = pl_changes.back().first;
+		if (did == last) {
+		    pl_changes.back().second = wdf;
+		    return;
+		}
+		if (did < last) sorted = false;
+	    }
+	    pl_changes.push_back(std::make_pair(did, wdf));
+	}
 
       public:
 	/// Constructor for an added posting.
 	PostingChanges(Xapian::docid did, Xapian::termcount wdf)
-	    : tf_delta(1), cf_delta(Xapian::termcount_diff(wdf))
+	    : tf_delta(1), cf_delta(Xapian::termcount_diff(wdf)), sorted(true)
 	{
-	    pl_changes.insert(std::make_pair(did, wdf));
+	    set(did, wdf);
 	}
 
 	/// Constructor for a removed posting.
 	PostingChanges(Xapian::docid did, Xapian::termcount wdf, bool)
-	    : tf_delta(-1), cf_delta(-Xapian::termcount_diff(wdf))
+	    : tf_delta(-1), cf_delta(-Xapian::termcount_diff(wdf)), sorted(true)
 	{
-	    pl_changes.insert(std::make_pair(did, DELETED_POSTING));
+	    set(did, DELETED_POSTING);
 	}
 
 	/// Constructor for an updated posting.
 	PostingChanges(Xapian::docid did, Xapian::termcount old_wdf,
 		       Xapian::termcount new_wdf)
-	    : tf_delta(0), cf_delta(Xapian::termcount_diff(new_wdf - old_wdf))
+	    : tf_delta(0), cf_delta(Xapian::termcount_diff(new_wdf - old_wdf)),
+	      sorted(true)
 	{
-	    pl_changes.insert(std::make_pair(did, new_wdf));
+	    set(did, new_wdf);
 	}
 
 	/// Add a posting.
@@ -86,7 +138,7 @@ class Inverter {
 	    ++tf_delta;
 	    cf_delta += wdf;
 	    // Add did to term's postlist
-	    pl_changes[did] = wdf;
+	    set(did, wdf);
 	}
 
 	/// Remove a posting.
@@ -94,29 +146,97 @@ class Inverter {
 	    --tf_delta;
 	    cf_delta -= wdf;
 	    // Remove did from term's postlist.
-	    pl_changes[did] = DELETED_POSTING;
+	    set(did, DELETED_POSTING);
 	}
 
 	/// Update a posting.
 	void update_posting(Xapian::docid did, Xapian::termcount old_wdf,
 			    Xapian::termcount new_wdf) {
 	    cf_delta += new_wdf - old_wdf;
-	    pl_changes[did] = new_wdf;
+	    set(did, new_wdf);
 	}
 
+	/** Sort pl_changes into ascending docid order.
+	 *
+	 *  Where there are several changes for the same docid, only the last
+	 *  is kept.
+	 */
+	void sort();
+
 	/// Get the term frequency delta.
 	Xapian::termcount_diff get_tfdelta() const { return tf_delta; }
 
 	/// Get the collection frequency delta.
 	Xapian::termcount_diff get_cfdelta() const { return cf_delta; }
+
+	/** Approximate memory used to buffer these changes.
+	 *
+	 *  The term name isn't included as term_blocks is accounted for
+	 *  separately.
+	 */
+	size_t get_memory_used() const {
+	    return map_node_size<TermRef, PostingChanges>() +
+		pl_changes.capacity() *
+		sizeof(std::pair<Xapian::docid, Xapian::termcount>);
+	}
     };
 
     /// Buffered changes to postlists.
-    std::map<std::string, PostingChanges> postlist_changes;
+    std::map<TermRef, PostingChanges> postlist_changes;
+
+    /// Approximate memory used by postlist_changes.
+    size_t postlist_changes_size;
+
+    /// Blocks of storage for the term names in postlist_changes.
+    std::vector<std::unique_ptr<char[]>> term_blocks;
+
+    /// Start of the unused space in the last block in term_blocks.
+    char * term_block_next;
+
+    /// Bytes still unused at the end of the last block in term_blocks.
+    size_t term_block_avail;
+
+    /// Size of each block in term_blocks.
+    enum { TERM_BLOCK_SIZE = 65536 };
+
+    /// Copy @a term into term_blocks.
+    TermRef intern(const std::string & term);
+
+    /** Find the entry in postlist_changes for @a term.
+     *
+     *  If there isn't one, an entry is created by passing @a args to the
+     *  PostingChanges constructor, and end() is returned to signal that
+     *  it needs no further updating.
+     */
+    template<typename... Args>
+    std::map<TermRef, PostingChanges>::iterator
+    find_or_create(const std::string & term, Args... args) {
+	std::map<TermRef, PostingChanges>::iterator i;
+	i = postlist_changes.find(TermRef(term));
+	if (i == postlist_changes.end()) {
+	    i = postlist_changes.insert(
+		std::make_pair(intern(term), PostingChanges(args...))).first;
+	    postlist_changes_size += i->second.get_memory_used();
+	    return postlist_changes.end();
+	}
+	return i;
+    }
+
+    /// Forget all buffered postlist changes.
+    void clear_postlist_changes() {
+	postlist_changes.clear();
+	postlist_changes_size = 0;
+	term_blocks.clear();
+	term_block_next = NULL;
+	term_block_avail = 0;
+    }
 
     /// Buffered changes to positional data.
     std::map<std::string, std::map<Xapian::docid, std::string> > pos_changes;
 
+    /// Approximate memory used by pos_changes.
+    size_t pos_changes_size;
+
     void store_positions(const GlassPositionListTable & position_table,
 			 Xapian::docid did,
 			 const std::string & tname,
@@ -132,40 +252,41 @@ class Inverter {
     std::map<Xapian::docid, Xapian::termcount> doclen_changes;
 
   public:
+    Inverter()
+	: postlist_changes_size(0), term_block_next(NULL), term_block_avail(0),
+	  pos_changes_size(0) { }
+
     void add_posting(Xapian::docid did, const std::string & term,
 		     Xapian::doccount wdf) {
-	std::map<std::string, PostingChanges>::iterator i;
-	i = postlist_changes.find(term);
-	if (i == postlist_changes.end()) {
-	    postlist_changes.insert(
-		std::make_pair(term, PostingChanges(did, wdf)));
-	} else {
+	std::map<TermRef, PostingChanges>::iterator i;
+	i = find_or_create(term, did, wdf);
+	if (i != postlist_changes.end()) {
+	    postlist_changes_size -= i->second.get_memory_used();
 	    i->second.add_posting(did, wdf);
+	    postlist_changes_size += i->second.get_memory_used();
 	}
     }
 
     void remove_posting(Xapian::docid did, const std::string & term,
 			Xapian::doccount wdf) {
-	std::map<std::string, PostingChanges>::iterator i;
-	i = postlist_changes.find(term);
-	if (i == postlist_changes.end()) {
-	    postlist_changes.insert(
-		std::make_pair(term, PostingChanges(did, wdf, false)));
-	} else {
+	std::map<TermRef, PostingChanges>::iterator i;
+	i = find_or_create(term, did, wdf, false);
+	if (i != postlist_changes.end()) {
+	    postlist_changes_size -= i->second.get_memory_used();
 	    i->second.remove_posting(did, wdf);
+	    postlist_changes_size += i->second.get_memory_used();
 	}
     }
 
     void update_posting(Xapian::docid did, const std::string & term,
 			Xapian::termcount old_wdf,
 			Xapian::termcount new_wdf) {
-	std::map<std::string, PostingChanges>::iterator i;
-	i = postlist_changes.find(term);
-	if (i == postlist_changes.end()) {
-	    postlist_changes.insert(
-		std::make_pair(term, PostingChanges(did, old_wdf, new_wdf)));
-	} else {
+	std::map<TermRef, PostingChanges>::iterator i;
+	i = find_or_create(term, did, old_wdf, new_wdf);
+	if (i != postlist_changes.end()) {
+	    postlist_changes_size -= i->second.get_memory_used();
 	    i->second.update_posting(did, old_wdf, new_wdf);
+	    postlist_changes_size += i->second.get_memory_used();
 	}
     }
 
@@ -186,8 +307,16 @@ class Inverter {
 
     void clear() {
 	doclen_changes.clear();
-	postlist_changes.clear();
+	clear_postlist_changes();
 	pos_changes.clear();
+	pos_changes_size = 0;
+    }
+
+    /// Approximate memory used to buffer changes.
+    size_t get_memory_used() const {
+	return postlist_changes_size + pos_changes_size +
+	    doclen_changes.size() *
+	    map_node_size<Xapian::docid, Xapian::termcount>();
     }
 
     void set_doclength(Xapian::docid did, Xapian::termcount doclen, bool add) {
@@ -234,8 +363,8 @@ class Inverter {
     bool get_deltas(const std::string & term,
 		    Xapian::termcount_diff & tf_delta,
 		    Xapian::termcount_diff & cf_delta) const {
-	std::map<std::string, PostingChanges>::const_iterator i;
-	i = postlist_changes.find(term);
+	std::map<TermRef, PostingChanges>::const_iterator i;
+	i = postlist_changes.find(TermRef(term));
 	if (i == postlist_changes.end()) {
 	    return false;
 	}
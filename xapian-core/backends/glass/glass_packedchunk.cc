@@ -0,0 +1,392 @@
+/** @file glass_packedchunk.cc
+ * @brief Packed encoding of glass posting list chunks.
+ */
+/* Copyright (C) 2026 The Xapian contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include <config.h>
+
+#include "glass_packedchunk.h"
+
+#include "internaltypes.h"
+#include "omassert.h"
+#include "pack.h"
+
+#include <algorithm>
+
+#ifdef HAVE_X86_SIMD_TARGETS
+# include <immintrin.h>
+#endif
+
+using namespace std;
+
+bool
+Glass::read_packed_block_header(const char ** posptr, const char * end,
+				Xapian::docid * increase_to_last,
+				const char ** block_end)
+{
+    size_t len;
+    if (!unpack_uint(posptr, end, increase_to_last) ||
+	!unpack_uint(posptr, end, &len) ||
+	len > size_t(end - *posptr)) {
+	return false;
+    }
+    *block_end = *posptr + len;
+    return true;
+}
+
+/** Decode values in stream-VByte form one at a time.
+ *
+ *  @param ctrl	The control bytes, starting with the one for the first
+ *		value.
+ *  @param data	The start of the values.
+ *  @param end	The end of the data which may be read.
+ *  @param n	The number of values to decode.
+ *  @param out	Array to store the decoded values in.
+ *  @param prev	If DELTA is true, each value is stored as the increase
+ *		from the one before, and this is the value before the
+ *		first.
+ *
+ *  @return Pointer to after the values, or NULL if they run past @a end.
+ */
+template<bool DELTA, typename T>
+static const char *
+decode_scalar(const unsigned char * ctrl, const char * data,
+	      const char * end, unsigned n, T * out, T prev)
+{
+    for (unsigned i = 0; i != n; ++i) {
+	unsigned len = ((ctrl[i / 4] >> (2 * (i % 4))) & 3) + 1;
+	if (rare(size_t(end - data) < len)) return NULL;
+	T value = 0;
+	for (unsigned j = len; j != 0; --j) {
+	    value = (value << 8) | T(static_cast<unsigned char>(data[j - 1]));
+	}
+	data += len;
+	if (DELTA) {
+	    prev += value;
+	    value = prev;
+	}
+	out[i] = value;
+    }
+    return data;
+}
+
+#ifdef HAVE_X86_SIMD_TARGETS
+/// Tables for decoding a group of four values given its control byte.
+struct StreamVByteTables {
+    /// The total length in bytes of the four values.
+    unsigned char length[256];
+
+    /** The byte shuffle which expands the four values to 32 bits each.
+     *
+     *  0x80 makes the shuffle store a zero byte.
+     */
+    unsigned char shuffle[256][16];
+
+    StreamVByteTables() {
+	for (unsigned c = 0; c != 256; ++c) {
+	    unsigned offset = 0;
+	    for (unsigned j = 0; j != 4; ++j) {
+		unsigned len = ((c >> (2 * j)) & 3) + 1;
+		for (unsigned b = 0; b != 4; ++b) {
+		    shuffle[c][4 * j + b] = (b < len) ? offset + b : 0x80;
+		}
+		offset += len;
+	    }
+	    length[c] = offset;
+	}
+    }
+};
+
+static const StreamVByteTables &
+get_shuffle_tables()
+{
+    static const StreamVByteTables tables;
+    return tables;
+}
+
+/// Decode values in stream-VByte form four at a time using SSSE3.
+template<bool DELTA>
+__attribute__((target("ssse3")))
+static const char *
+decode_ssse3(const unsigned char * ctrl, const char * data,
+	     const char * end, unsigned n, uint4 * out, uint4 prev)
+{
+    const StreamVByteTables & tables = get_shuffle_tables();
+    __m128i carry = _mm_set1_epi32(int(prev));
+    unsigned i = 0;
+    // A group of four values is at most 16 bytes long, but we always load 16
+    // bytes, so stop when fewer than that are left and finish one at a time.
+    while (n - i >= 4 && end - data >= 16) {
+	unsigned c = *ctrl++;
+	__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+	v = _mm_shuffle_epi8(v, _mm_loadu_si128(
+		reinterpret_cast<const __m128i*>(tables.shuffle[c])));
+	if (DELTA) {
+	    // Sum the increases within the group, then add the previous
+	    // value.
+	    v = _mm_add_epi32(v, _mm_slli_si128(v, 4));
+	    v = _mm_add_epi32(v, _mm_slli_si128(v, 8));
+	    v = _mm_add_epi32(v, carry);
+	    carry = _mm_shuffle_epi32(v, 0xff);
+	}
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), v);
+	data += tables.length[c];
+	i += 4;
+    }
+    if (DELTA) prev = uint4(_mm_cvtsi128_si32(carry));
+    return decode_scalar<DELTA>(ctrl, data, end, n - i, out + i, prev);
+}
+
+/// Decode values in stream-VByte form eight at a time using AVX2.
+template<bool DELTA>
+__attribute__((target("avx2")))
+static const char *
+decode_avx2(const unsigned char * ctrl, const char * data,
+	    const char * end, unsigned n, uint4 * out, uint4 prev)
+{
+    const StreamVByteTables & tables = get_shuffle_tables();
+    __m256i carry = _mm256_set1_epi32(int(prev));
+    unsigned i = 0;
+    // Each 128-bit lane decodes one group of four values.  The second group
+    // starts at most 16 bytes in, so 32 bytes must be left to load both.
+    while (n - i >= 8 && end - data >= 32) {
+	unsigned c0 = ctrl[0];
+	unsigned c1 = ctrl[1];
+	ctrl += 2;
+	const char * data1 = data + tables.length[c0];
+	__m256i v = _mm256_inserti128_si256(
+		_mm256_castsi128_si256(_mm_loadu_si128(
+			reinterpret_cast<const __m128i*>(data))),
+		_mm_loadu_si128(reinterpret_cast<const __m128i*>(data1)), 1);
+	__m256i mask = _mm256_inserti128_si256(
+		_mm256_castsi128_si256(_mm_loadu_si128(
+			reinterpret_cast<const __m128i*>(tables.shuffle[c0]))),
+		_mm_loadu_si128(
+			reinterpret_cast<const __m128i*>(tables.shuffle[c1])), 1);
+	v = _mm256_shuffle_epi8(v, mask);
+	if (DELTA) {
+	    // Sum the increases within each lane, carry the total of the low
+	    // lane into the high lane, then add the previous value.
+	    v = _mm256_add_epi32(v, _mm256_slli_si256(v, 4));
+	    v = _mm256_add_epi32(v, _mm256_slli_si256(v, 8));
+	    __m256i low_total =
+		_mm256_permutevar8x32_epi32(v, _mm256_set1_epi32(3));
+	    v = _mm256_add_epi32(v, _mm256_blend_epi32(_mm256_setzero_si256(),
+							low_total, 0xf0));
+	    v = _mm256_add_epi32(v, carry);
+	    carry = _mm256_permutevar8x32_epi32(v, _mm256_set1_epi32(7));
+	}
+	_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), v);
+	data = data1 + tables.length[c1];
+	i += 8;
+    }
+    if (DELTA) prev = uint4(_mm_cvtsi128_si32(_mm256_castsi256_si128(carry)));
+    // Any group of four left over can still be decoded with SSSE3.
+    return decode_ssse3<DELTA>(ctrl, data, end, n - i, out + i, prev);
+}
+
+typedef const char * (*decode_function)(const unsigned char *, const char *,
+					const char *, unsigned,
+					uint4 *, uint4);
+
+/// The fastest decoders which the CPU we're running on supports.
+struct StreamVByteDecoders {
+    decode_function deltas;
+
+    decode_function values;
+
+    StreamVByteDecoders()
+	: deltas(decode_scalar<true, uint4>),
+	  values(decode_scalar<false, uint4>)
+    {
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+	    deltas = decode_avx2<true>;
+	    values = decode_avx2<false>;
+	} else if (__builtin_cpu_supports("ssse3")) {
+	    deltas = decode_ssse3<true>;
+	    values = decode_ssse3<false>;
+	}
+    }
+};
+
+static const StreamVByteDecoders &
+get_decoders()
+{
+    static const StreamVByteDecoders decoders;
+    return decoders;
+}
+#endif
+
+/** Decode values in stream-VByte form.
+ *
+ *  Parameters and return value are as for decode_scalar().
+ */
+template<bool DELTA, typename T>
+static inline const char *
+decode_values(const unsigned char * ctrl, const char * data,
+	      const char * end, unsigned n, T * out, T prev)
+{
+    return decode_scalar<DELTA>(ctrl, data, end, n, out, prev);
+}
+
+#ifdef HAVE_X86_SIMD_TARGETS
+// The SIMD decoders produce 32-bit values, so are only used if the output
+// type is 32-bit, which overload resolution picks this for.
+template<bool DELTA>
+static inline const char *
+decode_values(const unsigned char * ctrl, const char * data,
+	      const char * end, unsigned n, uint4 * out, uint4 prev)
+{
+    const StreamVByteDecoders & decoders = get_decoders();
+    return (DELTA ? decoders.deltas : decoders.values)(ctrl, data, end,
+							n, out, prev);
+}
+#endif
+
+bool
+Glass::decode_packed_block(const char * pos, const char * block_end,
+			   const char * end, unsigned n, Xapian::docid base,
+			   Xapian::docid * dids, Xapian::termcount * wdfs)
+{
+    AssertRel(n,>,0);
+    AssertRel(n,<=,PACKED_BLOCK_SIZE);
+    size_t ctrl_len = (n + 3) / 4;
+    if (size_t(block_end - pos) < ctrl_len) return false;
+    const unsigned char * ctrl = reinterpret_cast<const unsigned char *>(pos);
+    pos = decode_values<true>(ctrl, pos + ctrl_len, end, n, dids, base);
+    if (!pos || pos > block_end || size_t(block_end - pos) < ctrl_len)
+	return false;
+    ctrl = reinterpret_cast<const unsigned char *>(pos);
+    pos = decode_values<false>(ctrl, pos + ctrl_len, end, n, wdfs,
+			       Xapian::termcount(0));
+    return pos == block_end;
+}
+
+bool
+Glass::decode_packed_chunk(const char * pos, const char * end,
+			   Xapian::docid first_did,
+			   vector<Xapian::docid> & dids,
+			   vector<Xapian::termcount> & wdfs)
+{
+    Xapian::doccount n;
+    if (!unpack_uint(&pos, end, &n) || n == 0) return false;
+    // Each entry takes at least two bytes, so this rejects a corrupt count
+    // before it's used to size the vectors.
+    if (n > size_t(end - pos) / 2) return false;
+    size_t start = dids.size();
+    dids.resize(start + n);
+    wdfs.resize(start + n);
+    Xapian::docid base = first_did;
+    size_t i = start;
+    while (i != dids.size()) {
+	unsigned k = unsigned(min(dids.size() - i, size_t(PACKED_BLOCK_SIZE)));
+	Xapian::docid increase_to_last;
+	const char * block_end;
+	if (!read_packed_block_header(&pos, end, &increase_to_last,
+				      &block_end))
+	    return false;
+	Xapian::docid last = base + increase_to_last;
+	if (last < base) return false;
+	if (!decode_packed_block(pos, block_end, end, k, base,
+				 &dids[i], &wdfs[i]))
+	    return false;
+	// The docids must increase, starting from first_did (the gap for the
+	// first entry in the chunk is 0).  Overflow would make them decrease.
+	Xapian::docid prev = base;
+	unsigned j = 0;
+	if (i == start) {
+	    if (dids[i] != first_did) return false;
+	    j = 1;
+	}
+	for ( ; j != k; ++j) {
+	    if (dids[i + j] <= prev) return false;
+	    prev = dids[i + j];
+	}
+	if (prev != last) return false;
+	base = last;
+	pos = block_end;
+	i += k;
+    }
+    return pos == end;
+}
+
+/// Append values in stream-VByte form.
+static void
+encode_values(string & s, const uint4 * values, unsigned n)
+{
+    size_t ctrl = s.size();
+    s.append((n + 3) / 4, '\0');
+    for (unsigned i = 0; i != n; ++i) {
+	uint4 value = values[i];
+	unsigned len = 1;
+	while (len < 4 && (value >> (8 * len))) ++len;
+	s[ctrl + i / 4] |= char((len - 1) << (2 * (i % 4)));
+	while (len--) {
+	    s += char(value & 0xff);
+	    value >>= 8;
+	}
+    }
+}
+
+/// Does @a value fit in 32 bits?
+template<typename T>
+static inline bool
+fits_in_32_bits(T value)
+{
+    return (value >> 16 >> 16) == 0;
+}
+
+bool
+Glass::encode_packed_chunk(string & chunk,
+			   const vector<Xapian::docid> & dids,
+			   const vector<Xapian::termcount> & wdfs)
+{
+    Assert(!dids.empty());
+    AssertEq(dids.size(), wdfs.size());
+    string body;
+    pack_uint(body, dids.size());
+    uint4 gaps[PACKED_BLOCK_SIZE];
+    uint4 values[PACKED_BLOCK_SIZE];
+    string block;
+    Xapian::docid base = dids[0];
+    size_t i = 0;
+    while (i != dids.size()) {
+	unsigned k = unsigned(min(dids.size() - i, size_t(PACKED_BLOCK_SIZE)));
+	Xapian::docid prev = base;
+	for (unsigned j = 0; j != k; ++j) {
+	    Xapian::docid gap = dids[i + j] - prev;
+	    Xapian::termcount wdf = wdfs[i + j];
+	    if (!fits_in_32_bits(gap) || !fits_in_32_bits(wdf)) return false;
+	    gaps[j] = uint4(gap);
+	    values[j] = uint4(wdf);
+	    prev = dids[i + j];
+	}
+	block.resize(0);
+	encode_values(block, gaps, k);
+	encode_values(block, values, k);
+	pack_uint(body, prev - base);
+	pack_uint(body, block.size());
+	body += block;
+	base = prev;
+	i += k;
+    }
+    chunk += body;
+    return true;
+}
@@ -0,0 +1,155 @@
+/** @file glass_packedchunk.h
+ * @brief Packed encoding of glass posting list chunks.
+ */
+/* Copyright (C) 2026 The Xapian contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef XAPIAN_INCLUDED_GLASS_PACKEDCHUNK_H
+#define XAPIAN_INCLUDED_GLASS_PACKEDCHUNK_H
+
+#include "xapian/types.h"
+
+#include <string>
+#include <vector>
+
+/* A posting list chunk is either in the original format, where each entry is
+ * a docid increase and a wdf packed with pack_uint(), or in the packed
+ * format, which the chunk header flags.  The packed format is:
+ *
+ *   pack_uint(number of entries in the chunk)
+ *   one or more blocks of PACKED_BLOCK_SIZE entries (the last may be shorter)
+ *
+ * and each block is:
+ *
+ *   pack_uint(last docid in the block - base)
+ *   pack_uint(length of the rest of the block in bytes)
+ *   the docid gaps in stream-VByte form
+ *   the wdfs in stream-VByte form
+ *
+ * The base is the first docid in the chunk for the first block, and the last
+ * docid of the previous block otherwise.  Each docid gap is from the previous
+ * entry, or from the base for the first entry in the block (so it's 0 for the
+ * first entry in the chunk).
+ *
+ * The stream-VByte form of n values is (n + 3) / 4 control bytes followed by
+ * the values.  Bits 2*j and 2*j+1 of control byte i hold the length in bytes
+ * minus one of value 4*i+j, and each value is stored little-endian in 1 to 4
+ * bytes.  Keeping the lengths apart from the values means a group of four can
+ * be decoded with a single shuffle using a table indexed by the control byte.
+ *
+ * Whether new chunks are written in the packed format is a property of the
+ * database, marked by the key "\0\xc4" in the postlist table (which sorts
+ * after the user metadata and before the term dictionary).
+ */
+
+namespace Glass {
+
+/// The number of entries in each block of a packed chunk.
+const unsigned PACKED_BLOCK_SIZE = 128;
+
+/// The key which marks that new posting list chunks should be packed.
+inline std::string
+make_packed_postlists_key()
+{
+    return std::string("\0\xc4", 2);
+}
+
+/** Read the header of a block of a packed chunk.
+ *
+ *  @param posptr		Position in the chunk - updated to point after
+ *				the header.
+ *  @param end			End of the chunk.
+ *  @param increase_to_last	Set to the last docid in the block minus the
+ *				base.
+ *  @param block_end		Set to the end of the block.
+ *
+ *  @return false if the header is corrupt.
+ */
+bool read_packed_block_header(const char ** posptr, const char * end,
+			      Xapian::docid * increase_to_last,
+			      const char ** block_end);
+
+/** Decode the entries of a block of a packed chunk.
+ *
+ *  @param pos		The start of the block after its header.
+ *  @param block_end	The end of the block.
+ *  @param end		The end of the chunk (data up to here may be read
+ *			but is ignored).
+ *  @param n		The number of entries in the block.
+ *  @param base		The base docid for the block.
+ *  @param dids		Array to store the n docids in.
+ *  @param wdfs		Array to store the n wdfs in.
+ *
+ *  @return false if the block is corrupt.
+ */
+bool decode_packed_block(const char * pos, const char * block_end,
+			 const char * end, unsigned n, Xapian::docid base,
+			 Xapian::docid * dids, Xapian::termcount * wdfs);
+
+/** Decode all the entries of a packed chunk.
+ *
+ *  This checks the docids increase, so is intended for when the entries are
+ *  being copied or checked rather than for searching.
+ *
+ *  @param pos		The start of the chunk after the chunk header.
+ *  @param end		The end of the chunk.
+ *  @param first_did	The first docid in the chunk.
+ *  @param dids		Vector to append the docids to.
+ *  @param wdfs		Vector to append the wdfs to.
+ *
+ *  @return false if the chunk is corrupt.
+ */
+bool decode_packed_chunk(const char * pos, const char * end,
+			 Xapian::docid first_did,
+			 std::vector<Xapian::docid> & dids,
+			 std::vector<Xapian::termcount> & wdfs);
+
+/** Encode entries as the body of a packed chunk.
+ *
+ *  @param chunk	String to append the encoded entries to.
+ *  @param dids		The docids in ascending order (there must be at least
+ *			one).
+ *  @param wdfs		The corresponding wdfs.
+ *
+ *  @return false if a docid gap or wdf is too large for the packed format
+ *	    (which can only happen if docid or termcount are 64-bit types),
+ *	    in which case @a chunk is left unchanged.
+ */
+bool encode_packed_chunk(std::string & chunk,
+			 const std::vector<Xapian::docid> & dids,
+			 const std::vector<Xapian::termcount> & wdfs);
+
+/** The size of the values of a packed entry.
+ *
+ *  This doesn't include the control bits, which add half a byte per entry.
+ *
+ *  @param gap	The increase in docid from the previous entry.
+ *  @param wdf	The wdf of the entry.
+ */
+inline unsigned
+packed_entry_size(Xapian::docid gap, Xapian::termcount wdf)
+{
+    unsigned size = 2;
+    while (gap >>= 8) ++size;
+    while (wdf >>= 8) ++size;
+    return size;
+}
+
+}
+
+#endif // XAPIAN_INCLUDED_GLASS_PACKEDCHUNK_H
@@ -3,6 +3,7 @@
  * Copyright 1999,2000,2001 BrightStation PLC
  * Copyright 2002,2003,2004,2005,2007,2008,2009,2011,2013,2014,2015 Olly Betts
  * Copyright 2007,2008,2009 Lemur Consulting Ltd
+ * Copyright 2026 The Xapian contributors
  *
  * This program is free software; you can redistribute it and/or
  * modify it under the terms of the GNU General Public License as
@@ -24,14 +25,27 @@
 
 #include "glass_postlist.h"
 
+#include "glass_completions.h"
 #include "glass_cursor.h"
 #include "glass_database.h"
+#include "glass_termdict.h"
 #include "debuglog.h"
 #include "noreturn.h"
 #include "pack.h"
 #include "str.h"
+#include "stringutils.h"
 #include "unicode/description_append.h"
 
+#include <algorithm>
+#include <set>
+
+using Glass::CompletionList;
+using Glass::CompletionsBuilder;
+using Glass::TermDictBlockReader;
+using Glass::TermDictCursor;
+using Glass::TermDictWriter;
+using Glass::is_termdict_key;
+using Glass::make_termdict_key;
 using Xapian::Internal::intrusive_ptr;
 
 void
@@ -96,7 +110,8 @@ class Glass::PostlistChunkWriter {
 	PostlistChunkWriter(const string &orig_key_,
 			    bool is_first_chunk_,
 			    const string &tname_,
-			    bool is_last_chunk_);
+			    bool is_last_chunk_,
+			    bool packed_);
 
 	/// Append an entry to this chunk.
 	void append(GlassTable * table, Xapian::docid did,
@@ -104,10 +119,12 @@ class Glass::PostlistChunkWriter {
 
 	/// Append a block of raw entries to this chunk.
 	void raw_append(Xapian::docid first_did_, Xapian::docid current_did_,
-			const string & s) {
+			Xapian::termcount max_wdf_, const string & s) {
 	    Assert(!started);
+	    Assert(!packed);
 	    first_did = first_did_;
 	    current_did = current_did_;
+	    max_wdf = max_wdf_;
 	    if (!s.empty()) {
 		chunk.append(s);
 		started = true;
@@ -127,10 +144,25 @@ class Glass::PostlistChunkWriter {
 	bool is_last_chunk;
 	bool started;
 
+	/// Should the chunk be written in the packed format?
+	bool packed;
+
 	Xapian::docid first_did;
 	Xapian::docid current_did;
 
+	/// The highest wdf of any entry in the chunk.
+	Xapian::termcount max_wdf;
+
 	string chunk;
+
+	/// The docids of a packed chunk, which flush() encodes.
+	vector<Xapian::docid> dids;
+
+	/// The wdfs corresponding to dids.
+	vector<Xapian::termcount> wdfs;
+
+	/// The encoded size of dids and wdfs, less the control bits.
+	size_t packed_size;
 };
 
 using Glass::PostlistChunkWriter;
@@ -223,20 +255,67 @@ read_wdf(const char ** posptr, const char * end, Xapian::termcount * wdf_ptr)
     if (!unpack_uint(posptr, end, wdf_ptr)) report_read_error(*posptr);
 }
 
+/** Decode a run of entries from a chunk.
+ *
+ *  @param posptr	Position in the chunk - updated to point after the
+ *			entries decoded.
+ *  @param end		End of the chunk.
+ *  @param did		The document id of the entry before *posptr.
+ *  @param dids		Array to store the document ids in.
+ *  @param wdfs		Array to store the wdfs in.
+ *  @param n		Maximum number of entries to decode.
+ *
+ *  @return The number of entries decoded.
+ */
+static unsigned
+read_entries(const char ** posptr, const char * end, Xapian::docid did,
+	     Xapian::docid * dids, Xapian::termcount * wdfs, unsigned n)
+{
+    const char * p = *posptr;
+    unsigned i = 0;
+    while (i != n && p != end) {
+	// Most entries have a docid increase and wdf which both fit in a
+	// single byte, so handle that case without the general decoding.
+	unsigned char inc = static_cast<unsigned char>(p[0]);
+	if (end - p >= 2 && (inc | static_cast<unsigned char>(p[1])) < 128) {
+	    did += inc + 1;
+	    wdfs[i] = static_cast<unsigned char>(p[1]);
+	    p += 2;
+	} else {
+	    read_did_increase(&p, end, &did);
+	    read_wdf(&p, end, &wdfs[i]);
+	}
+	dids[i++] = did;
+    }
+    *posptr = p;
+    return i;
+}
+
 /// Read the start of a chunk.
 static Xapian::docid
 read_start_of_chunk(const char ** posptr,
 		    const char * end,
 		    Xapian::docid first_did_in_chunk,
-		    bool * is_last_chunk_ptr)
+		    bool * is_last_chunk_ptr,
+		    Xapian::termcount * max_wdf_ptr,
+		    bool * is_packed_chunk_ptr)
 {
-    LOGCALL_STATIC(DB, Xapian::docid, "read_start_of_chunk", reinterpret_cast<const void*>(posptr) | reinterpret_cast<const void*>(end) | first_did_in_chunk | reinterpret_cast<const void*>(is_last_chunk_ptr));
+    LOGCALL_STATIC(DB, Xapian::docid, "read_start_of_chunk", reinterpret_cast<const void*>(posptr) | reinterpret_cast<const void*>(end) | first_did_in_chunk | reinterpret_cast<const void*>(is_last_chunk_ptr) | reinterpret_cast<const void*>(max_wdf_ptr) | reinterpret_cast<const void*>(is_packed_chunk_ptr));
     Assert(is_last_chunk_ptr);
-
-    // Read whether this is the last chunk
-    if (!unpack_bool(posptr, end, is_last_chunk_ptr))
-	report_read_error(*posptr);
+    Assert(is_packed_chunk_ptr);
+
+    // Read whether this is the last chunk and whether it's packed, which are
+    // bits 0 and 1 of a byte which is otherwise '0'.
+    if (*posptr == end)
+	report_read_error(0);
+    unsigned char flags = static_cast<unsigned char>(**posptr);
+    if ((flags & ~3) != '0')
+	throw Xapian::DatabaseCorruptError("Bad posting list chunk flags");
+    ++*posptr;
+    *is_last_chunk_ptr = (flags & 1);
+    *is_packed_chunk_ptr = (flags & 2);
     LOGVALUE(DB, *is_last_chunk_ptr);
+    LOGVALUE(DB, *is_packed_chunk_ptr);
 
     // Read what the final document ID in this chunk is.
     Xapian::docid increase_to_last;
@@ -244,6 +323,12 @@ read_start_of_chunk(const char ** posptr,
 	report_read_error(*posptr);
     Xapian::docid last_did_in_chunk = first_did_in_chunk + increase_to_last;
     LOGVALUE(DB, last_did_in_chunk);
+
+    // Read the highest wdf of any entry in this chunk.
+    if (!unpack_uint(posptr, end, max_wdf_ptr))
+	report_read_error(*posptr);
+    if (max_wdf_ptr)
+	LOGVALUE(DB, *max_wdf_ptr);
     RETURN(last_did_in_chunk);
 }
 
@@ -262,16 +347,36 @@ class Glass::PostlistChunkReader {
     Xapian::docid did;
     Xapian::termcount wdf;
 
+    /// The docids of a packed chunk, which are all decoded up front.
+    vector<Xapian::docid> packed_dids;
+
+    /// The wdfs corresponding to packed_dids.
+    vector<Xapian::termcount> packed_wdfs;
+
+    /// The index of the current entry in packed_dids.
+    size_t packed_index;
+
   public:
     /** Initialise the postlist chunk reader.
      *
      *  @param first_did  First document id in this chunk.
+     *  @param packed     Is the chunk in the packed format?
      *  @param data       The tag string with the header removed.
      */
-    PostlistChunkReader(Xapian::docid first_did, const string & data_)
-	: data(data_), pos(data.data()), end(pos + data.length()), at_end(data.empty()), did(first_did)
+    PostlistChunkReader(Xapian::docid first_did, bool packed,
+			const string & data_)
+	: data(data_), pos(data.data()), end(pos + data.length()), at_end(data.empty()), did(first_did), packed_index(0)
     {
-	if (!at_end) read_wdf(&pos, end, &wdf);
+	if (at_end) return;
+	if (!packed) {
+	    read_wdf(&pos, end, &wdf);
+	    return;
+	}
+	if (!Glass::decode_packed_chunk(pos, end, first_did,
+					packed_dids, packed_wdfs)) {
+	    throw Xapian::DatabaseCorruptError("Packed posting list chunk is corrupt");
+	}
+	wdf = packed_wdfs[0];
     }
 
     Xapian::docid get_docid() const {
@@ -295,7 +400,14 @@ using Glass::PostlistChunkReader;
 void
 PostlistChunkReader::next()
 {
-    if (pos == end) {
+    if (!packed_dids.empty()) {
+	if (++packed_index == packed_dids.size()) {
+	    at_end = true;
+	} else {
+	    did = packed_dids[packed_index];
+	    wdf = packed_wdfs[packed_index];
+	}
+    } else if (pos == end) {
 	at_end = true;
     } else {
 	read_did_increase(&pos, end, &did);
@@ -306,13 +418,17 @@ PostlistChunkReader::next()
 PostlistChunkWriter::PostlistChunkWriter(const string &orig_key_,
 					 bool is_first_chunk_,
 					 const string &tname_,
-					 bool is_last_chunk_)
+					 bool is_last_chunk_,
+					 bool packed_)
 	: orig_key(orig_key_),
 	  tname(tname_), is_first_chunk(is_first_chunk_),
 	  is_last_chunk(is_last_chunk_),
-	  started(false)
+	  started(false),
+	  packed(packed_),
+	  max_wdf(0),
+	  packed_size(0)
 {
-    LOGCALL_CTOR(DB, "PostlistChunkWriter", orig_key_ | is_first_chunk_ | tname_ | is_last_chunk_);
+    LOGCALL_CTOR(DB, "PostlistChunkWriter", orig_key_ | is_first_chunk_ | tname_ | is_last_chunk_ | packed_);
 }
 
 void
@@ -322,24 +438,38 @@ PostlistChunkWriter::append(GlassTable * table, Xapian::docid did,
     if (!started) {
 	started = true;
 	first_did = did;
+	max_wdf = 0;
     } else {
 	Assert(did > current_did);
 	// Start a new chunk if this one has grown to the threshold.
-	if (chunk.size() >= CHUNKSIZE) {
+	size_t size = packed ? packed_size + dids.size() / 2 : chunk.size();
+	if (size >= CHUNKSIZE) {
 	    bool save_is_last_chunk = is_last_chunk;
 	    is_last_chunk = false;
 	    flush(table);
 	    is_last_chunk = save_is_last_chunk;
 	    is_first_chunk = false;
 	    first_did = did;
+	    max_wdf = 0;
 	    chunk.resize(0);
+	    dids.clear();
+	    wdfs.clear();
+	    packed_size = 0;
 	    orig_key = GlassPostListTable::make_key(tname, first_did);
-	} else {
+	} else if (!packed) {
 	    pack_uint(chunk, did - current_did - 1);
 	}
     }
     current_did = did;
-    pack_uint(chunk, wdf);
+    if (wdf > max_wdf) max_wdf = wdf;
+    if (packed) {
+	Xapian::docid gap = dids.empty() ? 0 : did - dids.back();
+	packed_size += Glass::packed_entry_size(gap, wdf);
+	dids.push_back(did);
+	wdfs.push_back(wdf);
+    } else {
+	pack_uint(chunk, wdf);
+    }
 }
 
 /** Make the data to go at the start of the very first chunk.
@@ -361,12 +491,16 @@ make_start_of_first_chunk(Xapian::doccount entries,
 static inline string
 make_start_of_chunk(bool new_is_last_chunk,
 		    Xapian::docid new_first_did,
-		    Xapian::docid new_final_did)
+		    Xapian::docid new_final_did,
+		    Xapian::termcount new_max_wdf,
+		    bool new_is_packed_chunk)
 {
     Assert(new_final_did >= new_first_did);
     string chunk;
-    pack_bool(chunk, new_is_last_chunk);
+    chunk += char('0' | (new_is_last_chunk ? 1 : 0) |
+		  (new_is_packed_chunk ? 2 : 0));
     pack_uint(chunk, new_final_did - new_first_did);
+    pack_uint(chunk, new_max_wdf);
     return chunk;
 }
 
@@ -376,14 +510,53 @@ write_start_of_chunk(string & chunk,
 		     unsigned int end_of_chunk_header,
 		     bool is_last_chunk,
 		     Xapian::docid first_did_in_chunk,
-		     Xapian::docid last_did_in_chunk)
+		     Xapian::docid last_did_in_chunk,
+		     Xapian::termcount max_wdf_in_chunk,
+		     bool is_packed_chunk)
 {
     Assert((size_t)(end_of_chunk_header - start_of_chunk_header) <= chunk.size());
 
     chunk.replace(start_of_chunk_header,
 		  end_of_chunk_header - start_of_chunk_header,
 		  make_start_of_chunk(is_last_chunk, first_did_in_chunk,
-				      last_did_in_chunk));
+				      last_did_in_chunk, max_wdf_in_chunk,
+				      is_packed_chunk));
+}
+
+void
+Glass::add_packed_postlists_marker(GlassTable * table)
+{
+    // The tag is a format version number.
+    string tag;
+    pack_uint(tag, 1u);
+    table->add(Glass::make_packed_postlists_key(), tag);
+}
+
+void
+Glass::pack_postlist_chunk(string & chunk, Xapian::docid first_did)
+{
+    LOGCALL_STATIC_VOID(DB, "Glass::pack_postlist_chunk", chunk | first_did);
+    const char * pos = chunk.data();
+    const char * end = pos + chunk.size();
+    bool is_last_chunk, is_packed_chunk;
+    Xapian::termcount max_wdf;
+    Xapian::docid last_did = read_start_of_chunk(&pos, end, first_did,
+						 &is_last_chunk, &max_wdf,
+						 &is_packed_chunk);
+    if (is_packed_chunk || pos == end) return;
+
+    vector<Xapian::docid> dids;
+    vector<Xapian::termcount> wdfs;
+    PostlistChunkReader reader(first_did, false, string(pos, end));
+    while (!reader.is_at_end()) {
+	dids.push_back(reader.get_docid());
+	wdfs.push_back(reader.get_wdf());
+	reader.next();
+    }
+    string new_chunk = make_start_of_chunk(is_last_chunk, first_did, last_did,
+					   max_wdf, true);
+    if (Glass::encode_packed_chunk(new_chunk, dids, wdfs))
+	swap(chunk, new_chunk);
 }
 
 void
@@ -474,9 +647,12 @@ PostlistChunkWriter::flush(GlassTable *table)
 
 	    // Read the chunk header
 	    bool new_is_last_chunk;
+	    Xapian::termcount new_max_wdf_in_chunk;
+	    bool new_is_packed_chunk;
 	    Xapian::docid new_last_did_in_chunk =
 		read_start_of_chunk(&tagpos, tagend, new_first_did,
-				    &new_is_last_chunk);
+				    &new_is_last_chunk, &new_max_wdf_in_chunk,
+				    &new_is_packed_chunk);
 
 	    string chunk_data(tagpos, tagend);
 
@@ -488,7 +664,9 @@ PostlistChunkWriter::flush(GlassTable *table)
 	    tag = make_start_of_first_chunk(num_ent, coll_freq, new_first_did);
 	    tag += make_start_of_chunk(new_is_last_chunk,
 					      new_first_did,
-					      new_last_did_in_chunk);
+					      new_last_did_in_chunk,
+					      new_max_wdf_in_chunk,
+					      new_is_packed_chunk);
 	    tag += chunk_data;
 	    table->add(orig_key, tag);
 	    return;
@@ -536,10 +714,13 @@ PostlistChunkWriter::flush(GlassTable *table)
 		    report_read_error(keypos);
 	    }
 	    bool wrong_is_last_chunk;
+	    Xapian::termcount max_wdf_in_chunk;
+	    bool is_packed_chunk;
 	    string::size_type start_of_chunk_header = tagpos - tag.data();
 	    Xapian::docid last_did_in_chunk =
 		read_start_of_chunk(&tagpos, tagend, first_did_in_chunk,
-				    &wrong_is_last_chunk);
+				    &wrong_is_last_chunk, &max_wdf_in_chunk,
+				    &is_packed_chunk);
 	    string::size_type end_of_chunk_header = tagpos - tag.data();
 
 	    // write new is_last flag
@@ -548,7 +729,9 @@ PostlistChunkWriter::flush(GlassTable *table)
 				 end_of_chunk_header,
 				 true, // is_last_chunk
 				 first_did_in_chunk,
-				 last_did_in_chunk);
+				 last_did_in_chunk,
+				 max_wdf_in_chunk,
+				 is_packed_chunk);
 	    table->add(cursor->current_key, tag);
 	}
     } else {
@@ -559,6 +742,20 @@ PostlistChunkWriter::flush(GlassTable *table)
 	 *
 	 * The subcases just affect the chunk header.
 	 */
+	bool is_packed_chunk = packed;
+	if (packed) {
+	    Assert(chunk.empty());
+	    if (!Glass::encode_packed_chunk(chunk, dids, wdfs)) {
+		// An entry doesn't fit in the packed format, so write this
+		// chunk in the original format.
+		is_packed_chunk = false;
+		for (size_t i = 0; i != dids.size(); ++i) {
+		    if (i) pack_uint(chunk, dids[i] - dids[i - 1] - 1);
+		    pack_uint(chunk, wdfs[i]);
+		}
+	    }
+	}
+
 	string tag;
 
 	/* First write the header, which depends on whether this is the
@@ -586,7 +783,8 @@ PostlistChunkWriter::flush(GlassTable *table)
 
 	    tag = make_start_of_first_chunk(num_ent, coll_freq, first_did);
 
-	    tag += make_start_of_chunk(is_last_chunk, first_did, current_did);
+	    tag += make_start_of_chunk(is_last_chunk, first_did, current_did,
+				   max_wdf, is_packed_chunk);
 	    tag += chunk;
 	    table->add(key, tag);
 	    return;
@@ -626,7 +824,8 @@ PostlistChunkWriter::flush(GlassTable *table)
 	}
 
 	// ...and write the start of this chunk.
-	tag = make_start_of_chunk(is_last_chunk, first_did, current_did);
+	tag = make_start_of_chunk(is_last_chunk, first_did, current_did,
+				   max_wdf, is_packed_chunk);
 
 	tag += chunk;
 	table->add(new_key, tag);
@@ -657,11 +856,16 @@ void GlassPostList::read_number_of_entries(const char ** posptr,
  *
  *  A chunk (except for the first chunk) contains:
  *
- *  1)  bool - true if this is the last chunk.
+ *  1)  flags - '0', plus 1 if this is the last chunk, plus 2 if the chunk
+ *      is packed.
  *  2)  difference between final docid in chunk and first docid.
- *  3)  wdf for the first item.
- *  4)  increment in docid to next item, followed by wdf for the item.
- *  5)  (4) repeatedly.
+ *  3)  the highest wdf of any item in the chunk.
+ *  4)  wdf for the first item.
+ *  5)  increment in docid to next item, followed by wdf for the item.
+ *  6)  (5) repeatedly.
+ *
+ *  In a packed chunk, (4) to (6) are replaced by the blocks of entries
+ *  described in glass_packedchunk.h.
  *
  *  The first chunk begins with the number of entries, the collection
  *  frequency, then the docid of the first document, then has the header of a
@@ -696,16 +900,20 @@ GlassPostList::GlassPostList(intrusive_ptr<const GlassDatabase> this_db_,
 void
 GlassPostList::init()
 {
+    decoded_pos = decoded_end = 0;
     string key = GlassPostListTable::make_key(term);
     int found = cursor->find_entry(key);
     if (!found) {
 	LOGLINE(DB, "postlist for term not found");
 	number_of_entries = 0;
 	is_at_end = true;
+	is_packed_chunk = false;
 	pos = 0;
 	end = 0;
 	first_did_in_chunk = 0;
 	last_did_in_chunk = 0;
+	max_wdf_in_chunk = 0;
+	chunk_max_weight = -1.0;
 	return;
     }
     cursor->read_tag();
@@ -715,8 +923,10 @@ GlassPostList::init()
     did = read_start_of_first_chunk(&pos, end, &number_of_entries, NULL);
     first_did_in_chunk = did;
     last_did_in_chunk = read_start_of_chunk(&pos, end, first_did_in_chunk,
-					    &is_last_chunk);
-    read_wdf(&pos, end, &wdf);
+					    &is_last_chunk, &max_wdf_in_chunk,
+					    &is_packed_chunk);
+    chunk_max_weight = -1.0;
+    start_chunk();
     LOGLINE(DB, "Initial docid " << did);
 }
 
@@ -758,19 +968,94 @@ bool
 GlassPostList::next_in_chunk()
 {
     LOGCALL(DB, bool, "GlassPostList::next_in_chunk", NO_ARGS);
-    if (pos == end) RETURN(false);
+    if (decoded_pos == decoded_end && !decode_batch()) RETURN(false);
 
-    read_did_increase(&pos, end, &did);
-    read_wdf(&pos, end, &wdf);
+    did = decoded_did[decoded_pos];
+    wdf = decoded_wdf[decoded_pos];
+    ++decoded_pos;
 
-    // Either not at last doc in chunk, or pos == end, but not both.
+    // Either not at last doc in chunk, or at the end of the chunk, but not
+    // both.
     Assert(did <= last_did_in_chunk);
-    Assert(did < last_did_in_chunk || pos == end);
-    Assert(pos != end || did == last_did_in_chunk);
+    Assert(did < last_did_in_chunk ||
+	   (pos == end && decoded_pos == decoded_end));
+    Assert(pos != end || decoded_pos != decoded_end ||
+	   did == last_did_in_chunk);
 
     RETURN(true);
 }
 
+bool
+GlassPostList::decode_batch(Xapian::docid desired_did)
+{
+    LOGCALL(DB, bool, "GlassPostList::decode_batch", desired_did);
+    Assert(decoded_pos == decoded_end);
+    if (!is_packed_chunk) {
+	if (pos == end) RETURN(false);
+	// The current entry may have been skipped over without being made
+	// current by move_forward_in_chunk_to_at_least().
+	Xapian::docid prev_did =
+	    decoded_end ? decoded_did[decoded_end - 1] : did;
+	decoded_pos = 0;
+	decoded_end = read_entries(&pos, end, prev_did,
+				   decoded_did, decoded_wdf,
+				   DECODE_BATCH_SIZE);
+	RETURN(true);
+    }
+
+    while (packed_entries_left) {
+	unsigned n = DECODE_BATCH_SIZE;
+	if (packed_entries_left < n) n = packed_entries_left;
+	packed_entries_left -= n;
+	Xapian::docid increase_to_last;
+	const char * block_end;
+	if (!Glass::read_packed_block_header(&pos, end, &increase_to_last,
+					     &block_end)) {
+	    throw Xapian::DatabaseCorruptError("Bad block header in packed posting list chunk");
+	}
+	Xapian::docid block_last_did = packed_base + increase_to_last;
+	if (block_last_did < desired_did && packed_entries_left) {
+	    // Nothing in this block is wanted, so skip it without decoding.
+	    pos = block_end;
+	    packed_base = block_last_did;
+	    continue;
+	}
+	if (!Glass::decode_packed_block(pos, block_end, end, n, packed_base,
+					decoded_did, decoded_wdf) ||
+	    decoded_did[n - 1] != block_last_did) {
+	    throw Xapian::DatabaseCorruptError("Bad block in packed posting list chunk");
+	}
+	pos = block_end;
+	packed_base = block_last_did;
+	decoded_pos = 0;
+	decoded_end = n;
+	RETURN(true);
+    }
+    RETURN(false);
+}
+
+void
+GlassPostList::start_chunk()
+{
+    LOGCALL_VOID(DB, "GlassPostList::start_chunk", NO_ARGS);
+    decoded_pos = decoded_end = 0;
+    if (!is_packed_chunk) {
+	read_wdf(&pos, end, &wdf);
+	return;
+    }
+
+    if (!unpack_uint(&pos, end, &packed_entries_left))
+	report_read_error(pos);
+    packed_base = did;
+    if (!decode_batch()) {
+	throw Xapian::DatabaseCorruptError("Packed posting list chunk is empty");
+    }
+    // The docid gap of the first entry is 0, so it's at did.
+    AssertEq(decoded_did[0], did);
+    wdf = decoded_wdf[0];
+    decoded_pos = 1;
+}
+
 void
 GlassPostList::next_chunk()
 {
@@ -813,8 +1098,10 @@ GlassPostList::next_chunk()
 
     first_did_in_chunk = did;
     last_did_in_chunk = read_start_of_chunk(&pos, end, first_did_in_chunk,
-					    &is_last_chunk);
-    read_wdf(&pos, end, &wdf);
+					    &is_last_chunk, &max_wdf_in_chunk,
+					    &is_packed_chunk);
+    chunk_max_weight = -1.0;
+    start_chunk();
 }
 
 PositionList *
@@ -834,11 +1121,27 @@ GlassPostList::open_position_list() const
     RETURN(new GlassPositionList(&this_db->position_table, did, term));
 }
 
+void
+GlassPostList::skip_low_weight_chunks(double w_min)
+{
+    LOGCALL_VOID(DB, "GlassPostList::skip_low_weight_chunks", w_min);
+    Assert(weight);
+    while (!is_at_end) {
+	if (chunk_max_weight < 0.0)
+	    chunk_max_weight = weight->get_maxpart_for_wdf(max_wdf_in_chunk);
+	if (chunk_max_weight >= w_min) return;
+	LOGLINE(DB, "Skipping chunk with max weight " << chunk_max_weight);
+	pos = end;
+	decoded_pos = decoded_end;
+	packed_entries_left = 0;
+	next_chunk();
+    }
+}
+
 PostList *
 GlassPostList::next(double w_min)
 {
     LOGCALL(DB, PostList *, "GlassPostList::next", w_min);
-    (void)w_min; // no warning
 
     if (!have_started) {
 	have_started = true;
@@ -846,6 +1149,8 @@ GlassPostList::next(double w_min)
 	if (!next_in_chunk()) next_chunk();
     }
 
+    if (w_min > 0.0 && weight) skip_low_weight_chunks(w_min);
+
     if (is_at_end) {
 	LOGLINE(DB, "Moved to end");
     } else {
@@ -906,8 +1211,10 @@ GlassPostList::move_to_chunk_containing(Xapian::docid desired_did)
 
     first_did_in_chunk = did;
     last_did_in_chunk = read_start_of_chunk(&pos, end, first_did_in_chunk,
-					    &is_last_chunk);
-    read_wdf(&pos, end, &wdf);
+					    &is_last_chunk, &max_wdf_in_chunk,
+					    &is_packed_chunk);
+    chunk_max_weight = -1.0;
+    start_chunk();
 
     // Possible, since desired_did might be after end of this chunk and before
     // the next.
@@ -922,14 +1229,17 @@ GlassPostList::move_forward_in_chunk_to_at_least(Xapian::docid desired_did)
 	RETURN(true);
 
     if (desired_did <= last_did_in_chunk) {
-	while (pos != end) {
-	    read_did_increase(&pos, end, &did);
-	    if (did >= desired_did) {
-		read_wdf(&pos, end, &wdf);
-		RETURN(true);
+	while (decoded_pos != decoded_end || decode_batch(desired_did)) {
+	    if (decoded_did[decoded_end - 1] < desired_did) {
+		// The whole batch is before desired_did.
+		decoded_pos = decoded_end;
+		continue;
 	    }
-	    // It's faster to just skip over the wdf than to decode it.
-	    read_wdf(&pos, end, NULL);
+	    while (decoded_did[decoded_pos] < desired_did) ++decoded_pos;
+	    did = decoded_did[decoded_pos];
+	    wdf = decoded_wdf[decoded_pos];
+	    ++decoded_pos;
+	    RETURN(true);
 	}
 
 	// If we hit the end of the chunk then last_did_in_chunk must be wrong.
@@ -937,6 +1247,8 @@ GlassPostList::move_forward_in_chunk_to_at_least(Xapian::docid desired_did)
     }
 
     pos = end;
+    decoded_pos = decoded_end;
+    packed_entries_left = 0;
     RETURN(false);
 }
 
@@ -944,7 +1256,6 @@ PostList *
 GlassPostList::skip_to(Xapian::docid desired_did, double w_min)
 {
     LOGCALL(DB, PostList *, "GlassPostList::skip_to", desired_did | w_min);
-    (void)w_min; // no warning
     // We've started now - if we hadn't already, we're already positioned
     // at start so there's no need to actually do anything.
     have_started = true;
@@ -965,6 +1276,8 @@ GlassPostList::skip_to(Xapian::docid desired_did, double w_min)
     (void)have_document;
     Assert(have_document);
 
+    if (w_min > 0.0 && weight) skip_low_weight_chunks(w_min);
+
     if (is_at_end) {
 	LOGLINE(DB, "Skipped to end");
     } else {
@@ -1042,7 +1355,8 @@ GlassPostListTable::get_chunk(const string &tname,
 	    throw Xapian::DatabaseCorruptError("Attempted to delete or modify an entry in a non-existent posting list for " + tname);
 
 	*from = NULL;
-	*to = new PostlistChunkWriter(string(), true, tname, true);
+	*to = new PostlistChunkWriter(string(), true, tname, true,
+				      has_packed_postlists());
 	RETURN(Xapian::docid(-1));
     }
 
@@ -1064,19 +1378,28 @@ GlassPostListTable::get_chunk(const string &tname,
     }
 
     bool is_last_chunk;
+    Xapian::termcount max_wdf_in_chunk;
+    bool is_packed_chunk;
     Xapian::docid last_did_in_chunk;
-    last_did_in_chunk = read_start_of_chunk(&pos, end, first_did_in_chunk, &is_last_chunk);
+    last_did_in_chunk = read_start_of_chunk(&pos, end, first_did_in_chunk,
+					    &is_last_chunk, &max_wdf_in_chunk,
+					    &is_packed_chunk);
+    bool packed = has_packed_postlists();
     *to = new PostlistChunkWriter(cursor->current_key, is_first_chunk, tname,
-				  is_last_chunk);
-    if (did > last_did_in_chunk) {
+				  is_last_chunk, packed);
+    if (did > last_did_in_chunk && !packed && !is_packed_chunk) {
 	// This is the shortcut.  Not very pretty, but I'll leave refactoring
 	// until I've a clearer picture of everything which needs to be done.
 	// (FIXME)
+	//
+	// Packed chunks can't be appended to like this, so they're always
+	// decoded and written again.
 	*from = NULL;
 	(*to)->raw_append(first_did_in_chunk, last_did_in_chunk,
-			  string(pos, end));
+			  max_wdf_in_chunk, string(pos, end));
     } else {
-	*from = new PostlistChunkReader(first_did_in_chunk, string(pos, end));
+	*from = new PostlistChunkReader(first_did_in_chunk, is_packed_chunk,
+					string(pos, end));
     }
     if (is_last_chunk) RETURN(Xapian::docid(-1));
 
@@ -1110,12 +1433,14 @@ GlassPostListTable::merge_doclen_changes(const map<Xapian::docid, Xapian::termco
     LOGVALUE(DB, doclens.size());
     if (doclens.empty()) return;
 
+    (void)use_packed_chunks();
+
     // Ensure there's a first chunk.
     string current_key = make_key(string());
     if (!key_exists(current_key)) {
 	LOGLINE(DB, "Adding dummy first chunk");
 	string newtag = make_start_of_first_chunk(0, 0, 0);
-	newtag += make_start_of_chunk(true, 0, 0);
+	newtag += make_start_of_chunk(true, 0, 0, 0, false);
 	add(current_key, newtag);
     }
 
@@ -1171,6 +1496,7 @@ void
 GlassPostListTable::merge_changes(const string &term,
 				  const Inverter::PostingChanges & changes)
 {
+    (void)use_packed_chunks();
     {
 	// Rewrite the first chunk of this posting list with the updated
 	// termfreq and collfreq.
@@ -1185,20 +1511,33 @@ GlassPostListTable::merge_changes(const string &term,
 	Xapian::termcount collfreq;
 	Xapian::docid firstdid, lastdid;
 	bool islast;
+	Xapian::termcount maxwdf;
+	bool ispacked;
 	if (pos == end) {
 	    termfreq = 0;
 	    collfreq = 0;
 	    firstdid = 0;
 	    lastdid = 0;
 	    islast = true;
+	    maxwdf = 0;
+	    // The new chunk has no entries yet, and the writer decides its
+	    // format when it adds them.
+	    ispacked = false;
 	} else {
 	    firstdid = read_start_of_first_chunk(&pos, end,
 						 &termfreq, &collfreq);
 	    // Handle the generic start of chunk header.
-	    lastdid = read_start_of_chunk(&pos, end, firstdid, &islast);
+	    lastdid = read_start_of_chunk(&pos, end, firstdid, &islast,
+					  &maxwdf, &ispacked);
 	}
 
 	termfreq += changes.get_tfdelta();
+	if (want_termdict || has_termdict()) {
+	    pair<Xapian::doccount, Xapian::termcount> & entry =
+		termdict_changes[term];
+	    entry.first = termfreq;
+	    entry.second = collfreq + changes.get_cfdelta();
+	}
 	if (termfreq == 0) {
 	    // All postings deleted!  So we can shortcut by zapping the
 	    // posting list.
@@ -1222,7 +1561,8 @@ GlassPostListTable::merge_changes(const string &term,
 
 	// Rewrite start of first chunk to update termfreq and collfreq.
 	string newhdr = make_start_of_first_chunk(termfreq, collfreq, firstdid);
-	newhdr += make_start_of_chunk(islast, firstdid, lastdid);
+	newhdr += make_start_of_chunk(islast, firstdid, lastdid, maxwdf,
+				      ispacked);
 	if (pos == end) {
 	    add(current_key, newhdr);
 	} else {
@@ -1231,7 +1571,8 @@ GlassPostListTable::merge_changes(const string &term,
 	    add(current_key, tag);
 	}
     }
-    map<Xapian::docid, Xapian::termcount>::const_iterator j;
+    Assert(changes.sorted);
+    vector<pair<Xapian::docid, Xapian::termcount>>::const_iterator j;
     j = changes.pl_changes.begin();
     Assert(j != changes.pl_changes.end()); // This case is caught above.
 
@@ -1280,6 +1621,211 @@ next_chunk:
     delete to;
 }
 
+bool
+GlassPostListTable::has_packed_postlists() const
+{
+    if (packed_present < 0)
+	packed_present = key_exists(Glass::make_packed_postlists_key());
+    return packed_present;
+}
+
+bool
+GlassPostListTable::use_packed_chunks()
+{
+    if (want_packed && !has_packed_postlists()) {
+	Glass::add_packed_postlists_marker(this);
+	packed_present = 1;
+    }
+    return has_packed_postlists();
+}
+
+bool
+GlassPostListTable::has_termdict() const
+{
+    if (termdict_present < 0)
+	termdict_present = key_exists(make_termdict_key());
+    return termdict_present;
+}
+
+void
+GlassPostListTable::build_termdict()
+{
+    LOGCALL_VOID(DB, "GlassPostListTable::build_termdict", NO_ARGS);
+    TermDictWriter writer(this);
+    AutoPtr<GlassCursor> cursor(cursor_get());
+    (void)cursor->find_entry_ge(string("\x00\xff", 2));
+    string term;
+    while (!cursor->after_end()) {
+	const char * p = cursor->current_key.data();
+	const char * pend = p + cursor->current_key.size();
+	if (!unpack_string_preserving_sort(&p, pend, term)) {
+	    throw Xapian::DatabaseCorruptError("PostList table key has unexpected format");
+	}
+	if (p == pend) {
+	    // The first chunk of a posting list.
+	    cursor->read_tag();
+	    p = cursor->current_tag.data();
+	    pend = p + cursor->current_tag.size();
+	    Xapian::doccount termfreq;
+	    Xapian::termcount collfreq;
+	    GlassPostList::read_number_of_entries(&p, pend,
+						  &termfreq, &collfreq);
+	    writer.append(term, termfreq, collfreq);
+	}
+	cursor->next();
+    }
+    writer.flush();
+    Glass::add_termdict_marker(this);
+    termdict_present = 1;
+}
+
+bool
+GlassPostListTable::has_completions() const
+{
+    if (completions_present < 0)
+	completions_present = key_exists(Glass::make_completions_key());
+    return completions_present;
+}
+
+void
+GlassPostListTable::build_completions()
+{
+    LOGCALL_VOID(DB, "GlassPostListTable::build_completions", NO_ARGS);
+    CompletionsBuilder builder(this, 1, Glass::COMPLETIONS_MAX_PREFIX_LEN);
+    TermDictCursor cursor(this);
+    while (cursor.next()) {
+	builder.add(cursor.reader.term, cursor.reader.termfreq);
+    }
+    builder.flush();
+    Glass::add_completions_marker(this);
+    completions_present = 1;
+}
+
+void
+GlassPostListTable::merge_completions_changes()
+{
+    LOGCALL_VOID(DB, "GlassPostListTable::merge_completions_changes", NO_ARGS);
+    // Update the list for each prefix of each changed term.  Usually we can
+    // do this from the list alone, but if a term in a list becomes less
+    // frequent than a term which isn't, we need to rebuild that list from the
+    // term dictionary.
+    map<string, CompletionList> lists;
+    set<string> rebuild;
+    map<string, pair<Xapian::doccount, Xapian::termcount> >::const_iterator i;
+    for (i = termdict_changes.begin(); i != termdict_changes.end(); ++i) {
+	const string & term = i->first;
+	size_t max_len = min(term.size(), Glass::COMPLETIONS_MAX_PREFIX_LEN);
+	for (size_t len = 1; len <= max_len; ++len) {
+	    string prefix(term, 0, len);
+	    if (rebuild.find(prefix) != rebuild.end()) continue;
+	    map<string, CompletionList>::iterator j = lists.find(prefix);
+	    if (j == lists.end()) {
+		j = lists.insert(make_pair(prefix, CompletionList())).first;
+		string tag;
+		if (get_exact_entry(Glass::make_completions_key(prefix), tag))
+		    j->second.unserialise(tag);
+	    }
+	    if (!j->second.update(term, i->second.first)) {
+		lists.erase(j);
+		rebuild.insert(prefix);
+	    }
+	}
+    }
+
+    map<string, CompletionList>::const_iterator j;
+    for (j = lists.begin(); j != lists.end(); ++j) {
+	string key = Glass::make_completions_key(j->first);
+	if (j->second.entries.empty()) {
+	    del(key);
+	} else {
+	    add(key, j->second.serialise());
+	}
+    }
+
+    set<string>::const_iterator k;
+    for (k = rebuild.begin(); k != rebuild.end(); ++k) {
+	const string & prefix = *k;
+	del(Glass::make_completions_key(prefix));
+	CompletionsBuilder builder(this, prefix.size(), prefix.size());
+	TermDictCursor cursor(this, prefix);
+	while (cursor.next()) {
+	    const string & term = cursor.reader.term;
+	    if (term < prefix) continue;
+	    if (!startswith(term, prefix)) break;
+	    builder.add(term, cursor.reader.termfreq);
+	}
+	builder.flush();
+    }
+}
+
+void
+GlassPostListTable::merge_termdict_changes()
+{
+    LOGCALL_VOID(DB, "GlassPostListTable::merge_termdict_changes", NO_ARGS);
+    if (want_termdict && !has_termdict()) {
+	// The dictionary is built from the merged posting lists, so already
+	// reflects any pending changes.
+	build_termdict();
+	termdict_changes.clear();
+    }
+    if (want_completions && !has_completions()) {
+	termdict_changes.clear();
+	build_completions();
+	return;
+    }
+    if (termdict_changes.empty()) return;
+
+    AutoPtr<GlassCursor> cursor(cursor_get());
+    string block;
+    auto i = termdict_changes.begin();
+    while (i != termdict_changes.end()) {
+	// Find the block which the next changed term belongs in.  If it's
+	// before the first block, the cursor will be on the marker key.
+	(void)cursor->find_entry(make_termdict_key(i->first));
+	string old_key;
+	block.resize(0);
+	if (cursor->current_key.size() > 2) {
+	    old_key = cursor->current_key;
+	    cursor->read_tag();
+	    swap(block, cursor->current_tag);
+	}
+	// Changes for terms from the start of the next block onwards are
+	// handled in a later iteration.
+	string limit;
+	bool have_limit = false;
+	if (cursor->next() && is_termdict_key(cursor->current_key)) {
+	    limit.assign(cursor->current_key, 2, string::npos);
+	    have_limit = true;
+	}
+	if (!old_key.empty()) del(old_key);
+
+	// Merge the changes into the block, which may split it into several.
+	TermDictWriter writer(this);
+	TermDictBlockReader reader;
+	reader.init(block);
+	bool more = reader.next();
+	while (true) {
+	    bool have_change = (i != termdict_changes.end() &&
+				(!have_limit || i->first < limit));
+	    if (have_change && (!more || i->first <= reader.term)) {
+		if (more && i->first == reader.term) more = reader.next();
+		if (i->second.first) {
+		    writer.append(i->first, i->second.first, i->second.second);
+		}
+		++i;
+	    } else if (more) {
+		writer.append(reader.term, reader.termfreq, reader.collfreq);
+		more = reader.next();
+	    } else {
+		break;
+	    }
+	}
+	writer.flush();
+    }
+    if (has_completions()) merge_completions_changes();
+    termdict_changes.clear();
+}
+
 void
 GlassPostListTable::get_used_docid_range(Xapian::docid & first,
 					 Xapian::docid & last) const
@@ -1328,5 +1874,6 @@ GlassPostListTable::get_used_docid_range(Xapian::docid & first,
     }
 
     bool dummy;
-    last = read_start_of_chunk(&p, e, start_of_last_chunk, &dummy);
+    last = read_start_of_chunk(&p, e, start_of_last_chunk, &dummy, NULL,
+			       &dummy);
 }
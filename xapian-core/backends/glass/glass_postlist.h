@@ -5,6 +5,7 @@
  * Copyright 2002 Ananova Ltd
  * Copyright 2002,2003,2004,2005,2007,2008,2009,2011,2013,2014,2015 Olly Betts
  * Copyright 2007,2009 Lemur Consulting Ltd
+ * Copyright 2026 The Xapian contributors
  *
  * This program is free software; you can redistribute it and/or
  * modify it under the terms of the GNU General Public License as
@@ -29,6 +30,7 @@
 
 #include "glass_defs.h"
 #include "glass_inverter.h"
+#include "glass_packedchunk.h"
 #include "glass_positionlist.h"
 #include "api/leafpostlist.h"
 #include "omassert.h"
@@ -36,6 +38,7 @@
 #include "autoptr.h"
 #include <map>
 #include <string>
+#include <utility>
 
 using namespace std;
 
@@ -46,6 +49,21 @@ namespace Glass {
     class PostlistChunkReader;
     class PostlistChunkWriter;
     class RootInfo;
+
+    /** Convert a posting list chunk to the packed format.
+     *
+     *  The chunk is left unchanged if it's already packed or can't be
+     *  packed.
+     *
+     *  @param chunk	    The chunk, starting with its flags (i.e. without
+     *			    the extra header of the first chunk of a posting
+     *			    list).
+     *  @param first_did    The first docid in the chunk.
+     */
+    void pack_postlist_chunk(std::string & chunk, Xapian::docid first_did);
+
+    /// Add the key which marks that @a table should have packed chunks.
+    void add_packed_postlists_marker(GlassTable * table);
 }
 
 using Glass::RootInfo;
@@ -56,6 +74,57 @@ class GlassPostListTable : public GlassTable {
 	/// PostList for looking up document lengths.
 	mutable AutoPtr<GlassPostList> doclen_pl;
 
+	/** Changed term dictionary entries not yet written.
+	 *
+	 *  Maps each term to its new termfreq and collfreq (termfreq 0 if
+	 *  the term has been removed).
+	 */
+	std::map<std::string,
+		 std::pair<Xapian::doccount, Xapian::termcount> > termdict_changes;
+
+	/// Should we build the term dictionary if it isn't present?
+	bool want_termdict;
+
+	/** Cached result of has_termdict().
+	 *
+	 *  -1 means not yet checked.
+	 */
+	mutable int termdict_present;
+
+	/// Should we build the completions if they aren't present?
+	bool want_completions;
+
+	/** Cached result of has_completions().
+	 *
+	 *  -1 means not yet checked.
+	 */
+	mutable int completions_present;
+
+	/// Should we write packed chunks if the table isn't marked for them?
+	bool want_packed;
+
+	/** Cached result of has_packed_postlists().
+	 *
+	 *  -1 means not yet checked.
+	 */
+	mutable int packed_present;
+
+	/** Return true if changed chunks should be written packed.
+	 *
+	 *  If packed chunks are wanted but the table isn't marked for them
+	 *  yet, this adds the marker.
+	 */
+	bool use_packed_chunks();
+
+	/// Build the term dictionary from the posting lists.
+	void build_termdict();
+
+	/// Build the completions from the term dictionary.
+	void build_completions();
+
+	/// Update the completions for the pending term dictionary changes.
+	void merge_completions_changes();
+
     public:
 	/** Create a new table object.
 	 *
@@ -68,23 +137,71 @@ class GlassPostListTable : public GlassTable {
 	 *  @param path_          - Path at which the table is stored.
 	 *  @param readonly_      - whether to open the table for read only
 	 *                          access.
+	 *  @param want_termdict_ - true to build the term dictionary if the
+	 *                          table doesn't have one.
+	 *  @param want_completions_ - true to build the completions if the
+	 *                          table doesn't have them (this requires
+	 *                          want_termdict_ to be true too).
+	 *  @param want_packed_   - true to write changed chunks in the packed
+	 *                          format if the table isn't already marked
+	 *                          to have them.
 	 */
-	GlassPostListTable(const string & path_, bool readonly_)
+	GlassPostListTable(const string & path_, bool readonly_,
+			   bool want_termdict_ = false,
+			   bool want_completions_ = false,
+			   bool want_packed_ = false)
 	    : GlassTable("postlist", path_ + "/postlist.", readonly_),
-	      doclen_pl()
+	      doclen_pl(), want_termdict(want_termdict_), termdict_present(-1),
+	      want_completions(want_completions_), completions_present(-1),
+	      want_packed(want_packed_), packed_present(-1)
 	{ }
 
 	GlassPostListTable(int fd, off_t offset_, bool readonly_)
 	    : GlassTable("postlist", fd, offset_, readonly_),
-	      doclen_pl()
+	      doclen_pl(), want_termdict(false), termdict_present(-1),
+	      want_completions(false), completions_present(-1),
+	      want_packed(false), packed_present(-1)
 	{ }
 
 	void open(int flags_, const RootInfo & root_info,
-		  glass_revision_number_t rev) {
+		  glass_revision_number_t rev, const char * uuid = NULL) {
 	    doclen_pl.reset(0);
-	    GlassTable::open(flags_, root_info, rev);
+	    termdict_present = -1;
+	    completions_present = -1;
+	    packed_present = -1;
+	    GlassTable::open(flags_, root_info, rev, uuid);
 	}
 
+	void cancel(const RootInfo & root_info, glass_revision_number_t rev) {
+	    termdict_changes.clear();
+	    termdict_present = -1;
+	    completions_present = -1;
+	    packed_present = -1;
+	    GlassTable::cancel(root_info, rev);
+	}
+
+	bool is_modified() const {
+	    return GlassTable::is_modified() || !termdict_changes.empty() ||
+		   (want_termdict && !empty() && !has_termdict()) ||
+		   (want_completions && !empty() && !has_completions());
+	}
+
+	/// Does this table contain a term dictionary?
+	bool has_termdict() const;
+
+	/// Does this table contain completions?
+	bool has_completions() const;
+
+	/// Is this table marked to have its chunks written packed?
+	bool has_packed_postlists() const;
+
+	/** Write pending changes to the term dictionary and completions.
+	 *
+	 *  If the term dictionary or completions are wanted but not present,
+	 *  they are built.
+	 */
+	void merge_termdict_changes();
+
 	/// Merge changes for a term.
 	void merge_changes(const string &term, const Inverter::PostingChanges & changes);
 
@@ -155,6 +272,18 @@ class GlassPostList : public LeafPostList {
 	/// Whether we've run off the end of the list yet.
 	bool is_at_end;
 
+	/// True if the current chunk is in the packed format.
+	bool is_packed_chunk;
+
+	/// The number of entries in the current packed chunk not yet decoded.
+	Xapian::doccount packed_entries_left;
+
+	/** The base docid for the next block of the current packed chunk.
+	 *
+	 *  This is the last docid in the previous block.
+	 */
+	Xapian::docid packed_base;
+
 	/// Cursor pointing to current chunk of postlist.
 	AutoPtr<GlassCursor> cursor;
 
@@ -164,6 +293,16 @@ class GlassPostList : public LeafPostList {
 	/// The last document id in this chunk.
 	Xapian::docid last_did_in_chunk;
 
+	/// The highest wdf of any document in this chunk.
+	Xapian::termcount max_wdf_in_chunk;
+
+	/** Upper bound on the weight of any document in this chunk.
+	 *
+	 *  This is calculated lazily from max_wdf_in_chunk - a negative value
+	 *  means it hasn't been calculated for the current chunk yet.
+	 */
+	double chunk_max_weight;
+
 	/// Position of iteration through current chunk.
 	const char * pos;
 
@@ -176,6 +315,30 @@ class GlassPostList : public LeafPostList {
 	/// The wdf of the current document.
 	Xapian::termcount wdf;
 
+	/** How many entries to decode from a chunk at once.
+	 *
+	 *  For a packed chunk, this is a block.
+	 */
+	enum { DECODE_BATCH_SIZE = Glass::PACKED_BLOCK_SIZE };
+
+	/** Document ids of entries decoded ahead of the current position.
+	 *
+	 *  Entries after the current one are decoded from the chunk in
+	 *  batches, which is cheaper than decoding them one at a time and
+	 *  means skip_to() can scan forward through plain arrays.  pos points
+	 *  after the last decoded entry.
+	 */
+	Xapian::docid decoded_did[DECODE_BATCH_SIZE];
+
+	/// The wdfs corresponding to decoded_did.
+	Xapian::termcount decoded_wdf[DECODE_BATCH_SIZE];
+
+	/// Index of the next unused entry in decoded_did and decoded_wdf.
+	unsigned decoded_pos;
+
+	/// Number of entries in decoded_did and decoded_wdf.
+	unsigned decoded_end;
+
 	/// The number of entries in the posting list.
 	Xapian::doccount number_of_entries;
 
@@ -190,6 +353,23 @@ class GlassPostList : public LeafPostList {
 	 */
 	bool next_in_chunk();
 
+	/** Decode the next batch of entries from the current chunk.
+	 *
+	 *  @param desired_did	In a packed chunk, blocks which only contain
+	 *			entries before this are skipped without being
+	 *			decoded (unless there are no more blocks).
+	 *
+	 *  @return false if there are no more entries in the chunk.
+	 */
+	bool decode_batch(Xapian::docid desired_did = 0);
+
+	/** Read the first entry of the current chunk.
+	 *
+	 *  This is called once the chunk header has been read, with did set
+	 *  to the first docid in the chunk.
+	 */
+	void start_chunk();
+
 	/** Move to the next chunk.
 	 *
 	 *  If there are no more chunks in this postlist, this will set
@@ -230,6 +410,14 @@ class GlassPostList : public LeafPostList {
 	 */
 	bool move_forward_in_chunk_to_at_least(Xapian::docid desired_did);
 
+	/** Skip any chunks which can't contain a document weighing w_min.
+	 *
+	 *  If the upper bound on the weight of the current chunk is less
+	 *  than @a w_min, move to the start of the next chunk whose upper
+	 *  bound is at least @a w_min (or to the end of the list).
+	 */
+	void skip_low_weight_chunks(double w_min);
+
 	GlassPostList(Xapian::Internal::intrusive_ptr<const GlassDatabase> this_db_,
 		      const string & term,
 		      GlassCursor * cursor_);
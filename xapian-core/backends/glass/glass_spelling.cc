@@ -2,6 +2,7 @@
  * @brief Spelling correction data for a glass database.
  */
 /* Copyright (C) 2004,2005,2006,2007,2008,2009,2010,2011,2015 Olly Betts
+ * Copyright (C) 2026 The Xapian contributors
  *
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -24,14 +25,19 @@
 #include <xapian/types.h>
 
 #include "expand/expandweight.h"
+#include "glass_cursor.h"
 #include "glass_spelling.h"
+#include "autoptr.h"
 #include "omassert.h"
 #include "expand/ortermlist.h"
 #include "pack.h"
+#include "str.h"
+#include "stringutils.h"
 
 #include "../prefix_compressed_strings.h"
 
 #include <algorithm>
+#include <cstdlib>
 #include <map>
 #include <queue>
 #include <vector>
@@ -41,58 +47,151 @@
 using namespace Glass;
 using namespace std;
 
-void
-GlassSpellingTable::merge_changes()
+/// The maximum number of deletions the deletion index is built for.
+const unsigned INDEX_MAX_DELETES = 2;
+
+/** Add the strings made by deleting characters from a word.
+ *
+ *  Between 1 and @a max_deletes characters (which may be multi-byte UTF-8
+ *  sequences) are deleted.  Empty strings aren't added.
+ */
+static void
+add_delete_variants(const string & word, unsigned max_deletes,
+		    set<string> & result)
 {
-    map<fragment, set<string> >::const_iterator i;
-    for (i = termlist_deltas.begin(); i != termlist_deltas.end(); ++i) {
-	string key = i->first;
-	const set<string> & changes = i->second;
-
-	set<string>::const_iterator d = changes.begin();
-	if (d == changes.end()) continue;
-
-	string updated;
-	string current;
-	PrefixCompressedStringWriter out(updated);
-	if (get_exact_entry(key, current)) {
-	    PrefixCompressedStringItor in(current);
-	    updated.reserve(current.size()); // FIXME plus some?
-	    while (!in.at_end() && d != changes.end()) {
-		const string & word = *in;
-		Assert(d != changes.end());
-		int cmp = word.compare(*d);
-		if (cmp < 0) {
-		    out.append(word);
-		    ++in;
-		} else if (cmp > 0) {
-		    out.append(*d);
-		    ++d;
-		} else {
-		    // If an existing entry is in the changes list, that means
-		    // we should remove it.
-		    ++in;
-		    ++d;
+    set<string> current;
+    current.insert(word);
+    for (unsigned n = 0; n != max_deletes; ++n) {
+	set<string> shorter;
+	for (const string & w : current) {
+	    size_t i = 0;
+	    while (i != w.size()) {
+		size_t j = i + 1;
+		// Skip UTF-8 continuation bytes.
+		while (j != w.size() &&
+		       (static_cast<unsigned char>(w[j]) & 0xc0) == 0x80) {
+		    ++j;
 		}
-	    }
-	    if (!in.at_end()) {
-		// FIXME : easy to optimise this to a fix-up and substring copy.
-		while (!in.at_end()) {
-		    out.append(*in++);
+		if (j - i != w.size()) {
+		    string variant(w, 0, i);
+		    variant.append(w, j, string::npos);
+		    shorter.insert(variant);
 		}
+		i = j;
 	    }
 	}
-	while (d != changes.end()) {
-	    out.append(*d++);
+	result.insert(shorter.begin(), shorter.end());
+	swap(current, shorter);
+    }
+}
+
+void
+GlassSpellingTable::merge_word_list(const string & key,
+				    const set<string> & changes)
+{
+    set<string>::const_iterator d = changes.begin();
+    if (d == changes.end()) return;
+
+    string updated;
+    string current;
+    PrefixCompressedStringWriter out(updated);
+    if (get_exact_entry(key, current)) {
+	PrefixCompressedStringItor in(current);
+	updated.reserve(current.size()); // FIXME plus some?
+	while (!in.at_end() && d != changes.end()) {
+	    const string & word = *in;
+	    Assert(d != changes.end());
+	    int cmp = word.compare(*d);
+	    if (cmp < 0) {
+		out.append(word);
+		++in;
+	    } else if (cmp > 0) {
+		out.append(*d);
+		++d;
+	    } else {
+		// If an existing entry is in the changes list, that means
+		// we should remove it.
+		++in;
+		++d;
+	    }
 	}
-	if (!updated.empty()) {
-	    add(key, updated);
-	} else {
-	    del(key);
+	if (!in.at_end()) {
+	    // FIXME : easy to optimise this to a fix-up and substring copy.
+	    while (!in.at_end()) {
+		out.append(*in++);
+	    }
 	}
     }
+    while (d != changes.end()) {
+	out.append(*d++);
+    }
+    if (!updated.empty()) {
+	add(key, updated);
+    } else {
+	del(key);
+    }
+}
+
+unsigned
+GlassSpellingTable::get_index_max_deletes() const
+{
+    if (has_index >= 0)
+	return unsigned(has_index);
+    // The key "D" holds a list with the maximum number of deletions as its
+    // only entry (a list so that merge_spellings() can merge it).
+    unsigned max_deletes = 0;
+    string data;
+    if (get_exact_entry("D", data)) {
+	PrefixCompressedStringItor it(data);
+	if (!it.at_end())
+	    max_deletes = unsigned(atoi((*it).c_str()));
+    }
+    if (is_writable())
+	has_index = int(max_deletes);
+    return max_deletes;
+}
+
+void
+GlassSpellingTable::build_index()
+{
+    // The deltas work like an exclusive-or with what's on disk, so the
+    // entries for words which are being added or removed in this batch
+    // (which we've already toggled) come out correctly.
+    AutoPtr<GlassCursor> cursor(cursor_get());
+    if (cursor.get()) {
+	cursor->find_entry_ge("W");
+	while (!cursor->after_end() && startswith(cursor->current_key, 'W')) {
+	    toggle_deletes(cursor->current_key.substr(1));
+	    cursor->next();
+	}
+    }
+    string data;
+    PrefixCompressedStringWriter wr(data);
+    wr.append(str(INDEX_MAX_DELETES));
+    add("D", data);
+    has_index = int(INDEX_MAX_DELETES);
+}
+
+void
+GlassSpellingTable::merge_changes()
+{
+    if (want_index && get_index_max_deletes() == 0 &&
+	(!empty() || !wordfreq_changes.empty())) {
+	build_index();
+    }
+
+    map<fragment, set<string> >::const_iterator i;
+    for (i = termlist_deltas.begin(); i != termlist_deltas.end(); ++i) {
+	merge_word_list(i->first, i->second);
+    }
     termlist_deltas.clear();
 
+    map<string, set<string> >::const_iterator k;
+    for (k = delete_deltas.begin(); k != delete_deltas.end(); ++k) {
+	merge_word_list(k->first, k->second);
+    }
+    delete_deltas.clear();
+
     map<string, Xapian::termcount>::const_iterator j;
     for (j = wordfreq_changes.begin(); j != wordfreq_changes.end(); ++j) {
 	string key = "W" + j->first;
@@ -205,9 +304,27 @@ GlassSpellingTable::remove_word(const string & word, Xapian::termcount freqdec)
     toggle_word(word);
 }
 
+void
+GlassSpellingTable::toggle_deletes(const string & word)
+{
+    set<string> variants;
+    add_delete_variants(word, INDEX_MAX_DELETES, variants);
+    for (const string & variant : variants) {
+	set<string> & changes = delete_deltas["D" + variant];
+	pair<set<string>::iterator, bool> res = changes.insert(word);
+	if (!res.second) {
+	    // word is already in the set, so remove it.
+	    changes.erase(res.first);
+	}
+    }
+}
+
 void
 GlassSpellingTable::toggle_word(const string & word)
 {
+    if (want_index || get_index_max_deletes())
+	toggle_deletes(word);
+
     fragment buf;
     // Head:
     buf[0] = 'H';
@@ -396,6 +513,45 @@ GlassSpellingTable::get_word_frequency(const string & word) const
     return 0;
 }
 
+TermList *
+GlassSpellingTable::open_candidates(const string & word,
+				    unsigned max_edit_distance)
+{
+    // Merge any pending changes to disk, but don't call commit() so they
+    // won't be switched live.
+    if (!wordfreq_changes.empty()) merge_changes();
+
+    unsigned max_deletes = get_index_max_deletes();
+    if (max_deletes == 0 || max_edit_distance > max_deletes)
+	return NULL;
+
+    // A word is within max_edit_distance edits of word only if deleting at
+    // most max_edit_distance characters from each gives the same string.
+    // So look up each such deletion from word both as a word and in the
+    // deletion index.
+    set<string> variants;
+    add_delete_variants(word, max_edit_distance, variants);
+    variants.insert(word);
+    set<string> candidates;
+    string data;
+    for (const string & variant : variants) {
+	if (key_exists("W" + variant))
+	    candidates.insert(variant);
+	if (get_exact_entry("D" + variant, data)) {
+	    for (PrefixCompressedStringItor it(data); !it.at_end(); ++it) {
+		candidates.insert(*it);
+	    }
+	}
+    }
+
+    string encoded;
+    PrefixCompressedStringWriter wr(encoded);
+    for (const string & candidate : candidates) {
+	wr.append(candidate);
+    }
+    return new GlassSpellingTermList(encoded);
+}
+
 ///////////////////////////////////////////////////////////////////////////
 
 Xapian::termcount
@@ -64,6 +64,22 @@ class GlassSpellingTable : public GlassLazyTable {
     void toggle_word(const std::string & word);
     void toggle_fragment(Glass::fragment frag, const std::string & word);
 
+    /// Toggle the entries for @a word in the deletion index.
+    void toggle_deletes(const std::string & word);
+
+    /// Apply a set of changes to the word list stored under @a key.
+    void merge_word_list(const std::string & key,
+			 const std::set<std::string> & changes);
+
+    /// Add entries for all the existing words to the deletion index.
+    void build_index();
+
+    /** The maximum number of deletions the deletion index is built for.
+     *
+     *  Returns 0 if there's no deletion index.
+     */
+    unsigned get_index_max_deletes() const;
+
     std::map<std::string, Xapian::termcount> wordfreq_changes;
 
     /** Changes to make to the termlists.
@@ -76,6 +92,21 @@ class GlassSpellingTable : public GlassLazyTable {
      */
     std::map<Glass::fragment, std::set<std::string> > termlist_deltas;
 
+    /** Changes to make to the word lists in the deletion index.
+     *
+     *  These work in the same way as termlist_deltas.
+     */
+    std::map<std::string, std::set<std::string> > delete_deltas;
+
+    /// Build the deletion index if it doesn't exist (DB_SPELLING_INDEX).
+    bool want_index;
+
+    /** Cached result of get_index_max_deletes().
+     *
+     *  -1 means not yet checked.  Only cached for a writable table.
+     */
+    mutable int has_index = -1;
+
     /** Used to track an upper bound on wordfreq. */
     Xapian::termcount wordfreq_upper_bound = 0;
 
@@ -87,12 +118,17 @@ class GlassSpellingTable : public GlassLazyTable {
      *
      *  @param dbdir		The directory the glass database is stored in.
      *  @param readonly		true if we're opening read-only, else false.
+     *  @param want_index_	true to build the deletion index if the table
+     *				doesn't already have it.
      */
-    GlassSpellingTable(const std::string & dbdir, bool readonly)
-	: GlassLazyTable("spelling", dbdir + "/spelling.", readonly) { }
+    GlassSpellingTable(const std::string & dbdir, bool readonly,
+		       bool want_index_ = false)
+	: GlassLazyTable("spelling", dbdir + "/spelling.", readonly),
+	  want_index(want_index_) { }
 
     GlassSpellingTable(int fd, off_t offset_, bool readonly)
-	: GlassLazyTable("spelling", fd, offset_, readonly) { }
+	: GlassLazyTable("spelling", fd, offset_, readonly),
+	  want_index(false) { }
 
     /** Merge in batched-up changes.
      *
@@ -105,6 +141,17 @@ class GlassSpellingTable : public GlassLazyTable {
 
     TermList * open_termlist(const std::string & word);
 
+    /** Open a list of candidate corrections for @a word.
+     *
+     *  These are found using the deletion index, and include all the words
+     *  within @a max_edit_distance edits of @a word.
+     *
+     *  Returns NULL if there's no deletion index, or it doesn't support
+     *  @a max_edit_distance.
+     */
+    TermList * open_candidates(const std::string & word,
+			       unsigned max_edit_distance);
+
     Xapian::doccount get_word_frequency(const std::string & word) const;
 
     void set_wordfreq_upper_bound(Xapian::termcount ub) {
@@ -119,7 +166,8 @@ class GlassSpellingTable : public GlassLazyTable {
      */
 
     bool is_modified() const {
-	return !wordfreq_changes.empty() || GlassTable::is_modified();
+	return !wordfreq_changes.empty() || GlassTable::is_modified() ||
+	       (want_index && !empty() && get_index_max_deletes() == 0);
     }
 
     /** Returns updated wordfreq upper bound. */
@@ -133,6 +181,8 @@ class GlassSpellingTable : public GlassLazyTable {
 	// Discard batched-up changes.
 	wordfreq_changes.clear();
 	termlist_deltas.clear();
+	delete_deltas.clear();
+	has_index = -1;
 
 	GlassTable::cancel(root_info, rev);
     }
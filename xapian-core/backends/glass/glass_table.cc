@@ -166,6 +166,20 @@ GlassTable::read_block(uint4 n, byte * p) const
 	GlassTable::throw_database_closed();
     AssertRel(n,<,free_list.get_first_unused_block());
 
+    GlassBlockCache * cache = NULL;
+    if (use_block_cache) {
+	Assert(!writable);
+	cache = &GlassBlockCache::get_instance();
+	if (!cache->enabled()) {
+	    cache = NULL;
+	} else if (cache->lookup(GlassBlockCache::Key(block_cache_file,
+						      revision_number, n),
+				 p, block_size)) {
+	    // Blocks are checked before being added to the cache.
+	    return;
+	}
+    }
+
     io_read_block(handle, reinterpret_cast<char *>(p), block_size, n, offset);
 
     if (GET_LEVEL(p) != LEVEL_FREELIST) {
@@ -176,6 +190,11 @@ GlassTable::read_block(uint4 n, byte * p) const
 	    throw Xapian::DatabaseCorruptError(msg);
 	}
     }
+
+    if (cache) {
+	cache->insert(GlassBlockCache::Key(block_cache_file, revision_number, n),
+		      p, block_size);
+    }
 }
 
 /** write_block(n, p, appending) writes block n in the DB file from address p.
@@ -1721,7 +1740,8 @@ GlassTable::GlassTable(const char * tablename_, const string & path_,
 	  comp_stream(Z_DEFAULT_STRATEGY),
 	  lazy(lazy_),
 	  last_readahead(BLK_UNUSED),
-	  offset(0)
+	  offset(0),
+	  use_block_cache(false)
 {
     LOGCALL_CTOR(DB, "GlassTable", tablename_ | path_ | readonly_ | compress_strategy | lazy_);
 }
@@ -1756,7 +1776,8 @@ GlassTable::GlassTable(const char * tablename_, int fd, off_t offset_,
 	  comp_stream(Z_DEFAULT_STRATEGY),
 	  lazy(lazy_),
 	  last_readahead(BLK_UNUSED),
-	  offset(offset_)
+	  offset(offset_),
+	  use_block_cache(false)
 {
     LOGCALL_CTOR(DB, "GlassTable", tablename_ | fd | offset_ | readonly_ | compress_strategy | lazy_);
 }
@@ -1818,6 +1839,7 @@ void GlassTable::close(bool permanent) {
 	    handle = -1;
 	}
     }
+    use_block_cache = false;
 
     if (permanent) {
 	handle = -2;
@@ -1969,7 +1991,8 @@ GlassTable::cancel(const RootInfo & root_info, glass_revision_number_t rev)
 
 void
 GlassTable::do_open_to_read(const RootInfo * root_info,
-			    glass_revision_number_t rev)
+			    glass_revision_number_t rev,
+			    const char * uuid)
 {
     LOGCALL(DB, bool, "GlassTable::do_open_to_read", root_info|rev);
     if (handle == -2) {
@@ -1993,6 +2016,10 @@ GlassTable::do_open_to_read(const RootInfo * root_info,
 	}
     }
 
+    // Identify the file so that blocks can be shared with other readers of
+    // the same revision via the GlassBlockCache.
+    use_block_cache = block_cache_file.init(handle, offset, uuid);
+
     basic_open(root_info, rev);
 
     read_root();
@@ -2000,7 +2027,7 @@ GlassTable::do_open_to_read(const RootInfo * root_info,
 
 void
 GlassTable::open(int flags_, const RootInfo & root_info,
-		 glass_revision_number_t rev)
+		 glass_revision_number_t rev, const char * uuid)
 {
     LOGCALL_VOID(DB, "GlassTable::open", flags_|root_info|rev);
     close();
@@ -2010,7 +2037,7 @@ GlassTable::open(int flags_, const RootInfo & root_info,
     root = root_info.get_root();
 
     if (!writable) {
-	do_open_to_read(&root_info, rev);
+	do_open_to_read(&root_info, rev, uuid);
 	return;
     }
 
@@ -28,6 +28,7 @@
 #include <xapian/error.h>
 
 #include "glass_freelist.h"
+#include "glass_blockcache.h"
 #include "glass_cursor.h"
 #include "glass_defs.h"
 
@@ -414,9 +415,14 @@ class GlassTable {
 	void basic_open(const RootInfo * root_info,
 			glass_revision_number_t rev);
 
-	/** Perform the opening operation to read. */
+	/** Perform the opening operation to read.
+	 *
+	 *  @param uuid	The database's UUID, used to share blocks via the
+	 *		GlassBlockCache (NULL to not use the cache).
+	 */
 	void do_open_to_read(const RootInfo * root_info,
-			     glass_revision_number_t rev);
+			     glass_revision_number_t rev,
+			     const char * uuid);
 
 	/** Perform the opening operation to write. */
 	void do_open_to_write(const RootInfo * root_info,
@@ -467,6 +473,10 @@ class GlassTable {
 	 *
 	 *  @param flags_	flags for opening
 	 *  @param root_info	root block info
+	 *  @param uuid		the database's UUID (16 bytes), which allows
+	 *			a read-only table to share blocks with other
+	 *			readers via the GlassBlockCache (default: NULL,
+	 *			which means don't use the cache)
 	 *
 	 *  @exception Xapian::DatabaseCorruptError will be thrown if the table
 	 *	is in a corrupt state.
@@ -475,7 +485,7 @@ class GlassTable {
 	 *	not present, etc).
 	 */
 	void open(int flags_, const RootInfo & root_info,
-		  glass_revision_number_t rev);
+		  glass_revision_number_t rev, const char * uuid = NULL);
 
 	/** Return true if this table is open.
 	 *
@@ -872,6 +882,12 @@ class GlassTable {
 	/// offset to start of table in file.
 	off_t offset;
 
+	/// Should blocks be looked up in and added to the GlassBlockCache?
+	bool use_block_cache;
+
+	/// Identifies this table's file for the GlassBlockCache.
+	GlassBlockCache::FileId block_cache_file;
+
 	/* Debugging methods */
 //	void report_block_full(int m, int n, const byte * p);
 };
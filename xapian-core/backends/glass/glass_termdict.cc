@@ -0,0 +1,226 @@
+/** @file glass_termdict.cc
+ * @brief Front-coded term dictionary for a glass database.
+ */
+/* Copyright (C) 2026 The Xapian contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include <config.h>
+
+#include "glass_termdict.h"
+
+#include "glass_cursor.h"
+#include "glass_table.h"
+
+#include "debuglog.h"
+#include "omassert.h"
+#include "pack.h"
+#include "stringutils.h"
+
+#include "xapian/error.h"
+
+using namespace Glass;
+using namespace std;
+
+/// Start a new block once the current one reaches this many bytes.
+const size_t TERMDICT_BLOCK_SIZE = 2048;
+
+bool
+TermDictBlockReader::next()
+{
+    if (p == end) return false;
+    size_t shared, len;
+    if (!unpack_uint(&p, end, &shared) ||
+	!unpack_uint(&p, end, &len) ||
+	shared > term.size() ||
+	len > size_t(end - p)) {
+	throw Xapian::DatabaseCorruptError("Bad term dictionary block");
+    }
+    term.resize(shared);
+    term.append(p, len);
+    p += len;
+    if (!unpack_uint(&p, end, &termfreq) ||
+	!unpack_uint(&p, end, &collfreq)) {
+	throw Xapian::DatabaseCorruptError("Bad term dictionary block");
+    }
+    return true;
+}
+
+void
+TermDictWriter::append(const string & term,
+		       Xapian::doccount termfreq, Xapian::termcount collfreq)
+{
+    Assert(block.empty() || term > last_term);
+    if (block.size() >= TERMDICT_BLOCK_SIZE) flush();
+
+    size_t shared = 0;
+    if (block.empty()) {
+	first_term = term;
+    } else {
+	size_t len = min(term.size(), last_term.size());
+	while (shared != len && term[shared] == last_term[shared]) ++shared;
+    }
+    pack_uint(block, shared);
+    pack_uint(block, term.size() - shared);
+    block.append(term, shared, string::npos);
+    pack_uint(block, termfreq);
+    pack_uint(block, collfreq);
+    last_term = term;
+}
+
+void
+TermDictWriter::flush()
+{
+    if (block.empty()) return;
+    table->add(make_termdict_key(first_term), block);
+    block.resize(0);
+}
+
+void
+Glass::add_termdict_marker(GlassTable * table)
+{
+    // The tag is a format version number.
+    string tag;
+    pack_uint(tag, 1u);
+    table->add(make_termdict_key(), tag);
+}
+
+TermDictCursor::TermDictCursor(GlassTable * in, const string & start)
+    : GlassCursor(in)
+{
+    // This finds the block which would contain start, or the marker key if
+    // start is before the first block.
+    (void)find_entry(make_termdict_key(start));
+    if (current_key.size() > 2 && is_termdict_key(current_key)) {
+	read_tag();
+	swap(block, current_tag);
+    }
+    reader.init(block);
+}
+
+bool
+TermDictCursor::next()
+{
+    while (!reader.next()) {
+	if (!GlassCursor::next() || !is_termdict_key(current_key))
+	    return false;
+	read_tag();
+	swap(block, current_tag);
+	reader.init(block);
+    }
+    return true;
+}
+
+GlassTermDictAllTermsList::~GlassTermDictAllTermsList()
+{
+    LOGCALL_DTOR(DB, "GlassTermDictAllTermsList");
+    delete cursor;
+}
+
+bool
+GlassTermDictAllTermsList::next_entry()
+{
+    while (!reader.next()) {
+	if (!cursor->next() || !is_termdict_key(cursor->current_key))
+	    return false;
+	cursor->read_tag();
+	swap(block, cursor->current_tag);
+	reader.init(block);
+    }
+    return true;
+}
+
+void
+GlassTermDictAllTermsList::position(const string & term)
+{
+    if (!cursor) {
+	cursor = database->postlist_table.cursor_get();
+	Assert(cursor); // The postlist table isn't optional.
+    }
+
+    // This finds the block which would contain term, or the marker key if
+    // term is before the first block.
+    (void)cursor->find_entry(make_termdict_key(term));
+    block.resize(0);
+    if (cursor->current_key.size() > 2) {
+	cursor->read_tag();
+	swap(block, cursor->current_tag);
+    }
+    reader.init(block);
+    while (true) {
+	if (!next_entry()) {
+	    reached_end = true;
+	    return;
+	}
+	if (reader.term >= term) break;
+    }
+    if (!startswith(reader.term, prefix)) reached_end = true;
+}
+
+string
+GlassTermDictAllTermsList::get_termname() const
+{
+    LOGCALL(DB, string, "GlassTermDictAllTermsList::get_termname", NO_ARGS);
+    Assert(!at_end());
+    RETURN(reader.term);
+}
+
+Xapian::doccount
+GlassTermDictAllTermsList::get_termfreq() const
+{
+    LOGCALL(DB, Xapian::doccount, "GlassTermDictAllTermsList::get_termfreq", NO_ARGS);
+    Assert(!at_end());
+    RETURN(reader.termfreq);
+}
+
+Xapian::termcount
+GlassTermDictAllTermsList::get_collection_freq() const
+{
+    LOGCALL(DB, Xapian::termcount, "GlassTermDictAllTermsList::get_collection_freq", NO_ARGS);
+    Assert(!at_end());
+    RETURN(reader.collfreq);
+}
+
+TermList *
+GlassTermDictAllTermsList::next()
+{
+    LOGCALL(DB, TermList *, "GlassTermDictAllTermsList::next", NO_ARGS);
+    Assert(!at_end());
+    if (rare(!cursor)) {
+	position(prefix);
+    } else if (!next_entry() || !startswith(reader.term, prefix)) {
+	reached_end = true;
+    }
+    RETURN(NULL);
+}
+
+TermList *
+GlassTermDictAllTermsList::skip_to(const string & term)
+{
+    LOGCALL(DB, TermList *, "GlassTermDictAllTermsList::skip_to", term);
+    Assert(!at_end());
+    if (cursor && reader.term >= term) RETURN(NULL);
+    position(max(term, prefix));
+    RETURN(NULL);
+}
+
+bool
+GlassTermDictAllTermsList::at_end() const
+{
+    LOGCALL(DB, bool, "GlassTermDictAllTermsList::at_end", NO_ARGS);
+    RETURN(reached_end);
+}
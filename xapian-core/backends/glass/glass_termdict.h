@@ -0,0 +1,204 @@
+/** @file glass_termdict.h
+ * @brief Front-coded term dictionary for a glass database.
+ */
+/* Copyright (C) 2026 The Xapian contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef XAPIAN_INCLUDED_GLASS_TERMDICT_H
+#define XAPIAN_INCLUDED_GLASS_TERMDICT_H
+
+#include "backends/alltermslist.h"
+#include "glass_cursor.h"
+#include "glass_database.h"
+
+#include "xapian/types.h"
+
+#include <string>
+
+class GlassTable;
+
+/* The term dictionary lives in the postlist table, in keys starting with
+ * "\0\xc8" (which sort after the user metadata and before the value
+ * statistics).  The key which is just that prefix marks that the dictionary
+ * is present.  The entries are stored in blocks of up to about
+ * TERMDICT_BLOCK_SIZE bytes, each under the prefix followed by the first
+ * term in the block.  Each entry in a block is:
+ *
+ *   pack_uint(bytes shared with the previous term in the block)
+ *   pack_uint(length of the rest of the term)
+ *   the rest of the term
+ *   pack_uint(termfreq)
+ *   pack_uint(collfreq)
+ */
+
+namespace Glass {
+
+/// Make the key for a term dictionary block starting with @a first_term.
+inline std::string
+make_termdict_key(const std::string & first_term = std::string())
+{
+    std::string key("\0\xc8", 2);
+    key += first_term;
+    return key;
+}
+
+/// Is @a key part of the term dictionary?
+inline bool
+is_termdict_key(const std::string & key)
+{
+    return key.size() > 1 && key[0] == '\0' && key[1] == '\xc8';
+}
+
+/// Decode the entries in a term dictionary block.
+class TermDictBlockReader {
+    const char * p;
+
+    const char * end;
+
+  public:
+    /// The current term.
+    std::string term;
+
+    /// The term frequency of the current term.
+    Xapian::doccount termfreq;
+
+    /// The collection frequency of the current term.
+    Xapian::termcount collfreq;
+
+    TermDictBlockReader() : p(NULL), end(NULL) { }
+
+    /** Start reading a block.
+     *
+     *  @a block must remain valid while this object reads from it.
+     */
+    void init(const std::string & block) {
+	p = block.data();
+	end = p + block.size();
+	term.resize(0);
+    }
+
+    /// Move to the next entry, returning false if there isn't one.
+    bool next();
+};
+
+/// Encode entries in ascending term order into term dictionary blocks.
+class TermDictWriter {
+    /// Don't allow assignment.
+    void operator=(const TermDictWriter &);
+
+    /// Don't allow copying.
+    TermDictWriter(const TermDictWriter &);
+
+    GlassTable * table;
+
+    std::string block;
+
+    std::string first_term;
+
+    std::string last_term;
+
+  public:
+    explicit TermDictWriter(GlassTable * table_) : table(table_) { }
+
+    void append(const std::string & term,
+		Xapian::doccount termfreq, Xapian::termcount collfreq);
+
+    /// Write any partial block to the table.
+    void flush();
+};
+
+/// Add the key which marks that @a table has a term dictionary.
+void add_termdict_marker(GlassTable * table);
+
+/// Iterate the entries in the term dictionary of a table.
+class TermDictCursor : private GlassCursor {
+    std::string block;
+
+  public:
+    TermDictBlockReader reader;
+
+    /** Construct a cursor.
+     *
+     *  The first call to next() moves to the first entry in the block which
+     *  would contain @a start, so the caller needs to skip any entries before
+     *  @a start.
+     */
+    explicit TermDictCursor(GlassTable * in,
+			    const std::string & start = std::string());
+
+    /// Move to the next entry, returning false if there isn't one.
+    bool next();
+};
+
+}
+
+/// A termlist of the terms in a glass database, read from its dictionary.
+class GlassTermDictAllTermsList : public AllTermsList {
+    /// Copying is not allowed.
+    GlassTermDictAllTermsList(const GlassTermDictAllTermsList &);
+
+    /// Assignment is not allowed.
+    void operator=(const GlassTermDictAllTermsList &);
+
+    /// Keep a reference to our database to stop it being deleted.
+    Xapian::Internal::intrusive_ptr<const GlassDatabase> database;
+
+    /// Cursor on the current dictionary block.
+    GlassCursor * cursor;
+
+    /// The current block.
+    std::string block;
+
+    /// Reader for the current block.
+    Glass::TermDictBlockReader reader;
+
+    /// The prefix to restrict the terms to.
+    std::string prefix;
+
+    /// True once we've reached the end.
+    bool reached_end;
+
+    /// Read the next entry, moving on to the next block if necessary.
+    bool next_entry();
+
+    /// Move to the first term >= @a term.
+    void position(const std::string & term);
+
+  public:
+    GlassTermDictAllTermsList(Xapian::Internal::intrusive_ptr<const GlassDatabase> database_,
+			      const std::string & prefix_)
+	: database(database_), cursor(NULL), prefix(prefix_),
+	  reached_end(false) { }
+
+    /// Destructor.
+    ~GlassTermDictAllTermsList();
+
+    std::string get_termname() const;
+
+    Xapian::doccount get_termfreq() const;
+
+    Xapian::termcount get_collection_freq() const;
+
+    TermList * next();
+
+    TermList * skip_to(const std::string & term);
+
+    bool at_end() const;
+};
+
+#endif // XAPIAN_INCLUDED_GLASS_TERMDICT_H
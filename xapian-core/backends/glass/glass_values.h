@@ -23,6 +23,7 @@
 #define XAPIAN_INCLUDED_GLASS_VALUES_H
 
 #include "pack.h"
+#include "backends/flushpolicy.h"
 #include "backends/valuestats.h"
 
 #include "xapian/error.h"
@@ -93,6 +94,9 @@ class GlassValueManager {
 
     std::map<Xapian::valueno, std::map<Xapian::docid, std::string> > changes;
 
+    /// Approximate memory used by changes.
+    size_t changes_size;
+
     mutable AutoPtr<GlassCursor> cursor;
 
     void add_value(Xapian::docid did, Xapian::valueno slot,
@@ -100,6 +104,10 @@ class GlassValueManager {
 
     void remove_value(Xapian::docid did, Xapian::valueno slot);
 
+    /// Record a change to a value, keeping changes_size up to date.
+    void set_change(Xapian::docid did, Xapian::valueno slot,
+		    const std::string & val);
+
     Xapian::docid get_chunk_containing_did(Xapian::valueno slot,
 					   Xapian::docid did,
 					   std::string &chunk) const;
@@ -115,7 +123,8 @@ class GlassValueManager {
 		      GlassTermListTable * termlist_table_)
 	: mru_slot(Xapian::BAD_VALUENO),
 	  postlist_table(postlist_table_),
-	  termlist_table(termlist_table_) { }
+	  termlist_table(termlist_table_),
+	  changes_size(0) { }
 
     // Merge in batched-up changes.
     void merge_changes();
@@ -167,10 +176,17 @@ class GlassValueManager {
 	return !changes.empty();
     }
 
+    /// Approximate memory used by batched-up changes.
+    size_t get_memory_used() const {
+	return changes_size +
+	    slots.size() * map_node_size<Xapian::docid, std::string>();
+    }
+
     void cancel() {
 	// Discard batched-up changes.
 	slots.clear();
 	changes.clear();
+	changes_size = 0;
     }
 };
 
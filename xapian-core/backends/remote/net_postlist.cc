@@ -26,8 +26,54 @@
 #include "net/length.h"
 #include "unicode/description_append.h"
 
+#include <algorithm>
+
 using namespace std;
 
+/// The number of entries to ask for in the first window.
+const Xapian::doccount INITIAL_WINDOW_SIZE = 256;
+
+/** The largest number of entries to ask for in one window.
+ *
+ *  When we're iterating with next(), we double the window size each time up to
+ *  this limit, which bounds the memory used while keeping the number of round
+ *  trips to the server low.
+ */
+const Xapian::doccount MAX_WINDOW_SIZE = 16384;
+
+NetworkPostList::NetworkPostList(
+	Xapian::Internal::intrusive_ptr<const RemoteDatabase> db_,
+	const string & term_)
+    : LeafPostList(term_),
+      db(db_), started(false), pos(NULL), pos_end(NULL), more(false),
+      window_size(INITIAL_WINDOW_SIZE),
+      lastdocid(0), lastwdf(0), termfreq(0)
+{
+    // Fetch the first window now, as we need the term frequency.
+    fetch_window(1);
+}
+
+void
+NetworkPostList::fetch_window(Xapian::docid did)
+{
+    Xapian::doccount tf;
+    more = !db->read_post_list(term, did, window_size, tf, postings);
+    if (did == 1) termfreq = tf;
+    pos = postings.data();
+    pos_end = pos + postings.size();
+    lastdocid = did - 1;
+}
+
+void
+NetworkPostList::decode_posting()
+{
+    Xapian::docid inc;
+    decode_length(&pos, pos_end, inc);
+    lastdocid += inc + 1;
+
+    decode_length(&pos, pos_end, lastwdf);
+}
+
 Xapian::doccount
 NetworkPostList::get_termfreq() const
 {
@@ -74,34 +120,42 @@ NetworkPostList::open_position_list() const
 PostList *
 NetworkPostList::next(double)
 {
-    if (!started) {
-	started = true;
-	pos = postings.data();
-	pos_end = pos + postings.size();
-	lastdocid = 0;
-    }
-
+    started = true;
     if (pos == pos_end) {
-	pos = NULL;
-    } else {
-	Xapian::docid inc;
-	decode_length(&pos, pos_end, inc);
-	lastdocid += inc + 1;
-
-	decode_length(&pos, pos_end, lastwdf);
+	if (more) {
+	    window_size = min(window_size * 2, MAX_WINDOW_SIZE);
+	    fetch_window(lastdocid + 1);
+	}
+	if (pos == pos_end) {
+	    pos = NULL;
+	    return NULL;
+	}
     }
 
+    decode_posting();
     return NULL;
 }
 
 PostList *
-NetworkPostList::skip_to(Xapian::docid did, double min_weight)
+NetworkPostList::skip_to(Xapian::docid did, double)
 {
-    if (!started)
-	next(min_weight);
-    while (pos && lastdocid < did)
-	next(min_weight);
-    return NULL;
+    if (started && (pos == NULL || lastdocid >= did))
+	return NULL;
+    started = true;
+    while (true) {
+	while (pos != pos_end) {
+	    decode_posting();
+	    if (lastdocid >= did)
+		return NULL;
+	}
+	if (!more) {
+	    pos = NULL;
+	    return NULL;
+	}
+	// Ask for the window starting at did so that the server skips the
+	// entries in between for us.
+	fetch_window(did);
+    }
 }
 
 bool
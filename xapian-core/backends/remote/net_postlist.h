@@ -32,40 +32,42 @@
 using namespace std;
 
 /** A postlist in a remote database.
+ *
+ *  The postlist is fetched from the server a window at a time as it's
+ *  iterated, so only the current window is held in memory, and skip_to()
+ *  can avoid fetching the entries it skips over.
  */
 class NetworkPostList : public LeafPostList {
-    friend class RemoteDatabase;
-
     Xapian::Internal::intrusive_ptr<const RemoteDatabase> db;
 
+    /// The encoded entries in the current window.
     string postings;
     bool started;
     const char * pos;
     const char * pos_end;
 
+    /// Are there more entries on the server after the current window?
+    bool more;
+
+    /// The number of entries to ask for in the next window.
+    Xapian::doccount window_size;
+
     Xapian::docid lastdocid;
     Xapian::termcount lastwdf;
     Xapian::Internal::intrusive_ptr<PositionList> lastposlist;
 
     Xapian::doccount termfreq;
 
-    /// Append a posting to the end of the postlist.
-    void append_posting(const string & serialised) {
-	Assert(pos == NULL);
-	Assert(!started);
-	postings.append(serialised);
-    }
+    /// Fetch the window of entries starting at the first docid >= did.
+    void fetch_window(Xapian::docid did);
+
+    /// Decode the next entry in the current window.
+    void decode_posting();
 
   public:
     /// Constructor.
     NetworkPostList(Xapian::Internal::intrusive_ptr<const RemoteDatabase> db_,
-		    const string & term_)
-	: LeafPostList(term_),
-	  db(db_), started(false), pos(NULL), pos_end(NULL),
-	  lastdocid(0), lastwdf(0), termfreq(0)
-    {
-	termfreq = db->read_post_list(term, *this);
-    }
+		    const string & term_);
 
     /// Get number of documents indexed by this term.
     Xapian::doccount get_termfreq() const;
@@ -25,6 +25,7 @@
 
 #include "safeerrno.h"
 #include <signal.h>
+#include <cstdlib>
 
 #include "autoptr.h"
 #include "api/emptypostlist.h"
@@ -43,6 +44,7 @@
 #include "stringutils.h" // For STRINGIZE().
 #include "weight/weightinternal.h"
 
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -69,12 +71,15 @@ throw_connection_closed_unexpectedly()
 
 RemoteDatabase::RemoteDatabase(int fd, double timeout_,
 			       const string & context_, bool writable,
-			       int flags)
+			       int flags, bool reused)
 	: link(fd, fd, context_),
+	  server_minor_version(0),
 	  context(context_),
 	  cached_stats_valid(),
 	  mru_valstats(),
 	  mru_slot(Xapian::BAD_VALUENO),
+	  have_cached_stats(false),
+	  unfinished_exchanges(reused ? 0 : 1),
 	  timeout(timeout_)
 {
 #ifndef __WIN32__
@@ -94,6 +99,18 @@ RemoteDatabase::RemoteDatabase(int fd, double timeout_,
 	transaction_state = TRANSACTION_UNIMPLEMENTED;
     }
 
+    if (reused) {
+	// Check the connection still works, and get the server to reopen the
+	// database and send its statistics, in a single round trip.  The reply
+	// to MSG_UPDATE then takes the place of the greeting.
+	send_message(MSG_REOPEN, string());
+	send_message(MSG_UPDATE, string());
+	string message;
+	reply_type type = get_message(message);
+	if (type != REPLY_DONE && type != REPLY_UPDATE)
+	    throw_bad_message(context);
+    }
+
     update_stats(MSG_MAX);
 
     if (writable) {
@@ -230,27 +247,49 @@ RemoteDatabase::open_post_list(const string &term) const
     return new NetworkPostList(intrusive_ptr<const RemoteDatabase>(this), term);
 }
 
-Xapian::doccount
-RemoteDatabase::read_post_list(const string &term, NetworkPostList & pl) const
+bool
+RemoteDatabase::read_post_list(const string &term,
+			       Xapian::docid did,
+			       Xapian::doccount max_items,
+			       Xapian::doccount & termfreq,
+			       string & postings) const
 {
-    send_message(MSG_POSTLIST, term);
+    if (server_minor_version < 4) {
+	// The server doesn't support MSG_POSTLISTWINDOW, so read the whole
+	// postlist, which NetworkPostList asks for first.
+	Assert(did == 1);
+	send_message(MSG_POSTLIST, term);
 
-    string message;
-    char type;
-    get_message(message, REPLY_POSTLISTSTART);
+	string message;
+	get_message(message, REPLY_POSTLISTSTART);
+	const char * p = message.data();
+	const char * p_end = p + message.size();
+	decode_length(&p, p_end, termfreq);
+
+	postings.resize(0);
+	reply_type type;
+	while ((type = get_message(message)) == REPLY_POSTLISTITEM) {
+	    postings += message;
+	}
+	if (type != REPLY_DONE)
+	    throw_bad_message(context);
+	return true;
+    }
+
+    string message = encode_length(did);
+    message += encode_length(max_items);
+    message += term;
+    send_message(MSG_POSTLISTWINDOW, message);
 
+    get_message(message, REPLY_POSTLISTWINDOW);
     const char * p = message.data();
     const char * p_end = p + message.size();
-    Xapian::doccount termfreq;
     decode_length(&p, p_end, termfreq);
-
-    while ((type = get_message(message)) == REPLY_POSTLISTITEM) {
-	pl.append_posting(message);
-    }
-    if (type != REPLY_DONE)
+    if (p == p_end)
 	throw_bad_message(context);
-
-    return termfreq;
+    bool at_end = (*p++ == '1');
+    postings.assign(p, p_end);
+    return at_end;
 }
 
 PositionList *
@@ -288,6 +327,7 @@ bool
 RemoteDatabase::reopen()
 {
     mru_slot = Xapian::BAD_VALUENO;
+    forget_cached_stats();
     return update_stats(MSG_REOPEN);
 }
 
@@ -309,10 +349,23 @@ RemoteDatabase::open_document(Xapian::docid did, bool /*lazy*/) const
 {
     Assert(did);
 
+    // Use the document if the server sent it with the MSet.
+    if (is_prefetched(did))
+	return collect_document(did);
+
     send_message(MSG_DOCUMENT, encode_length(did));
     string doc_data;
     map<Xapian::valueno, string> values;
-    get_message(doc_data, REPLY_DOCDATA);
+    receive_document(doc_data, values);
+
+    return new RemoteDocument(this, did, doc_data, values);
+}
+
+void
+RemoteDatabase::receive_document(string & data,
+				 map<Xapian::valueno, string> & values) const
+{
+    get_message(data, REPLY_DOCDATA);
 
     reply_type type;
     string message;
@@ -325,8 +378,80 @@ RemoteDatabase::open_document(Xapian::docid did, bool /*lazy*/) const
     }
     if (type != REPLY_DONE)
 	throw_bad_message(context);
+}
 
-    return new RemoteDocument(this, did, doc_data, values);
+void
+RemoteDatabase::request_document(Xapian::docid did) const
+{
+    Assert(did);
+
+    // No need to ask for a document the server sent with the MSet.
+    if (is_prefetched(did))
+	return;
+
+    send_message(MSG_DOCUMENT, encode_length(did));
+    pending_docs.push_back(did);
+}
+
+bool
+RemoteDatabase::is_prefetched(Xapian::docid did) const
+{
+    return find(prefetched_docs.begin(), prefetched_docs.end(), did) !=
+	   prefetched_docs.end() &&
+	   fetched_docs.find(did) != fetched_docs.end();
+}
+
+void
+RemoteDatabase::receive_pending_documents() const
+{
+    // Take the list first, so get_message() doesn't try to read these
+    // replies again.
+    deque<Xapian::docid> docs;
+    swap(docs, pending_docs);
+    for (Xapian::docid did : docs) {
+	if (did == 0) {
+	    // Discard an abandoned reply.
+	    string message;
+	    try {
+		get_message(message);
+	    } catch (const Xapian::NetworkError &) {
+		throw;
+	    } catch (const Xapian::Error &) {
+		// Ignore an exception sent in place of the reply.
+	    }
+	    continue;
+	}
+	auto & doc = fetched_docs[did];
+	try {
+	    receive_document(doc.first, doc.second);
+	} catch (const Xapian::NetworkError &) {
+	    throw;
+	} catch (const Xapian::Error &) {
+	    // The server reported an error for this document (most likely that
+	    // it doesn't exist).  Drop it and collect_document() will report
+	    // the error when it asks for the document again.
+	    fetched_docs.erase(did);
+	}
+    }
+}
+
+Xapian::Document::Internal *
+RemoteDatabase::collect_document(Xapian::docid did) const
+{
+    if (!pending_docs.empty())
+	receive_pending_documents();
+
+    auto i = fetched_docs.find(did);
+    if (i == fetched_docs.end())
+	return open_document(did, false);
+
+    Xapian::Document::Internal * doc =
+	new RemoteDocument(this, did, i->second.first, i->second.second);
+    fetched_docs.erase(i);
+    auto j = find(prefetched_docs.begin(), prefetched_docs.end(), did);
+    if (j != prefetched_docs.end())
+	prefetched_docs.erase(j);
+    return doc;
 }
 
 bool
@@ -350,12 +475,12 @@ RemoteDatabase::update_stats(message_type msg_code, const string & body) const
     const char *p = message.c_str();
     const char *p_end = p + message.size();
 
-    // The protocol major versions must match.  The protocol minor version of
-    // the server must be >= that of the client.
+    // The protocol major versions must match.  The server may support an
+    // older protocol minor version than the client, in which case we only use
+    // the features that server supports.
     int protocol_major = static_cast<unsigned char>(*p++);
     int protocol_minor = static_cast<unsigned char>(*p++);
-    if (protocol_major != XAPIAN_REMOTE_PROTOCOL_MAJOR_VERSION ||
-	protocol_minor < XAPIAN_REMOTE_PROTOCOL_MINOR_VERSION) {
+    if (protocol_major != XAPIAN_REMOTE_PROTOCOL_MAJOR_VERSION) {
 	string errmsg("Server supports protocol version");
 	if (protocol_minor) {
 	    errmsg += "s ";
@@ -385,7 +510,25 @@ RemoteDatabase::update_stats(message_type msg_code, const string & body) const
     has_positional_info = (*p++ == '1');
     decode_length(&p, p_end, total_length);
     uuid.assign(p, p_end);
+    server_minor_version = protocol_minor;
     cached_stats_valid = true;
+
+    if (msg_code == MSG_MAX && server_minor_version >= 3) {
+	// Tell the server the smallest message we want it to compress.  If
+	// XAPIAN_REMOTE_COMPRESS_MIN is unset, we accept whatever the server
+	// offers (1 is raised to its threshold), and if it's 0 we ask for no
+	// compression.  No reply is sent.
+	size_t compress_min = 1;
+	const char * env = getenv("XAPIAN_REMOTE_COMPRESS_MIN");
+	if (env) {
+	    long n = atol(env);
+	    compress_min = n > 0 ? size_t(n) : 0;
+	}
+	send_message(MSG_COMPRESSION, encode_length(compress_min));
+	// We only compress messages we send if asked to explicitly, as most
+	// messages to the server are small.
+	link.set_compress_min(env ? compress_min : 0);
+    }
     return true;
 }
 
@@ -519,12 +662,20 @@ RemoteDatabase::get_doclength_upper_bound() const
 }
 
 Xapian::termcount
-RemoteDatabase::get_wdf_upper_bound(const string &) const
+RemoteDatabase::get_wdf_upper_bound(const string & term) const
 {
     // The default implementation returns get_collection_freq(), but we
     // don't want the overhead of a remote message and reply per query
     // term, and we can get called in the middle of a remote exchange
-    // too.  FIXME: handle this bound in the stats local/remote code...
+    // too.  Instead the server sends a bound for each query term along with
+    // the statistics.
+    auto i = cached_termfreqs.find(term);
+    if (i != cached_termfreqs.end()) {
+	// A server older than protocol 39.2 doesn't send wdf upper bounds, so
+	// a bound of 0 is only trustworthy if the term doesn't occur.
+	if (i->second.wdf_upper_bound || i->second.collfreq == 0)
+	    return i->second.wdf_upper_bound;
+    }
     return doclen_ubound;
 }
 
@@ -562,14 +713,74 @@ RemoteDatabase::get_unique_terms(Xapian::docid did) const
     return doclen;
 }
 
+/** The number of exchanges a message starts.
+ *
+ *  This is the number of replies to it which reply_ends_exchange() is true
+ *  for.
+ */
+static unsigned
+exchanges_started(message_type type)
+{
+    switch (type) {
+	case MSG_GETMSET:
+	    // Part of the exchange started by MSG_QUERY.
+	case MSG_COMPRESSION:
+	case MSG_CANCEL:
+	case MSG_DELETEDOCUMENTTERM:
+	case MSG_REPLACEDOCUMENT:
+	case MSG_SETMETADATA:
+	case MSG_ADDSPELLING:
+	case MSG_REMOVESPELLING:
+	case MSG_SHUTDOWN:
+	    // No reply is sent.
+	    return 0;
+	case MSG_TERMLIST:
+	    // Both REPLY_DOCLENGTH and the final REPLY_DONE.
+	    return 2;
+	default:
+	    return 1;
+    }
+}
+
+/// Is @a type the last reply to a message?
+static bool
+reply_ends_exchange(reply_type type)
+{
+    switch (type) {
+	case REPLY_ALLTERMS:
+	case REPLY_DOCDATA:
+	case REPLY_VALUE:
+	case REPLY_TERMLIST:
+	case REPLY_POSITIONLIST:
+	case REPLY_POSTLISTSTART:
+	case REPLY_POSTLISTITEM:
+	case REPLY_METADATAKEYLIST:
+	case REPLY_STATS:
+	    return false;
+	default:
+	    return true;
+    }
+}
+
 reply_type
-RemoteDatabase::get_message(string &result, reply_type required_type) const
+RemoteDatabase::get_message(string &result, reply_type required_type,
+			    double end_time) const
 {
-    double end_time = RealTime::end_time(timeout);
+    // The replies to any documents requested by request_document() come
+    // before the reply we want.
+    if (!pending_docs.empty())
+	receive_pending_documents();
+
+    double timeout_end_time = RealTime::end_time(timeout);
+    if (end_time == 0.0 ||
+	(timeout_end_time != 0.0 && timeout_end_time < end_time))
+	end_time = timeout_end_time;
     int type_int = link.get_message(result, end_time);
     if (type_int < 0)
 	throw_connection_closed_unexpectedly();
     reply_type type = static_cast<reply_type>(type_int);
+    if (reply_ends_exchange(type) && unfinished_exchanges)
+	--unfinished_exchanges;
     if (type == REPLY_EXCEPTION) {
 	unserialise_error(result, "REMOTE:", context);
     }
@@ -588,9 +799,22 @@ void
 RemoteDatabase::send_message(message_type type, const string &message) const
 {
     double end_time = RealTime::end_time(timeout);
+    // Count the exchange first, so it's left unfinished if sending fails.
+    unfinished_exchanges += exchanges_started(type);
     link.send_message(static_cast<unsigned char>(type), message, end_time);
 }
 
+int
+RemoteDatabase::detach_connection()
+{
+    if (transaction_state != TRANSACTION_UNIMPLEMENTED)
+	return -1;
+    if (unfinished_exchanges || !pending_docs.empty() ||
+	link.has_buffered_data())
+	return -1;
+    return link.release_fd();
+}
+
 void
 RemoteDatabase::do_close()
 {
@@ -625,7 +849,8 @@ RemoteDatabase::set_query(const Xapian::Query& query,
 			 const vector<Xapian::Internal::opt_intrusive_ptr<Xapian::MatchSpy>> & matchspies)
 {
     string tmp = query.serialise();
-    string message = encode_length(tmp.size());
+    string & message = pending_query;
+    message = encode_length(tmp.size());
     message += tmp;
 
     // Serialise assorted Enquire settings.
@@ -664,19 +889,57 @@ RemoteDatabase::set_query(const Xapian::Query& query,
 	message += encode_length(tmp.size());
 	message += tmp;
     }
-
-    send_message(MSG_QUERY, message);
 }
 
 bool
 RemoteDatabase::get_remote_stats(bool nowait, Xapian::Weight::Internal &out)
 {
+    if (!pending_query.empty()) {
+	send_message(MSG_QUERY, pending_query);
+	pending_query.resize(0);
+    }
+
     if (nowait && !link.ready_to_read()) return false;
 
     string message;
     get_message(message, REPLY_STATS);
     unserialise_stats(message, out);
 
+    // Remember the statistics to guess those for later queries with.  Just
+    // start again if a lot of different terms have been seen.
+    if (cached_termfreqs.size() > 10000)
+	cached_termfreqs.clear();
+    for (auto && i : out.termfreqs) {
+	cached_termfreqs[i.first] = i.second;
+    }
+    cached_total_length = out.total_length;
+    cached_collection_size = out.collection_size;
+    cached_total_term_count = out.total_term_count;
+    have_cached_stats = true;
+
+    return true;
+}
+
+bool
+RemoteDatabase::add_cached_stats(Xapian::Weight::Internal & stats) const
+{
+    if (!have_cached_stats) return false;
+
+    Xapian::Weight::Internal remote_stats;
+    remote_stats.total_length = cached_total_length;
+    remote_stats.collection_size = cached_collection_size;
+    remote_stats.total_term_count = cached_total_term_count;
+    Xapian::TermIterator t;
+    for (t = stats.query.get_unique_terms_begin(); t != Xapian::TermIterator();
+	 ++t) {
+	auto i = cached_termfreqs.find(*t);
+	if (i == cached_termfreqs.end())
+	    return false;
+	TermFreqs & tf = remote_stats.termfreqs[*t];
+	tf.termfreq = i->second.termfreq;
+	tf.collfreq = i->second.collfreq;
+    }
+    stats += remote_stats;
     return true;
 }
 
@@ -693,15 +956,88 @@ RemoteDatabase::send_global_stats(Xapian::doccount first,
     send_message(MSG_GETMSET, message);
 }
 
+void
+RemoteDatabase::send_query_mset(Xapian::doccount first,
+				Xapian::doccount maxitems,
+				Xapian::doccount check_at_least)
+{
+    string message = encode_length(first);
+    message += encode_length(maxitems);
+    message += encode_length(check_at_least);
+    message += pending_query;
+    pending_query.resize(0);
+    send_message(MSG_QUERYMSET, message);
+}
+
+void
+RemoteDatabase::send_pipelined_query(Xapian::doccount first,
+				     Xapian::doccount maxitems,
+				     Xapian::doccount check_at_least,
+				     Xapian::doccount n_docs,
+				     const Xapian::Weight::Internal * stats_hint)
+{
+    if (!pending_query.empty()) {
+	swap(sent_query, pending_query);
+	pending_query.resize(0);
+    }
+    string message = encode_length(first);
+    message += encode_length(maxitems);
+    message += encode_length(check_at_least);
+    message += encode_length(n_docs);
+    if (stats_hint) {
+	string tmp = serialise_stats(*stats_hint);
+	message += encode_length(tmp.size());
+	message += tmp;
+    } else {
+	message += encode_length(0);
+    }
+    message += sent_query;
+    send_message(MSG_PIPELINEDQUERY, message);
+}
+
 void
 RemoteDatabase::get_mset(Xapian::MSet &mset,
-			 const vector<Xapian::Internal::opt_intrusive_ptr<Xapian::MatchSpy>> & matchspies)
+			 const vector<Xapian::Internal::opt_intrusive_ptr<Xapian::MatchSpy>> & matchspies,
+			 double end_time)
 {
     string message;
-    get_message(message, REPLY_RESULTS);
+    reply_type type = get_message(message, REPLY_MAX, end_time);
+    if (type != REPLY_RESULTS && type != REPLY_RESULTSWITHDOCS)
+	throw_bad_message(context);
     const char * p = message.data();
     const char * p_end = p + message.size();
 
+    // Drop any documents sent with the previous MSet which weren't used.
+    for (Xapian::docid did : prefetched_docs) {
+	fetched_docs.erase(did);
+    }
+    prefetched_docs.clear();
+
+    if (type == REPLY_RESULTSWITHDOCS) {
+	Xapian::doccount n_docs;
+	decode_length(&p, p_end, n_docs);
+	while (n_docs--) {
+	    Xapian::docid did;
+	    decode_length(&p, p_end, did);
+	    auto & doc = fetched_docs[did];
+	    size_t len;
+	    decode_length_and_check(&p, p_end, len);
+	    doc.first.assign(p, len);
+	    p += len;
+	    Xapian::valueno count;
+	    decode_length(&p, p_end, count);
+	    doc.second.clear();
+	    while (count--) {
+		Xapian::valueno slot;
+		decode_length(&p, p_end, slot);
+		decode_length_and_check(&p, p_end, len);
+		doc.second[slot].assign(p, len);
+		p += len;
+	    }
+	    prefetched_docs.push_back(did);
+	}
+    }
+
     for (auto i : matchspies) {
 	if (p == p_end)
 	    throw Xapian::NetworkError("Expected serialised matchspy");
@@ -714,6 +1050,18 @@ RemoteDatabase::get_mset(Xapian::MSet &mset,
     mset = unserialise_mset(p, p_end);
 }
 
+bool
+RemoteDatabase::wait_to_read(const vector<const RemoteDatabase *> & dbs,
+			     double end_time)
+{
+    vector<const RemoteConnection *> conns;
+    conns.reserve(dbs.size());
+    for (const RemoteDatabase * db : dbs) {
+	conns.push_back(&db->link);
+    }
+    return RemoteConnection::wait_to_read(conns, end_time);
+}
+
 void
 RemoteDatabase::commit()
 {
@@ -729,6 +1077,7 @@ RemoteDatabase::cancel()
 {
     cached_stats_valid = false;
     mru_slot = Xapian::BAD_VALUENO;
+    forget_cached_stats();
 
     send_message(MSG_CANCEL, string());
 }
@@ -738,6 +1087,7 @@ RemoteDatabase::add_document(const Xapian::Document & doc)
 {
     cached_stats_valid = false;
     mru_slot = Xapian::BAD_VALUENO;
+    forget_cached_stats();
 
     send_message(MSG_ADDDOCUMENT, serialise_document(doc));
 
@@ -756,6 +1106,7 @@ RemoteDatabase::delete_document(Xapian::docid did)
 {
     cached_stats_valid = false;
     mru_slot = Xapian::BAD_VALUENO;
+    forget_cached_stats();
 
     send_message(MSG_DELETEDOCUMENT, encode_length(did));
     string dummy;
@@ -767,6 +1118,7 @@ RemoteDatabase::delete_document(const std::string & unique_term)
 {
     cached_stats_valid = false;
     mru_slot = Xapian::BAD_VALUENO;
+    forget_cached_stats();
 
     send_message(MSG_DELETEDOCUMENTTERM, unique_term);
 }
@@ -777,6 +1129,7 @@ RemoteDatabase::replace_document(Xapian::docid did,
 {
     cached_stats_valid = false;
     mru_slot = Xapian::BAD_VALUENO;
+    forget_cached_stats();
 
     string message = encode_length(did);
     message += serialise_document(doc);
@@ -790,6 +1143,7 @@ RemoteDatabase::replace_document(const std::string & unique_term,
 {
     cached_stats_valid = false;
     mru_slot = Xapian::BAD_VALUENO;
+    forget_cached_stats();
 
     string message = encode_length(unique_term.size());
     message += unique_term;
@@ -28,8 +28,14 @@
 #include "api/queryinternal.h"
 #include "net/remoteconnection.h"
 #include "backends/valuestats.h"
+#include "weight/weightinternal.h"
 #include "xapian/weight.h"
 
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
 namespace Xapian {
     class RSet;
 }
@@ -73,6 +79,9 @@ class RemoteDatabase : public Xapian::Database::Internal {
     /// The UUID of the remote database.
     mutable string uuid;
 
+    /// The minor protocol version the server supports.
+    mutable int server_minor_version;
+
     /// The context to return with any error messages
     string context;
 
@@ -87,6 +96,81 @@ class RemoteDatabase : public Xapian::Database::Internal {
      */
     mutable Xapian::valueno mru_slot;
 
+    /** Statistics the server has sent for the terms of earlier queries.
+     *
+     *  These include upper bounds on the wdf of the terms, and are used to
+     *  guess the global statistics for a pipelined query.  They're cleared
+     *  by forget_cached_stats() if the database might have changed since.
+     */
+    mutable std::map<string, TermFreqs> cached_termfreqs;
+
+    /// Have the collection statistics below been sent by the server?
+    mutable bool have_cached_stats;
+
+    /// The total_length from the statistics the server last sent.
+    mutable totlen_t cached_total_length;
+
+    /// The collection_size from the statistics the server last sent.
+    mutable Xapian::doccount cached_collection_size;
+
+    /// The total_term_count from the statistics the server last sent.
+    mutable Xapian::termcount cached_total_term_count;
+
+    /** The serialised query set by set_query().
+     *
+     *  Empty once the query has been sent to the server.
+     */
+    string pending_query;
+
+    /** The serialised query last sent by send_pipelined_query().
+     *
+     *  Kept so the query can be sent again if the statistics hint sent with
+     *  it turns out to be wrong.
+     */
+    string sent_query;
+
+    /** Documents requested by request_document() which we've not read yet.
+     *
+     *  A docid of 0 marks the reply to another message which the caller
+     *  has given up waiting for (see abandon_reply()), which is discarded.
+     */
+    mutable std::deque<Xapian::docid> pending_docs;
+
+    /// Data and values of requested documents which haven't been collected.
+    mutable std::map<Xapian::docid,
+		     std::pair<string, std::map<Xapian::valueno, string>>>
+	fetched_docs;
+
+    /** Documents the server sent with the last MSet which haven't been used.
+     *
+     *  These are dropped from fetched_docs when the next MSet is read.
+     */
+    mutable std::vector<Xapian::docid> prefetched_docs;
+
+    /** Number of exchanges with the server which haven't finished yet.
+     *
+     *  An exchange is a message and all its replies.  If this isn't zero
+     *  when the database is closed, replies may still be on their way so
+     *  the connection can't be reused.
+     */
+    mutable unsigned unfinished_exchanges;
+
+    /// Did the server send document @a did with the MSet (and it's unused)?
+    bool is_prefetched(Xapian::docid did) const;
+
+    /// Forget the statistics cached from earlier queries.
+    void forget_cached_stats() const {
+	cached_termfreqs.clear();
+	have_cached_stats = false;
+    }
+
+    /// Read the reply to MSG_DOCUMENT.
+    void receive_document(string & data,
+			  std::map<Xapian::valueno, string> & values) const;
+
+    /// Read the replies for all the entries in pending_docs.
+    void receive_pending_documents() const;
+
     bool update_stats(message_type msg_code = MSG_UPDATE,
 		      const std::string & body = std::string()) const;
 
@@ -104,12 +188,33 @@ class RemoteDatabase : public Xapian::Database::Internal {
      *  @param context_ The context to return with any error messages.
      *	@param writable	Is this a WritableDatabase?
      *	@param flags	Xapian::DB_RETRY_LOCK or 0.
+     *	@param reused	Is @a fd a connection which has been used before (and
+     *			released by detach_connection())?  If so, there's no
+     *			greeting to read, so we ask the server to reopen the
+     *			database and send its statistics instead.
      */
     RemoteDatabase(int fd, double timeout_, const string & context_,
-		   bool writable, int flags);
+		   bool writable, int flags, bool reused = false);
 
-    /// Receive a message from the server.
-    reply_type get_message(string & message, reply_type required_type = REPLY_MAX) const;
+    /** Detach the connection from this object so it can be reused.
+     *
+     *  This is only possible for a read-only database with no replies still
+     *  to be read, and which didn't give up on an exchange with the server
+     *  part way through (for example after a NetworkTimeoutError).
+     *
+     *  @return The file descriptor for the connection, or -1 if it can't be
+     *		reused (in which case it's left attached).
+     */
+    int detach_connection();
+
+    /** Receive a message from the server.
+     *
+     *  @param end_time	Give up at this time if it's before the timeout
+     *			would be reached (0.0 to just use the timeout).
+     */
+    reply_type get_message(string & message,
+			   reply_type required_type = REPLY_MAX,
+			   double end_time = 0.0) const;
 
     /// Send a message to the server.
     void send_message(message_type type, const string & data) const;
@@ -127,6 +232,9 @@ class RemoteDatabase : public Xapian::Database::Internal {
     void keep_alive();
 
     /** Set the query
+     *
+     * The query is sent to the server by get_remote_stats() or
+     * send_query_mset().
      *
      * @param query			The query.
      * @param qlen			The query length.
@@ -161,20 +269,109 @@ class RemoteDatabase : public Xapian::Database::Internal {
 		   const vector<Xapian::Internal::opt_intrusive_ptr<Xapian::MatchSpy>> & matchspies);
 
     /** Get the stats from the remote server.
+     *
+     *  This sends the query set by set_query() if that hasn't been sent yet.
      *
      *  @return	true if we got the remote stats; false if we should try again.
      */
     bool get_remote_stats(bool nowait, Xapian::Weight::Internal &out);
 
+    /** Can the server run the query without exchanging statistics?
+     *
+     *  This is only correct if this is the only database being searched,
+     *  since then its statistics are the global statistics.
+     */
+    bool supports_query_mset() const { return server_minor_version >= 1; }
+
+    /** Send the query set by set_query() and ask for the MSet.
+     *
+     *  Use instead of get_remote_stats() and send_global_stats() if
+     *  supports_query_mset() is true and this is the only database being
+     *  searched.  The MSet is then read with get_mset() as usual.
+     */
+    void send_query_mset(Xapian::doccount first,
+			 Xapian::doccount maxitems,
+			 Xapian::doccount check_at_least);
+
+    /** Can the server run a query sent with a guess at the global statistics?
+     *
+     *  If so, send_pipelined_query() can be used.
+     */
+    bool supports_pipelined_query() const { return server_minor_version >= 5; }
+
+    /** Add the statistics cached from earlier queries.
+     *
+     *  The statistics the server sent for the terms of @a stats.query in
+     *  earlier queries are added to @a stats, which gives a guess at the
+     *  statistics it'll send for this query.
+     *
+     *  @return	false if there aren't cached statistics for all the terms (in
+     *		which case @a stats is left unchanged).
+     */
+    bool add_cached_stats(Xapian::Weight::Internal & stats) const;
+
+    /** Send the query set by set_query() and ask for the MSet.
+     *
+     *  Only valid if supports_pipelined_query() returns true.  If @a
+     *  stats_hint is NULL, this database must be the only one being searched
+     *  (as for send_query_mset()).  Otherwise the server sends its statistics
+     *  (which get_remote_stats() reads) and then the MSet, which is calculated
+     *  using @a stats_hint as the global statistics.  The MSet is read with
+     *  get_mset() as usual.
+     *
+     *  If this is called again without set_query() being called in between,
+     *  the same query is sent again.
+     *
+     *  @param n_docs	   The number of documents from the start of the MSet
+     *			   for the server to send along with it.
+     *  @param stats_hint  Our guess at the global statistics, or NULL.
+     */
+    void send_pipelined_query(Xapian::doccount first,
+			      Xapian::doccount maxitems,
+			      Xapian::doccount check_at_least,
+			      Xapian::doccount n_docs,
+			      const Xapian::Weight::Internal * stats_hint);
+
     /// Send the global stats to the remote server.
     void send_global_stats(Xapian::doccount first,
 			   Xapian::doccount maxitems,
 			   Xapian::doccount check_at_least,
 			   const Xapian::Weight::Internal &stats);
 
-    /// Get the MSet from the remote server.
+    /** Get the MSet from the remote server.
+     *
+     *  @param end_time	If the MSet hasn't been read by this time, throw
+     *			Xapian::NetworkTimeoutError (0.0 for no limit other
+     *			than the timeout).  The rest of the reply can then be
+     *			discarded with abandon_reply().
+     */
     void get_mset(Xapian::MSet &mset,
-		  const vector<Xapian::Internal::opt_intrusive_ptr<Xapian::MatchSpy>> & matchspies);
+		  const vector<Xapian::Internal::opt_intrusive_ptr<Xapian::MatchSpy>> & matchspies,
+		  double end_time = 0.0);
+
+    /** Give up waiting for the reply to the last message sent.
+     *
+     *  The reply is read and discarded before the reply to the next message.
+     */
+    void abandon_reply() { pending_docs.push_back(0); }
+
+    /// Is there data from the server waiting to be read?
+    bool ready_to_read() const { return link.ready_to_read(); }
+
+    /** Wait until there's data waiting to be read from any of several
+     *  remote databases.
+     *
+     *  @param dbs	 The databases to wait on.
+     *  @param end_time  If this time is reached, give up waiting.  If
+     *			 (end_time == 0.0) then wait indefinitely.
+     *
+     *  @return	true if there's data to read; false if end_time was reached.
+     */
+    static bool wait_to_read(const vector<const RemoteDatabase *> & dbs,
+			     double end_time);
+
+    /// The timeout used for network operations, in seconds.
+    double get_timeout() const { return timeout; }
 
     /// Get remote metadata key list.
     TermList * open_metadata_keylist(const std::string & prefix) const;
@@ -193,7 +390,23 @@ class RemoteDatabase : public Xapian::Database::Internal {
 
     LeafPostList * open_post_list(const string & tname) const;
 
-    Xapian::doccount read_post_list(const string &term, NetworkPostList & pl) const;
+    /** Read a window of a postlist from the server.
+     *
+     *  @param term		The term to read the postlist for.
+     *  @param did		Start from the first entry with docid >= did.
+     *  @param max_items	Return at most this many entries.
+     *  @param[out] termfreq	The term frequency of @a term.
+     *  @param[out] postings	The entries: for each, the difference from the
+     *				previous docid minus 1 (where the "previous
+     *				docid" for the first is did - 1), then the wdf.
+     *
+     *  @return true if there are no entries after those returned.
+     */
+    bool read_post_list(const string &term,
+			Xapian::docid did,
+			Xapian::doccount max_items,
+			Xapian::doccount & termfreq,
+			string & postings) const;
 
     PositionList * open_position_list(Xapian::docid did,
 				      const string & tname) const;
@@ -201,6 +414,16 @@ class RemoteDatabase : public Xapian::Database::Internal {
     /// Get a remote document.
     Xapian::Document::Internal * open_document(Xapian::docid did, bool lazy) const;
 
+    /** Request a document.
+     *
+     *  The request is sent to the server straight away, so the replies for
+     *  several requested documents only need a single round trip.
+     */
+    void request_document(Xapian::docid did) const;
+
+    /// Collect a document requested by request_document().
+    Xapian::Document::Internal * collect_document(Xapian::docid did) const;
+
     /// Get the document count.
     Xapian::doccount get_doccount() const;
 
@@ -37,6 +37,7 @@ using namespace std;
 #define OPT_HELP 1
 #define OPT_VERSION 2
 #define OPT_NO_RENUMBER 3
+#define OPT_PACKED_POSTLISTS 4
 
 static void show_usage() {
     cout << "Usage: " PROG_NAME " [OPTIONS] SOURCE_DATABASE... DESTINATION_DATABASE\n\n"
@@ -55,6 +56,9 @@ static void show_usage() {
 "                     option is only supported when merging databases if they\n"
 "                     have disjoint ranges of used document ids\n"
 "  -s, --single-file  Produce a single file database (not supported for chert)\n"
+"      --packed-postlists\n"
+"                     Write the posting lists in the packed format, which is\n"
+"                     faster to decode (glass only)\n"
 "  --help             display this help and exit\n"
 "  --version          output version information and exit" << endl;
 }
@@ -112,6 +116,7 @@ main(int argc, char **argv)
 	{"blocksize",	required_argument, 0, 'b'},
 	{"no-renumber", no_argument, 0, OPT_NO_RENUMBER},
 	{"single-file", no_argument, 0, 's'},
+	{"packed-postlists", no_argument, 0, OPT_PACKED_POSTLISTS},
 	{"quiet",	no_argument, 0, 'q'},
 	{"help",	no_argument, 0, OPT_HELP},
 	{"version",	no_argument, 0, OPT_VERSION},
@@ -157,6 +162,9 @@ main(int argc, char **argv)
 	    case 's':
 		flags |= Xapian::DBCOMPACT_SINGLE_FILE;
 		break;
+	    case OPT_PACKED_POSTLISTS:
+		flags |= Xapian::DBCOMPACT_PACKED_POSTLISTS;
+		break;
 	    case 'q':
 		compactor.set_quiet(true);
 		break;
@@ -29,6 +29,7 @@
 #include "stringutils.h"
 #include "safeunistd.h"
 
+#include <algorithm>
 #include <iostream>
 
 using namespace std;
@@ -62,6 +63,10 @@ static void show_usage() {
 "                      no timeout (default: " STRINGIZE(DEFAULT_TIMEOUT) ")\n"
 "  -f, --force-copy    force a full copy of the database to be sent (and then\n"
 "                      replicate as normal)\n"
+"  -c, --checksums     if a full copy is needed, compare checksums of the\n"
+"                      master's blocks first so only changed blocks are sent\n"
+"  -s, --streams=N     fetch the tables of a full copy over N connections to\n"
+"                      the master at once (default: 1)\n"
 "  -o, --one-shot      replicate only once and then exit\n"
 "  -q, --quiet         only report errors\n"
 "  -v, --verbose       be more verbose\n"
@@ -72,7 +77,7 @@ static void show_usage() {
 int
 main(int argc, char **argv)
 {
-    const char * opts = "h:p:m:i:r:t:ofqv";
+    const char * opts = "h:p:m:i:r:t:s:ofcqv";
     const struct option long_opts[] = {
 	{"host",	required_argument,	0, 'h'},
 	{"port",	required_argument,	0, 'p'},
@@ -82,6 +87,8 @@ main(int argc, char **argv)
 	{"timeout",	required_argument,	0, 't'},
 	{"one-shot",	no_argument,		0, 'o'},
 	{"force-copy",	no_argument,		0, 'f'},
+	{"checksums",	no_argument,		0, 'c'},
+	{"streams",	required_argument,	0, 's'},
 	{"quiet",	no_argument,		0, 'q'},
 	{"verbose",	no_argument,		0, 'v'},
 	{"help",	no_argument, 0, OPT_HELP},
@@ -96,8 +103,10 @@ main(int argc, char **argv)
     bool one_shot = false;
     enum { NORMAL, VERBOSE, QUIET } verbosity = NORMAL;
     bool force_copy = false;
+    bool block_checksums = false;
     int reader_close_time = READER_CLOSE_TIME;
     int timeout = DEFAULT_TIMEOUT;
+    int streams = 1;
 
     int c;
     while ((c = gnu_getopt_long(argc, argv, opts, long_opts, 0)) != -1) {
@@ -123,6 +132,12 @@ main(int argc, char **argv)
 	    case 'f':
 		force_copy = true;
 		break;
+	    case 'c':
+		block_checksums = true;
+		break;
+	    case 's':
+		streams = atoi(optarg);
+		break;
 	    case 'o':
 		one_shot = true;
 		break;
@@ -180,7 +195,9 @@ main(int argc, char **argv)
 	    }
 	    Xapian::ReplicationInfo info;
 	    client.update_from_master(dbpath, masterdb, info,
-				      reader_close_time, force_copy);
+				      reader_close_time, force_copy,
+				      block_checksums,
+				      unsigned(max(streams, 1)));
 	    if (verbosity == VERBOSE) {
 		cout << "Update complete: "
 		     << info.fullcopy_count << " copies, "
@@ -39,6 +39,7 @@ noinst_HEADERS +=\
 	common/safewindows.h\
 	common/safewinsock2.h\
 	common/serialise-double.h\
+	common/sha1.h\
 	common/socket_utils.h\
 	common/str.h\
 	common/stringutils.h\
@@ -65,6 +66,7 @@ lib_src +=\
 	common/replicate_utils.cc\
 	common/safe.cc\
 	common/serialise-double.cc\
+	common/sha1.cc\
 	common/socket_utils.cc\
 	common/str.cc
 
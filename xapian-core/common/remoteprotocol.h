@@ -49,8 +49,14 @@
 // 37: 1.3.1 Prefix-compress termlists.
 // 38: 1.3.2 Stats serialisation now includes collection freq, and more...
 // 39: 1.3.3 New query operator OP_WILDCARD; sort keys in serialised MSet.
+// 39.1: New MSG_QUERYMSET sends the query and asks for the MSet together.
+// 39.2: Serialised stats can end with wdf upper bounds for the terms.
+// 39.3: New MSG_COMPRESSION asks the server to compress its messages.
+// 39.4: New MSG_POSTLISTWINDOW fetches a postlist a window at a time.
+// 39.5: New MSG_PIPELINEDQUERY sends a query with a guess at the global stats
+//       and gets the local stats, MSet and documents in reply.
 #define XAPIAN_REMOTE_PROTOCOL_MAJOR_VERSION 39
-#define XAPIAN_REMOTE_PROTOCOL_MINOR_VERSION 0
+#define XAPIAN_REMOTE_PROTOCOL_MINOR_VERSION 5
 
 /** Message types (client -> server).
  *
@@ -89,6 +95,10 @@ enum message_type {
     MSG_METADATAKEYLIST,	// Iterator for metadata keys
     MSG_FREQS,			// Get termfreq and collfreq
     MSG_UNIQUETERMS,		// Get number of unique terms in doc
+    MSG_QUERYMSET,		// Run Query and get MSet
+    MSG_COMPRESSION,		// Set message compression threshold
+    MSG_POSTLISTWINDOW,		// Get part of a PostList
+    MSG_PIPELINEDQUERY,		// Run Query with stats hint, get MSet and docs
     MSG_MAX
 };
 
@@ -117,7 +127,15 @@ enum reply_type {
     REPLY_METADATAKEYLIST,	// Iterator for metadata keys
     REPLY_FREQS,		// Get termfreq and collfreq
     REPLY_UNIQUETERMS,		// Get number of unique terms in doc
+    REPLY_POSTLISTWINDOW,	// Part of a postlist
+    REPLY_RESULTSWITHDOCS,	// Results (MSet) with document data
     REPLY_MAX
 };
 
+/** Flag set in the message type code if the message contents are compressed.
+ *
+ *  All message and reply type codes must be less than this.
+ */
+#define MESSAGE_COMPRESSED 0x80
+
 #endif // XAPIAN_INCLUDED_REMOTEPROTOCOL_H
@@ -23,8 +23,11 @@
 
 // Versions:
 // 1: Initial support
+// 1.1: Add REPL_REPLY_DB_FILEDELTA, REPL_REPLY_DB_CHECKSUMS and
+//      REPL_REPLY_DB_BLOCKCHECKSUMS
+// 1.2: Add REPL_REPLY_DB_FILEPARTS and REPL_REPLY_DB_FILEPART
 #define XAPIAN_REPLICATION_PROTOCOL_MAJOR_VERSION 1
-#define XAPIAN_REPLICATION_PROTOCOL_MINOR_VERSION 0
+#define XAPIAN_REPLICATION_PROTOCOL_MINOR_VERSION 2
 
 // Reply types (master -> slave)
 enum replicate_reply_type {
@@ -34,9 +37,27 @@ enum replicate_reply_type {
     REPL_REPLY_DB_FILENAME,	// The name of a file in a DB copy.
     REPL_REPLY_DB_FILEDATA,	// Contents of a file in a DB copy.
     REPL_REPLY_DB_FOOTER,	// End of a whole DB copy.
-    REPL_REPLY_CHANGESET	// A changeset file is being sent.
+    REPL_REPLY_CHANGESET,	// A changeset file is being sent.
+    REPL_REPLY_DB_FILEDELTA,	// Changed blocks of a file in a DB copy.
+    REPL_REPLY_DB_CHECKSUMS,	// Block checksums sent instead of a DB copy.
+    REPL_REPLY_DB_BLOCKCHECKSUMS,	// Checksums of blocks of a file.
+    REPL_REPLY_DB_FILEPARTS,	// Files in a DB copy to fetch in parts.
+    REPL_REPLY_DB_FILEPART	// Part of a file in a DB copy.
 };
 
+// Appended to the revision by a replica which can make a DB copy from the
+// blocks of its live database which are unchanged, to ask for block checksums
+// if a copy is needed.
+#define REPL_DELTA_CAPABLE '?'
+
+// Appended to the revision by a replica, followed by the blocks it needs,
+// once it has compared the block checksums.
+#define REPL_DELTA_BLOCKS_NEEDED '!'
+
+// The maximum number of times a replica asks for block checksums before
+// asking for a whole DB copy instead.
+#define MAX_DELTA_CHECKSUM_ROUNDS 3
+
 // The maximum number of copies of a database to send in a single conversation.
 // If more copies than this are required, a REPL_REPLY_FAIL message will be
 // sent.
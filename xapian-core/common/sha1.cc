@@ -0,0 +1,139 @@
+/** @file sha1.cc
+ * @brief Calculate SHA-1 message digests.
+ */
+/* Copyright (C) 2026 The Xapian contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include <config.h>
+
+#include "sha1.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+static inline uint4
+rotl(uint4 x, int n)
+{
+    return ((x << n) | (x >> (32 - n))) & 0xffffffff;
+}
+
+void
+SHA1::reset()
+{
+    h[0] = 0x67452301;
+    h[1] = 0xefcdab89;
+    h[2] = 0x98badcfe;
+    h[3] = 0x10325476;
+    h[4] = 0xc3d2e1f0;
+    buf_len = 0;
+    total_len = 0;
+}
+
+void
+SHA1::process_block(const unsigned char * p)
+{
+    uint4 w[80];
+    for (int i = 0; i != 16; ++i) {
+	w[i] = (uint4(p[4 * i]) << 24) | (uint4(p[4 * i + 1]) << 16) |
+	       (uint4(p[4 * i + 2]) << 8) | uint4(p[4 * i + 3]);
+    }
+    for (int i = 16; i != 80; ++i) {
+	w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+
+    uint4 a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    for (int i = 0; i != 80; ++i) {
+	uint4 f, k;
+	if (i < 20) {
+	    f = (b & c) | (~b & d);
+	    k = 0x5a827999;
+	} else if (i < 40) {
+	    f = b ^ c ^ d;
+	    k = 0x6ed9eba1;
+	} else if (i < 60) {
+	    f = (b & c) | (b & d) | (c & d);
+	    k = 0x8f1bbcdc;
+	} else {
+	    f = b ^ c ^ d;
+	    k = 0xca62c1d6;
+	}
+	uint4 t = (rotl(a, 5) + f + e + k + w[i]) & 0xffffffff;
+	e = d;
+	d = c;
+	c = rotl(b, 30);
+	b = a;
+	a = t;
+    }
+    h[0] = (h[0] + a) & 0xffffffff;
+    h[1] = (h[1] + b) & 0xffffffff;
+    h[2] = (h[2] + c) & 0xffffffff;
+    h[3] = (h[3] + d) & 0xffffffff;
+    h[4] = (h[4] + e) & 0xffffffff;
+}
+
+void
+SHA1::update(const char * p, size_t len)
+{
+    const unsigned char * data = reinterpret_cast<const unsigned char *>(p);
+    total_len += len;
+    if (buf_len) {
+	size_t n = min(len, sizeof(buf) - buf_len);
+	memcpy(buf + buf_len, data, n);
+	buf_len += n;
+	data += n;
+	len -= n;
+	if (buf_len < sizeof(buf)) return;
+	process_block(buf);
+	buf_len = 0;
+    }
+    while (len >= sizeof(buf)) {
+	process_block(data);
+	data += sizeof(buf);
+	len -= sizeof(buf);
+    }
+    memcpy(buf, data, len);
+    buf_len = len;
+}
+
+void
+SHA1::append_digest(string & result)
+{
+    unsigned long long bits = total_len * 8;
+    // Pad with a 1 bit, then 0 bits up to 8 bytes short of a whole block,
+    // then the length in bits.
+    buf[buf_len++] = 0x80;
+    if (buf_len > sizeof(buf) - 8) {
+	memset(buf + buf_len, 0, sizeof(buf) - buf_len);
+	process_block(buf);
+	buf_len = 0;
+    }
+    memset(buf + buf_len, 0, sizeof(buf) - 8 - buf_len);
+    for (int i = 0; i != 8; ++i) {
+	buf[sizeof(buf) - 1 - i] = static_cast<unsigned char>(bits >> (i * 8));
+    }
+    process_block(buf);
+    buf_len = 0;
+
+    for (int i = 0; i != 5; ++i) {
+	for (int j = 24; j >= 0; j -= 8) {
+	    result += static_cast<char>((h[i] >> j) & 0xff);
+	}
+    }
+}
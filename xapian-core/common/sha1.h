@@ -0,0 +1,79 @@
+/** @file sha1.h
+ * @brief Calculate SHA-1 message digests.
+ */
+/* Copyright (C) 2026 The Xapian contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef XAPIAN_INCLUDED_SHA1_H
+#define XAPIAN_INCLUDED_SHA1_H
+
+#include <cstddef>
+#include <string>
+
+#include "internaltypes.h"
+
+/// The size in bytes of a SHA-1 digest.
+#define SHA1_DIGEST_SIZE 20
+
+/** Calculate the SHA-1 digest of some data.
+ *
+ *  The data can be added in pieces by calling update() repeatedly.
+ */
+class SHA1 {
+    /// The intermediate hash value.
+    uint4 h[5];
+
+    /// Data which doesn't yet fill a whole 64 byte block.
+    unsigned char buf[64];
+
+    /// The number of bytes in buf.
+    size_t buf_len;
+
+    /// The total number of bytes added so far.
+    unsigned long long total_len;
+
+    /// Process the 64 byte block at @a p.
+    void process_block(const unsigned char * p);
+
+  public:
+    SHA1() { reset(); }
+
+    /// Start a new digest.
+    void reset();
+
+    /// Add @a len bytes at @a p to the data.
+    void update(const char * p, size_t len);
+
+    /** Append the digest of the data added to @a result.
+     *
+     *  SHA1_DIGEST_SIZE bytes are appended.  Call reset() before adding
+     *  any more data.
+     */
+    void append_digest(std::string & result);
+};
+
+/// Append the SHA-1 digest of @a len bytes at @a p to @a result.
+inline void
+append_sha1(std::string & result, const char * p, size_t len)
+{
+    SHA1 sha1;
+    sha1.update(p, len);
+    sha1.append_digest(result);
+}
+
+#endif // XAPIAN_INCLUDED_SHA1_H
@@ -194,6 +194,64 @@ const int DB_BACKEND_STUB	 = 0x300;
  */
 const int DB_BACKEND_INMEMORY	 = 0x400;
 
+/** Maintain an index to speed up spelling suggestions.
+ *
+ *  With this flag, a glass WritableDatabase also stores the spelling words
+ *  which each string made by deleting one or two characters from a spelling
+ *  word comes from.  Database::get_spelling_suggestion() can then find the
+ *  candidates within an edit distance of 2 by looking up the same deletions
+ *  of the word being corrected, instead of scoring every word which shares
+ *  trigrams with it.  The index takes significantly more space than the
+ *  trigrams.
+ *
+ *  When the index is built and how it's kept up to date is described under
+ *  "Optional Indexes" in the glass section of docs/admin_notes.rst.
+ */
+const int DB_SPELLING_INDEX	 = 0x1000;
+
+/** Maintain a dictionary of terms and their frequencies.
+ *
+ *  With this flag, a glass WritableDatabase also stores a compact sorted
+ *  dictionary of its terms with their term and collection frequencies.
+ *  Iterating the terms with a given prefix (e.g. Database::allterms_begin()
+ *  or expanding a wildcard or partial query) then reads this instead of
+ *  walking the keys of every chunk of every posting list.
+ *
+ *  The dictionary is built and maintained in the same way as the index for
+ *  Xapian::DB_SPELLING_INDEX.
+ */
+const int DB_TERM_DICTIONARY	 = 0x2000;
+
+/** Maintain precomputed completions for short prefixes.
+ *
+ *  With this flag, a glass WritableDatabase also stores the most frequent
+ *  terms starting with each prefix of up to 4 bytes, so that
+ *  Database::get_completions() and expanding a partial query or a wildcard
+ *  limited to the most frequent terms don't need to look at every term with
+ *  the prefix.  This flag implies Xapian::DB_TERM_DICTIONARY.
+ *
+ *  The completions are built and maintained in the same way as the index for
+ *  Xapian::DB_SPELLING_INDEX.
+ */
+const int DB_COMPLETIONS	 = 0x4000;
+
+/** Write posting lists in a packed format which is faster to decode.
+ *
+ *  With this flag, a glass WritableDatabase writes each chunk of a posting
+ *  list it changes in a block-packed format instead of a byte-wise variable
+ *  length encoding.  The packed format takes about the same space, but whole
+ *  blocks of entries can be decoded at once (using SSSE3 or AVX2 on x86 CPUs
+ *  which support them) and skip_to() can skip whole blocks without decoding
+ *  them.  Chunks in the original format are still read, so existing chunks
+ *  are converted as they're rewritten, or all at once by compacting with
+ *  Xapian::DBCOMPACT_PACKED_POSTLISTS.
+ *
+ *  Versions of Xapian without this flag can't read packed chunks.  How the
+ *  format is kept up to date is described under "Optional Indexes" in the
+ *  glass section of docs/admin_notes.rst.
+ */
+const int DB_PACKED_POSTLISTS	 = 0x8000;
+
 #ifdef XAPIAN_LIB_BUILD
 /** @internal Bit mask for backend codes. */
 const int DB_BACKEND_MASK_	 = 0x700;
@@ -267,6 +325,13 @@ const int DBCOMPACT_MULTIPASS = 8;
  */
 const int DBCOMPACT_SINGLE_FILE = 16;
 
+/** Write all the posting lists in the output in the packed format.
+ *
+ *  See Xapian::DB_PACKED_POSTLISTS.  The output is also packed without this
+ *  flag if any of the inputs is.  Only supported by the glass backend.
+ */
+const int DBCOMPACT_PACKED_POSTLISTS = 32;
+
 }
 
 #endif /* XAPIAN_INCLUDED_CONSTANTS_H */
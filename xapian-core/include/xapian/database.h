@@ -377,6 +377,25 @@ class XAPIAN_VISIBILITY_DEFAULT Database {
 	std::string get_spelling_suggestion(const std::string &word,
 					    unsigned max_edit_distance = 2) const;
 
+	/** Get the most frequent terms starting with a prefix.
+	 *
+	 *  This is intended for autocompletion.  If the database was built
+	 *  with Xapian::DB_COMPLETIONS then this can be answered for short
+	 *  prefixes without looking at every term which starts with @a prefix.
+	 *
+	 *  When searching several databases, the completions from each are
+	 *  combined, but if that doesn't determine the most frequent terms
+	 *  overall then every term with the prefix is looked at.
+	 *
+	 *  @param prefix	The prefix to complete.
+	 *  @param n		The maximum number of completions to return.
+	 *
+	 *  @return An iterator over the completions, most frequent first,
+	 *	    with the end of the list indicated by Xapian::TermIterator().
+	 */
+	Xapian::TermIterator get_completions(const std::string & prefix,
+					     Xapian::termcount n) const;
+
 	/** An iterator which returns all the spelling correction targets.
 	 *
 	 *  This returns all the words which are considered as targets for the
@@ -506,6 +525,40 @@ class XAPIAN_VISIBILITY_DEFAULT Database {
 	    return check_(NULL, fd, opts, out);
 	}
 
+	/** Set the memory limit of the process-wide block cache.
+	 *
+	 *  Read-only glass databases opened in the same process share a cache
+	 *  of the B-tree blocks they read, so that the same blocks (such as
+	 *  the interior blocks of each table) don't need to be read again for
+	 *  every Database object.  The cache is disabled unless a limit is
+	 *  set, either by calling this method or by setting
+	 *  XAPIAN_GLASS_BLOCK_CACHE_SIZE in the environment to a size in bytes.
+	 *
+	 *  Other backends don't use the cache.
+	 *
+	 *  @param max_size	The limit in bytes, or 0 to disable the cache
+	 *			(which also frees any cached blocks).
+	 */
+	static void set_block_cache_size(size_t max_size);
+
+	/// Get the memory limit of the process-wide block cache in bytes.
+	static size_t get_block_cache_size();
+
+	/** Get statistics for the process-wide block cache.
+	 *
+	 *  The counts are for the whole process, and aren't reset when the
+	 *  memory limit is changed.
+	 *
+	 *  @param[out] hits	The number of blocks found in the cache.
+	 *  @param[out] misses	The number of blocks looked for in the cache
+	 *			but not found, which were read from disk.
+	 *  @param[out] used	The memory currently used by cached blocks in
+	 *			bytes.
+	 */
+	static void get_block_cache_stats(unsigned long & hits,
+					  unsigned long & misses,
+					  size_t & used);
+
 	/** Produce a compact version of this database.
 	 *
 	 *  New 1.3.4.  Various methods of the Compactor class were deprecated
@@ -536,6 +589,9 @@ class XAPIAN_VISIBILITY_DEFAULT Database {
 	 *   - Xapian::DBCOMPACT_SINGLE_FILE
 	 *		Produce a single-file database (only supported for
 	 *		glass currently).
+	 *   - Xapian::DBCOMPACT_PACKED_POSTLISTS
+	 *		Write every posting list chunk in the packed format
+	 *		(only supported for glass).
 	 *
 	 *  @param block_size This specifies the block size (in bytes) for
 	 *		to use for the output.  For glass, the block size must
@@ -584,6 +640,9 @@ class XAPIAN_VISIBILITY_DEFAULT Database {
 	 *		Produce a single-file database (only supported for
 	 *		glass currently) - this flag is implied in this form
 	 *		and need not be specified explicitly.
+	 *   - Xapian::DBCOMPACT_PACKED_POSTLISTS
+	 *		Write every posting list chunk in the packed format
+	 *		(only supported for glass).
 	 *
 	 *  @param block_size This specifies the block size (in bytes) for
 	 *		to use for the output.  For glass, the block size must
@@ -630,6 +689,9 @@ class XAPIAN_VISIBILITY_DEFAULT Database {
 	 *   - Xapian::DBCOMPACT_SINGLE_FILE
 	 *		Produce a single-file database (only supported for
 	 *		glass currently).
+	 *   - Xapian::DBCOMPACT_PACKED_POSTLISTS
+	 *		Write every posting list chunk in the packed format
+	 *		(only supported for glass).
 	 *
 	 *  @param block_size This specifies the block size (in bytes) for
 	 *		to use for the output.  For glass, the block size must
@@ -685,6 +747,9 @@ class XAPIAN_VISIBILITY_DEFAULT Database {
 	 *		Produce a single-file database (only supported for
 	 *		glass currently) - this flag is implied in this form
 	 *		and need not be specified explicitly.
+	 *   - Xapian::DBCOMPACT_PACKED_POSTLISTS
+	 *		Write every posting list chunk in the packed format
+	 *		(only supported for glass).
 	 *
 	 *  @param block_size This specifies the block size (in bytes) for
 	 *		to use for the output.  For glass, the block size must
@@ -818,6 +883,15 @@ class XAPIAN_VISIBILITY_DEFAULT WritableDatabase : public Database {
 	 *  conservative, and if you have a machine with plenty of memory,
 	 *  you can improve indexing throughput dramatically by setting
 	 *  XAPIAN_FLUSH_THRESHOLD in the environment to a larger value.
+	 *  Alternatively, you can flush based on the memory used to buffer
+	 *  changes by setting XAPIAN_FLUSH_MEMORY in the environment (e.g. to
+	 *  512M) or by calling set_flush_memory().
+	 *
+	 *  With the glass backend, a commit of at least 1000 changed documents
+	 *  writes and syncs the database's tables using several threads.  The
+	 *  number of documents can be set with XAPIAN_PARALLEL_COMMIT_THRESHOLD
+	 *  in the environment, and setting it to 0 means threads are never
+	 *  used.
 	 *
 	 *  This method was new in Xapian 1.1.0 - in earlier versions it was
 	 *  called flush().
@@ -1168,6 +1242,29 @@ class XAPIAN_VISIBILITY_DEFAULT WritableDatabase : public Database {
 	 */
 	void set_metadata(const std::string & key, const std::string & value);
 
+	/** Set how much memory may be used to buffer changes.
+	 *
+	 *  Once the changes buffered in memory use approximately this many
+	 *  bytes, they are automatically committed (or just flushed if a
+	 *  transaction is active), in the same way as when the number of
+	 *  changed documents reaches XAPIAN_FLUSH_THRESHOLD.  This overrides
+	 *  XAPIAN_FLUSH_MEMORY in the environment, which accepts a K, M or G
+	 *  suffix (e.g. XAPIAN_FLUSH_MEMORY=512M).
+	 *
+	 *  While a memory limit is set, the default threshold of 10000
+	 *  changed documents isn't used, but XAPIAN_FLUSH_THRESHOLD is still
+	 *  honoured if explicitly set.
+	 *
+	 *  The limit applies separately to each sub-database.  Backends which
+	 *  don't buffer changes ignore it, as does the remote backend (set
+	 *  XAPIAN_FLUSH_MEMORY in the environment of the server instead).
+	 *
+	 *  @param bytes	The approximate memory limit in bytes, or 0 to
+	 *			only flush based on the number of changed
+	 *			documents.
+	 */
+	void set_flush_memory(size_t bytes);
+
 	/// Return a string describing this object.
 	std::string get_description() const;
 };
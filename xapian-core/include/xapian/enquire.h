@@ -619,6 +619,83 @@ class XAPIAN_VISIBILITY_DEFAULT Enquire {
 	 */
 	void set_time_limit(double time_limit);
 
+	/** Match the sub-databases of a combined database in parallel.
+	 *
+	 *  When the Database being searched is made up of several local
+	 *  sub-databases, the matcher normally considers their documents one
+	 *  sub-database after another.  This method allows the sub-databases
+	 *  to be matched concurrently by a number of threads, with the results
+	 *  from each combined at the end.  The MSet returned contains the same
+	 *  documents with the same weights as for a serial match, though the
+	 *  estimates of the number of matches may differ slightly.
+	 *
+	 *  @param n_threads  maximum number of threads to use (including the
+	 *		      calling thread).  The default of 0 (or 1) means
+	 *		      to match the sub-databases one after another.
+	 *
+	 *  Limitations:
+	 *
+	 *  Parallel matching is currently only used when sorting by relevance
+	 *  without collapsing, a percentage cutoff, a MatchDecider or any
+	 *  MatchSpy objects, and when none of the sub-databases are remote -
+	 *  in other cases the sub-databases are matched serially.  Any
+	 *  PostingSource subclasses used in the query must implement clone().
+	 */
+	void set_parallel_shards(unsigned n_threads);
+
+	/** Set how long to wait for remote sub-databases to return results.
+	 *
+	 *  When the Database being searched includes several remote
+	 *  sub-databases, the requests are sent to all of them before waiting
+	 *  for any replies, so the time taken is that of the slowest.  This
+	 *  method allows the match to give up on any remote sub-databases
+	 *  which haven't returned their results in time, and to return an MSet
+	 *  built from the other sub-databases.  MSet::is_partial() reports
+	 *  whether this happened.
+	 *
+	 *  @param timeout  time in seconds to wait for the results after
+	 *		    they've been requested.  The default of 0.0 means
+	 *		    to wait as long as the timeout of the remote databases
+	 *		    allows (which is an error if exceeded).
+	 *
+	 *  Limitations:
+	 *
+	 *  The timeout doesn't cover the initial exchange of statistics, and
+	 *  isn't used if the only sub-database is remote.  The next operation
+	 *  on a sub-database which was dropped waits for the dropped results
+	 *  to arrive first.
+	 */
+	void set_remote_timeout(double timeout);
+
+	/** Fetch the top documents from remote sub-databases with the results.
+	 *
+	 *  Normally the data and values of a document in the MSet are read
+	 *  from a remote sub-database when they're asked for, which takes a
+	 *  round trip to the server (though MSet::fetch() allows these to be
+	 *  overlapped).  This method asks the servers to send the documents
+	 *  for the top of the MSet along with the results instead.
+	 *
+	 *  When several remote sub-databases are searched, each server also
+	 *  has to be told the global statistics.  If each has already sent its
+	 *  statistics for the query's terms in an earlier search, the query is
+	 *  sent with a guess at the global statistics made from those, which
+	 *  saves a round trip (and if the guess is wrong, the query is
+	 *  automatically run again).  Otherwise the statistics are exchanged
+	 *  as usual and the documents aren't sent with the results.
+	 *
+	 *  @param n_docs  the number of documents from the start of the MSet
+	 *		   to fetch.  The default is 0.
+	 *
+	 *  Limitations:
+	 *
+	 *  This needs the servers to support remote protocol 39.5.  With
+	 *  several sub-databases, each server sends its top first + n_docs
+	 *  documents as it doesn't know which of them will be in the MSet.
+	 *  A document is only taken from those sent once - if it's read
+	 *  again, it's fetched from the server as usual.
+	 */
+	void set_remote_prefetch(Xapian::doccount n_docs);
+
 	/** Get (a portion of) the match set for the current query.
 	 *
 	 *  @param first     the first item in the result set to return.
@@ -95,6 +95,14 @@ class XAPIAN_VISIBILITY_DEFAULT MSet {
     double get_max_attained() const;
     double get_max_possible() const;
 
+    /** Were any sub-databases left out of this MSet?
+     *
+     *  This is true if a remote sub-database didn't return its results
+     *  within the time set by Enquire::set_remote_timeout(), in which case
+     *  the MSet only contains results from the other sub-databases.
+     */
+    bool is_partial() const;
+
     enum {
 	SNIPPET_BACKGROUND_MODEL = 1,
 	SNIPPET_EXHAUSTIVE = 2
@@ -53,6 +53,9 @@ class XAPIAN_VISIBILITY_DEFAULT Registry {
     /// @internal Reference counted internals.
     Xapian::Internal::intrusive_ptr<Internal> internal;
 
+    /// @internal Construct from internals.
+    explicit Registry(Internal * internal_);
+
   public:
     /** Copy constructor.
      *
@@ -79,6 +82,14 @@ class XAPIAN_VISIBILITY_DEFAULT Registry {
 
     ~Registry();
 
+    /** @private @internal Make a copy which doesn't share its internals.
+     *
+     *  The registered objects are cloned, so unlike copies made with the
+     *  copy constructor, the new Registry can be used in a different thread
+     *  to this one.
+     */
+    Registry clone_internals() const;
+
     /** Register a weighting scheme.
      *
      *  @param wt	The weighting scheme to register.
@@ -3,6 +3,7 @@
  */
 /* Copyright (C) 2005,2007,2010,2011,2013,2014,2015 Olly Betts
  * Copyright (C) 2010 Evgeny Sizikov
+ * Copyright (C) 2026 The Xapian contributors
  *
  * This program is free software; you can redistribute it and/or
  * modify it under the terms of the GNU General Public License as
@@ -138,6 +139,32 @@ class XAPIAN_VISIBILITY_DEFAULT Stem {
      */
     std::string operator()(const std::string &word) const;
 
+    /** Set the size of the cache of stemmed words.
+     *
+     *  Text in a natural language contains the same words over and over, so
+     *  remembering the stems of the words seen recently avoids running the
+     *  stemming algorithm again for most of them.  By default there's no
+     *  cache.
+     *
+     *  The cache isn't copy-on-write: copies of this object made after this
+     *  call (such as the copy made by TermGenerator::set_stemmer() or
+     *  QueryParser::set_stemmer()) share one mutable cache with it, and
+     *  stemming a word with any of them can update that cache.  Copies made
+     *  before this call are unaffected, as this always installs a new cache
+     *  (or removes it) rather than changing the shared one.
+     *
+     *  The cache isn't protected by a lock, so this object and the copies
+     *  sharing its cache mustn't be used in more than one thread at once.
+     *  That's already the case without a cache, since copies also share the
+     *  state of the stemming algorithm.  To stem in several threads,
+     *  construct a separate Stem object in each thread and set the cache
+     *  size on each.
+     *
+     *  @param size	The maximum number of words to remember (0 to turn
+     *			off the cache).
+     */
+    void set_cache_size(unsigned size);
+
     /// Return a string describing this object.
     std::string get_description() const;
 
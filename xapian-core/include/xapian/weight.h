@@ -230,6 +230,19 @@ class XAPIAN_VISIBILITY_DEFAULT Weight {
      */
     virtual double get_maxpart() const = 0;
 
+    /** Return an upper bound on what get_sumpart() can return for any
+     *  document in which the term's wdf is at most @a wdf_max.
+     *
+     *  Backends which store the highest wdf in each block of a posting list
+     *  use this to skip whole blocks which can't contain a document weighty
+     *  enough to matter.  The default implementation returns get_maxpart(),
+     *  which is always a valid bound, so subclasses need only override this
+     *  if they can calculate a tighter one.
+     *
+     *  @param wdf_max	Upper bound on the wdf.
+     */
+    virtual double get_maxpart_for_wdf(Xapian::termcount wdf_max) const;
+
     /** Calculate the term-independent weight component for a document.
      *
      *  The parameter gives information about the document which may be used
@@ -584,6 +597,7 @@ class XAPIAN_VISIBILITY_DEFAULT BM25Weight : public Weight {
 		       Xapian::termcount doclen,
 		       Xapian::termcount uniqterm) const;
     double get_maxpart() const;
+    double get_maxpart_for_wdf(Xapian::termcount wdf_max) const;
 
     double get_sumextra(Xapian::termcount doclen,
 			Xapian::termcount uniqterms) const;
@@ -645,6 +659,7 @@ class XAPIAN_VISIBILITY_DEFAULT TradWeight : public Weight {
 		       Xapian::termcount doclen,
 		       Xapian::termcount uniqueterms) const;
     double get_maxpart() const;
+    double get_maxpart_for_wdf(Xapian::termcount wdf_max) const;
 
     double get_sumextra(Xapian::termcount doclen,
 			Xapian::termcount uniqterms) const;
@@ -3,6 +3,7 @@
  */
 /* Copyright (C) 2007,2008,2010,2011,2012,2015 Olly Betts
  * Copyright (C) 2010 Evgeny Sizikov
+ * Copyright (C) 2026 The Xapian contributors
  *
  * This program is free software; you can redistribute it and/or
  * modify it under the terms of the GNU General Public License as
@@ -30,10 +31,56 @@
 #include "keyword.h"
 #include "sbl-dispatch.h"
 
+#include <functional>
 #include <string>
+#include <utility>
+#include <vector>
 
 using namespace std;
 
+/// Wrapper which remembers the stems of recently stemmed words.
+class CachingStemImplementation : public Xapian::StemImplementation {
+    /// The stemming algorithm being wrapped.
+    Xapian::Internal::intrusive_ptr<Xapian::StemImplementation> stemmer;
+
+    /** The cached (word, stem) pairs.
+     *
+     *  A word can only be cached in the slot its hash selects, so a lookup
+     *  is cheap and needs no bookkeeping, and a cached word is just replaced
+     *  when a different word needs its slot.  An empty word marks an unused
+     *  slot (Xapian::Stem never passes an empty word to its implementation).
+     */
+    vector<pair<string, string>> slots;
+
+  public:
+    CachingStemImplementation(Xapian::StemImplementation * stemmer_,
+			      unsigned size)
+	: stemmer(stemmer_), slots(size) { }
+
+    /// Return the stemming algorithm being wrapped.
+    Xapian::StemImplementation * get_stemmer() const {
+	return stemmer.get();
+    }
+
+    string operator()(const string & word) {
+	pair<string, string> & slot =
+	    slots[hash<string>()(word) % slots.size()];
+	if (slot.first != word) {
+	    string stem = (*stemmer)(word);
+	    // Mark the slot unused while we update it, in case an exception
+	    // is thrown.
+	    slot.first.resize(0);
+	    slot.second = stem;
+	    slot.first = word;
+	}
+	return slot.second;
+    }
+
+    string get_description() const {
+	return stemmer->get_description();
+    }
+};
+
 namespace Xapian {
 
 Stem::Stem(const Stem & o) : internal(o.internal) { }
@@ -143,6 +190,23 @@ Stem::operator()(const std::string &word) const
     return internal->operator()(word);
 }
 
+void
+Stem::set_cache_size(unsigned size)
+{
+    StemImplementation * impl = internal.get();
+    if (!impl) return;
+    CachingStemImplementation * cache =
+	dynamic_cast<CachingStemImplementation *>(impl);
+    if (cache) impl = cache->get_stemmer();
+    // Always make a new object rather than resizing an existing cache, since
+    // that may be shared with copies of this object.
+    if (size) {
+	internal = new CachingStemImplementation(impl, size);
+    } else {
+	internal = impl;
+    }
+}
+
 string
 Stem::get_description() const
 {
@@ -139,6 +139,13 @@ ConstDatabaseWrapper::open_allterms(const string & prefix) const
     return realdb->open_allterms(prefix);
 }
 
+TermList *
+ConstDatabaseWrapper::open_completions(const string & prefix,
+				       Xapian::termcount n) const
+{
+    return realdb->open_completions(prefix, n);
+}
+
 PositionList *
 ConstDatabaseWrapper::open_position_list(Xapian::docid did,
 					 const string & tname) const
@@ -158,6 +165,13 @@ ConstDatabaseWrapper::open_spelling_termlist(const string & word) const
     return realdb->open_spelling_termlist(word);
 }
 
+TermList *
+ConstDatabaseWrapper::open_spelling_candidates(const string & word,
+					       unsigned max_edit_distance) const
+{
+    return realdb->open_spelling_candidates(word, max_edit_distance);
+}
+
 TermList *
 ConstDatabaseWrapper::open_spelling_wordlist() const
 {
@@ -339,7 +353,7 @@ ConstDatabaseWrapper::replace_document(const string &,
 
 void
 ConstDatabaseWrapper::write_changesets_to_fd(int, const std::string &, bool,
-					     Xapian::ReplicationInfo *)
+					     Xapian::ReplicationInfo *, bool)
 {
     nonconst_access();
 }
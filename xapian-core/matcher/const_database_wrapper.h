@@ -66,11 +66,15 @@ class ConstDatabaseWrapper : public Xapian::Database::Internal {
     ValueList * open_value_list(Xapian::valueno slot) const;
     TermList * open_term_list(Xapian::docid did) const;
     TermList * open_allterms(const string & prefix) const;
+    TermList * open_completions(const string & prefix,
+				Xapian::termcount n) const;
     PositionList * open_position_list(Xapian::docid did,
 				      const string & tname) const;
     Xapian::Document::Internal *
 	open_document(Xapian::docid did, bool lazy) const;
     TermList * open_spelling_termlist(const string & word) const;
+    TermList * open_spelling_candidates(const string & word,
+					unsigned max_edit_distance) const;
     TermList * open_spelling_wordlist() const;
     Xapian::doccount get_spelling_frequency(const string & word) const;
     TermList * open_synonym_termlist(const string & term) const;
@@ -104,7 +108,7 @@ class ConstDatabaseWrapper : public Xapian::Database::Internal {
     void replace_document(Xapian::docid, const Xapian::Document &);
     Xapian::docid replace_document(const string &, const Xapian::Document &);
     void write_changesets_to_fd(int, const std::string &, bool,
-				Xapian::ReplicationInfo *);
+				Xapian::ReplicationInfo *, bool);
 };
 
 #endif /* XAPIAN_INCLUDED_CONST_DATABASE_WRAPPER_H */
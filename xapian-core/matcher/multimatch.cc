@@ -47,6 +47,7 @@
 #include "valuestreamdocument.h"
 #include "weight/weightinternal.h"
 
+#include <xapian/error.h>
 #include <xapian/matchspy.h>
 #include <xapian/version.h> // For XAPIAN_HAS_REMOTE_BACKEND
 
@@ -56,8 +57,12 @@
 #endif /* XAPIAN_HAS_REMOTE_BACKEND */
 
 #include <algorithm>
+#include <atomic>
 #include <cfloat> // For DBL_EPSILON.
 #include <climits> // For UINT_MAX.
+#include <exception>
+#include <system_error>
+#include <thread>
 #include <vector>
 #include <map>
 #include <set>
@@ -149,6 +154,27 @@ const Xapian::Enquire::Internal::sort_setting VAL_REL =
 	Xapian::Enquire::Internal::VAL_REL;
 #endif
 
+/// The results of matching one sub-database in a parallel match.
+struct ShardResult {
+    /// The best items found in this sub-database (not sorted).
+    vector<Xapian::Internal::MSetItem> items;
+
+    /// Number of documents which were considered.
+    Xapian::doccount docs_matched;
+
+    /// The greatest weight seen in this sub-database.
+    double greatest_wt;
+
+    /// Number of subqueries matched by the document with greatest_wt.
+    Xapian::termcount greatest_wt_subqs_matched;
+
+    /// Any exception thrown while matching this sub-database.
+    std::exception_ptr error;
+
+    ShardResult()
+	: docs_matched(0), greatest_wt(0), greatest_wt_subqs_matched(0) { }
+};
+
 /** Split an RSet into several sub rsets, one for each database.
  *
  *  @param rset The RSet to split.
@@ -189,6 +215,40 @@ split_rset_by_db(const Xapian::RSet * rset,
     Assert(subrsets.size() == number_of_subdbs);
 }
 
+#ifdef XAPIAN_HAS_REMOTE_BACKEND
+/** Wait until any of several remote submatches has a reply to read.
+ *
+ *  @param matches   The remote submatches to wait on.
+ *  @param end_time  Give up waiting at this time (0.0 for no limit).
+ *
+ *  @return false if end_time was reached.  If the timeout of the remote
+ *	    databases is reached first, Xapian::NetworkTimeoutError is thrown.
+ */
+static bool
+wait_for_remote(const vector<RemoteSubMatch *> & matches, double end_time)
+{
+    LOGCALL_STATIC(MATCH, bool, "wait_for_remote", matches.size() | end_time);
+    vector<const RemoteDatabase *> dbs;
+    // Wait as long as the database with the longest timeout would.
+    double timeout = 0.0;
+    for (size_t i = 0; i != matches.size(); ++i) {
+	const RemoteDatabase * rem_db = matches[i]->get_database();
+	dbs.push_back(rem_db);
+	double t = rem_db->get_timeout();
+	if (i == 0 || (timeout != 0.0 && (t == 0.0 || t > timeout)))
+	    timeout = t;
+    }
+    double db_end_time = RealTime::end_time(timeout);
+    bool db_first = (end_time == 0.0 ||
+		     (db_end_time != 0.0 && db_end_time < end_time));
+    if (RemoteDatabase::wait_to_read(dbs, db_first ? db_end_time : end_time))
+	RETURN(true);
+    if (db_first)
+	throw Xapian::NetworkTimeoutError("Timeout expired while waiting for remote databases");
+    RETURN(false);
+}
+#endif
+
 /** Prepare some SubMatches.
  *
  *  This calls the prepare_match() method on each SubMatch object, causing them
@@ -196,16 +256,15 @@ split_rset_by_db(const Xapian::RSet * rset,
  *
  *  This method is rather complicated in order to handle remote matches
  *  efficiently.  Instead of simply calling "prepare_match()" on each submatch
- *  and waiting for it to return, it first calls "prepare_match(true)" on each
+ *  and waiting for it to return, it calls "prepare_match(true)" on each
  *  submatch.  If any of these calls return false, indicating that the required
- *  information has not yet been received from the server, the method will try
- *  those which returned false again, passing "false" as a parameter to
- *  indicate that they should block until the information is ready.
+ *  information has not yet been received from the server, the method waits
+ *  until any of those servers has replied and then tries them again.
  *
  *  This should improve performance in the case of mixed local-and-remote
  *  searches - the local searchers will all fetch their statistics from disk
- *  without waiting for the remote searchers, so as soon as the remote searcher
- *  statistics arrive, we can move on to the next step.
+ *  without waiting for the remote searchers, and the statistics from the
+ *  remote searchers are handled in the order they arrive in.
  */
 static void
 prepare_sub_matches(vector<intrusive_ptr<SubMatch> > & leaves,
@@ -216,19 +275,27 @@ prepare_sub_matches(vector<intrusive_ptr<SubMatch> > & leaves,
     vector<bool> prepared;
     prepared.resize(leaves.size(), false);
     size_t unprepared = leaves.size();
-    bool nowait = true;
-    while (unprepared) {
+    while (true) {
+#ifdef XAPIAN_HAS_REMOTE_BACKEND
+	vector<RemoteSubMatch *> waiting;
+#endif
 	for (size_t leaf = 0; leaf < leaves.size(); ++leaf) {
 	    if (prepared[leaf]) continue;
 	    SubMatch * submatch = leaves[leaf].get();
-	    if (!submatch || submatch->prepare_match(nowait, stats)) {
+	    if (!submatch || submatch->prepare_match(true, stats)) {
 		prepared[leaf] = true;
 		--unprepared;
+		continue;
 	    }
+#ifdef XAPIAN_HAS_REMOTE_BACKEND
+	    // Only remote submatches need to wait.
+	    waiting.push_back(static_cast<RemoteSubMatch*>(submatch));
+#endif
 	}
-	// Use blocking IO on subsequent passes, so that we don't go into
-	// a tight loop.
-	nowait = false;
+	if (!unprepared) break;
+#ifdef XAPIAN_HAS_REMOTE_BACKEND
+	(void)wait_for_remote(waiting, 0.0);
+#endif
     }
 }
 
@@ -272,6 +339,9 @@ MultiMatch::MultiMatch(const Xapian::Database &db_,
 		       Xapian::Enquire::Internal::sort_setting sort_by_,
 		       bool sort_value_forward_,
 		       double time_limit_,
+		       unsigned parallel_shards_,
+		       double remote_timeout_,
+		       Xapian::doccount remote_prefetch_,
 		       Xapian::Weight::Internal & stats,
 		       const Xapian::Weight * weight_,
 		       const vector<Xapian::Internal::opt_intrusive_ptr<Xapian::MatchSpy>> & matchspies_,
@@ -283,11 +353,16 @@ MultiMatch::MultiMatch(const Xapian::Database &db_,
 	  sort_key(sort_key_), sort_by(sort_by_),
 	  sort_value_forward(sort_value_forward_),
 	  time_limit(time_limit_),
+	  parallel_shards(parallel_shards_),
+	  remote_timeout(remote_timeout_),
+	  remote_prefetch(remote_prefetch_),
 	  weight(weight_),
 	  is_remote(db.internal.size()),
+	  single_remote_query_mset(false),
+	  pipelined_remote_query(false),
 	  matchspies(matchspies_)
 {
-    LOGCALL_CTOR(MATCH, "MultiMatch", db_ | query_ | qlen | omrset | collapse_max_ | collapse_key_ | percent_cutoff_ | weight_cutoff_ | int(order_) | sort_key_ | int(sort_by_) | sort_value_forward_ | time_limit_| stats | weight_ | matchspies_ | have_sorter | have_mdecider);
+    LOGCALL_CTOR(MATCH, "MultiMatch", db_ | query_ | qlen | omrset | collapse_max_ | collapse_key_ | percent_cutoff_ | weight_cutoff_ | int(order_) | sort_key_ | int(sort_by_) | sort_value_forward_ | time_limit_| parallel_shards_ | remote_timeout_ | remote_prefetch_ | stats | weight_ | matchspies_ | have_sorter | have_mdecider);
 
     if (query.empty()) return;
 
@@ -335,10 +410,70 @@ MultiMatch::MultiMatch(const Xapian::Database &db_,
     }
 
     stats.set_query(query);
-    prepare_sub_matches(leaves, stats);
+#ifdef XAPIAN_HAS_REMOTE_BACKEND
+    // If all the databases are remote, get_mset() may be able to send the
+    // query, the global statistics and the request for the MSet to each in a
+    // single message, which saves a round trip.
+    bool all_pipelined = true;
+    for (size_t i = 0; i != leaves.size(); ++i) {
+	if (!is_remote[i] ||
+	    !static_cast<RemoteSubMatch*>(leaves[i].get())->supports_pipelined_match()) {
+	    all_pipelined = false;
+	    break;
+	}
+    }
+    if (leaves.size() == 1 && is_remote[0]) {
+	// With only one database, its statistics are the global statistics,
+	// and the MSet which comes back has them in it.  Unless we want the
+	// documents too, the older MSG_QUERYMSET does that.
+	RemoteSubMatch * rem_match =
+	    static_cast<RemoteSubMatch*>(leaves[0].get());
+	if (all_pipelined && remote_prefetch) {
+	    pipelined_remote_query = true;
+	} else {
+	    single_remote_query_mset = rem_match->supports_query_mset();
+	}
+    } else if (all_pipelined && (!omrset || omrset->empty())) {
+	// With several databases, we guess the global statistics from those
+	// each server sent for earlier queries.  If we haven't seen them all,
+	// exchange statistics as usual, which means we'll have them next time.
+	// With an RSet, the relevant term frequencies can't be guessed.
+	stats_hint.set_query(query);
+	pipelined_remote_query = true;
+	for (auto && leaf : leaves) {
+	    RemoteSubMatch * rem_match = static_cast<RemoteSubMatch*>(leaf.get());
+	    if (!rem_match->add_cached_stats(stats_hint)) {
+		pipelined_remote_query = false;
+		break;
+	    }
+	}
+    }
+    if (!single_remote_query_mset && !pipelined_remote_query)
+#endif
+	prepare_sub_matches(leaves, stats);
     stats.set_bounds_from_db(db);
 }
 
+MultiMatch::MultiMatch(const MultiMatch * parent)
+	: db(parent->db), query(parent->query),
+	  collapse_max(0), collapse_key(Xapian::BAD_VALUENO),
+	  percent_cutoff(0), weight_cutoff(parent->weight_cutoff),
+	  order(parent->order),
+	  sort_key(Xapian::BAD_VALUENO), sort_by(parent->sort_by),
+	  sort_value_forward(parent->sort_value_forward),
+	  time_limit(0.0),
+	  parallel_shards(0),
+	  remote_timeout(0.0),
+	  remote_prefetch(0),
+	  weight(parent->weight),
+	  recalculate_w_max(false),
+	  single_remote_query_mset(false),
+	  pipelined_remote_query(false),
+	  matchspies(parent->matchspies)
+{
+    LOGCALL_CTOR(MATCH, "MultiMatch", parent);
+}
+
 double
 MultiMatch::getorrecalc_maxweight(PostList *pl)
 {
@@ -357,6 +492,321 @@ MultiMatch::getorrecalc_maxweight(PostList *pl)
     RETURN(wt);
 }
 
+#ifdef XAPIAN_HAS_REMOTE_BACKEND
+/// Are the statistics the same (apart from the bounds and max_part)?
+static bool
+same_stats(const Xapian::Weight::Internal & a,
+	   const Xapian::Weight::Internal & b)
+{
+    if (a.total_length != b.total_length ||
+	a.collection_size != b.collection_size ||
+	a.rset_size != b.rset_size ||
+	a.total_term_count != b.total_term_count ||
+	a.termfreqs.size() != b.termfreqs.size())
+	return false;
+    auto j = b.termfreqs.begin();
+    for (auto && i : a.termfreqs) {
+	if (i.first != j->first ||
+	    i.second.termfreq != j->second.termfreq ||
+	    i.second.reltermfreq != j->second.reltermfreq ||
+	    i.second.collfreq != j->second.collfreq)
+	    return false;
+	++j;
+    }
+    return true;
+}
+#endif
+
+void
+MultiMatch::start_pipelined_matches(Xapian::doccount first,
+				    Xapian::doccount maxitems,
+				    Xapian::doccount check_at_least,
+				    Xapian::Weight::Internal & stats)
+{
+    LOGCALL_VOID(MATCH, "MultiMatch::start_pipelined_matches", first | maxitems | check_at_least | stats);
+#ifdef XAPIAN_HAS_REMOTE_BACKEND
+    // Each database could provide any of the documents in the MSet, so each
+    // needs to send those which would be the first "remote_prefetch" in the
+    // MSet if all the others matched nothing.
+    Xapian::doccount n_docs = 0;
+    if (remote_prefetch)
+	n_docs = first + min(remote_prefetch, maxitems);
+    for (auto && leaf : leaves) {
+	RemoteSubMatch * rem_match = static_cast<RemoteSubMatch*>(leaf.get());
+	rem_match->start_pipelined_match(0, first + maxitems,
+					 first + check_at_least, n_docs,
+					 &stats_hint);
+    }
+
+    // Each server sends its statistics before its MSet, so check the guess
+    // was right.
+    prepare_sub_matches(leaves, stats);
+    if (same_stats(stats, stats_hint)) return;
+
+    // The guess was wrong (probably because one of the databases has been
+    // reopened at a new revision), so the MSets are no good.  Run the query
+    // again with the actual global statistics.
+    LOGLINE(MATCH, "Statistics hint was wrong - running query again");
+    for (auto && leaf : leaves) {
+	static_cast<RemoteSubMatch*>(leaf.get())->discard_mset();
+    }
+    for (auto && leaf : leaves) {
+	RemoteSubMatch * rem_match = static_cast<RemoteSubMatch*>(leaf.get());
+	rem_match->start_pipelined_match(0, first + maxitems,
+					 first + check_at_least, n_docs,
+					 &stats);
+    }
+    Xapian::Weight::Internal check;
+    check.set_query(query);
+    prepare_sub_matches(leaves, check);
+    if (!same_stats(check, stats)) {
+	throw Xapian::DatabaseModifiedError("A remote database changed while it was being searched");
+    }
+#else
+    (void)first;
+    (void)maxitems;
+    (void)check_at_least;
+    (void)stats;
+#endif
+}
+
+bool
+MultiMatch::collect_remote_msets()
+{
+    LOGCALL(MATCH, bool, "MultiMatch::collect_remote_msets", NO_ARGS);
+#ifdef XAPIAN_HAS_REMOTE_BACKEND
+    // The requests have been sent to all the remote sub-databases, so read
+    // the replies in the order they arrive in rather than one after another.
+    vector<RemoteSubMatch *> waiting;
+    for (size_t i = 0; i != leaves.size(); ++i) {
+	if (is_remote[i])
+	    waiting.push_back(static_cast<RemoteSubMatch*>(leaves[i].get()));
+    }
+
+    double end_time = RealTime::end_time(remote_timeout);
+    bool partial = false;
+    while (true) {
+	for (size_t j = waiting.size(); j-- > 0; ) {
+	    if (waiting[j]->ready_to_read()) {
+		try {
+		    // The start of the reply being ready doesn't mean the rest
+		    // of it will arrive in time.
+		    waiting[j]->receive_mset(end_time);
+		} catch (const Xapian::NetworkTimeoutError &) {
+		    if (end_time == 0.0 || RealTime::now() < end_time) throw;
+		    LOGLINE(MATCH, "Dropping remote sub-database which didn't "
+				   "finish replying in time");
+		    waiting[j]->drop_mset();
+		    partial = true;
+		}
+		waiting[j] = waiting.back();
+		waiting.pop_back();
+	    }
+	}
+	if (waiting.empty()) break;
+	if (!wait_for_remote(waiting, end_time)) {
+	    LOGLINE(MATCH, "Dropping " << waiting.size() << " remote "
+			   "sub-databases which didn't reply in time");
+	    for (RemoteSubMatch * rem_match : waiting) {
+		rem_match->drop_mset();
+	    }
+	    RETURN(true);
+	}
+    }
+    RETURN(partial);
+#else
+    RETURN(false);
+#endif
+}
+
+bool
+MultiMatch::can_match_in_parallel(const Xapian::MatchDecider * mdecider) const
+{
+    LOGCALL(MATCH, bool, "MultiMatch::can_match_in_parallel", mdecider);
+    if (parallel_shards <= 1 || leaves.size() <= 1)
+	RETURN(false);
+    if (sort_by != REL || collapse_max || percent_cutoff ||
+	mdecider || !matchspies.empty())
+	RETURN(false);
+    for (size_t i = 0; i != leaves.size(); ++i) {
+	if (is_remote[i]) RETURN(false);
+	// The same database can be added more than once, and the state it
+	// holds for reading postlists can't be shared between threads.
+	for (size_t j = 0; j != i; ++j) {
+	    if (db.internal[i] == db.internal[j]) RETURN(false);
+	}
+    }
+    RETURN(true);
+}
+
+void
+MultiMatch::match_shard(AutoPtr<PostList> & pl,
+			Xapian::doccount shard,
+			Xapian::doccount n_shards,
+			Xapian::doccount max_msize,
+			Xapian::doccount maxitems,
+			Xapian::doccount check_at_least,
+			const TimeOut & timeout,
+			ShardResult & result)
+{
+    LOGCALL_VOID(MATCH, "MultiMatch::match_shard", pl.get() | shard | n_shards | max_msize | maxitems | check_at_least | Literal("timeout") | Literal("result"));
+    Assert(sort_by == REL);
+
+    vector<Xapian::Internal::MSetItem> & items = result.items;
+    items.reserve(max_msize + 1);
+
+    const double max_possible = pl->recalc_maxweight();
+    recalculate_w_max = false;
+
+    double min_weight = weight_cutoff;
+    bool sort_forward = (order != Xapian::Enquire::DESCENDING);
+    MSetCmp mcmp(get_msetcmp_function(sort_by, sort_forward, sort_value_forward));
+    bool is_heap = false;
+
+    // This is the relevance-only subset of the loop in get_mset(), which
+    // works on the docids of this sub-database and maps them to docids in
+    // the combined database for the MSet.
+    while (true) {
+	if (rare(recalculate_w_max)) {
+	    if (min_weight > 0.0) {
+		if (rare(getorrecalc_maxweight(pl.get()) < min_weight)) {
+		    LOGLINE(MATCH, "*** TERMINATING EARLY (1)");
+		    break;
+		}
+	    }
+	}
+
+	PostList * pl_copy = pl.get();
+	if (rare(next_handling_prune(pl_copy, min_weight, this))) {
+	    (void)pl.release();
+	    pl.reset(pl_copy);
+	    LOGLINE(MATCH, "*** REPLACING ROOT");
+
+	    if (min_weight > 0.0) {
+		if (rare(getorrecalc_maxweight(pl.get()) < min_weight)) {
+		    LOGLINE(MATCH, "*** TERMINATING EARLY (2)");
+		    break;
+		}
+	    }
+	}
+
+	if (rare(pl->at_end())) {
+	    LOGLINE(MATCH, "Reached end of potential matches");
+	    break;
+	}
+
+	double wt = pl->get_weight();
+	if (wt < min_weight) {
+	    LOGLINE(MATCH, "Rejecting potential match due to insufficient weight");
+	    continue;
+	}
+
+	Xapian::docid did = (pl->get_docid() - 1) * n_shards + shard + 1;
+	LOGLINE(MATCH, "Candidate document id " << did << " wt " << wt);
+	if (check_at_least > maxitems && timeout.timed_out()) {
+	    check_at_least = maxitems;
+	}
+
+	++result.docs_matched;
+	if (items.size() >= max_msize) {
+	    items.push_back(Xapian::Internal::MSetItem(wt, did));
+	    if (!is_heap) {
+		is_heap = true;
+		make_heap(items.begin(), items.end(), mcmp);
+	    } else {
+		push_heap<vector<Xapian::Internal::MSetItem>::iterator,
+			  MSetCmp>(items.begin(), items.end(), mcmp);
+	    }
+	    pop_heap<vector<Xapian::Internal::MSetItem>::iterator,
+		     MSetCmp>(items.begin(), items.end(), mcmp);
+	    items.pop_back();
+
+	    if (result.docs_matched >= check_at_least) {
+		// The docids from one sub-database arrive in ascending order,
+		// so a forward boolean match of it is done once we have
+		// enough items.
+		if (rare(max_possible == 0 && sort_forward)) break;
+		const Xapian::Internal::MSetItem & min_item = items.front();
+		if (min_item.wt > min_weight) {
+		    LOGLINE(MATCH, "Setting min_weight to " <<
+			    min_item.wt << " from " << min_weight);
+		    min_weight = min_item.wt;
+		}
+	    }
+	    if (rare(getorrecalc_maxweight(pl.get()) < min_weight)) {
+		LOGLINE(MATCH, "*** TERMINATING EARLY (3)");
+		break;
+	    }
+	} else {
+	    items.push_back(Xapian::Internal::MSetItem(wt, did));
+	    is_heap = false;
+	    if (items.size() == max_msize &&
+		result.docs_matched >= check_at_least) {
+		if (rare(max_possible == 0 && sort_forward)) break;
+	    }
+	}
+
+	// Keep a track of the greatest weight we've seen.
+	if (wt > result.greatest_wt) {
+	    result.greatest_wt = wt;
+	    result.greatest_wt_subqs_matched = pl->count_matching_subqs();
+	}
+    }
+}
+
+void
+MultiMatch::match_shards_in_parallel(vector<AutoPtr<PostList>> & postlists,
+				     vector<AutoPtr<MultiMatch>> & shard_matchers,
+				     Xapian::doccount max_msize,
+				     Xapian::doccount maxitems,
+				     Xapian::doccount check_at_least,
+				     const TimeOut & timeout,
+				     vector<ShardResult> & results)
+{
+    LOGCALL_VOID(MATCH, "MultiMatch::match_shards_in_parallel", postlists.size() | shard_matchers.size() | max_msize | maxitems | check_at_least | Literal("timeout") | Literal("results"));
+    Xapian::doccount n_shards = postlists.size();
+    results.resize(n_shards);
+
+    // Each thread repeatedly claims the next unmatched sub-database, which
+    // balances the load better than a fixed assignment when the
+    // sub-databases differ in size.
+    atomic<Xapian::doccount> next_shard(0);
+    auto worker = [&]() {
+	while (true) {
+	    Xapian::doccount i = next_shard++;
+	    if (i >= n_shards) break;
+	    try {
+		shard_matchers[i]->match_shard(postlists[i], i, n_shards,
+					       max_msize, maxitems,
+					       check_at_least, timeout,
+					       results[i]);
+	    } catch (...) {
+		results[i].error = std::current_exception();
+	    }
+	}
+    };
+
+    unsigned n_threads = min(parallel_shards, unsigned(n_shards));
+    vector<thread> threads;
+    threads.reserve(n_threads - 1);
+    try {
+	for (unsigned t = 1; t < n_threads; ++t) {
+	    threads.push_back(thread(worker));
+	}
+    } catch (const std::system_error &) {
+	// If we can't create as many threads as requested, just use the ones
+	// we have - the calling thread always matches too.
+    }
+    worker();
+    for (auto && t : threads) {
+	t.join();
+    }
+
+    for (auto && result : results) {
+	if (result.error) std::rethrow_exception(result.error);
+    }
+}
+
 void
 MultiMatch::get_mset(Xapian::doccount first, Xapian::doccount maxitems,
 		     Xapian::doccount check_at_least,
@@ -384,17 +834,36 @@ MultiMatch::get_mset(Xapian::doccount first, Xapian::doccount maxitems,
     if (leaves.size() == 1 && is_remote[0]) {
 	RemoteSubMatch * rem_match;
 	rem_match = static_cast<RemoteSubMatch*>(leaves[0].get());
-	rem_match->start_match(first, maxitems, check_at_least, stats);
+	if (pipelined_remote_query) {
+	    rem_match->start_pipelined_match(first, maxitems, check_at_least,
+					     min(remote_prefetch, maxitems),
+					     NULL);
+	} else if (single_remote_query_mset) {
+	    rem_match->start_match_without_stats(first, maxitems,
+						 check_at_least);
+	} else {
+	    rem_match->start_match(first, maxitems, check_at_least, stats);
+	}
 	rem_match->get_mset(mset);
 	return;
     }
 #endif
 
     // Start matchers.
-    for (auto && leaf : leaves) {
-	leaf->start_match(0, first + maxitems, first + check_at_least, stats);
+#ifdef XAPIAN_HAS_REMOTE_BACKEND
+    if (pipelined_remote_query) {
+	start_pipelined_matches(first, maxitems, check_at_least, stats);
+    } else
+#endif
+    {
+	for (auto && leaf : leaves) {
+	    leaf->start_match(0, first + maxitems, first + check_at_least,
+			      stats);
+	}
     }
 
+    bool partial = collect_remote_msets();
+
     // Get postlists and term info
     vector<PostList *> postlists;
     Xapian::termcount total_subqs = 0;
@@ -403,8 +872,18 @@ MultiMatch::get_mset(Xapian::doccount first, Xapian::doccount maxitems,
     // number of matching documents which is higher than the number of
     // documents it returns (because it wasn't asked for more documents).
     Xapian::doccount definite_matches_not_seen = 0;
+    // For a parallel match, each sub-database gets its own MultiMatch object
+    // for its postlist tree to notify of changes to its maxweight.
+    bool parallel = can_match_in_parallel(mdecider);
+    vector<AutoPtr<MultiMatch>> shard_matchers;
+    if (parallel) {
+	for (size_t i = 0; i != leaves.size(); ++i) {
+	    shard_matchers.push_back(AutoPtr<MultiMatch>(new MultiMatch(this)));
+	}
+    }
     for (size_t i = 0; i != leaves.size(); ++i) {
-	PostList * pl = leaves[i]->get_postlist(this, &total_subqs);
+	MultiMatch * matcher = parallel ? shard_matchers[i].get() : this;
+	PostList * pl = leaves[i]->get_postlist(matcher, &total_subqs);
 	if (is_remote[i]) {
 	    if (pl->get_termfreq_min() > first + maxitems) {
 		LOGLINE(MATCH, "Found " <<
@@ -423,15 +902,23 @@ MultiMatch::get_mset(Xapian::doccount first, Xapian::doccount maxitems,
     ++vsdoc._refs;
     Xapian::Document doc(&vsdoc);
 
-    // Get a single combined postlist
+    // Get a single combined postlist, or for a parallel match keep the
+    // postlist for each sub-database separate.
     AutoPtr<PostList> pl;
-    if (postlists.size() == 1) {
+    vector<AutoPtr<PostList>> shard_postlists;
+    if (parallel) {
+	for (auto && shard_pl : postlists) {
+	    shard_postlists.push_back(AutoPtr<PostList>(shard_pl));
+	}
+    } else if (postlists.size() == 1) {
 	pl.reset(postlists.front());
     } else {
 	pl.reset(new MergePostList(postlists, this, vsdoc));
     }
 
-    LOGLINE(MATCH, "pl = (" << pl->get_description() << ")");
+    if (pl.get()) {
+	LOGLINE(MATCH, "pl = (" << pl->get_description() << ")");
+    }
 
     // Empty result set
     Xapian::doccount docs_matched = 0;
@@ -443,20 +930,35 @@ MultiMatch::get_mset(Xapian::doccount first, Xapian::doccount maxitems,
     vector<Xapian::Internal::MSetItem> items;
 
     // maximum weight a document could possibly have
-    const double max_possible = pl->recalc_maxweight();
+    double max_possible = 0;
+    Xapian::doccount matches_upper_bound = 0;
+    Xapian::doccount matches_lower_bound = 0;
+    Xapian::doccount matches_estimated = 0;
+    Xapian::doccount termfreq_min = 0;
+    if (parallel) {
+	// Combine the sub-database statistics as MergePostList would.
+	for (auto && shard_pl : shard_postlists) {
+	    max_possible = max(max_possible, shard_pl->recalc_maxweight());
+	    matches_upper_bound += shard_pl->get_termfreq_max();
+	    matches_estimated += shard_pl->get_termfreq_est();
+	    termfreq_min += shard_pl->get_termfreq_min();
+	}
+    } else {
+	max_possible = pl->recalc_maxweight();
 
-    LOGLINE(MATCH, "pl = (" << pl->get_description() << ")");
-    recalculate_w_max = false;
+	LOGLINE(MATCH, "pl = (" << pl->get_description() << ")");
+	recalculate_w_max = false;
 
-    Xapian::doccount matches_upper_bound = pl->get_termfreq_max();
-    Xapian::doccount matches_lower_bound = 0;
-    Xapian::doccount matches_estimated   = pl->get_termfreq_est();
+	matches_upper_bound = pl->get_termfreq_max();
+	matches_estimated = pl->get_termfreq_est();
+	termfreq_min = pl->get_termfreq_min();
+    }
 
     if (mdecider == NULL) {
 	// If we have a match decider, the lower bound must be
 	// set to 0 as we could discard all hits.  Otherwise set it to the
 	// minimum number of entries which the postlist could return.
-	matches_lower_bound = pl->get_termfreq_min();
+	matches_lower_bound = termfreq_min;
     }
 
     // Prepare the matchspy
@@ -493,6 +995,7 @@ MultiMatch::get_mset(Xapian::doccount first, Xapian::doccount maxitems,
 					   matches_estimated,
 					   max_possible, greatest_wt, items,
 					   0);
+	mset.internal->partial = partial;
 	return;
     }
 
@@ -541,7 +1044,34 @@ MultiMatch::get_mset(Xapian::doccount first, Xapian::doccount maxitems,
     // Is the mset a valid heap?
     bool is_heap = false;
 
-    while (true) {
+    if (parallel) {
+	vector<ShardResult> results;
+	match_shards_in_parallel(shard_postlists, shard_matchers,
+				 max_msize, maxitems, check_at_least, timeout,
+				 results);
+	shard_postlists.clear();
+
+	// Combine the results.  The sub-databases are considered in order, as
+	// MergePostList would, so ties for the greatest weight are resolved in
+	// the same way as for a serial match.
+	for (auto && result : results) {
+	    docs_matched += result.docs_matched;
+	    if (result.greatest_wt > greatest_wt) {
+		greatest_wt = result.greatest_wt;
+		greatest_wt_subqs_matched = result.greatest_wt_subqs_matched;
+	    }
+	    items.insert(items.end(), result.items.begin(), result.items.end());
+	}
+	if (items.size() > max_msize) {
+	    nth_element(items.begin(), items.begin() + max_msize, items.end(),
+			mcmp);
+	    items.erase(items.begin() + max_msize, items.end());
+	}
+    }
+
+    // For a parallel match, the matching has already been done and pl is
+    // NULL.
+    while (pl.get()) {
 	bool pushback;
 
 	if (rare(recalculate_w_max)) {
@@ -1119,4 +1649,5 @@ new_greatest_weight:
 				       uncollapsed_estimated,
 				       max_possible, greatest_wt, items,
 				       percent_scale * 100.0);
+    mset.internal->partial = partial;
 }
@@ -30,6 +30,12 @@
 
 #include "xapian/query.h"
 #include "xapian/weight.h"
+#include "weight/weightinternal.h"
+
+#include "autoptr.h"
+
+class TimeOut;
+struct ShardResult;
 
 class MultiMatch
 {
@@ -59,6 +65,24 @@ class MultiMatch
 
 	double time_limit;
 
+	/** Maximum number of threads to use to match sub-databases in parallel.
+	 *
+	 *  0 or 1 means to match them one after another in this thread.
+	 */
+	unsigned parallel_shards;
+
+	/** Seconds to wait for remote sub-databases to return their results.
+	 *
+	 *  0 means to wait as long as the remote databases' own timeouts
+	 *  allow.
+	 */
+	double remote_timeout;
+
+	/** The number of top documents remote sub-databases should send the
+	 *  data and values of along with their results.
+	 */
+	Xapian::doccount remote_prefetch;
+
 	/// Weighting scheme
 	const Xapian::Weight * weight;
 
@@ -70,6 +94,30 @@ class MultiMatch
 	/** Is each sub-database remote? */
 	vector<bool> is_remote;
 
+	/** Is this a match against a single remote database which sends the
+	 *  query along with the request for the MSet?
+	 *
+	 *  In this case prepare_match() isn't called, as the remote database's
+	 *  statistics are the global statistics.
+	 */
+	bool single_remote_query_mset;
+
+	/** Is this a match against only remote databases which sends each the
+	 *  query, our guess at the global statistics and the request for the
+	 *  MSet together?
+	 *
+	 *  In this case prepare_match() isn't called until the query has been
+	 *  sent.  With more than one database, stats_hint is the guess.
+	 */
+	bool pipelined_remote_query;
+
+	/** The global statistics we expect for a pipelined remote query.
+	 *
+	 *  These are made up of the statistics each remote database sent for
+	 *  earlier queries.
+	 */
+	Xapian::Weight::Internal stats_hint;
+
 	/// The matchspies to use.
 	const vector<Xapian::Internal::opt_intrusive_ptr<Xapian::MatchSpy>> & matchspies;
 
@@ -79,6 +127,82 @@ class MultiMatch
 	 */
 	double getorrecalc_maxweight(PostList *pl);
 
+	/** Can the local sub-databases be matched in parallel?
+	 *
+	 *  This is only possible for a relevance ordered match without any
+	 *  features which need to see documents from all the sub-databases
+	 *  together (collapsing, percentage cutoffs, match deciders and match
+	 *  spies), and where every sub-database is a distinct local database.
+	 */
+	bool can_match_in_parallel(const Xapian::MatchDecider * mdecider) const;
+
+	/** Send a pipelined query to each remote sub-database.
+	 *
+	 *  The servers' statistics are read into @a stats, and if they don't
+	 *  match stats_hint, the query is sent again with those instead.
+	 */
+	void start_pipelined_matches(Xapian::doccount first,
+				     Xapian::doccount maxitems,
+				     Xapian::doccount check_at_least,
+				     Xapian::Weight::Internal & stats);
+
+	/** Read the MSets from the remote sub-databases as they arrive.
+	 *
+	 *  Any which haven't arrived within remote_timeout are dropped.
+	 *
+	 *  @return true if any remote sub-database was dropped.
+	 */
+	bool collect_remote_msets();
+
+	/** Match one sub-database as part of a parallel match.
+	 *
+	 *  This is called on the MultiMatch object created for the shard, so
+	 *  that calls to recalc_maxweight() by the postlist tree only affect
+	 *  the thread matching it.
+	 *
+	 *  @param pl	     The postlist tree for the sub-database (ownership
+	 *		     is retained by the caller, but the pointer may be
+	 *		     updated if the tree is pruned).
+	 *  @param shard     The index of the sub-database.
+	 *  @param n_shards  The number of sub-databases.
+	 *  @param max_msize The number of items to keep.
+	 *  @param maxitems  The number of items requested.
+	 *  @param check_at_least  The minimum number of items to check.
+	 *  @param timeout   The time limit for the match.
+	 *  @param result    Object to store the results of matching in.
+	 */
+	void match_shard(AutoPtr<PostList> & pl,
+			 Xapian::doccount shard,
+			 Xapian::doccount n_shards,
+			 Xapian::doccount max_msize,
+			 Xapian::doccount maxitems,
+			 Xapian::doccount check_at_least,
+			 const TimeOut & timeout,
+			 ShardResult & result);
+
+	/** Match the sub-databases in parallel.
+	 *
+	 *  @param postlists The postlist trees for each sub-database, which
+	 *		     must have been built with the corresponding entry
+	 *		     in @a shard_matchers as the matcher.
+	 *  @param shard_matchers  MultiMatch objects for each sub-database.
+	 *  @param results   Vector to store the results for each sub-database
+	 *		     in.
+	 */
+	void match_shards_in_parallel(std::vector<AutoPtr<PostList>> & postlists,
+				      std::vector<AutoPtr<MultiMatch>> & shard_matchers,
+				      Xapian::doccount max_msize,
+				      Xapian::doccount maxitems,
+				      Xapian::doccount check_at_least,
+				      const TimeOut & timeout,
+				      std::vector<ShardResult> & results);
+
+	/** Create a MultiMatch to match one sub-database for a parallel match.
+	 *
+	 *  Only the settings used by match_shard() are copied from @a parent.
+	 */
+	explicit MultiMatch(const MultiMatch * parent);
+
 	/// Copying is not permitted.
 	MultiMatch(const MultiMatch &);
 
@@ -94,6 +218,14 @@ class MultiMatch
 	 *  @param omrset    The relevance set (or NULL for no RSet)
 	 *  @param time_limit_ Seconds to reduce check_at_least after (or <= 0
 	 *                     for no limit)
+	 *  @param parallel_shards_ Maximum number of threads to use to match
+	 *			    sub-databases in parallel (0 or 1 for no
+	 *			    parallel matching)
+	 *  @param remote_timeout_ Seconds to wait for remote sub-databases to
+	 *			   return their results before dropping them
+	 *			   (0 for no limit)
+	 *  @param remote_prefetch_ Number of top documents remote sub-databases
+	 *			    should send along with their results
 	 *  @param stats     The stats object to add our stats to.
 	 *  @param wtscheme  Weighting scheme
 	 *  @param matchspies_ Any the MatchSpy objects in use.
@@ -113,6 +245,9 @@ class MultiMatch
 		   Xapian::Enquire::Internal::sort_setting sort_by_,
 		   bool sort_value_forward_,
 		   double time_limit_,
+		   unsigned parallel_shards_,
+		   double remote_timeout_,
+		   Xapian::doccount remote_prefetch_,
 		   Xapian::Weight::Internal & stats,
 		   const Xapian::Weight *wtscheme,
 		   const vector<Xapian::Internal::opt_intrusive_ptr<Xapian::MatchSpy>> & matchspies_,
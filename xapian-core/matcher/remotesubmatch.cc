@@ -25,6 +25,7 @@
 
 #include "debuglog.h"
 #include "msetpostlist.h"
+#include "omassert.h"
 #include "backends/remote/remote-database.h"
 #include "weight/weightinternal.h"
 
@@ -33,6 +34,7 @@ RemoteSubMatch::RemoteSubMatch(RemoteDatabase *db_,
 			       const vector<Xapian::Internal::opt_intrusive_ptr<Xapian::MatchSpy>> & matchspies_)
 	: db(db_),
 	  decreasing_relevance(decreasing_relevance_),
+	  have_mset(false),
 	  matchspies(matchspies_)
 {
     LOGCALL_CTOR(MATCH, "RemoteSubMatch", db_ | decreasing_relevance_ | matchspies_);
@@ -65,11 +67,38 @@ RemoteSubMatch::get_postlist(MultiMatch * matcher,
 {
     LOGCALL(MATCH, PostList *, "RemoteSubMatch::get_postlist", matcher | total_subqs_ptr);
     (void)matcher;
-    Xapian::MSet mset;
-    db->get_mset(mset, matchspies);
-    percent_factor = mset.internal->percent_factor;
+    receive_mset();
+    percent_factor = remote_mset.internal->percent_factor;
     // For remote databases we report percent_factor rather than counting the
     // number of subqueries.
     (void)total_subqs_ptr;
-    RETURN(new MSetPostList(mset, decreasing_relevance));
+    RETURN(new MSetPostList(remote_mset, decreasing_relevance));
+}
+
+void
+RemoteSubMatch::receive_mset(double end_time)
+{
+    LOGCALL_VOID(MATCH, "RemoteSubMatch::receive_mset", end_time);
+    if (have_mset) return;
+    db->get_mset(remote_mset, matchspies, end_time);
+    have_mset = true;
+}
+
+void
+RemoteSubMatch::drop_mset()
+{
+    LOGCALL_VOID(MATCH, "RemoteSubMatch::drop_mset", NO_ARGS);
+    Assert(!have_mset);
+    db->abandon_reply();
+    remote_mset = Xapian::MSet();
+    have_mset = true;
+}
+
+void
+RemoteSubMatch::discard_mset()
+{
+    LOGCALL_VOID(MATCH, "RemoteSubMatch::discard_mset", NO_ARGS);
+    receive_mset();
+    remote_mset = Xapian::MSet();
+    have_mset = false;
 }
@@ -50,6 +50,12 @@ class RemoteSubMatch : public SubMatch {
     /// The factor to use to convert weights to percentages.
     double percent_factor;
 
+    /// The MSet from the remote database, if it's been received.
+    Xapian::MSet remote_mset;
+
+    /// Has remote_mset been received (or given up on)?
+    bool have_mset;
+
     /// The matchspies to use.
     const vector<Xapian::Internal::opt_intrusive_ptr<Xapian::MatchSpy>> & matchspies;
 
@@ -72,9 +78,81 @@ class RemoteSubMatch : public SubMatch {
     PostList * get_postlist(MultiMatch * matcher,
 			    Xapian::termcount * total_subqs_ptr);
 
+    /// The remote database.
+    const RemoteDatabase * get_database() const { return db; }
+
+    /// Is the MSet ready to read (or already read)?
+    bool ready_to_read() const { return have_mset || db->ready_to_read(); }
+
+    /** Read the MSet now.
+     *
+     *  Otherwise it's read by get_postlist().
+     *
+     *  @param end_time	If the MSet hasn't been read by this time,
+     *			Xapian::NetworkTimeoutError is thrown and drop_mset()
+     *			can be called (0.0 for no limit other than the
+     *			database's timeout).
+     */
+    void receive_mset(double end_time = 0.0);
+
+    /** Give up waiting for the MSet.
+     *
+     *  get_postlist() will then return an empty postlist.
+     */
+    void drop_mset();
+
     /// Get percentage factor - only valid after get_postlist().
     double get_percent_factor() const { return percent_factor; }
 
+    /// Can a single remote match be started without prepare_match()?
+    bool supports_query_mset() const { return db->supports_query_mset(); }
+
+    /** Start a single remote match without exchanging statistics.
+     *
+     *  Only valid if supports_query_mset() returns true.
+     */
+    void start_match_without_stats(Xapian::doccount first,
+				   Xapian::doccount maxitems,
+				   Xapian::doccount check_at_least) {
+	db->send_query_mset(first, maxitems, check_at_least);
+    }
+
+    /// Can the match be started with a guess at the global statistics?
+    bool supports_pipelined_match() const {
+	return db->supports_pipelined_query();
+    }
+
+    /** Add the statistics cached from earlier matches.
+     *
+     *  @return false if these aren't available for all the terms.
+     */
+    bool add_cached_stats(Xapian::Weight::Internal & stats) const {
+	return db->add_cached_stats(stats);
+    }
+
+    /** Start the match, with a guess at the global statistics.
+     *
+     *  Only valid if supports_pipelined_match() returns true.  Unless @a
+     *  stats_hint is NULL (for a single remote match), prepare_match() is
+     *  then used to read the statistics, and if they aren't what was
+     *  guessed, discard_mset() and start_pipelined_match() should be called
+     *  again with the correct global statistics.
+     *
+     *  @param n_docs  Ask for the documents at the top of the MSet too.
+     */
+    void start_pipelined_match(Xapian::doccount first,
+			       Xapian::doccount maxitems,
+			       Xapian::doccount check_at_least,
+			       Xapian::doccount n_docs,
+			       const Xapian::Weight::Internal * stats_hint) {
+	have_mset = false;
+	db->send_pipelined_query(first, maxitems, check_at_least, n_docs,
+				 stats_hint);
+    }
+
+    /// Read the MSet and throw it away.
+    void discard_mset();
+
     /// Short-cut for single remote match.
     void get_mset(Xapian::MSet & mset) { db->get_mset(mset, matchspies); }
 };
@@ -2,6 +2,7 @@
  *  @brief RemoteConnection class used by the remote backend.
  */
 /* Copyright (C) 2006,2007,2008,2009,2010,2011,2012,2013,2014,2015 Olly Betts
+ * Copyright (C) 2026 The Xapian contributors
  *
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -31,7 +32,11 @@
 
 #include <algorithm>
 #include <climits>
+#include <cstdlib>
 #include <string>
+#ifdef HAVE_SENDFILE
+# include <sys/sendfile.h>
+#endif
 
 #include "debuglog.h"
 #include "fd.h"
@@ -47,6 +52,39 @@ using namespace std;
 
 #define CHUNKSIZE 4096
 
+/// Maximum number of bytes to ask sendfile() or splice() to move at once.
+#define ZERO_COPY_CHUNKSIZE 65536
+
+#if defined HAVE_SENDFILE || defined HAVE_SPLICE
+/** Should send_file() and receive_file() use sendfile() and splice()?
+ *
+ *  Setting XAPIAN_NO_ZERO_COPY in the environment makes them use read() and
+ *  write() instead, as they do if the kernel won't move the data for us.
+ */
+static bool
+use_zero_copy()
+{
+    const char * p = getenv("XAPIAN_NO_ZERO_COPY");
+    return !p || !*p;
+}
+#endif
+
+/** Largest message contents we'll compress or accept compressed.
+ *
+ *  The receiver allocates the declared uncompressed length, so this stops a
+ *  small compressed message claiming to expand to an enormous size.  Larger
+ *  messages are simply sent uncompressed.
+ */
+#define MAX_DECOMPRESSED_SIZE (64 * 1024 * 1024)
+
+/** Number of bytes of compressed data to inflate at once.
+ *
+ *  Deflate can expand data by a factor of about 1000, so feeding the input
+ *  in small pieces means we notice output exceeding the declared length
+ *  before we've allocated much more than it.
+ */
+#define DECOMPRESS_INPUT_CHUNKSIZE 256
+
 XAPIAN_NORETURN(static void throw_database_closed());
 static void
 throw_database_closed()
@@ -73,7 +111,11 @@ update_overlapped_offset(WSAOVERLAPPED & overlapped, DWORD n)
 
 RemoteConnection::RemoteConnection(int fdin_, int fdout_,
 				   const string & context_)
-    : fdin(fdin_), fdout(fdout_), context(context_)
+    : fdin(fdin_), fdout(fdout_), chunked_data_left(0), compress_min(0),
+#ifndef __WIN32__
+      queue_output(false),
+#endif
+      context(context_)
 {
 #ifdef __WIN32__
     memset(&overlapped, 0, sizeof(overlapped));
@@ -178,7 +220,8 @@ RemoteConnection::read_at_least(size_t min_len, double end_time)
 
 	    struct timeval tv;
 	    RealTime::to_timeval(time_diff, &tv);
-	    int select_result = select(fdin + 1, &fdset, 0, &fdset, &tv);
+	    fd_set exceptfds = fdset;
+	    int select_result = select(fdin + 1, &fdset, 0, &exceptfds, &tv);
 	    if (select_result > 0) break;
 
 	    if (select_result == 0)
@@ -193,6 +236,97 @@ RemoteConnection::read_at_least(size_t min_len, double end_time)
     return true;
 }
 
+#ifndef __WIN32__
+bool
+RemoteConnection::read_available()
+{
+    LOGCALL(REMOTE, bool, "RemoteConnection::read_available", NO_ARGS);
+    if (fdin == -1)
+	throw_database_closed();
+
+    if (fcntl(fdin, F_SETFL, O_NONBLOCK) < 0) {
+	throw Xapian::NetworkError("Failed to set fdin non-blocking-ness",
+				   context, errno);
+    }
+
+    while (true) {
+	char buf[CHUNKSIZE];
+	ssize_t received = read(fdin, buf, sizeof(buf));
+
+	if (received > 0) {
+	    buffer.append(buf, received);
+	    if (size_t(received) < sizeof(buf)) RETURN(true);
+	    continue;
+	}
+
+	if (received == 0)
+	    RETURN(false);
+
+	LOGLINE(REMOTE, "read gave errno = " << errno);
+	if (errno == EINTR) continue;
+
+	if (errno != EAGAIN)
+	    throw Xapian::NetworkError("read failed", context, errno);
+	RETURN(true);
+    }
+}
+
+bool
+RemoteConnection::has_complete_message() const
+{
+    if (buffer.size() < 2) return false;
+    size_t len = static_cast<unsigned char>(buffer[1]);
+    if (len != 0xff) return buffer.size() >= len + 2;
+    len = 0;
+    string::const_iterator i = buffer.begin() + 2;
+    unsigned char ch;
+    int shift = 0;
+    do {
+	// If the length is insane, say the message is complete so that
+	// get_message() is called and reports the problem.
+	if (shift > 28) return true;
+	if (i == buffer.end()) return false;
+	ch = *i++;
+	len |= size_t(ch & 0x7f) << shift;
+	shift += 7;
+    } while ((ch & 0x80) == 0);
+    len += 255;
+    return size_t(buffer.end() - i) >= len;
+}
+
+bool
+RemoteConnection::flush_output()
+{
+    LOGCALL(REMOTE, bool, "RemoteConnection::flush_output", NO_ARGS);
+    if (fdout == -1)
+	throw_database_closed();
+
+    if (fcntl(fdout, F_SETFL, O_NONBLOCK) < 0) {
+	throw Xapian::NetworkError("Failed to set fdout non-blocking-ness",
+				   context, errno);
+    }
+
+    size_t count = 0;
+    while (count < out_buffer.size()) {
+	ssize_t n = write(fdout, out_buffer.data() + count,
+			  out_buffer.size() - count);
+	if (n >= 0) {
+	    count += n;
+	    continue;
+	}
+
+	LOGLINE(REMOTE, "write gave errno = " << errno);
+	if (errno == EINTR) continue;
+
+	if (errno != EAGAIN)
+	    throw Xapian::NetworkError("write failed", context, errno);
+	break;
+    }
+    out_buffer.erase(0, count);
+    RETURN(out_buffer.empty());
+}
+#endif
+
 bool
 RemoteConnection::ready_to_read() const
 {
@@ -207,13 +341,53 @@ RemoteConnection::ready_to_read() const
     FD_ZERO(&fdset);
     FD_SET(fdin, &fdset);
 
-    // Set a 0.1 second timeout to avoid a busy loop.
-    // FIXME: this would be much better done by exposing the fd so that the
-    // matcher can call select on all the fds involved...
+    // Don't wait - callers which need to wait for data should use
+    // wait_to_read() to wait on all the connections involved at once.
     struct timeval tv;
     tv.tv_sec = 0;
-    tv.tv_usec = 100000;
-    RETURN(select(fdin + 1, &fdset, 0, &fdset, &tv) > 0);
+    tv.tv_usec = 0;
+    fd_set exceptfds = fdset;
+    RETURN(select(fdin + 1, &fdset, 0, &exceptfds, &tv) > 0);
+}
+
+bool
+RemoteConnection::wait_to_read(const vector<const RemoteConnection *> & conns,
+			       double end_time)
+{
+    LOGCALL_STATIC(REMOTE, bool, "RemoteConnection::wait_to_read", conns.size() | end_time);
+    fd_set fdset;
+    FD_ZERO(&fdset);
+    int max_fd = -1;
+    for (const RemoteConnection * conn : conns) {
+	if (conn->fdin == -1)
+	    throw_database_closed();
+	if (!conn->buffer.empty()) RETURN(true);
+	FD_SET(conn->fdin, &fdset);
+	max_fd = max(max_fd, conn->fdin);
+    }
+
+    while (true) {
+	struct timeval tv;
+	struct timeval * tv_ptr = NULL;
+	if (end_time != 0.0) {
+	    // Calculate how far in the future end_time is.
+	    double time_diff = end_time - RealTime::now();
+	    if (time_diff < 0) RETURN(false);
+	    RealTime::to_timeval(time_diff, &tv);
+	    tv_ptr = &tv;
+	}
+
+	// select() modifies the sets passed, so pass copies.
+	fd_set readfds = fdset;
+	fd_set exceptfds = fdset;
+	int select_result = select(max_fd + 1, &readfds, 0, &exceptfds, tv_ptr);
+	if (select_result > 0) RETURN(true);
+	if (select_result == 0) RETURN(false);
+
+	// EINTR means select was interrupted by a signal.
+	if (errno != EINTR)
+	    throw Xapian::NetworkError("select failed", errno);
+    }
 }
 
 void
@@ -224,9 +398,29 @@ RemoteConnection::send_message(char type, const string &message,
     if (fdout == -1)
 	throw_database_closed();
 
+    AssertRel(static_cast<unsigned char>(type),<,MESSAGE_COMPRESSED);
+    const string * body = &message;
+    string compressed_message;
+    // CompressionStream and zlib use int and uInt for lengths.
+    if (compress_min && message.size() >= compress_min &&
+	message.size() <= size_t(MAX_DECOMPRESSED_SIZE)) {
+	size_t size = message.size();
+	const char * compressed = comp_stream.compress(message.data(), &size);
+	if (compressed) {
+	    // We only get here if the compressed data is smaller, but it also
+	    // needs to be once the uncompressed length is prepended.
+	    compressed_message = encode_length(message.size());
+	    if (compressed_message.size() + size < message.size()) {
+		compressed_message.append(compressed, size);
+		body = &compressed_message;
+		type |= MESSAGE_COMPRESSED;
+	    }
+	}
+    }
+
     string header;
     header += type;
-    header += encode_length(message.size());
+    header += encode_length(body->size());
 
 #ifdef __WIN32__
     HANDLE hout = fd_to_handle(fdout);
@@ -259,12 +453,21 @@ RemoteConnection::send_message(char type, const string &message,
 	update_overlapped_offset(overlapped, n);
 
 	if (count == str->size()) {
-	    if (str == &message || message.empty()) return;
-	    str = &message;
+	    if (str == body || body->empty()) return;
+	    str = body;
 	    count = 0;
 	}
     }
 #else
+    if (queue_output) {
+	// Keep the messages in order by queueing behind any output which
+	// hasn't been written yet.
+	out_buffer += header;
+	out_buffer += *body;
+	(void)flush_output();
+	return;
+    }
+
     // If there's no end_time, just use blocking I/O.
     if (fcntl(fdout, F_SETFL, (end_time != 0.0) ? O_NONBLOCK : 0) < 0) {
 	throw Xapian::NetworkError("Failed to set fdout non-blocking-ness",
@@ -283,8 +486,8 @@ RemoteConnection::send_message(char type, const string &message,
 	if (n >= 0) {
 	    count += n;
 	    if (count == str->size()) {
-		if (str == &message || message.empty()) return;
-		str = &message;
+		if (str == body || body->empty()) return;
+		str = body;
 		count = 0;
 	    }
 	    continue;
@@ -308,7 +511,8 @@ RemoteConnection::send_message(char type, const string &message,
 
 	struct timeval tv;
 	RealTime::to_timeval(time_diff, &tv);
-	int select_result = select(fdout + 1, 0, &fdset, &fdset, &tv);
+	fd_set exceptfds = fdset;
+	int select_result = select(fdout + 1, 0, &fdset, &exceptfds, &tv);
 
 	if (select_result < 0) {
 	    if (errno == EINTR) {
@@ -336,7 +540,6 @@ RemoteConnection::send_file(char type, int fd, double end_time)
     off_t size = file_size(fd);
     if (errno)
 	throw Xapian::NetworkError("Couldn't stat file to send", errno);
-    // FIXME: Use sendfile() or similar if available?
 
     char buf[CHUNKSIZE];
     buf[0] = type;
@@ -400,15 +603,45 @@ RemoteConnection::send_file(char type, int fd, double end_time)
 
     fd_set fdset;
     size_t count = 0;
+#ifdef HAVE_SENDFILE
+    // Once the header is written, have the kernel copy the file's contents
+    // to fdout, falling back to read() and write() if it can't.
+    bool use_sendfile = use_zero_copy();
+#endif
     while (true) {
-	// We've set write to non-blocking, so just try writing as there
-	// will usually be space.
-	ssize_t n = write(fdout, buf + count, c - count);
+	ssize_t n;
+#ifdef HAVE_SENDFILE
+	if (use_sendfile && count == c) {
+	    n = sendfile(fdout, fd, NULL,
+			 size_t(min(size, off_t(ZERO_COPY_CHUNKSIZE))));
+	    if (n > 0) {
+		size -= n;
+		if (size == 0) return;
+		continue;
+	    }
+	    if (n == 0)
+		throw Xapian::NetworkError("File shrank while being sent",
+					   context);
+	    if (errno == EINVAL || errno == ENOSYS) {
+		use_sendfile = false;
+		c = count = 0;
+		continue;
+	    }
+	} else
+#endif
+	{
+	    // We've set write to non-blocking, so just try writing as there
+	    // will usually be space.
+	    n = write(fdout, buf + count, c - count);
+	}
 
 	if (n >= 0) {
 	    count += n;
 	    if (count == c) {
 		if (size == 0) return;
+#ifdef HAVE_SENDFILE
+		if (use_sendfile) continue;
+#endif
 
 		ssize_t res;
 		do {
@@ -441,7 +674,8 @@ RemoteConnection::send_file(char type, int fd, double end_time)
 
 	struct timeval tv;
 	RealTime::to_timeval(time_diff, &tv);
-	int select_result = select(fdout + 1, 0, &fdset, &fdset, &tv);
+	fd_set exceptfds = fdset;
+	int select_result = select(fdout + 1, 0, &fdset, &exceptfds, &tv);
 
 	if (select_result < 0) {
 	    if (errno == EINTR) {
@@ -469,7 +703,7 @@ RemoteConnection::sniff_next_message_type(double end_time)
     if (!read_at_least(1, end_time))
 	RETURN(-1);
     unsigned char type = buffer[0];
-    RETURN(type);
+    RETURN(type & ~MESSAGE_COMPRESSED);
 }
 
 int
@@ -485,8 +719,13 @@ RemoteConnection::get_message(string &result, double end_time)
     if (!read_at_least(len + 2, end_time))
 	RETURN(-1);
     if (len != 0xff) {
-	result.assign(buffer.data() + 2, len);
 	unsigned char type = buffer[0];
+	if (type & MESSAGE_COMPRESSED) {
+	    type &= ~MESSAGE_COMPRESSED;
+	    decompress_message(buffer.data() + 2, len, result);
+	} else {
+	    result.assign(buffer.data() + 2, len);
+	}
 	buffer.erase(0, len + 2);
 	RETURN(type);
     }
@@ -507,12 +746,54 @@ RemoteConnection::get_message(string &result, double end_time)
     size_t header_len = (i - buffer.begin());
     if (!read_at_least(header_len + len, end_time))
 	RETURN(-1);
-    result.assign(buffer.data() + header_len, len);
     unsigned char type = buffer[0];
+    if (type & MESSAGE_COMPRESSED) {
+	type &= ~MESSAGE_COMPRESSED;
+	decompress_message(buffer.data() + header_len, len, result);
+    } else {
+	result.assign(buffer.data() + header_len, len);
+    }
     buffer.erase(0, header_len + len);
     RETURN(type);
 }
 
+void
+RemoteConnection::decompress_message(const char * p, size_t len,
+				     string & result)
+{
+    const char * end = p + len;
+    size_t uncompressed_len;
+    decode_length(&p, end, uncompressed_len);
+    if (rare(uncompressed_len > size_t(MAX_DECOMPRESSED_SIZE)))
+	throw_network_error_insane_message_length();
+    result.resize(0);
+    result.reserve(uncompressed_len);
+    try {
+	comp_stream.decompress_start();
+	bool done = false;
+	while (!done) {
+	    // Once all the input has been consumed, decompress_chunk() is
+	    // called with none so that any pending output is flushed.  If the
+	    // data is truncated, zlib reports an error when it can't make
+	    // progress.
+	    size_t n = min(size_t(end - p), size_t(DECOMPRESS_INPUT_CHUNKSIZE));
+	    done = comp_stream.decompress_chunk(p, int(n), result);
+	    p += n;
+	    if (rare(result.size() > uncompressed_len)) {
+		throw Xapian::NetworkError("Compressed message longer than "
+					   "declared length", context);
+	    }
+	}
+    } catch (const Xapian::DatabaseError & e) {
+	throw Xapian::NetworkError("Bad compressed message received: " +
+				   e.get_msg(), context);
+    }
+    if (rare(result.size() != uncompressed_len)) {
+	throw Xapian::NetworkError("Compressed message shorter than declared "
+				   "length", context);
+    }
+}
+
 int
 RemoteConnection::get_message_chunked(double end_time)
 {
@@ -524,6 +805,10 @@ RemoteConnection::get_message_chunked(double end_time)
 
     if (!read_at_least(2, end_time))
 	RETURN(-1);
+    if (rare(static_cast<unsigned char>(buffer[0]) & MESSAGE_COMPRESSED)) {
+	throw Xapian::NetworkError("Can't read compressed message in chunks",
+				   context);
+    }
     uoff_t len = static_cast<unsigned char>(buffer[1]);
     if (len != 0xff) {
 	chunked_data_left = len;
@@ -618,6 +903,87 @@ write_all(int fd, const char * p, size_t n)
     }
 }
 
+#ifdef HAVE_SPLICE
+int
+RemoteConnection::splice_to_file(int fd, double end_time)
+{
+    LOGCALL(REMOTE, int, "RemoteConnection::splice_to_file", fd | end_time);
+    AssertEq(buffer.size(), 0);
+
+    // splice() needs a pipe at one end, so go via one.
+    int fds[2];
+    if (pipe(fds) < 0)
+	RETURN(0);
+    FD pipe_in(fds[0]), pipe_out(fds[1]);
+
+    bool first = true;
+    while (chunked_data_left) {
+	size_t len = size_t(min(chunked_data_left, off_t(ZERO_COPY_CHUNKSIZE)));
+	// fdin is non-blocking iff end_time is set - see read_at_least().
+	ssize_t n = splice(fdin, NULL, pipe_out, NULL, len, SPLICE_F_MOVE);
+	if (n == 0) {
+	    do_close(false);
+	    RETURN(-1);
+	}
+	if (n < 0) {
+	    LOGLINE(REMOTE, "splice gave errno = " << errno);
+	    if (errno == EINTR) continue;
+	    if (first && (errno == EINVAL || errno == ENOSYS))
+		RETURN(0);
+	    if (errno != EAGAIN)
+		throw Xapian::NetworkError("splice failed", context, errno);
+
+	    Assert(end_time != 0.0);
+	    double time_diff = end_time - RealTime::now();
+	    if (time_diff < 0) {
+		LOGLINE(REMOTE, "splice: timeout has expired");
+		throw Xapian::NetworkTimeoutError("Timeout expired while trying to read", context);
+	    }
+	    fd_set fdset;
+	    FD_ZERO(&fdset);
+	    FD_SET(fdin, &fdset);
+	    struct timeval tv;
+	    RealTime::to_timeval(time_diff, &tv);
+	    fd_set exceptfds = fdset;
+	    int select_result = select(fdin + 1, &fdset, 0, &exceptfds, &tv);
+	    if (select_result == 0)
+		throw Xapian::NetworkTimeoutError("Timeout expired while trying to read", context);
+	    if (select_result < 0 && errno != EINTR)
+		throw Xapian::NetworkError("select failed during read", context, errno);
+	    continue;
+	}
+	first = false;
+	chunked_data_left -= n;
+
+	// Empty the pipe into the file.
+	while (n) {
+	    ssize_t m = splice(pipe_in, NULL, fd, NULL, size_t(n),
+			       SPLICE_F_MOVE);
+	    if (m < 0) {
+		if (errno == EINTR) continue;
+		if (errno != EINVAL && errno != ENOSYS)
+		    throw Xapian::NetworkError("Error writing to file", errno);
+		// The file doesn't support splice(), so copy what's in the
+		// pipe and read the rest the usual way.
+		char buf[CHUNKSIZE];
+		while (n) {
+		    ssize_t r = read(pipe_in, buf, min(size_t(n), sizeof(buf)));
+		    if (r <= 0) {
+			if (r < 0 && errno == EINTR) continue;
+			throw Xapian::NetworkError("Error reading from pipe", errno);
+		    }
+		    write_all(fd, buf, r);
+		    n -= r;
+		}
+		RETURN(0);
+	    }
+	    n -= m;
+	}
+    }
+    RETURN(1);
+}
+#endif
+
 int
 RemoteConnection::receive_file(const string &file, double end_time)
 {
@@ -631,6 +997,20 @@ RemoteConnection::receive_file(const string &file, double end_time)
 	throw Xapian::NetworkError("Couldn't open file for writing: " + file, errno);
 
     int type = get_message_chunked(end_time);
+#ifdef HAVE_SPLICE
+    if (chunked_data_left > off_t(buffer.size()) && use_zero_copy()) {
+	// Write out the part of the file we've already read, then move the
+	// rest straight from fdin to the file.
+	write_all(fd, buffer.data(), buffer.size());
+	chunked_data_left -= buffer.size();
+	buffer.resize(0);
+	int res = splice_to_file(fd, end_time);
+	if (res < 0)
+	    RETURN(-1);
+	if (res > 0)
+	    RETURN(type);
+    }
+#endif
     do {
 	off_t min_read = min(chunked_data_left, off_t(CHUNKSIZE));
 	if (!read_at_least(min_read, end_time))
@@ -672,7 +1052,10 @@ RemoteConnection::do_close(bool wait)
 	    FD_SET(fdin, &fdset);
 	    int res;
 	    do {
-		res = select(fdin + 1, &fdset, 0, &fdset, NULL);
+		// select() modifies the sets passed, so pass copies.
+		fd_set readfds = fdset;
+		fd_set exceptfds = fdset;
+		res = select(fdin + 1, &readfds, 0, &exceptfds, NULL);
 	    } while (res < 0 && errno == EINTR);
 #endif
 	}
@@ -22,7 +22,9 @@
 #define XAPIAN_INCLUDED_REMOTECONNECTION_H
 
 #include <string>
+#include <vector>
 
+#include "compression_stream.h"
 #include "remoteprotocol.h"
 #include "safeerrno.h"
 #include "safenetdb.h" // For EAI_* constants.
@@ -194,6 +196,26 @@ class RemoteConnection {
     /// Remaining bytes of message data still to come over fdin for a chunked read.
     off_t chunked_data_left;
 
+    /** Compress messages sent with send_message() of at least this size.
+     *
+     *  If this is 0, messages aren't compressed.
+     */
+    size_t compress_min;
+
+    /// Used to compress and decompress message contents.
+    CompressionStream comp_stream;
+
+#ifndef __WIN32__
+    /** Should send_message() queue output rather than waiting to write it?
+     *
+     *  See set_queue_output().
+     */
+    bool queue_output;
+
+    /// Output queued by send_message() which hasn't been written yet.
+    std::string out_buffer;
+#endif
+
     /** Read until there are at least min_len bytes in buffer.
      *
      *  If for some reason this isn't possible, returns false upon EOF and
@@ -208,6 +230,35 @@ class RemoteConnection {
      */
     bool read_at_least(size_t min_len, double end_time);
 
+#ifdef HAVE_SPLICE
+    /** Move the rest of a chunked message straight from fdin to a file.
+     *
+     *  Uses splice() so the data doesn't need to be copied through
+     *  userspace.  The buffer must already be empty.
+     *
+     *  @param fd	The file to write to.
+     *  @param end_time	If this time is reached, then a timeout
+     *			exception will be thrown.  If (end_time == 0.0),
+     *			then keep trying indefinitely.
+     *
+     *	@return 1 on success, 0 if splice() can't be used for these file
+     *		descriptors (in which case any data still to come should be
+     *		read in the usual way), or -1 on EOF.
+     */
+    int splice_to_file(int fd, double end_time);
+#endif
+
+    /** Decompress the contents of a compressed message.
+     *
+     *  Throws NetworkError if the contents don't decompress to exactly the
+     *  uncompressed length they start with, or if that is implausibly large.
+     *
+     *  @param p	The compressed contents.
+     *  @param len	The length of the compressed contents.
+     *  @param[out] result	The decompressed contents.
+     */
+    void decompress_message(const char * p, size_t len, std::string & result);
+
 #ifdef __WIN32__
     /** On Windows we use overlapped IO.  We share an overlapped structure
      *  for both reading and writing, as we know that we always wait for
@@ -241,11 +292,77 @@ class RemoteConnection {
 #endif
 
     /** See if there is data available to read.
+     *
+     *  This doesn't wait - use wait_to_read() to wait for data.
      *
      *  @return		true if there is data waiting to be read.
      */
     bool ready_to_read() const;
 
+    /** Wait until there is data available to read on any of several
+     *  connections.
+     *
+     *  @param conns		The connections to wait on.
+     *  @param end_time		If this time is reached, give up waiting.  If
+     *				(end_time == 0.0) then wait indefinitely.
+     *
+     *  @return		true if there is data waiting to be read on at least
+     *			one of @a conns; false if end_time was reached.
+     */
+    static bool wait_to_read(const std::vector<const RemoteConnection *> & conns,
+			     double end_time);
+
+    /// Is there data which has already been read from fdin buffered?
+    bool has_buffered_data() const { return !buffer.empty(); }
+
+#ifndef __WIN32__
+    /** Read whatever data is available on fdin without waiting.
+     *
+     *  This is for callers which use poll() or similar to find out when
+     *  there's data to read, and so don't want to block in read().
+     *
+     *  @return false on EOF, otherwise true.
+     */
+    bool read_available();
+
+    /** Has a whole message been read from fdin and buffered?
+     *
+     *  If so, get_message() will return it without needing to wait.
+     */
+    bool has_complete_message() const;
+
+    /** Queue output from send_message() rather than waiting to write it.
+     *
+     *  Messages are written as far as possible without waiting, and the rest
+     *  is kept for flush_output() to write once fdout is writable.
+     */
+    void set_queue_output() { queue_output = true; }
+
+    /// Is there output queued by send_message() still to write?
+    bool has_queued_output() const { return !out_buffer.empty(); }
+
+    /** Write as much queued output as possible without waiting.
+     *
+     *  @return true if all the queued output has now been written.
+     */
+    bool flush_output();
+#endif
+
+    /** Set the size threshold for compressing messages we send.
+     *
+     *  This should only be set to non-zero once the other end has agreed to
+     *  receive compressed messages.  Messages read with get_message() are
+     *  decompressed whatever this is set to, but the chunked reading methods
+     *  and send_file() don't support compression.
+     *
+     *  @param n	Compress messages with contents of at least this many
+     *			bytes, or 0 to not compress messages.
+     */
+    void set_compress_min(size_t n) { compress_min = n; }
+
+    /// Get the size threshold for compressing messages we send.
+    size_t get_compress_min() const { return compress_min; }
+
     /** Check what the next message type is.
      *
      *  This must not be called after a call to get_message_chunked() until
@@ -353,6 +470,19 @@ class RemoteConnection {
      */
     void send_file(char type, int fd, double end_time);
 
+    /** Release the file descriptor without closing it.
+     *
+     *  Only valid if fdin and fdout are the same.  The connection is left in
+     *  the same state as after do_close().
+     *
+     *  @return The file descriptor, or -1 if the connection was closed.
+     */
+    int release_fd() {
+	int fd = fdin;
+	fdin = fdout = -1;
+	return fd;
+    }
+
     /** Shutdown the connection.
      *
      *  @param wait	If true, wait for the remote end to close the
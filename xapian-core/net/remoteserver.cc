@@ -33,6 +33,7 @@
 #include "safeerrno.h"
 #include <signal.h>
 #include <cstdlib>
+#include <algorithm>
 
 #include "autoptr.h"
 #include "length.h"
@@ -57,13 +58,72 @@ throw_read_only()
 /// Class to throw when we receive the connection closing message.
 struct ConnectionClosed { };
 
+/// Get the message compression threshold to offer clients.
+static size_t
+get_compress_offer()
+{
+    const char * p = getenv("XAPIAN_REMOTE_COMPRESS_MIN");
+    if (!p)
+	return 0;
+    long n = atol(p);
+    return n > 0 ? size_t(n) : 0;
+}
+
+/// Get the protocol minor version to tell clients we support.
+static int
+get_protocol_minor_version()
+{
+    const char * p = getenv("XAPIAN_REMOTE_PROTOCOL_MINOR");
+    if (p) {
+	int n = atoi(p);
+	if (n >= 0 && n < XAPIAN_REMOTE_PROTOCOL_MINOR_VERSION)
+	    return n;
+    }
+    return XAPIAN_REMOTE_PROTOCOL_MINOR_VERSION;
+}
+
+/// Get the number of seconds to wait before sending each MSet.
+static double
+get_results_delay()
+{
+    const char * p = getenv("XAPIAN_REMOTE_RESULTS_DELAY");
+    if (!p)
+	return 0.0;
+    double t = atof(p);
+    return t > 0.0 ? t : 0.0;
+}
+
+/// A query waiting for the client to send MSG_GETMSET.
+struct RemoteServer::PendingQuery {
+    /// The query.
+    Xapian::Query query;
+
+    /// The relevance set.
+    Xapian::RSet rset;
+
+    /// The weighting scheme.
+    AutoPtr<Xapian::Weight> wt;
+
+    /// The match spies.
+    vector<Xapian::Internal::opt_intrusive_ptr<Xapian::MatchSpy>> matchspies;
+
+    /// The statistics from our database.
+    Xapian::Weight::Internal local_stats;
+
+    /// The match, which refers to the other members.
+    AutoPtr<MultiMatch> match;
+};
+
 RemoteServer::RemoteServer(const std::vector<std::string> &dbpaths,
 			   int fdin_, int fdout_,
 			   double active_timeout_, double idle_timeout_,
 			   bool writable_)
     : RemoteConnection(fdin_, fdout_, std::string()),
-      db(NULL), wdb(NULL), writable(writable_),
-      active_timeout(active_timeout_), idle_timeout(idle_timeout_)
+      db(NULL), wdb(NULL), own_db(true), writable(writable_),
+      active_timeout(active_timeout_), idle_timeout(idle_timeout_),
+      compress_offer(get_compress_offer()),
+      protocol_minor_version(get_protocol_minor_version()),
+      results_delay(get_results_delay())
 {
     // Catch errors opening the database and propagate them to the client.
     try {
@@ -105,9 +165,32 @@ RemoteServer::RemoteServer(const std::vector<std::string> &dbpaths,
     msg_update(string());
 }
 
+RemoteServer::RemoteServer(Xapian::Database * shared_db,
+			   const vector<string> & dbpaths,
+			   const string & context_,
+			   int fd, double active_timeout_, double idle_timeout_)
+    : RemoteConnection(fd, fd, context_),
+      db(shared_db), wdb(NULL), own_db(false), shared_dbpaths(dbpaths),
+      writable(false),
+      active_timeout(active_timeout_), idle_timeout(idle_timeout_),
+      compress_offer(get_compress_offer()),
+      protocol_minor_version(get_protocol_minor_version()),
+      results_delay(get_results_delay())
+{
+#ifndef __WIN32__
+    // It's simplest to just ignore SIGPIPE.  We'll still know if the
+    // connection dies because we'll get EPIPE back from write().
+    if (signal(SIGPIPE, SIG_IGN) == SIG_ERR)
+	throw Xapian::NetworkError("Couldn't set SIGPIPE to SIG_IGN", errno);
+#endif
+
+    // Send greeting message.
+    msg_update(string());
+}
+
 RemoteServer::~RemoteServer()
 {
-    delete db;
+    if (own_db) delete db;
     // wdb is either NULL or equal to db, so we shouldn't delete it too!
 }
 
@@ -150,92 +233,109 @@ RemoteServer::send_message(reply_type type, const string &message)
 
 typedef void (RemoteServer::* dispatch_func)(const string &);
 
-void
-RemoteServer::run()
+bool
+RemoteServer::handle_message()
 {
-    while (true) {
+    try {
+	/* This list needs to be kept in the same order as the list of
+	 * message types in "remoteprotocol.h". Note that messages at the
+	 * end of the list in "remoteprotocol.h" can be omitted if they
+	 * don't correspond to dispatch actions.
+	 */
+	static const dispatch_func dispatch[] = {
+	    &RemoteServer::msg_allterms,
+	    &RemoteServer::msg_collfreq,
+	    &RemoteServer::msg_document,
+	    &RemoteServer::msg_termexists,
+	    &RemoteServer::msg_termfreq,
+	    &RemoteServer::msg_valuestats,
+	    &RemoteServer::msg_keepalive,
+	    &RemoteServer::msg_doclength,
+	    &RemoteServer::msg_query,
+	    &RemoteServer::msg_termlist,
+	    &RemoteServer::msg_positionlist,
+	    &RemoteServer::msg_postlist,
+	    &RemoteServer::msg_reopen,
+	    &RemoteServer::msg_update,
+	    &RemoteServer::msg_adddocument,
+	    &RemoteServer::msg_cancel,
+	    &RemoteServer::msg_deletedocumentterm,
+	    &RemoteServer::msg_commit,
+	    &RemoteServer::msg_replacedocument,
+	    &RemoteServer::msg_replacedocumentterm,
+	    &RemoteServer::msg_deletedocument,
+	    &RemoteServer::msg_writeaccess,
+	    &RemoteServer::msg_getmetadata,
+	    &RemoteServer::msg_setmetadata,
+	    &RemoteServer::msg_addspelling,
+	    &RemoteServer::msg_removespelling,
+	    &RemoteServer::msg_getmset,
+	    0, // MSG_SHUTDOWN - handled by get_message().
+	    &RemoteServer::msg_openmetadatakeylist,
+	    &RemoteServer::msg_freqs,
+	    &RemoteServer::msg_uniqueterms,
+	    &RemoteServer::msg_querymset,
+	    &RemoteServer::msg_compression,
+	    &RemoteServer::msg_postlistwindow,
+	    &RemoteServer::msg_pipelinedquery,
+	};
+
+	// Once we've sent REPLY_STATS for a query, the only message we
+	// accept is MSG_GETMSET with the global statistics.
+	string message;
+	size_t type;
+	if (pending_query.get()) {
+	    type = get_message(active_timeout, message, MSG_GETMSET);
+	} else {
+	    type = get_message(idle_timeout, message);
+	}
+	if (type >= sizeof(dispatch)/sizeof(dispatch[0]) || !dispatch[type]) {
+	    string errmsg("Unexpected message type ");
+	    errmsg += str(type);
+	    throw Xapian::InvalidArgumentError(errmsg);
+	}
+	(this->*(dispatch[type]))(message);
+	return true;
+    } catch (const Xapian::NetworkTimeoutError & e) {
 	try {
-	    /* This list needs to be kept in the same order as the list of
-	     * message types in "remoteprotocol.h". Note that messages at the
-	     * end of the list in "remoteprotocol.h" can be omitted if they
-	     * don't correspond to dispatch actions.
-	     */
-	    static const dispatch_func dispatch[] = {
-		&RemoteServer::msg_allterms,
-		&RemoteServer::msg_collfreq,
-		&RemoteServer::msg_document,
-		&RemoteServer::msg_termexists,
-		&RemoteServer::msg_termfreq,
-		&RemoteServer::msg_valuestats,
-		&RemoteServer::msg_keepalive,
-		&RemoteServer::msg_doclength,
-		&RemoteServer::msg_query,
-		&RemoteServer::msg_termlist,
-		&RemoteServer::msg_positionlist,
-		&RemoteServer::msg_postlist,
-		&RemoteServer::msg_reopen,
-		&RemoteServer::msg_update,
-		&RemoteServer::msg_adddocument,
-		&RemoteServer::msg_cancel,
-		&RemoteServer::msg_deletedocumentterm,
-		&RemoteServer::msg_commit,
-		&RemoteServer::msg_replacedocument,
-		&RemoteServer::msg_replacedocumentterm,
-		&RemoteServer::msg_deletedocument,
-		&RemoteServer::msg_writeaccess,
-		&RemoteServer::msg_getmetadata,
-		&RemoteServer::msg_setmetadata,
-		&RemoteServer::msg_addspelling,
-		&RemoteServer::msg_removespelling,
-		0, // MSG_GETMSET - used during a conversation.
-		0, // MSG_SHUTDOWN - handled by get_message().
-		&RemoteServer::msg_openmetadatakeylist,
-		&RemoteServer::msg_freqs,
-		&RemoteServer::msg_uniqueterms,
-	    };
-
-	    string message;
-	    size_t type = get_message(idle_timeout, message);
-	    if (type >= sizeof(dispatch)/sizeof(dispatch[0]) || !dispatch[type]) {
-		string errmsg("Unexpected message type ");
-		errmsg += str(type);
-		throw Xapian::InvalidArgumentError(errmsg);
-	    }
-	    (this->*(dispatch[type]))(message);
-	} catch (const Xapian::NetworkTimeoutError & e) {
-	    try {
-		// We've had a timeout, so the client may not be listening, so
-		// set the end_time to 1 and if we can't send the message right
-		// away, just exit and the client will cope.
-		send_message(REPLY_EXCEPTION, serialise_error(e), 1.0);
-	    } catch (...) {
-	    }
-	    // And rethrow it so our caller can log it and close the
-	    // connection.
-	    throw;
-	} catch (const Xapian::NetworkError &) {
-	    // All other network errors mean we are fatally confused and are
-	    // unlikely to be able to communicate further across this
-	    // connection.  So we don't try to propagate the error to the
-	    // client, but instead just rethrow the exception so our caller can
-	    // log it and close the connection.
-	    throw;
-	} catch (const Xapian::Error &e) {
-	    // Propagate the exception to the client, then return to the main
-	    // message handling loop.
-	    send_message(REPLY_EXCEPTION, serialise_error(e));
-	} catch (ConnectionClosed &) {
-	    return;
+	    // We've had a timeout, so the client may not be listening, so
+	    // set the end_time to 1 and if we can't send the message right
+	    // away, just exit and the client will cope.
+	    send_message(REPLY_EXCEPTION, serialise_error(e), 1.0);
 	} catch (...) {
-	    // Propagate an unknown exception to the client.
-	    send_message(REPLY_EXCEPTION, string());
-	    // And rethrow it so our caller can log it and close the
-	    // connection.
-	    throw;
 	}
+	// And rethrow it so our caller can log it and close the
+	// connection.
+	throw;
+    } catch (const Xapian::NetworkError &) {
+	// All other network errors mean we are fatally confused and are
+	// unlikely to be able to communicate further across this
+	// connection.  So we don't try to propagate the error to the
+	// client, but instead just rethrow the exception so our caller can
+	// log it and close the connection.
+	throw;
+    } catch (const Xapian::Error &e) {
+	// Propagate the exception to the client, then return to the main
+	// message handling loop.
+	send_message(REPLY_EXCEPTION, serialise_error(e));
+	return true;
+    } catch (ConnectionClosed &) {
+	return false;
+    } catch (...) {
+	// Propagate an unknown exception to the client.
+	send_message(REPLY_EXCEPTION, string());
+	// And rethrow it so our caller can log it and close the
+	// connection.
+	throw;
     }
 }
 
+void
+RemoteServer::run()
+{
+    while (handle_message()) { }
+}
+
 void
 RemoteServer::msg_allterms(const string &message)
 {
@@ -332,6 +432,39 @@ RemoteServer::msg_postlist(const string &message)
     send_message(REPLY_DONE, string());
 }
 
+void
+RemoteServer::msg_postlistwindow(const string &message)
+{
+    const char *p = message.data();
+    const char *p_end = p + message.size();
+    Xapian::docid did;
+    decode_length(&p, p_end, did);
+    Xapian::doccount max_items;
+    decode_length(&p, p_end, max_items);
+    string term(p, p_end);
+
+    // We don't keep any state between windows, which is simpler and means a
+    // client can't tie up resources on the server, at the cost of having to
+    // skip to the start of each window.
+    string postings;
+    Xapian::docid lastdocid = did - 1;
+    Xapian::PostingIterator i = db->postlist_begin(term);
+    const Xapian::PostingIterator end = db->postlist_end(term);
+    if (did > 1)
+	i.skip_to(did);
+    for ( ; i != end && max_items; ++i, --max_items) {
+	Xapian::docid newdocid = *i;
+	postings += encode_length(newdocid - lastdocid - 1);
+	postings += encode_length(i.get_wdf());
+	lastdocid = newdocid;
+    }
+
+    string reply = encode_length(db->get_termfreq(term));
+    reply += (i == end ? '1' : '0');
+    reply += postings;
+    send_message(REPLY_POSTLISTWINDOW, reply);
+}
+
 void
 RemoteServer::msg_writeaccess(const string & msg)
 {
@@ -359,6 +492,20 @@ RemoteServer::msg_writeaccess(const string & msg)
 void
 RemoteServer::msg_reopen(const string & msg)
 {
+    if (!own_db) {
+	// Other connections share the database, and mustn't see it change
+	// revision under them (one might be between REPLY_STATS and
+	// MSG_GETMSET), so open our own copy at the latest revision instead.
+	AutoPtr<Xapian::Database> new_db(new Xapian::Database);
+	for (auto && path : shared_dbpaths) {
+	    new_db->add_database(Xapian::Database(path));
+	}
+	db = new_db.release();
+	own_db = true;
+	msg_update(msg);
+	return;
+    }
+
     if (!db->reopen()) {
 	send_message(REPLY_DONE, string());
 	return;
@@ -369,11 +516,8 @@ RemoteServer::msg_reopen(const string & msg)
 void
 RemoteServer::msg_update(const string &)
 {
-    static const char protocol[2] = {
-	char(XAPIAN_REMOTE_PROTOCOL_MAJOR_VERSION),
-	char(XAPIAN_REMOTE_PROTOCOL_MINOR_VERSION)
-    };
-    string message(protocol, 2);
+    string message(1, char(XAPIAN_REMOTE_PROTOCOL_MAJOR_VERSION));
+    message += char(protocol_minor_version);
     Xapian::doccount num_docs = db->get_doccount();
     message += encode_length(num_docs);
     message += encode_length(db->get_lastdocid() - num_docs);
@@ -392,14 +536,52 @@ RemoteServer::msg_update(const string &)
 
 void
 RemoteServer::msg_query(const string &message_in)
+{
+    run_query(message_in, MSG_QUERY);
+}
+
+void
+RemoteServer::msg_querymset(const string &message_in)
+{
+    run_query(message_in, MSG_QUERYMSET);
+}
+
+void
+RemoteServer::msg_pipelinedquery(const string &message_in)
+{
+    run_query(message_in, MSG_PIPELINEDQUERY);
+}
+
+void
+RemoteServer::run_query(const string &message_in, message_type type)
 {
     const char *p = message_in.c_str();
     const char *p_end = p + message_in.size();
 
-    // Unserialise the Query.
+    Xapian::termcount first;
+    Xapian::termcount maxitems;
+    Xapian::termcount check_at_least;
+    if (type != MSG_QUERY) {
+	decode_length(&p, p_end, first);
+	decode_length(&p, p_end, maxitems);
+	decode_length(&p, p_end, check_at_least);
+    }
+
     size_t len;
+    Xapian::doccount n_docs = 0;
+    string stats_hint;
+    if (type == MSG_PIPELINEDQUERY) {
+	decode_length(&p, p_end, n_docs);
+	decode_length_and_check(&p, p_end, len);
+	stats_hint.assign(p, len);
+	p += len;
+    }
+
+    AutoPtr<PendingQuery> q(new PendingQuery);
+
+    // Unserialise the Query.
     decode_length_and_check(&p, p_end, len);
-    Xapian::Query query(Xapian::Query::unserialise(string(p, len), reg));
+    q->query = Xapian::Query::unserialise(string(p, len), reg);
     p += len;
 
     // Unserialise assorted Enquire settings.
@@ -460,16 +642,15 @@ RemoteServer::msg_query(const string &message_in)
     }
 
     decode_length_and_check(&p, p_end, len);
-    AutoPtr<Xapian::Weight> wt(wttype->unserialise(string(p, len)));
+    q->wt.reset(wttype->unserialise(string(p, len)));
     p += len;
 
     // Unserialise the RSet object.
     decode_length_and_check(&p, p_end, len);
-    Xapian::RSet rset = unserialise_rset(string(p, len));
+    q->rset = unserialise_rset(string(p, len));
     p += len;
 
     // Unserialise any MatchSpy objects.
-    vector<Xapian::Internal::opt_intrusive_ptr<Xapian::MatchSpy>> matchspies;
     while (p != p_end) {
 	decode_length_and_check(&p, p_end, len);
 	string spytype(p, len);
@@ -481,48 +662,115 @@ RemoteServer::msg_query(const string &message_in)
 	p += len;
 
 	decode_length_and_check(&p, p_end, len);
-	matchspies.push_back(spyclass->unserialise(string(p, len), reg)->release());
+	q->matchspies.push_back(spyclass->unserialise(string(p, len), reg)->release());
 	p += len;
     }
 
-    Xapian::Weight::Internal local_stats;
-    MultiMatch match(*db, query, qlen, &rset, collapse_max, collapse_key,
-		     percent_cutoff, weight_cutoff, order,
-		     sort_key, sort_by, sort_value_forward, time_limit,
-		     local_stats, wt.get(), matchspies, false, false);
+    // The client can use wdf upper bounds for the query terms if it gets our
+    // statistics, but they aren't needed if it only wants the MSet.
+    q->local_stats.want_wdf_upper_bounds =
+	(type == MSG_QUERY || !stats_hint.empty());
+    q->match.reset(new MultiMatch(*db, q->query, qlen, &q->rset,
+				  collapse_max, collapse_key,
+				  percent_cutoff, weight_cutoff, order,
+				  sort_key, sort_by, sort_value_forward,
+				  time_limit, 0, 0.0, 0,
+				  q->local_stats, q->wt.get(), q->matchspies,
+				  false, false));
+
+    if (type == MSG_QUERY) {
+	send_message(REPLY_STATS, serialise_stats(q->local_stats));
+	// Rather than waiting here for the client to reply with the global
+	// statistics, return to the message loop so that a caller serving
+	// several connections can serve the others meanwhile.  The reply is
+	// handled by msg_getmset().
+	pending_query = std::move(q);
+	return;
+    }
 
-    send_message(REPLY_STATS, serialise_stats(local_stats));
+    AutoPtr<Xapian::Weight::Internal> total_stats(new Xapian::Weight::Internal);
+    if (stats_hint.empty()) {
+	// The client is only searching this database, so our statistics are
+	// the global statistics - use them just as if the client had sent them
+	// back to us.
+	unserialise_stats(serialise_stats(q->local_stats), *(total_stats.get()));
+    } else {
+	// Use the client's guess at the global statistics, and send our
+	// statistics first so it can check the guess was right.
+	send_message(REPLY_STATS, serialise_stats(q->local_stats));
+	unserialise_stats(stats_hint, *(total_stats.get()));
+    }
+    send_mset(*q, first, maxitems, check_at_least, total_stats, n_docs);
+}
 
-    string message;
-    get_message(active_timeout, message, MSG_GETMSET);
-    p = message.c_str();
-    p_end = p + message.size();
+void
+RemoteServer::msg_getmset(const string &message_in)
+{
+    if (!pending_query.get())
+	throw Xapian::InvalidArgumentError("Unexpected message type " +
+					   str(int(MSG_GETMSET)));
+    AutoPtr<PendingQuery> q(std::move(pending_query));
+
+    const char *p = message_in.c_str();
+    const char *p_end = p + message_in.size();
 
     Xapian::termcount first;
-    decode_length(&p, p_end, first);
     Xapian::termcount maxitems;
-    decode_length(&p, p_end, maxitems);
-
     Xapian::termcount check_at_least;
+    decode_length(&p, p_end, first);
+    decode_length(&p, p_end, maxitems);
     decode_length(&p, p_end, check_at_least);
 
-    message.erase(0, message.size() - (p_end - p));
     AutoPtr<Xapian::Weight::Internal> total_stats(new Xapian::Weight::Internal);
-    unserialise_stats(message, *(total_stats.get()));
+    unserialise_stats(string(p, p_end - p), *(total_stats.get()));
+    send_mset(*q, first, maxitems, check_at_least, total_stats);
+}
+
+void
+RemoteServer::send_mset(PendingQuery & q, Xapian::doccount first,
+			Xapian::doccount maxitems,
+			Xapian::doccount check_at_least,
+			AutoPtr<Xapian::Weight::Internal> & total_stats,
+			Xapian::doccount n_docs)
+{
     total_stats->set_bounds_from_db(*db);
 
     Xapian::MSet mset;
-    match.get_mset(first, maxitems, check_at_least, mset, *(total_stats.get()), 0, 0);
+    q.match->get_mset(first, maxitems, check_at_least, mset,
+		      *(total_stats.get()), 0, 0);
     mset.internal->stats = total_stats.release();
 
-    message.resize(0);
-    for (auto i : matchspies) {
+    string message;
+    n_docs = std::min(n_docs, mset.size());
+    bool with_docs = (n_docs != 0);
+    if (with_docs) {
+	// Send the data and values of the top documents before the MSet, so
+	// the client doesn't need to ask for them.
+	message += encode_length(n_docs);
+	for (Xapian::MSetIterator i = mset.begin(); n_docs; ++i, --n_docs) {
+	    Xapian::Document doc = db->get_document(*i);
+	    message += encode_length(*i);
+	    string data = doc.get_data();
+	    message += encode_length(data.size());
+	    message += data;
+	    message += encode_length(doc.values_count());
+	    for (Xapian::ValueIterator v = doc.values_begin();
+		 v != doc.values_end(); ++v) {
+		message += encode_length(v.get_valueno());
+		message += encode_length((*v).size());
+		message += *v;
+	    }
+	}
+    }
+    for (auto i : q.matchspies) {
 	string spy_results = i->serialise_results();
 	message += encode_length(spy_results.size());
 	message += spy_results;
     }
     message += serialise_mset(mset);
-    send_message(REPLY_RESULTS, message);
+    if (results_delay > 0.0)
+	RealTime::sleep(RealTime::end_time(results_delay));
+    send_message(with_docs ? REPLY_RESULTSWITHDOCS : REPLY_RESULTS, message);
 }
 
 void
@@ -621,6 +869,22 @@ RemoteServer::msg_uniqueterms(const string &message)
     send_message(REPLY_UNIQUETERMS, encode_length(db->get_unique_terms(did)));
 }
 
+void
+RemoteServer::msg_compression(const string &message)
+{
+    const char *p = message.data();
+    const char *p_end = p + message.size();
+    size_t n;
+    decode_length(&p, p_end, n);
+    if (compress_offer == 0 || n == 0) {
+	n = 0;
+    } else if (n < compress_offer) {
+	n = compress_offer;
+    }
+    set_compress_min(n);
+    // No reply is sent, so this doesn't cost the client a round trip.
+}
+
 void
 RemoteServer::msg_commit(const string &)
 {
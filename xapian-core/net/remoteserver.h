@@ -28,6 +28,7 @@
 #include "xapian/visibility.h"
 #include "xapian/weight.h"
 
+#include "autoptr.h"
 #include "remoteconnection.h"
 
 #include <string>
@@ -49,6 +50,16 @@ class XAPIAN_VISIBILITY_DEFAULT RemoteServer : private RemoteConnection {
     /// The WritableDatabase we're using, or NULL if we're read-only.
     Xapian::WritableDatabase * wdb;
 
+    /// Should we delete db when we're destroyed?
+    bool own_db;
+
+    /** The paths of the databases if db is shared with other connections.
+     *
+     *  If the client asks us to reopen a shared database, we open our own
+     *  copy of it from these instead.
+     */
+    std::vector<std::string> shared_dbpaths;
+
     /// Do we support writing?
     bool writable;
 
@@ -66,9 +77,42 @@ class XAPIAN_VISIBILITY_DEFAULT RemoteServer : private RemoteConnection {
      */
     double idle_timeout;
 
+    /** The smallest message we're willing to compress.
+     *
+     *  This is set from the environment variable XAPIAN_REMOTE_COMPRESS_MIN,
+     *  and is 0 (don't compress messages) if that isn't set.  We only
+     *  compress messages once the client asks for compression with
+     *  MSG_COMPRESSION, as older clients can't decompress them.
+     */
+    size_t compress_offer;
+
+    /** The protocol minor version we tell clients we support.
+     *
+     *  The environment variable XAPIAN_REMOTE_PROTOCOL_MINOR can set this
+     *  lower than XAPIAN_REMOTE_PROTOCOL_MINOR_VERSION, which allows testing
+     *  clients against an older server.
+     */
+    int protocol_minor_version;
+
+    /** Seconds to wait before sending each MSet.
+     *
+     *  This is set from the environment variable XAPIAN_REMOTE_RESULTS_DELAY,
+     *  and is 0 if that isn't set.  It allows testing how clients handle a
+     *  slow server.
+     */
+    double results_delay;
+
     /// The registry, which allows unserialisation of user subclasses.
     Xapian::Registry reg;
 
+    struct PendingQuery;
+
+    /** The query we've sent REPLY_STATS for, if any.
+     *
+     *  The client replies to REPLY_STATS with MSG_GETMSET.
+     */
+    AutoPtr<PendingQuery> pending_query;
+
     /// Accept a message from the client.
     message_type get_message(double timeout, std::string & result,
 			     message_type required_type = MSG_MAX);
@@ -110,15 +154,54 @@ class XAPIAN_VISIBILITY_DEFAULT RemoteServer : private RemoteConnection {
     // get doclength
     void msg_doclength(const std::string & message);
 
-    // set the query; return the mset
+    /** Run a query and send the MSet.
+     *
+     *  @param message	The body of the message.
+     *  @param type	MSG_QUERY, which replies with the statistics and then
+     *			waits for MSG_GETMSET; or MSG_QUERYMSET or
+     *			MSG_PIPELINEDQUERY, which have the parameters for
+     *			the MSet first and reply with it straight away.
+     */
+    void run_query(const std::string & message, message_type type);
+
+    /** Run the match for a query and send the MSet.
+     *
+     *  @param q		The query.
+     *  @param first		The first item to return.
+     *  @param maxitems		The maximum number of items to return.
+     *  @param check_at_least	The minimum number of items to check.
+     *  @param total_stats	The global statistics.  Ownership is passed
+     *				to the MSet.
+     *  @param n_docs		Send the data and values of this many
+     *				documents from the start of the MSet too.
+     */
+    void send_mset(PendingQuery & q, Xapian::doccount first,
+		   Xapian::doccount maxitems, Xapian::doccount check_at_least,
+		   AutoPtr<Xapian::Weight::Internal> & total_stats,
+		   Xapian::doccount n_docs = 0);
+
+    // set the query; return the statistics
     void msg_query(const std::string & message);
 
+    // get the mset for the query set by msg_query
+    void msg_getmset(const std::string & message);
+
+    // set the query and return the mset without exchanging statistics
+    void msg_querymset(const std::string & message);
+
+    // set the query with a guess at the global statistics, and return our
+    // statistics, the mset and the top documents
+    void msg_pipelinedquery(const std::string & message);
+
     // get termlist
     void msg_termlist(const std::string & message);
 
     // get postlist
     void msg_postlist(const std::string & message);
 
+    // get part of a postlist
+    void msg_postlistwindow(const std::string & message);
+
     // get positionlist
     void msg_positionlist(const std::string &message);
 
@@ -170,6 +253,9 @@ class XAPIAN_VISIBILITY_DEFAULT RemoteServer : private RemoteConnection {
     // get number of unique terms
     void msg_uniqueterms(const std::string & message);
 
+    // agree the message compression threshold
+    void msg_compression(const std::string & message);
+
   public:
     /** Construct a RemoteServer.
      *
@@ -189,6 +275,33 @@ class XAPIAN_VISIBILITY_DEFAULT RemoteServer : private RemoteConnection {
 		 double idle_timeout_,
 		 bool writable = false);
 
+    /** Construct a read-only RemoteServer using an open database.
+     *
+     *  This allows several connections to share a database which is already
+     *  open.  They must all be served by the same thread.
+     *
+     *  The shared database is never reopened, as that would move all the
+     *  connections using it to the new revision.  If the client asks to
+     *  reopen it, this connection opens its own copy from @a dbpaths
+     *  instead, and uses that from then on.
+     *
+     *  @param shared_db	The database to use.  The caller retains
+     *			ownership of it, and must keep it open for the
+     *			lifetime of this object.
+     *  @param dbpaths	The paths of the databases which @a shared_db
+     *			was opened from.
+     *  @param context_	Description of the database to use in messages.
+     *  @param fd	The file descriptor of the connection.
+     *  @param active_timeout_	Timeout for actions during a conversation
+     *			(specified in seconds).
+     *  @param idle_timeout_	Timeout while waiting for a new action from
+     *			the client (specified in seconds).
+     */
+    RemoteServer(Xapian::Database * shared_db,
+		 const std::vector<std::string> & dbpaths,
+		 const std::string & context_,
+		 int fd, double active_timeout_, double idle_timeout_);
+
     /// Destructor.
     ~RemoteServer();
 
@@ -199,6 +312,64 @@ class XAPIAN_VISIBILITY_DEFAULT RemoteServer : private RemoteConnection {
      */
     void run();
 
+    /** Accept one message from the client and process it.
+     *
+     *  This waits for up to the idle timeout for the message to arrive.
+     *
+     *  @return false if the connection was closed, true otherwise.
+     */
+    bool handle_message();
+
+    /** Is there more input from the client already buffered?
+     *
+     *  If so, handle_message() should be called again without waiting for
+     *  the connection to become readable.
+     */
+    bool has_buffered_data() const {
+	return RemoteConnection::has_buffered_data();
+    }
+
+    /** Are we part way through a conversation with the client?
+     *
+     *  If so, the next message is expected within the active timeout rather
+     *  than the idle timeout.
+     */
+    bool in_conversation() const { return pending_query.get() != NULL; }
+
+#ifndef __WIN32__
+    /** Prepare to be driven by a caller which uses poll() or similar.
+     *
+     *  Replies are then queued if they can't be written without waiting,
+     *  and the caller should call flush_output() once the connection is
+     *  writable.  The caller should call read_available() when the
+     *  connection is readable, and handle_message() only once
+     *  message_ready() returns true, so neither ever waits.
+     */
+    void set_nonblocking() { set_queue_output(); }
+
+    /// Read input without waiting - returns false on EOF.
+    bool read_available() { return RemoteConnection::read_available(); }
+
+    /// Has a whole message from the client been buffered?
+    bool message_ready() const {
+	return RemoteConnection::has_complete_message();
+    }
+
+    /// Is there output queued still to write?
+    bool has_queued_output() const {
+	return RemoteConnection::has_queued_output();
+    }
+
+    /// Write queued output without waiting - returns true if all written.
+    bool flush_output() { return RemoteConnection::flush_output(); }
+#endif
+
+    /** Release the connection's file descriptor without closing it.
+     *
+     *  @return The file descriptor, or -1 if it has already been closed.
+     */
+    int release_fd() { return RemoteConnection::release_fd(); }
+
     /// Get the registry used for (un)serialisation.
     const Xapian::Registry & get_registry() const { return reg; }
 
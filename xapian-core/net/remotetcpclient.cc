@@ -2,6 +2,7 @@
  *  @brief TCP/IP socket based RemoteDatabase implementation
  */
 /* Copyright (C) 2008,2010 Olly Betts
+ * Copyright (C) 2026 The Xapian contributors
  *
  * This program is free software; you can redistribute it and/or
  * modify it under the terms of the GNU General Public License as
@@ -24,11 +25,115 @@
 
 #include <xapian/error.h>
 
+#include "realtime.h"
 #include "str.h"
 #include "tcpclient.h"
 
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <vector>
+
 using namespace std;
 
+/** How long to keep an idle connection in the pool for (in seconds).
+ *
+ *  This is less than xapian-tcpsrv's default idle timeout, so we shouldn't
+ *  usually try to reuse a connection which the server has closed.
+ */
+const double POOL_IDLE_TIME = 30.0;
+
+namespace {
+
+/** Process-wide pool of idle read-only connections.
+ *
+ *  The connections are keyed by context string, which identifies the host and
+ *  port.
+ */
+class ConnectionPool {
+    /// An idle connection.
+    struct Idle {
+	int fd;
+
+	/// Time after which we close the connection rather than reuse it.
+	double expiry;
+    };
+
+    std::mutex mutex;
+
+    /// Idle connections for each key, most recently used last.
+    map<string, vector<Idle>> idle;
+
+  public:
+    /// Get an idle connection for @a key, or -1 if there isn't one.
+    int get(const string & key) {
+	double now = RealTime::now();
+	lock_guard<std::mutex> lock(mutex);
+	auto i = idle.find(key);
+	if (i == idle.end()) return -1;
+	vector<Idle> & conns = i->second;
+	while (!conns.empty()) {
+	    Idle conn = conns.back();
+	    conns.pop_back();
+	    if (conn.expiry > now) return conn.fd;
+	    CLOSESOCKET(conn.fd);
+	}
+	return -1;
+    }
+
+    /// Add connection @a fd for @a key, keeping at most @a max_idle per key.
+    void put(const string & key, int fd, size_t max_idle) {
+	Idle conn = { fd, RealTime::now() + POOL_IDLE_TIME };
+	lock_guard<std::mutex> lock(mutex);
+	vector<Idle> & conns = idle[key];
+	if (conns.size() >= max_idle) {
+	    CLOSESOCKET(conns.front().fd);
+	    conns.erase(conns.begin());
+	}
+	conns.push_back(conn);
+    }
+
+    /// Close all the idle connections.
+    void clear() {
+	lock_guard<std::mutex> lock(mutex);
+	for (auto && i : idle) {
+	    for (auto && conn : i.second) {
+		CLOSESOCKET(conn.fd);
+	    }
+	}
+	idle.clear();
+    }
+};
+
+}
+
+static ConnectionPool &
+get_pool()
+{
+    // Deliberately never destroyed, since a Database object destroyed during
+    // static destruction may try to return its connection to the pool.
+    static ConnectionPool * pool = new ConnectionPool;
+    return *pool;
+}
+
+/// Close a socket (RemoteTcpClient::close() hides close() in its methods).
+static void
+close_socket(int fd)
+{
+    CLOSESOCKET(fd);
+}
+
+/// Get the maximum number of idle connections to pool per host and port.
+static size_t
+get_max_idle()
+{
+    const char * p = getenv("XAPIAN_REMOTE_POOL_SIZE");
+    if (!p)
+	return 0;
+    long n = atol(p);
+    return n > 0 ? size_t(n) : 0;
+}
+
 int
 RemoteTcpClient::open_socket(const string & hostname, int port,
 			     double timeout_connect)
@@ -56,7 +161,54 @@ RemoteTcpClient::get_tcpcontext(const string & hostname, int port)
     return result;
 }
 
+RemoteTcpClient *
+RemoteTcpClient::open(const string & hostname, int port,
+		      double timeout_, double timeout_connect)
+{
+    const string & key = get_tcpcontext(hostname, port);
+    int fd;
+    while ((fd = get_pool().get(key)) >= 0) {
+	try {
+	    return new RemoteTcpClient(fd, hostname, port, timeout_);
+	} catch (const Xapian::Error &) {
+	    // The server has probably closed the connection, so try the next
+	    // one.  If there's a real problem, opening a new connection will
+	    // report it.
+	    close_socket(fd);
+	}
+    }
+    return new RemoteTcpClient(hostname, port, timeout_, timeout_connect,
+			       false, 0);
+}
+
+bool
+RemoteTcpClient::return_to_pool()
+{
+    size_t max_idle = get_max_idle();
+    if (max_idle == 0) {
+	// Pooling may have been disabled since connections were pooled.
+	get_pool().clear();
+	return false;
+    }
+    int fd = detach_connection();
+    if (fd < 0)
+	return false;
+    // The context identifies the host and port.
+    string key;
+    (void)get_backend_info(&key);
+    get_pool().put(key, fd, max_idle);
+    return true;
+}
+
 RemoteTcpClient::~RemoteTcpClient()
 {
-    do_close();
+    if (!return_to_pool())
+	do_close();
+}
+
+void
+RemoteTcpClient::close()
+{
+    if (!return_to_pool())
+	RemoteDatabase::close();
 }
@@ -61,6 +61,19 @@ class RemoteTcpClient : SOCKET_INITIALIZER_MIXIN public RemoteDatabase {
      */
     static std::string get_tcpcontext(const std::string & hostname, int port);
 
+    /// Constructor for reusing an idle read-only connection from the pool.
+    RemoteTcpClient(int fd, const std::string & hostname, int port,
+		    double timeout_)
+	: RemoteDatabase(fd, timeout_, get_tcpcontext(hostname, port),
+			 false, 0, true) { }
+
+    /** Return our connection to the pool of idle connections.
+     *
+     *  @return true if the connection was returned to the pool, false if it
+     *		can't be reused or pooling is disabled.
+     */
+    bool return_to_pool();
+
   public:
     /** Constructor.
      *
@@ -80,8 +93,23 @@ class RemoteTcpClient : SOCKET_INITIALIZER_MIXIN public RemoteDatabase {
 			 timeout_, get_tcpcontext(hostname, port),
 			 writable, flags) { }
 
+    /** Open a read-only connection, reusing an idle one if possible.
+     *
+     *  Read-only connections are returned to a process-wide pool when the
+     *  database is closed or destroyed, if the environment variable
+     *  XAPIAN_REMOTE_POOL_SIZE is set to the number of idle connections to
+     *  keep for each host and port.  Writable connections are never pooled,
+     *  as the server would keep holding the write lock.
+     *
+     *  Parameters are as for the constructor.
+     */
+    static RemoteTcpClient * open(const std::string & hostname, int port,
+				  double timeout_, double timeout_connect);
+
     /** Destructor. */
     ~RemoteTcpClient();
+
+    void close();
 };
 
 #endif  // XAPIAN_INCLUDED_REMOTETCPCLIENT_H
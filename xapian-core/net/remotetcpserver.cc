@@ -28,6 +28,20 @@
 
 #include "remoteserver.h"
 
+#ifdef HAVE_POLL
+# include "realtime.h"
+# include "safeerrno.h"
+# include "safefcntl.h"
+# include "safeunistd.h"
+# include <poll.h>
+# include <atomic>
+# include <exception>
+# include <memory>
+# include <mutex>
+# include <thread>
+#endif
+
+#include <cstdlib>
 #include <iostream>
 
 using namespace std;
@@ -60,3 +74,316 @@ RemoteTcpServer::handle_one_connection(int socket)
 	// ignore other exceptions
     }
 }
+
+#ifdef HAVE_POLL
+
+/** A thread serving connections from the thread pool.
+ *
+ *  Each worker has its own open database, which all the connections it
+ *  serves share until they ask to reopen it (see RemoteServer).  The worker
+ *  never waits for any one connection - it polls them all, only handles a
+ *  message once the whole of it has arrived, and queues replies which can't
+ *  be written straight away.
+ */
+class RemoteTcpServer::Worker {
+    /// A connection being served.
+    struct Connection {
+	/// The socket for the connection.
+	int fd;
+
+	/// The server handling messages on this connection.
+	unique_ptr<RemoteServer> server;
+
+	/// The time at which the connection times out.
+	double end_time;
+    };
+
+    /// The server we're a worker for.
+    const RemoteTcpServer & tcpserver;
+
+    /** Our own copy of the registry.
+     *
+     *  Copies of a Registry share their internals, which isn't safe between
+     *  threads, so this is made in the thread creating the worker.
+     */
+    Xapian::Registry reg;
+
+    /// The database shared by all our connections.
+    Xapian::Database db;
+
+    /// Description of db for use in messages.
+    string context;
+
+    /// Pipe used to wake up the worker when a connection is added.
+    int wake_fds[2];
+
+    /// Protects new_fds.
+    mutex new_fds_mutex;
+
+    /// Connections which have been added but not yet started.
+    vector<int> new_fds;
+
+    /// The number of connections added and not yet closed.
+    atomic<size_t> n_connections;
+
+    /// Connections being served.
+    vector<Connection> connections;
+
+    /// Start serving a connection.
+    void start_connection(int fd);
+
+    /// Stop serving connection @a i.
+    void close_connection(size_t i);
+
+    /// Handle connection @a i, which poll() says is ready.
+    void handle_connection(size_t i);
+
+  public:
+    explicit Worker(const RemoteTcpServer & tcpserver_);
+
+    /// Add a connection for this worker to serve.
+    void add_connection(int fd);
+
+    /// The number of connections this worker is serving.
+    size_t get_connection_count() const { return n_connections; }
+
+    /// Stop serving all the connections which have been started.
+    void close_all_connections();
+
+    /// Serve connections indefinitely.
+    void run();
+};
+
+RemoteTcpServer::Worker::Worker(const RemoteTcpServer & tcpserver_)
+    : tcpserver(tcpserver_), reg(tcpserver_.reg.clone_internals()),
+      n_connections(0)
+{
+    for (auto && path : tcpserver.dbpaths) {
+	db.add_database(Xapian::Database(path));
+	if (!context.empty()) context += ' ';
+	context += path;
+    }
+    if (pipe(wake_fds) < 0)
+	throw Xapian::NetworkError("Couldn't create pipe", errno);
+    // Neither end should block - see add_connection() and run().
+    for (int fd : wake_fds) {
+	if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0)
+	    throw Xapian::NetworkError("Couldn't make pipe non-blocking", errno);
+    }
+}
+
+void
+RemoteTcpServer::Worker::add_connection(int fd)
+{
+    ++n_connections;
+    {
+	lock_guard<mutex> lock(new_fds_mutex);
+	new_fds.push_back(fd);
+    }
+    // If the write fails because the pipe is full, the worker is already
+    // due to wake up.
+    if (write(wake_fds[1], "", 1) < 0) { }
+}
+
+void
+RemoteTcpServer::Worker::start_connection(int fd)
+{
+    try {
+	Connection con;
+	con.fd = fd;
+	// This sends the greeting message to the client.
+	con.server.reset(new RemoteServer(&db, tcpserver.dbpaths, context, fd,
+					  tcpserver.active_timeout,
+					  tcpserver.idle_timeout));
+	con.server->set_registry(reg);
+	con.server->set_nonblocking();
+	con.end_time = RealTime::end_time(tcpserver.idle_timeout);
+	connections.push_back(std::move(con));
+	return;
+    } catch (const Xapian::Error &e) {
+	cerr << "Got exception " << e.get_description() << endl;
+    } catch (...) {
+	// ignore other exceptions
+    }
+    close(fd);
+    --n_connections;
+}
+
+void
+RemoteTcpServer::Worker::close_connection(size_t i)
+{
+    // The RemoteServer will already have closed the socket if it saw EOF.
+    int fd = connections[i].server->release_fd();
+    if (fd >= 0) close(fd);
+    if (i != connections.size() - 1)
+	swap(connections[i], connections.back());
+    connections.pop_back();
+    --n_connections;
+    if (tcpserver.verbose) cout << "Connection closed." << endl;
+}
+
+void
+RemoteTcpServer::Worker::close_all_connections()
+{
+    while (!connections.empty()) {
+	close_connection(connections.size() - 1);
+    }
+}
+
+void
+RemoteTcpServer::Worker::handle_connection(size_t i)
+{
+    Connection & con = connections[i];
+    RemoteServer & server = *con.server;
+    try {
+	// We only poll for the connection being writable while there's output
+	// queued, and don't read more until it has all been written, so a
+	// client which isn't reading our replies can't make us buffer
+	// unbounded amounts of output.
+	if (server.has_queued_output()) {
+	    (void)server.flush_output();
+	} else if (!server.read_available()) {
+	    // The client has closed the connection.
+	    close_connection(i);
+	    return;
+	}
+
+	while (!server.has_queued_output() && server.message_ready()) {
+	    if (!server.handle_message()) {
+		close_connection(i);
+		return;
+	    }
+	}
+
+	// Between requests the client has the idle timeout to send the next,
+	// but once it has started one everything should keep moving.
+	bool active = server.in_conversation() || server.has_buffered_data() ||
+		      server.has_queued_output();
+	con.end_time = RealTime::end_time(active ? tcpserver.active_timeout
+						 : tcpserver.idle_timeout);
+	return;
+    } catch (const Xapian::NetworkTimeoutError &e) {
+	if (tcpserver.verbose)
+	    cerr << "Connection timed out: " << e.get_description() << endl;
+    } catch (const Xapian::Error &e) {
+	cerr << "Got exception " << e.get_description() << endl;
+    } catch (...) {
+	// ignore other exceptions
+    }
+    close_connection(i);
+}
+
+void
+RemoteTcpServer::Worker::run()
+{
+    vector<struct pollfd> fds;
+    while (true) {
+	struct pollfd p;
+	p.events = POLLIN;
+	p.revents = 0;
+	fds.clear();
+	p.fd = wake_fds[0];
+	fds.push_back(p);
+
+	// Wait until a connection is ready or the first timeout.
+	double now = RealTime::now();
+	int timeout = -1;
+	for (auto && con : connections) {
+	    p.fd = con.fd;
+	    p.events = con.server->has_queued_output() ? POLLOUT : POLLIN;
+	    fds.push_back(p);
+	    double left = con.end_time - now;
+	    int ms = left <= 0 ? 0 : int(left * 1000) + 1;
+	    if (timeout < 0 || ms < timeout) timeout = ms;
+	}
+
+	if (poll(&fds[0], fds.size(), timeout) < 0) {
+	    if (errno == EINTR) continue;
+	    throw Xapian::NetworkError("poll failed", errno);
+	}
+
+	// Check the existing connections before starting any new ones, so the
+	// entries in fds still line up with those in connections.  Work
+	// backwards as close_connection() moves the last entry into the gap.
+	now = RealTime::now();
+	for (size_t i = fds.size() - 1; i-- > 0; ) {
+	    if (fds[i + 1].revents) {
+		handle_connection(i);
+	    } else if (now >= connections[i].end_time) {
+		if (tcpserver.verbose) cerr << "Connection timed out" << endl;
+		close_connection(i);
+	    }
+	}
+
+	if (fds[0].revents) {
+	    char buf[64];
+	    if (read(wake_fds[0], buf, sizeof(buf)) < 0) { }
+	    vector<int> fds_to_start;
+	    {
+		lock_guard<mutex> lock(new_fds_mutex);
+		swap(fds_to_start, new_fds);
+	    }
+	    for (int fd : fds_to_start) {
+		start_connection(fd);
+	    }
+	}
+    }
+}
+
+#endif
+
+void
+RemoteTcpServer::run_threaded(unsigned n_threads)
+{
+#ifdef HAVE_POLL
+    if (writable)
+	throw Xapian::InvalidOperationError("A pool of threads can't be used to serve a writable database");
+    if (n_threads == 0) n_threads = 1;
+
+    // The workers are never deleted, as the threads run until the process
+    // exits.
+    vector<Worker *> workers;
+    for (unsigned i = 0; i != n_threads; ++i) {
+	workers.push_back(new Worker(*this));
+    }
+    for (Worker * worker : workers) {
+	thread([worker]() {
+	    while (true) {
+		try {
+		    worker->run();
+		} catch (const Xapian::Error &e) {
+		    cerr << "Worker thread caught " << e.get_description()
+			 << endl;
+		} catch (const exception &e) {
+		    cerr << "Worker thread caught standard exception: "
+			 << e.what() << endl;
+		} catch (...) {
+		    cerr << "Worker thread caught unknown exception" << endl;
+		}
+		// Rather than taking the whole server down, drop the
+		// connections this worker was serving and carry on.
+		worker->close_all_connections();
+	    }
+	}).detach();
+    }
+
+    while (true) {
+	try {
+	    int connected_socket = TcpServer::accept_connection();
+	    // Give the new connection to the least busy worker.
+	    Worker * worker = workers[0];
+	    for (Worker * w : workers) {
+		if (w->get_connection_count() < worker->get_connection_count())
+		    worker = w;
+	    }
+	    worker->add_connection(connected_socket);
+	} catch (const Xapian::Error &e) {
+	    // FIXME: better error handling.
+	    cerr << "Caught " << e.get_description() << endl;
+	}
+    }
+#else
+    (void)n_threads;
+    throw Xapian::FeatureUnavailableError("A pool of threads requires poll()");
+#endif
+}
@@ -62,6 +62,8 @@ class XAPIAN_VISIBILITY_DEFAULT RemoteTcpServer : public TcpServer {
     /** Accept a connection and return the filedescriptor for it. */
     int accept_connection();
 
+    class Worker;
+
   public:
     /** Construct a RemoteTcpServer for a Database and start listening for
      *  connections.
@@ -90,6 +92,29 @@ class XAPIAN_VISIBILITY_DEFAULT RemoteTcpServer : public TcpServer {
      *  This method may be called by multiple threads.
      */
     void handle_one_connection(int socket);
+
+    /** Accept connections and serve them with a pool of threads.
+     *
+     *  Rather than forking for each connection, each connection is handed
+     *  to one of @a n_threads threads.  Each thread opens the databases once
+     *  and shares them between all the connections it serves, using poll()
+     *  to wait for requests on any of them.  This saves the cost of opening
+     *  the databases for every connection, and the caches stay warm.  A
+     *  thread doesn't wait on any one connection - it only handles a request
+     *  once the whole of it has arrived, and queues replies which can't be
+     *  written straight away.
+     *
+     *  This is only supported for read-only databases.  If a client calls
+     *  reopen(), the connection opens its own copy of the databases at the
+     *  latest revision and uses that from then on, so the other connections
+     *  sharing the databases stay at the revision they're using.
+     *
+     *  This method doesn't return, except by throwing an exception if the
+     *  threads can't be started.
+     *
+     *  @param n_threads	The number of threads to use.
+     */
+    void run_threaded(unsigned n_threads);
 };
 
 #endif // XAPIAN_INCLUDED_REMOTETCPSERVER_H
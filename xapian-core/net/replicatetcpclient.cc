@@ -2,6 +2,7 @@
  *  @brief TCP/IP replication client class.
  */
 /* Copyright (C) 2008,2010,2011,2015 Olly Betts
+ * Copyright (C) 2026 The Xapian contributors
  *
  * This program is free software; you can redistribute it and/or
  * modify it under the terms of the GNU General Public License as
@@ -27,47 +28,124 @@
 #include "socket_utils.h"
 #include "tcpclient.h"
 
+#include <algorithm>
+#include <exception>
+#include <mutex>
+#include <system_error>
+#include <thread>
+
 using namespace std;
 
-ReplicateTcpClient::ReplicateTcpClient(const string & hostname, int port,
-				       double timeout_connect,
-				       double socket_timeout)
-    : socket(open_socket(hostname, port, timeout_connect)),
-      remconn(-1, socket)
+ReplicateTcpClient::ReplicateTcpClient(const string & hostname_, int port_,
+				       double timeout_connect_,
+				       double socket_timeout_)
+    : socket(open_socket(hostname_, port_, timeout_connect_)),
+      remconn(-1, socket),
+      hostname(hostname_),
+      port(port_),
+      timeout_connect(timeout_connect_),
+      socket_timeout(socket_timeout_),
+      streams(1)
 {
     set_socket_timeouts(socket, socket_timeout);
 }
 
 int
-ReplicateTcpClient::open_socket(const string & hostname, int port,
-				double timeout_connect)
+ReplicateTcpClient::open_socket(const string & hostname_, int port_,
+				double timeout_connect_)
 {
-    return TcpClient::open_socket(hostname, port, timeout_connect, false);
+    return TcpClient::open_socket(hostname_, port_, timeout_connect_, false);
 }
 
 void
 ReplicateTcpClient::update_from_master(const std::string & path,
-				       const std::string & masterdb,
+				       const std::string & remotedb,
 				       Xapian::ReplicationInfo & info,
 				       double reader_close_time,
-				       bool force_copy)
+				       bool force_copy,
+				       bool block_checksums,
+				       unsigned streams_)
 {
     Xapian::DatabaseReplica replica(path);
-    remconn.send_message('R',
-			 force_copy ? string() : replica.get_revision_info(),
-			 0.0);
-    remconn.send_message('D', masterdb, 0.0);
     replica.set_read_fd(socket);
+    masterdb = remotedb;
+    streams = streams_;
+    if (streams > 1) {
+	// Ask for any full copy to be sent in parts, which we fetch over
+	// connections of their own.
+	replica.set_part_fetcher(this);
+	remconn.send_message('P', string(), 0.0);
+    }
     info.clear();
-    bool more;
     do {
-	Xapian::ReplicationInfo subinfo;
-	more = replica.apply_next_changeset(&subinfo, reader_close_time);
-	info.changeset_count += subinfo.changeset_count;
-	info.fullcopy_count += subinfo.fullcopy_count;
-	if (subinfo.changed)
-	    info.changed = true;
-    } while (more);
+	remconn.send_message('R',
+			     force_copy ? string() :
+			     replica.get_revision_info(block_checksums),
+			     0.0);
+	remconn.send_message('D', remotedb, 0.0);
+	bool more;
+	do {
+	    Xapian::ReplicationInfo subinfo;
+	    more = replica.apply_next_changeset(&subinfo, reader_close_time);
+	    info.changeset_count += subinfo.changeset_count;
+	    info.fullcopy_count += subinfo.fullcopy_count;
+	    if (subinfo.changed)
+		info.changed = true;
+	} while (more);
+	// If the master sent checksums of its blocks instead of a copy, ask
+	// again for the blocks which differ.
+    } while (replica.delta_copy_pending());
+}
+
+void
+ReplicateTcpClient::fetch_parts(Xapian::DatabaseReplica & replica,
+				const vector<string> & requests)
+{
+    mutex next_mutex;
+    size_t next = 0;
+    exception_ptr error;
+    auto fetch = [&]() {
+	try {
+	    int part_socket = open_socket(hostname, port, timeout_connect);
+	    RemoteConnection conn(-1, part_socket);
+	    try {
+		set_socket_timeouts(part_socket, socket_timeout);
+		conn.send_message('D', masterdb, 0.0);
+		while (true) {
+		    size_t i;
+		    {
+			lock_guard<mutex> lock(next_mutex);
+			if (error || next == requests.size()) break;
+			i = next++;
+		    }
+		    conn.send_message('F', requests[i], 0.0);
+		    replica.apply_file_part_from_fd(part_socket);
+		}
+	    } catch (...) {
+		conn.do_close(false);
+		throw;
+	    }
+	    conn.do_close(false);
+	} catch (...) {
+	    lock_guard<mutex> lock(next_mutex);
+	    if (!error) error = current_exception();
+	}
+    };
+
+    // This thread fetches parts too.  If a thread can't be created, the
+    // parts are fetched over fewer connections.
+    vector<thread> threads;
+    size_t n_threads = min(size_t(streams), requests.size());
+    while (threads.size() + 1 < n_threads) {
+	try {
+	    threads.emplace_back(fetch);
+	} catch (const system_error &) {
+	    break;
+	}
+    }
+    fetch();
+    for (auto & t : threads) t.join();
+    if (error) rethrow_exception(error);
 }
 
 ReplicateTcpClient::~ReplicateTcpClient()
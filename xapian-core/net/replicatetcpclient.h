@@ -2,6 +2,7 @@
  *  @brief TCP/IP replication client class.
  */
 /* Copyright (C) 2008,2010,2011,2015 Olly Betts
+ * Copyright (C) 2026 The Xapian contributors
  *
  * This program is free software; you can redistribute it and/or
  * modify it under the terms of the GNU General Public License as
@@ -27,13 +28,14 @@
 #include "api/replication.h"
 
 #ifdef __WIN32__
-# define SOCKET_INITIALIZER_MIXIN : private WinsockInitializer
+# define SOCKET_INITIALIZER_MIXIN private WinsockInitializer,
 #else
 # define SOCKET_INITIALIZER_MIXIN
 #endif
 
 /// TCP/IP replication client class.
-class XAPIAN_VISIBILITY_DEFAULT ReplicateTcpClient SOCKET_INITIALIZER_MIXIN {
+class XAPIAN_VISIBILITY_DEFAULT ReplicateTcpClient
+    : SOCKET_INITIALIZER_MIXIN private Xapian::ReplicaPartFetcher {
     /// Don't allow assignment.
     void operator=(const ReplicateTcpClient &);
 
@@ -46,36 +48,75 @@ class XAPIAN_VISIBILITY_DEFAULT ReplicateTcpClient SOCKET_INITIALIZER_MIXIN {
     /// Write-only connection to the server.
     RemoteConnection remconn;
 
+    /// The host the server is on.
+    std::string hostname;
+
+    /// The port the server is listening on.
+    int port;
+
+    /// Timeout for connecting to the server (in seconds).
+    double timeout_connect;
+
+    /// Socket timeout (in seconds); 0 for no timeout.
+    double socket_timeout;
+
+    /// The name of the database on the master being replicated.
+    std::string masterdb;
+
+    /// The number of connections to fetch parts of a database copy over.
+    unsigned streams;
+
+    /** Fetch parts of a database copy over several connections.
+     *
+     *  Each connection fetches parts until there are none left, so a slow
+     *  connection doesn't hold up the others.
+     */
+    void fetch_parts(Xapian::DatabaseReplica & replica,
+		     const std::vector<std::string> & requests);
+
     /** Attempt to open a TCP/IP socket connection to a replication server.
      *
-     *  Connect to replication server running on port @a port of host @a hostname.
-     *  Give up trying to connect after @a timeout_connect seconds.
+     *  Connect to replication server running on port @a port_ of host @a hostname_.
+     *  Give up trying to connect after @a timeout_connect_ seconds.
      *
      *  Note: this method is called early on during class construction before
      *  any member variables or even the base class have been initialised.
      *  To help avoid accidentally trying to use member variables or call other
      *  methods which do, this method has been deliberately made "static".
      */
-    static int open_socket(const std::string & hostname, int port,
-			   double timeout_connect);
+    static int open_socket(const std::string & hostname_, int port_,
+			   double timeout_connect_);
 
   public:
     /** Constructor.
      *
-     *  Connect to replication server running on port @a port of host @a hostname.
-     *  Give up trying to connect after @a timeout_connect seconds.
+     *  Connect to replication server running on port @a port_ of host @a hostname_.
+     *  Give up trying to connect after @a timeout_connect_ seconds.
      *
-     *  @param timeout_connect	 Timeout for trying to connect (in seconds).
-     *  @param socket_timeout	 Socket timeout (in seconds); 0 for no timeout.
+     *  @param timeout_connect_	 Timeout for trying to connect (in seconds).
+     *  @param socket_timeout_	 Socket timeout (in seconds); 0 for no timeout.
      */
-    ReplicateTcpClient(const std::string & hostname, int port,
-		       double timeout_connect, double socket_timeout);
+    ReplicateTcpClient(const std::string & hostname_, int port_,
+		       double timeout_connect_, double socket_timeout_);
 
+    /** Update the replica at @a path from database @a remotedb on the master.
+     *
+     *  @param force_copy	Ask for a full copy of the database.
+     *  @param block_checksums	If a full copy is needed, get checksums of
+     *				the master's blocks first, so that only
+     *				blocks which differ from the replica's are
+     *				sent.
+     *  @param streams_	If greater than 1, the table files of a full copy
+     *			are fetched in parts over this many connections at
+     *			once.
+     */
     void update_from_master(const std::string & path,
 			    const std::string & remotedb,
 			    Xapian::ReplicationInfo & info,
 			    double reader_close_time,
-			    bool force_copy);
+			    bool force_copy,
+			    bool block_checksums = false,
+			    unsigned streams_ = 1);
 
     /** Destructor. */
     ~ReplicateTcpClient();
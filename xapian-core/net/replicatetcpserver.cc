@@ -2,6 +2,7 @@
  * @brief TCP/IP replication server class.
  */
 /* Copyright (C) 2008,2010,2011 Olly Betts
+ * Copyright (C) 2026 The Xapian contributors
  *
  * This program is free software; you can redistribute it and/or
  * modify it under the terms of the GNU General Public License as
@@ -36,31 +37,64 @@ ReplicateTcpServer::ReplicateTcpServer(const string & host, int port,
 ReplicateTcpServer::~ReplicateTcpServer() {
 }
 
+/// Get the path of the database named @a dbname by a client.
+static string
+get_dbpath(const string & path, const string & dbname)
+{
+    if (dbname.find("..") != string::npos) {
+	throw Xapian::NetworkError("dbname contained '..'");
+    }
+
+    string dbpath(path);
+    dbpath += '/';
+    dbpath += dbname;
+    return dbpath;
+}
+
 void
 ReplicateTcpServer::handle_one_connection(int socket)
 {
     RemoteConnection client(socket, -1);
     try {
-	// Read start_revision from the client.
-	string start_revision;
-	if (client.get_message(start_revision, 0.0) != 'R') {
-	    throw Xapian::NetworkError("Bad replication client message");
+	string message;
+	int type = client.get_message(message, 0.0);
+	if (type == 'D') {
+	    // A connection for fetching parts of a database copy, which are
+	    // requested one at a time.
+	    Xapian::DatabaseMaster master(get_dbpath(path, message));
+	    while (client.get_message(message, 0.0) == 'F') {
+		master.write_file_part_to_fd(socket, message);
+	    }
+	    return;
 	}
 
-	// Read dbname from the client.
-	string dbname;
-	if (client.get_message(dbname, 0.0) != 'D') {
-	    throw Xapian::NetworkError("Bad replication client message (2)");
+	// The client can ask for a database copy to be sent as parts, which
+	// it fetches over other connections.
+	bool copy_in_parts = false;
+	if (type == 'P') {
+	    copy_in_parts = true;
+	    type = client.get_message(message, 0.0);
 	}
-	if (dbname.find("..") != string::npos) {
-	    throw Xapian::NetworkError("dbname contained '..'");
+
+	// Read start_revision from the client.
+	if (type != 'R') {
+	    throw Xapian::NetworkError("Bad replication client message");
 	}
+	string start_revision = message;
+
+	// The client asks again if we send block checksums instead of a
+	// database copy.
+	do {
+	    // Read dbname from the client.
+	    string dbname;
+	    if (client.get_message(dbname, 0.0) != 'D') {
+		throw Xapian::NetworkError("Bad replication client message (2)");
+	    }
 
-	string dbpath(path);
-	dbpath += '/';
-	dbpath += dbname;
-	Xapian::DatabaseMaster master(dbpath);
-	master.write_changesets_to_fd(socket, start_revision, NULL);
+	    Xapian::DatabaseMaster master(get_dbpath(path, dbname));
+	    master.write_changesets_to_fd(socket, start_revision, NULL,
+					  copy_in_parts);
+	} while (client.get_message(start_revision, 0.0) == 'R');
     } catch (...) {
 	// Ignore exceptions.
     }
@@ -34,6 +34,7 @@
 
 #include "autoptr.h"
 #include <string>
+#include <vector>
 
 using namespace std;
 
@@ -49,6 +50,7 @@ serialise_stats(const Xapian::Weight::Internal &stats)
     result += static_cast<char>(stats.have_max_part);
 
     result += encode_length(stats.termfreqs.size());
+    bool have_wdf_upper_bounds = false;
     map<string, TermFreqs>::const_iterator i;
     for (i = stats.termfreqs.begin(); i != stats.termfreqs.end(); ++i) {
 	result += encode_length(i->first.size());
@@ -59,6 +61,16 @@ serialise_stats(const Xapian::Weight::Internal &stats)
 	result += encode_length(i->second.collfreq);
 	if (stats.have_max_part)
 	    result += serialise_double(i->second.max_part);
+	if (i->second.wdf_upper_bound)
+	    have_wdf_upper_bounds = true;
+    }
+
+    // Any wdf upper bounds follow the terms, so that a peer which doesn't
+    // know about them (protocol < 39.2) just ignores them.
+    if (have_wdf_upper_bounds) {
+	for (i = stats.termfreqs.begin(); i != stats.termfreqs.end(); ++i) {
+	    result += encode_length(i->second.wdf_upper_bound);
+	}
     }
 
     return result;
@@ -79,6 +91,8 @@ unserialise_stats(const string &s, Xapian::Weight::Internal & stat)
 
     size_t n;
     decode_length(&p, p_end, n);
+    vector<TermFreqs*> entries;
+    entries.reserve(n);
     while (n--) {
 	size_t len;
 	decode_length_and_check(&p, p_end, len);
@@ -97,11 +111,19 @@ unserialise_stats(const string &s, Xapian::Weight::Internal & stat)
 	double max_part = 0.0;
 	if (stat.have_max_part)
 	    max_part = unserialise_double(&p, p_end);
-	stat.termfreqs.insert(make_pair(term,
-					TermFreqs(termfreq,
-						  reltermfreq,
-						  collfreq,
-						  max_part)));
+	auto r = stat.termfreqs.insert(make_pair(term,
+						 TermFreqs(termfreq,
+							   reltermfreq,
+							   collfreq,
+							   max_part)));
+	entries.push_back(&r.first->second);
+    }
+
+    // Wdf upper bounds for the terms may follow.
+    if (p != p_end) {
+	for (TermFreqs * tf : entries) {
+	    decode_length(&p, p_end, tf->wdf_upper_bound);
+	}
     }
 }
 
@@ -135,7 +135,10 @@ TcpClient::open_socket(const std::string & hostname, int port,
 		// FIXME: Reduce the timeout if we retry on EINTR.
 		struct timeval tv;
 		RealTime::to_timeval(timeout_connect, &tv);
-		retval = select(fd + 1, 0, &fdset, &fdset, &tv);
+		// select() modifies the sets passed, so pass copies.
+		fd_set writefds = fdset;
+		fd_set exceptfds = fdset;
+		retval = select(fd + 1, 0, &writefds, &exceptfds, &tv);
 	    } while (retval < 0 && errno == EINTR);
 
 	    if (retval <= 0) {
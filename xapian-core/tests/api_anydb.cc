@@ -306,6 +306,66 @@ DEFINE_TESTCASE(multidb5, backend && !multi) {
     return true;
 }
 
+/// Check that matching sub-databases in parallel gives the same results.
+DEFINE_TESTCASE(parallelshards1, backend && !multi) {
+    Xapian::Database db(get_database("apitest_simpledata"));
+    db.add_database(get_database("apitest_simpledata2"));
+    db.add_database(get_database("apitest_termorder"));
+    db.add_database(get_database("apitest_manydocs"));
+    Xapian::Enquire enquire(db);
+    Xapian::Enquire penquire(db);
+    penquire.set_parallel_shards(3);
+
+    const Xapian::Query queries[] = {
+	query(Xapian::Query::OP_OR, "this", "word"),
+	query(Xapian::Query::OP_AND, "this", "paragraph"),
+	query(Xapian::Query::OP_OR, "inmemory", "word"),
+	query(Xapian::Query::OP_AND_MAYBE, "this", "word"),
+    };
+    static const Xapian::doccount ranges[][3] = {
+	{ 0, 10, 0 }, { 0, 1, 0 }, { 2, 3, 0 }, { 0, 10, 50 }, { 0, 1000, 0 }
+    };
+    for (int bool_weight = 0; bool_weight != 2; ++bool_weight) {
+	if (bool_weight) {
+	    enquire.set_weighting_scheme(Xapian::BoolWeight());
+	    penquire.set_weighting_scheme(Xapian::BoolWeight());
+	}
+	for (auto && q : queries) {
+	    enquire.set_query(q);
+	    penquire.set_query(q);
+	    for (auto && r : ranges) {
+		Xapian::MSet mset = enquire.get_mset(r[0], r[1], r[2]);
+		Xapian::MSet pmset = penquire.get_mset(r[0], r[1], r[2]);
+		tout << q << " " << r[0] << " " << r[1] << " " << r[2] << endl;
+		TEST_EQUAL(mset.size(), pmset.size());
+		TEST(mset_range_is_same(mset, 0, pmset, 0, mset.size()));
+		TEST_EQUAL(mset.get_max_attained(), pmset.get_max_attained());
+		TEST_EQUAL(mset.get_max_possible(), pmset.get_max_possible());
+		for (Xapian::doccount i = 0; i != mset.size(); ++i) {
+		    TEST_EQUAL(mset.convert_to_percent(mset[i]),
+			       pmset.convert_to_percent(pmset[i]));
+		}
+		TEST_REL(pmset.get_matches_lower_bound(),<=,
+			 pmset.get_matches_estimated());
+		TEST_REL(pmset.get_matches_estimated(),<=,
+			 pmset.get_matches_upper_bound());
+	    }
+	}
+    }
+
+    // A percentage cutoff isn't supported by a parallel match, so check
+    // the fallback to a serial match works.
+    penquire.set_weighting_scheme(Xapian::BM25Weight());
+    penquire.set_query(queries[0]);
+    penquire.set_cutoff(50);
+    enquire.set_weighting_scheme(Xapian::BM25Weight());
+    enquire.set_query(queries[0]);
+    enquire.set_cutoff(50);
+    TEST(enquire.get_mset(0, 10) == penquire.get_mset(0, 10));
+
+    return true;
+}
+
 // tests that when specifying maxitems to get_mset, no more than
 // that are returned.
 DEFINE_TESTCASE(msetmaxitems1, backend) {
@@ -1196,6 +1256,38 @@ DEFINE_TESTCASE(fetchdocs1, backend) {
     return true;
 }
 
+// test that other calls can be made between prefetching and reading documents
+DEFINE_TESTCASE(fetchdocs2, backend) {
+    Xapian::Database db = get_database("apitest_simpledata");
+    Xapian::Enquire enquire(db);
+    enquire.set_query(query(Xapian::Query::OP_OR, "this", "word"));
+
+    Xapian::MSet mset = enquire.get_mset(0, 10);
+    TEST_REL(mset.size(), >=, 3);
+    mset.fetch();
+
+    // Make some requests before reading the prefetched documents.
+    TEST_EQUAL(db.get_termfreq("this"), 6);
+    TEST(db.get_doclength(*mset[1]) > 0);
+    Xapian::MSet mset2 = enquire.get_mset(0, 10);
+    TEST_EQUAL(mset, mset2);
+    // Fetch the same documents again with a read in between.
+    mset2.fetch(mset2[0], mset2[2]);
+    TEST_EQUAL(mset2[2].get_document().get_data(),
+	       db.get_document(*mset2[2]).get_data());
+
+    for (Xapian::MSetIterator i = mset.begin(); i != mset.end(); ++i) {
+	TEST_EQUAL(i.get_document().get_data(),
+		   db.get_document(*i).get_data());
+    }
+    for (Xapian::MSetIterator i = mset2.begin(); i != mset2.end(); ++i) {
+	TEST_EQUAL(i.get_document().get_data(),
+		   db.get_document(*i).get_data());
+    }
+
+    return true;
+}
+
 // test that searching for a term not in the database fails nicely
 DEFINE_TESTCASE(absentterm1, backend) {
     Xapian::Enquire enquire(get_database("apitest_simpledata"));
@@ -28,6 +28,8 @@
 #include <xapian.h>
 
 #include "backendmanager.h"
+#include "dbcheck.h"
+#include "envvarsetter.h"
 #include "filetests.h"
 #include "str.h"
 #include "testrunner.h"
@@ -37,6 +39,8 @@
 
 #include "apitest.h"
 
+#include "remoteprotocol.h"
+
 #include "safefcntl.h"
 #include "safesysstat.h"
 #include "safeunistd.h"
@@ -45,8 +49,24 @@
 # include <signal.h>
 # include "safesyswait.h"
 #endif
+#ifdef HAVE_SYS_RESOURCE_H
+# include <sys/types.h>
+# include <sys/resource.h>
+# include <signal.h>
+#endif
+#ifdef HAVE_POLL
+# include "safesyssocket.h"
+# include <netinet/in.h>
+# include <arpa/inet.h>
+# include <poll.h>
+# include <cstring>
+# include <thread>
+#endif
 
+#include <algorithm>
 #include <fstream>
+#include <utility>
+#include <vector>
 
 using namespace std;
 
@@ -352,6 +372,747 @@ DEFINE_TESTCASE(matchdecider4, remote) {
     return true;
 }
 
+/// Test searching several remote databases and dropping slow ones.
+DEFINE_TESTCASE(remotetimeout1, remote) {
+    Xapian::Database db;
+    db.add_database(get_database("apitest_simpledata"));
+    db.add_database(get_database("apitest_simpledata"));
+    Xapian::Enquire enquire(db);
+    enquire.set_query(Xapian::Query("paragraph"));
+    Xapian::MSet mset = enquire.get_mset(0, 100);
+    TEST(!mset.is_partial());
+    TEST_EQUAL(mset.size(), 2 * 5);
+
+    {
+	// The server is started by get_database(), so this makes it wait a
+	// second before sending each MSet.
+	EnvVarSetter delay("XAPIAN_REMOTE_RESULTS_DELAY", "1");
+	db.add_database(get_database("apitest_simpledata"));
+    }
+    enquire = Xapian::Enquire(db);
+    enquire.set_query(Xapian::Query("paragraph"));
+
+    // The slow database should be dropped.
+    enquire.set_remote_timeout(0.2);
+    Xapian::MSet mset2 = enquire.get_mset(0, 100);
+    TEST(mset2.is_partial());
+    TEST_EQUAL(mset2.size(), 2 * 5);
+    for (Xapian::MSetIterator i = mset2.begin(); i != mset2.end(); ++i) {
+	TEST_NOT_EQUAL((*i - 1) % 3, 2);
+    }
+
+    // Check the reply from the dropped database doesn't confuse later
+    // requests.
+    enquire.set_remote_timeout(0.0);
+    mset2 = enquire.get_mset(0, 100);
+    TEST(!mset2.is_partial());
+    TEST_EQUAL(mset2.size(), 3 * 5);
+    mset2.fetch();
+    for (Xapian::MSetIterator i = mset2.begin(); i != mset2.end(); ++i) {
+	TEST_EQUAL(i.get_document().get_data(),
+		   db.get_document(*i).get_data());
+    }
+
+    // A timeout which is long enough shouldn't drop anything.
+    enquire.set_remote_timeout(60.0);
+    Xapian::MSet mset3 = enquire.get_mset(0, 100);
+    TEST(!mset3.is_partial());
+    TEST_EQUAL(mset3, mset2);
+
+    return true;
+}
+
+/// Check the wdf upper bounds sent with the remote statistics are used.
+DEFINE_TESTCASE(remotewdfbound1, remote) {
+    Xapian::Database db;
+    db.add_database(get_database("apitest_simpledata"));
+    db.add_database(get_database("apitest_simpledata"));
+    Xapian::Enquire enquire(db);
+    enquire.set_query(Xapian::Query("paragraph"));
+    Xapian::MSet mset = enquire.get_mset(0, 10);
+    TEST(!mset.empty());
+
+    Xapian::termcount max_wdf = 0;
+    for (Xapian::PostingIterator p = db.postlist_begin("paragraph");
+	 p != db.postlist_end("paragraph"); ++p) {
+	max_wdf = max(max_wdf, p.get_wdf());
+    }
+    Xapian::termcount bound = db.get_wdf_upper_bound("paragraph");
+    tout << "max_wdf = " << max_wdf << ", bound = " << bound << endl;
+    TEST_REL(bound, >=, max_wdf);
+    // Previously the bound was always the document length upper bound.
+    TEST_REL(bound, <, db.get_doclength_upper_bound());
+    TEST_REL(bound, <=, db.get_collection_freq("paragraph"));
+
+    // The bounds may be out of date once the database is reopened, so we
+    // should fall back to the document length upper bound.
+    db.reopen();
+    TEST_EQUAL(db.get_wdf_upper_bound("paragraph"),
+	       db.get_doclength_upper_bound());
+
+    return true;
+}
+
+/// Check the documents sent with the results of a single remote database.
+DEFINE_TESTCASE(remotepipeline1, remote) {
+    Xapian::Database db = get_database("apitest_simpledata");
+    Xapian::Enquire enquire(db);
+    enquire.set_query(Xapian::Query("this"));
+    Xapian::MSet mset1 = enquire.get_mset(0, 10);
+    TEST_REL(mset1.size(), >=, 5);
+    vector<string> data;
+    for (Xapian::MSetIterator i = mset1.begin(); i != mset1.end(); ++i) {
+	data.push_back(i.get_document().get_data());
+    }
+
+    enquire.set_remote_prefetch(3);
+    Xapian::MSet mset2 = enquire.get_mset(1, 10);
+    TEST_EQUAL(mset2.size(), mset1.size() - 1);
+    for (Xapian::doccount i = 0; i != mset2.size(); ++i) {
+	TEST_EQUAL(*mset2[i], *mset1[i + 1]);
+	TEST_EQUAL_DOUBLE(mset2[i].get_weight(), mset1[i + 1].get_weight());
+    }
+    // The documents at the top of the MSet came with it, so no request needs
+    // to be made to read them.
+    db.close();
+    for (Xapian::doccount i = 0; i != 3; ++i) {
+	TEST_EQUAL(mset2[i].get_document().get_data(), data[i + 1]);
+    }
+    TEST_EXCEPTION(Xapian::DatabaseError, mset2[3].get_document());
+
+    return true;
+}
+
+/// Check pipelined searches of several remote databases.
+DEFINE_TESTCASE(remotepipeline2, remote) {
+    Xapian::Query query(Xapian::Query::OP_OR,
+			Xapian::Query("this"), Xapian::Query("paragraph"));
+    Xapian::Database db;
+    db.add_database(get_database("apitest_simpledata"));
+    db.add_database(get_database("apitest_simpledata2"));
+    Xapian::Enquire enquire(db);
+    enquire.set_query(query);
+
+    // The first search exchanges statistics, which are then used to guess the
+    // global statistics for the next.
+    Xapian::MSet mset1 = enquire.get_mset(0, 10);
+    TEST_REL(mset1.size(), >=, 5);
+    vector<string> data;
+    for (Xapian::MSetIterator i = mset1.begin(); i != mset1.end(); ++i) {
+	data.push_back(i.get_document().get_data());
+    }
+
+    enquire.set_remote_prefetch(5);
+    Xapian::MSet mset2 = enquire.get_mset(0, 10);
+    TEST_EQUAL(mset2, mset1);
+    // None of the documents we've fetched should need to be requested.
+    mset2.fetch(mset2[0], mset2[4]);
+    db.close();
+    for (Xapian::doccount i = 0; i != 5; ++i) {
+	TEST_EQUAL(mset2[i].get_document().get_data(), data[i]);
+    }
+
+    // The statistics for a term are counted for each position it's at in
+    // the query, so those for a query which doesn't repeat a term are the
+    // wrong guess for one which does (and vice versa).  The wrong guess
+    // should be spotted, and the query run again.
+    Xapian::Query dup_query(Xapian::Query::OP_OR,
+			    Xapian::Query("this", 1, 1),
+			    Xapian::Query("this", 1, 2));
+    dup_query = Xapian::Query(Xapian::Query::OP_OR,
+			      dup_query, Xapian::Query("paragraph"));
+    Xapian::Database db2;
+    db2.add_database(get_database("apitest_simpledata"));
+    db2.add_database(get_database("apitest_simpledata2"));
+    Xapian::Enquire enquire2(db2);
+    enquire2.set_query(dup_query);
+    Xapian::MSet dup_mset = enquire2.get_mset(0, 10);
+
+    Xapian::Database db3;
+    db3.add_database(get_database("apitest_simpledata"));
+    db3.add_database(get_database("apitest_simpledata2"));
+    Xapian::Enquire enquire3(db3);
+    enquire3.set_remote_prefetch(5);
+    enquire3.set_query(query);
+    TEST_EQUAL(enquire3.get_mset(0, 10), mset1);
+    enquire3.set_query(dup_query);
+    TEST_EQUAL(enquire3.get_mset(0, 10), dup_mset);
+    enquire3.set_query(query);
+    Xapian::MSet mset3 = enquire3.get_mset(0, 10);
+    TEST_EQUAL(mset3, mset1);
+    for (Xapian::doccount i = 0; i != 5; ++i) {
+	TEST_EQUAL(mset3[i].get_document().get_data(), data[i]);
+    }
+
+    return true;
+}
+
+/// Check searching remote servers which don't support pipelined queries.
+DEFINE_TESTCASE(remotepipeline3, remote) {
+    Xapian::Query query(Xapian::Query::OP_OR,
+			Xapian::Query("this"), Xapian::Query("paragraph"));
+    Xapian::Database ref_db;
+    ref_db.add_database(get_database("apitest_simpledata"));
+    ref_db.add_database(get_database("apitest_simpledata2"));
+    Xapian::Enquire ref_enquire(ref_db);
+    ref_enquire.set_query(query);
+    Xapian::MSet ref_mset = ref_enquire.get_mset(0, 10);
+    Xapian::Enquire ref_enquire1(get_database("apitest_simpledata"));
+    ref_enquire1.set_query(query);
+    Xapian::MSet ref_mset1 = ref_enquire1.get_mset(0, 10);
+
+    // The servers are started by get_database(), so this makes them report
+    // protocol 39.4, which has no MSG_PIPELINEDQUERY.
+    EnvVarSetter minor("XAPIAN_REMOTE_PROTOCOL_MINOR", "4");
+    Xapian::Database db;
+    db.add_database(get_database("apitest_simpledata"));
+    db.add_database(get_database("apitest_simpledata2"));
+    Xapian::Enquire enquire(db);
+    enquire.set_query(query);
+    enquire.set_remote_prefetch(5);
+    TEST_EQUAL(enquire.get_mset(0, 10), ref_mset);
+    Xapian::MSet mset = enquire.get_mset(0, 10);
+    TEST_EQUAL(mset, ref_mset);
+    // The documents weren't sent with the MSet.
+    db.close();
+    TEST_EXCEPTION(Xapian::DatabaseError, mset[0].get_document());
+
+    Xapian::Database db1 = get_database("apitest_simpledata");
+    Xapian::Enquire enquire1(db1);
+    enquire1.set_query(query);
+    enquire1.set_remote_prefetch(5);
+    mset = enquire1.get_mset(0, 10);
+    TEST_EQUAL(mset, ref_mset1);
+    db1.close();
+    TEST_EXCEPTION(Xapian::DatabaseError, mset[0].get_document());
+
+    // Protocol 39.0 doesn't support MSG_QUERYMSET either.
+    minor.set("0");
+    db1 = get_database("apitest_simpledata");
+    enquire1 = Xapian::Enquire(db1);
+    enquire1.set_query(query);
+    enquire1.set_remote_prefetch(5);
+    TEST_EQUAL(enquire1.get_mset(0, 10), ref_mset1);
+    enquire1.set_remote_prefetch(0);
+    TEST_EQUAL(enquire1.get_mset(0, 10), ref_mset1);
+
+    return true;
+}
+
+/// Check remote messages with compression in both directions.
+DEFINE_TESTCASE(remotecompress1, remote && writable) {
+    Xapian::Database db_plain = get_database("apitest_simpledata");
+    Xapian::Enquire enq_plain(db_plain);
+    enq_plain.set_query(Xapian::Query("this"));
+    Xapian::MSet mset_plain = enq_plain.get_mset(0, 100);
+
+    // The server is started by get_database() and inherits the environment,
+    // so both ends compress.  remotecompress2 checks that messages actually
+    // cross the wire compressed.
+    EnvVarSetter compress_min("XAPIAN_REMOTE_COMPRESS_MIN", "1");
+    Xapian::Database db = get_database("apitest_simpledata");
+    Xapian::Enquire enq(db);
+    enq.set_query(Xapian::Query("this"));
+    Xapian::MSet mset = enq.get_mset(0, 100);
+    TEST(!mset.empty());
+    TEST_EQUAL(mset, mset_plain);
+    for (Xapian::MSetIterator i = mset.begin(); i != mset.end(); ++i) {
+	TEST_EQUAL(i.get_document().get_data(),
+		   db_plain.get_document(*i).get_data());
+    }
+    TEST_EQUAL(postlist_to_string(db, "this"),
+	       postlist_to_string(db_plain, "this"));
+
+    // Compressible document data larger than a single zlib window.
+    string data;
+    for (int i = 0; i < 10000; ++i) {
+	data += "document data ";
+	data += str(i % 97);
+    }
+    Xapian::WritableDatabase wdb = get_writable_database();
+    Xapian::Document doc;
+    doc.set_data(data);
+    doc.add_term("big");
+    Xapian::docid did = wdb.add_document(doc);
+    wdb.commit();
+    TEST_EQUAL(wdb.get_document(did).get_data(), data);
+
+    return true;
+}
+
+#ifdef HAVE_POLL
+/// Close a file descriptor when it goes out of scope.
+struct FdCloser {
+    int fd;
+
+    explicit FdCloser(int fd_) : fd(fd_) { }
+
+    ~FdCloser() { if (fd >= 0) close(fd); }
+};
+#endif
+
+/** Check a server using a pool of threads with several concurrent clients.
+ *
+ *  A client which had only sent part of a message used to stop the other
+ *  connections served by the same thread from being served.
+ */
+DEFINE_TESTCASE(remotethreads1, remote) {
+#ifndef HAVE_POLL
+    SKIP_TEST("Serving with a pool of threads requires poll()");
+#else
+    skip_test_unless_backend("remotetcp");
+    Xapian::Database db_single = get_database("apitest_simpledata");
+    Xapian::Enquire enq_single(db_single);
+    enq_single.set_query(Xapian::Query("paragraph"));
+    Xapian::MSet mset_single = enq_single.get_mset(0, 10);
+    TEST_EQUAL(mset_single.size(), 5);
+
+    // With one thread, all the connections are served by the same thread.
+    for (unsigned n_threads = 1; n_threads <= 3; n_threads += 2) {
+	int port = start_threaded_remote_server("apitest_simpledata",
+						n_threads);
+
+	// Connect a client which sends the start of a message and then
+	// stalls.
+	FdCloser stalled(socket(AF_INET, SOCK_STREAM, 0));
+	TEST(stalled.fd >= 0);
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+	TEST_EQUAL(connect(stalled.fd, reinterpret_cast<sockaddr *>(&addr),
+			   sizeof(addr)), 0);
+	// A message type and a length of 100, followed by just 3 bytes.
+	TEST_EQUAL(write(stalled.fd, "\x08\x64" "abc", 5), 5);
+
+	// Several clients with requests in flight at once - a search over
+	// several remote shards sends the query to all of them before
+	// reading any of the replies.
+	const unsigned n_clients = 2 * n_threads + 2;
+	Xapian::Database db;
+	for (unsigned i = 0; i != n_clients; ++i) {
+	    db.add_database(Xapian::Remote::open("127.0.0.1", port, 10000));
+	}
+	Xapian::Enquire enquire(db);
+	enquire.set_query(Xapian::Query("paragraph"));
+	Xapian::MSet mset = enquire.get_mset(0, 100);
+	TEST_EQUAL(mset.size(), n_clients * mset_single.size());
+	mset.fetch();
+	for (Xapian::MSetIterator i = mset.begin(); i != mset.end(); ++i) {
+	    Xapian::docid did = (*i - 1) / n_clients + 1;
+	    TEST_EQUAL(i.get_document().get_data(),
+		       db_single.get_document(did).get_data());
+	}
+
+	// The clients can also search one at a time.
+	for (unsigned i = 0; i != n_clients; ++i) {
+	    Xapian::Database shard = Xapian::Remote::open("127.0.0.1", port,
+							  10000);
+	    Xapian::Enquire enq_shard(shard);
+	    enq_shard.set_query(Xapian::Query("paragraph"));
+	    TEST_EQUAL(enq_shard.get_mset(0, 10), mset_single);
+	}
+    }
+
+    return true;
+#endif
+}
+
+/// Check reopen() on one connection to a threaded server leaves the others be.
+DEFINE_TESTCASE(remotethreads2, remote && writable) {
+#ifndef HAVE_POLL
+    SKIP_TEST("Serving with a pool of threads requires poll()");
+#else
+    skip_test_unless_backend("remotetcp");
+    Xapian::WritableDatabase wdb = get_writable_database();
+    Xapian::Document doc;
+    doc.add_term("foo");
+    wdb.add_document(doc);
+    wdb.commit();
+
+    // With one thread, both connections are served by the same thread.
+    int port = start_threaded_remote_server_for_wdb(1);
+    Xapian::Database db1 = Xapian::Remote::open("127.0.0.1", port, 10000);
+    Xapian::Database db2 = Xapian::Remote::open("127.0.0.1", port, 10000);
+    TEST_EQUAL(db1.get_termfreq("foo"), 1);
+    TEST_EQUAL(db2.get_termfreq("foo"), 1);
+
+    wdb.add_document(doc);
+    wdb.commit();
+
+    TEST(db1.reopen());
+    TEST_EQUAL(db1.get_termfreq("foo"), 2);
+    TEST_EQUAL(db1.get_doccount(), 2);
+    TEST_EQUAL(db2.get_termfreq("foo"), 1);
+    TEST_EQUAL(db2.get_doccount(), 1);
+
+    TEST(db2.reopen());
+    TEST_EQUAL(db2.get_termfreq("foo"), 2);
+    TEST_EQUAL(db2.get_doccount(), 2);
+
+    return true;
+#endif
+}
+
+#ifdef HAVE_POLL
+/// Connect to the remote server listening on @a port on localhost.
+static int
+connect_to_remote_server(int port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+	close(fd);
+	return -1;
+    }
+    return fd;
+}
+
+/** Decode the header of a remote protocol message.
+ *
+ *  @param data	The data the message starts at position @a i in.
+ *  @param[in,out] i	Position of the message, which is advanced to the
+ *			start of its contents.
+ *  @param[out] len	The length of the message contents.
+ *
+ *  @return false if @a data ends before the end of the header.
+ */
+static bool
+decode_remote_header(const string & data, size_t & i, size_t & len)
+{
+    if (data.size() - i < 2) return false;
+    len = static_cast<unsigned char>(data[i + 1]);
+    size_t j = i + 2;
+    if (len == 0xff) {
+	len = 0;
+	unsigned shift = 0;
+	unsigned char ch;
+	do {
+	    if (j == data.size()) return false;
+	    ch = data[j++];
+	    len |= size_t(ch & 0x7f) << shift;
+	    shift += 7;
+	} while (!(ch & 0x80));
+	len += 255;
+    }
+    i = j;
+    return true;
+}
+
+/** Read a message from a remote connection.
+ *
+ *  @return The message type, or -1 if the connection is closed first.
+ */
+static int
+read_remote_message(int fd, string & contents)
+{
+    string buf;
+    while (true) {
+	size_t i = 0, len;
+	if (decode_remote_header(buf, i, len) && buf.size() - i >= len) {
+	    contents.assign(buf, i, len);
+	    return static_cast<unsigned char>(buf[0]);
+	}
+
+	struct pollfd pfd;
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	if (poll(&pfd, 1, 10000) <= 0) return -1;
+	char data[4096];
+	ssize_t n = read(fd, data, sizeof(data));
+	if (n <= 0) return -1;
+	buf.append(data, n);
+    }
+}
+
+/** Relay a single connection to a remote server, keeping a copy of the data.
+ *
+ *  Only one connection is accepted - any others are refused.
+ */
+class RemoteRelay {
+    int listener;
+
+    int port;
+
+    string to_server, from_server;
+
+    /// Did the client close the connection (rather than it timing out)?
+    bool client_closed;
+
+    thread relay_thread;
+
+    void relay(int server_port) {
+	FdCloser listen_fd(listener);
+	struct pollfd pfds[2];
+	pfds[0].fd = listener;
+	pfds[0].events = POLLIN;
+	if (poll(pfds, 1, 10000) <= 0) return;
+	FdCloser client(accept(listener, NULL, NULL));
+	close(listener);
+	listen_fd.fd = -1;
+	FdCloser server(connect_to_remote_server(server_port));
+	if (client.fd < 0 || server.fd < 0) return;
+
+	pfds[0].fd = client.fd;
+	pfds[1].fd = server.fd;
+	pfds[1].events = POLLIN;
+	while (poll(pfds, 2, 10000) > 0) {
+	    for (int i = 0; i != 2; ++i) {
+		if (!pfds[i].revents) continue;
+		char data[4096];
+		ssize_t n = read(pfds[i].fd, data, sizeof(data));
+		if (n <= 0) {
+		    client_closed = (i == 0);
+		    return;
+		}
+		(i ? from_server : to_server).append(data, n);
+		const char * p = data;
+		while (n) {
+		    ssize_t w = write(pfds[1 - i].fd, p, n);
+		    if (w <= 0) return;
+		    p += w;
+		    n -= w;
+		}
+	    }
+	}
+    }
+
+  public:
+    /// Listen on an unused port and relay to @a server_port.
+    explicit RemoteRelay(int server_port)
+	: port(-1), client_closed(false) {
+	listener = socket(AF_INET, SOCK_STREAM, 0);
+	if (listener < 0) return;
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = 0;
+	addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+	socklen_t addrlen = sizeof(addr);
+	if (bind(listener, reinterpret_cast<sockaddr *>(&addr), addrlen) < 0 ||
+	    listen(listener, 1) < 0 ||
+	    getsockname(listener, reinterpret_cast<sockaddr *>(&addr),
+			&addrlen) < 0) {
+	    close(listener);
+	    return;
+	}
+	port = ntohs(addr.sin_port);
+	relay_thread = thread(&RemoteRelay::relay, this, server_port);
+    }
+
+    ~RemoteRelay() { wait(); }
+
+    /// The port to connect to, or -1 if setting up the relay failed.
+    int get_port() const { return port; }
+
+    /// Wait for the relayed connection to be closed.
+    void wait() {
+	if (relay_thread.joinable()) relay_thread.join();
+    }
+
+    /// Did the client close the connection (only valid after wait())?
+    bool closed_by_client() const { return client_closed; }
+
+    /// Data sent by the client (only valid after wait()).
+    const string & get_to_server() const { return to_server; }
+
+    /// Data sent by the server (only valid after wait()).
+    const string & get_from_server() const { return from_server; }
+};
+
+/// Get the types of the messages in the data sent one way over a connection.
+static string
+get_message_types(const string & data)
+{
+    string types;
+    size_t i = 0, len;
+    while (i < data.size()) {
+	types += data[i];
+	if (!decode_remote_header(data, i, len)) break;
+	i += len;
+    }
+    return types;
+}
+
+/// Count the compressed messages in the data sent one way over a connection.
+static unsigned
+count_compressed_messages(const string & data)
+{
+    const string & types = get_message_types(data);
+    unsigned n_compressed = 0;
+    for (char type : types) {
+	if (type & MESSAGE_COMPRESSED) ++n_compressed;
+    }
+    return n_compressed;
+}
+#endif
+
+/** Check that compressible messages cross the wire compressed, and that
+ *  compressed messages which don't expand to their declared length are
+ *  rejected.
+ */
+DEFINE_TESTCASE(remotecompress2, remote) {
+#ifndef HAVE_POLL
+    SKIP_TEST("Serving with a pool of threads requires poll()");
+#else
+    skip_test_unless_backend("remotetcp");
+    Xapian::Database db_plain = get_database("apitest_simpledata");
+    const string & data = db_plain.get_document(2).get_data();
+    // This needs to be long enough to be worth compressing.
+    TEST_REL(data.size(),>,200);
+
+    // The server and the client both read XAPIAN_REMOTE_COMPRESS_MIN.
+    EnvVarSetter compress_min("XAPIAN_REMOTE_COMPRESS_MIN", "0");
+    for (int compress = 0; compress != 2; ++compress) {
+	compress_min.set(compress ? "1" : "0");
+	int port = start_threaded_remote_server("apitest_simpledata", 1);
+	RemoteRelay relay(port);
+	TEST(relay.get_port() >= 0);
+	{
+	    Xapian::Database db = Xapian::Remote::open("127.0.0.1",
+						       relay.get_port(),
+						       10000);
+	    TEST_EQUAL(db.get_document(2).get_data(), data);
+	    // A long term makes a compressible message to the server.
+	    TEST_EQUAL(db.get_termfreq(string(300, 'x')), 0);
+	    db.close();
+	}
+	relay.wait();
+	unsigned n_to_server = count_compressed_messages(relay.get_to_server());
+	unsigned n_from_server =
+	    count_compressed_messages(relay.get_from_server());
+	tout << "compress=" << compress << " to server: " << n_to_server
+	     << " from server: " << n_from_server << '\n';
+	if (compress) {
+	    TEST_REL(n_to_server,>,0);
+	    TEST_REL(n_from_server,>,0);
+	} else {
+	    TEST_EQUAL(n_to_server, 0);
+	    TEST_EQUAL(n_from_server, 0);
+	}
+    }
+
+    int port = start_threaded_remote_server("apitest_simpledata", 1);
+    // MSG_TERMFREQ for "paragraph", as a stored deflate block, and with the
+    // uncompressed length given before it.
+    const string block("\x01\x09\x00\xf6\xff" "paragraph", 14);
+    for (int declared_len = 9; declared_len >= 8; --declared_len) {
+	FdCloser fd(connect_to_remote_server(port));
+	TEST(fd.fd >= 0);
+	string contents;
+	TEST_EQUAL(read_remote_message(fd.fd, contents), REPLY_UPDATE);
+	string msg;
+	msg += char(MSG_TERMFREQ | MESSAGE_COMPRESSED);
+	msg += char(1 + block.size());
+	msg += char(declared_len);
+	msg += block;
+	TEST_EQUAL(write(fd.fd, msg.data(), msg.size()),
+		   ssize_t(msg.size()));
+	int type = read_remote_message(fd.fd, contents);
+	if (declared_len == 9) {
+	    TEST_EQUAL(type, REPLY_TERMFREQ);
+	    TEST_EQUAL(contents, "\x05");
+	} else {
+	    // The server drops the connection without replying.
+	    TEST_EQUAL(type, -1);
+	}
+    }
+
+    return true;
+#endif
+}
+
+/// Check closing a remote database with connection pooling enabled.
+DEFINE_TESTCASE(remotepool1, remote) {
+    // The testsuite's xapian-tcpsrv won't exit until any pooled connection
+    // to it is closed, so open the database we'll use to empty the pool now.
+    Xapian::Database db2 = get_database("apitest_simpledata");
+
+    {
+	EnvVarSetter pool_size("XAPIAN_REMOTE_POOL_SIZE", "1");
+	Xapian::Database db = get_database("apitest_simpledata");
+	Xapian::Enquire enquire(db);
+	enquire.set_query(Xapian::Query("paragraph"));
+	TEST_EQUAL(enquire.get_mset(0, 10).size(), 5);
+	// A remotetcp connection goes into the pool here, but the database
+	// should behave as if it were closed.
+	db.close();
+	TEST_EXCEPTION(Xapian::DatabaseError, db.get_termfreq("paragraph"));
+	db.close();
+    }
+
+    // Closing with pooling disabled closes any pooled connections, which the
+    // testsuite would otherwise report as leaked.
+    TEST_EQUAL(db2.get_doccount(), 6);
+    db2.close();
+
+    return true;
+}
+
+/** Check a pooled remote connection is reused, and one which timed out
+ *  isn't.
+ */
+DEFINE_TESTCASE(remotepool2, remote) {
+#ifndef HAVE_POLL
+    SKIP_TEST("Serving with a pool of threads requires poll()");
+#else
+    skip_test_unless_backend("remotetcp");
+    EnvVarSetter pool_size("XAPIAN_REMOTE_POOL_SIZE", "1");
+    int port = start_threaded_remote_server("apitest_simpledata", 1);
+    {
+	// The relay only accepts one connection, so reopening the database
+	// only works if the first connection is reused.
+	RemoteRelay relay(port);
+	TEST(relay.get_port() >= 0);
+	for (int i = 0; i != 3; ++i) {
+	    Xapian::Database db = Xapian::Remote::open("127.0.0.1",
+						       relay.get_port(),
+						       10000);
+	    TEST_EQUAL(db.get_doccount(), 6);
+	    Xapian::Enquire enquire(db);
+	    enquire.set_query(Xapian::Query("paragraph"));
+	    TEST_EQUAL(enquire.get_mset(0, 10).size(), 5);
+	    db.close();
+	}
+	// A reused connection is checked with MSG_REOPEN.
+	const string & types = get_message_types(relay.get_to_server());
+	TEST_EQUAL(count(types.begin(), types.end(), char(MSG_REOPEN)), 2);
+
+	// Closing with pooling disabled closes the pooled connection.
+	pool_size.set("0");
+	Xapian::Remote::open("127.0.0.1", port, 10000).close();
+	relay.wait();
+	TEST(relay.closed_by_client());
+    }
+
+    // The reply to a query which timed out may still arrive, so the
+    // connection mustn't be pooled.
+    pool_size.set("1");
+    EnvVarSetter results_delay("XAPIAN_REMOTE_RESULTS_DELAY", "1");
+    port = start_threaded_remote_server("apitest_simpledata", 1);
+    RemoteRelay relay(port);
+    TEST(relay.get_port() >= 0);
+    {
+	Xapian::Database db = Xapian::Remote::open("127.0.0.1",
+						   relay.get_port(), 200);
+	Xapian::Enquire enquire(db);
+	enquire.set_query(Xapian::Query("paragraph"));
+	TEST_EXCEPTION(Xapian::NetworkTimeoutError, enquire.get_mset(0, 10));
+	db.close();
+    }
+    relay.wait();
+    TEST(relay.closed_by_client());
+
+    return true;
+#endif
+}
+
 /** Check that replacing an unmodified document doesn't increase the automatic
  *  flush counter.  Regression test for bug fixed in 1.1.4/1.0.18.
  */
@@ -1209,7 +1970,8 @@ DEFINE_TESTCASE(retrylock1, writable && !inmemory && !remote) {
 	fd_set f;
 	FD_ZERO(&f);
 	FD_SET(fds[1], &f);
-	int sr = select(fds[1] + 1, &f, NULL, &f, &tv);
+	fd_set e = f;
+	int sr = select(fds[1] + 1, &f, NULL, &e, &tv);
 	if (sr == 0) {
 	    // Timed out.
 	    result[0] = 'T';
@@ -1401,3 +2163,368 @@ DEFINE_TESTCASE(embedded1, singlefile) {
 
     return true;
 }
+
+/// Feature test for Database::set_block_cache_size().
+DEFINE_TESTCASE(blockcache1, glass) {
+    const string & db_path = get_database_path("etext");
+    size_t old_size = Xapian::Database::get_block_cache_size();
+    // Start with an empty cache.
+    Xapian::Database::set_block_cache_size(0);
+    Xapian::Database::set_block_cache_size(1024 * 1024);
+    TEST_EQUAL(Xapian::Database::get_block_cache_size(), 1024 * 1024);
+
+    unsigned long hits0, misses0;
+    size_t used;
+    Xapian::Database::get_block_cache_stats(hits0, misses0, used);
+    TEST_EQUAL(used, 0);
+
+    Xapian::doccount termfreq;
+    {
+	Xapian::Database db(db_path);
+	termfreq = db.get_termfreq("the");
+    }
+    unsigned long hits1, misses1;
+    Xapian::Database::get_block_cache_stats(hits1, misses1, used);
+    TEST_REL(misses1, >, misses0);
+    TEST_REL(used, >, 0);
+
+    // A second Database object should find the same blocks in the cache.
+    {
+	Xapian::Database db(db_path);
+	TEST_EQUAL(db.get_termfreq("the"), termfreq);
+    }
+    unsigned long hits2, misses2;
+    Xapian::Database::get_block_cache_stats(hits2, misses2, used);
+    TEST_REL(hits2, >, hits1);
+    TEST_EQUAL(misses2, misses1);
+
+    Xapian::Database::set_block_cache_size(0);
+    Xapian::Database::get_block_cache_stats(hits2, misses2, used);
+    TEST_EQUAL(used, 0);
+
+    Xapian::Database::set_block_cache_size(old_size);
+    return true;
+}
+
+/// Check committing the tables in parallel, including when a table fails.
+DEFINE_TESTCASE(parallelcommit1, glass) {
+    // Use threads for every commit.
+    EnvVarSetter threshold("XAPIAN_PARALLEL_COMMIT_THRESHOLD", "1");
+    Xapian::WritableDatabase wdb =
+	get_named_writable_database("parallelcommit1");
+    const string & db_path = get_named_writable_database_path("parallelcommit1");
+    for (Xapian::docid did = 1; did <= 10; ++did) {
+	Xapian::Document doc;
+	doc.add_posting("foo", 1);
+	doc.add_posting("bar", 2);
+	doc.add_value(0, str(did));
+	doc.set_data(str(did));
+	wdb.add_document(doc);
+    }
+    wdb.add_synonym("foo", "fu");
+    wdb.add_spelling("foo");
+    wdb.commit();
+
+    Xapian::Database db(db_path);
+    TEST_EQUAL(db.get_doccount(), 10);
+    TEST_EQUAL(db.get_termfreq("foo"), 10);
+    TEST_EQUAL(db.get_document(7).get_data(), "7");
+    TEST_EQUAL(db.get_document(7).get_value(0), "7");
+    TEST_EQUAL(*db.positionlist_begin(3, "bar"), 2);
+    TEST_EQUAL(*db.synonyms_begin("foo"), "fu");
+    TEST_EQUAL(db.get_spelling_suggestion("fo"), "foo");
+    dbcheck(db, 10, 10);
+
+#if defined HAVE_GETRLIMIT && defined RLIMIT_FSIZE && defined SIGXFSZ
+    // Add enough document data that the docdata table is the largest, and
+    // then limit the size a file can grow to, so only writing the new blocks
+    // of the docdata table fails.  It's the last table to be committed, so
+    // is committed by a thread other than the caller's.
+    for (int i = 0; i != 200; ++i) {
+	Xapian::Document doc;
+	doc.add_term("foo");
+	doc.set_data(string(2000, 'x') + str(i));
+	wdb.add_document(doc);
+    }
+    off_t limit = file_size(db_path + "/docdata.glass");
+    TEST_REL(limit, >, file_size(db_path + "/postlist.glass"));
+
+    struct FileSizeLimit {
+	struct rlimit old_rl;
+	void (*old_handler)(int);
+
+	FileSizeLimit(off_t limit_) {
+	    // Writing beyond the limit then fails with EFBIG, rather than the
+	    // process being killed.
+	    old_handler = signal(SIGXFSZ, SIG_IGN);
+	    getrlimit(RLIMIT_FSIZE, &old_rl);
+	    struct rlimit rl = old_rl;
+	    rl.rlim_cur = limit_;
+	    setrlimit(RLIMIT_FSIZE, &rl);
+	}
+
+	~FileSizeLimit() {
+	    setrlimit(RLIMIT_FSIZE, &old_rl);
+	    signal(SIGXFSZ, old_handler);
+	}
+    };
+
+    {
+	FileSizeLimit fsize_limit(limit);
+	TEST_EXCEPTION(Xapian::DatabaseError, wdb.commit());
+    }
+
+    // The failed commit mustn't have changed the revision on disk.
+    db.reopen();
+    TEST_EQUAL(db.get_doccount(), 10);
+    dbcheck(db, 10, 10);
+#endif
+    return true;
+}
+
+static void
+make_blockmax1_db(Xapian::WritableDatabase &db, const string &)
+{
+    // Enough documents for the posting lists to span many chunks, with a
+    // few documents where "common" has a high wdf clustered together so most
+    // chunks can be skipped once they're in the MSet.
+    for (Xapian::docid did = 1; did <= 5000; ++did) {
+	Xapian::Document doc;
+	Xapian::termcount wdf = 1;
+	if (did >= 2500 && did < 2520) wdf = 20 + did % 7;
+	doc.add_term("common", wdf);
+	doc.add_term("pad", did % 11 + 1);
+	if (did % 3 == 0) doc.add_term("third", did % 5 + 1);
+	db.add_document(doc);
+    }
+}
+
+/// Check skipping chunks using their max wdf doesn't change the results.
+DEFINE_TESTCASE(blockmax1, generated) {
+    Xapian::Database db = get_database("blockmax1", make_blockmax1_db);
+    Xapian::Enquire enq(db);
+    static const char * const queries[][2] = {
+	{ "common", NULL },
+	{ "common", "third" },
+	{ "third", "pad" },
+    };
+    for (auto & terms : queries) {
+	Xapian::Query query(terms[0]);
+	if (terms[1]) {
+	    query = Xapian::Query(Xapian::Query::OP_OR,
+				  query, Xapian::Query(terms[1]));
+	}
+	enq.set_query(query);
+	for (int wt = 0; wt != 2; ++wt) {
+	    if (wt) {
+		enq.set_weighting_scheme(Xapian::TradWeight());
+	    } else {
+		enq.set_weighting_scheme(Xapian::BM25Weight());
+	    }
+	    Xapian::MSet msetall = enq.get_mset(0, db.get_doccount());
+	    for (Xapian::doccount size : { 1, 5, 10, 25 }) {
+		Xapian::MSet mset = enq.get_mset(0, size);
+		TEST_EQUAL(mset.size(), size);
+		TEST(mset_range_is_same_weights(mset, 0, msetall, 0, size));
+	    }
+	}
+    }
+    return true;
+}
+
+static void
+make_postlistskipto1_db(Xapian::WritableDatabase &db, const string &)
+{
+    // Mix small and large docid gaps and wdfs so entries take one or more
+    // bytes to encode.
+    Xapian::docid did = 0;
+    for (unsigned i = 0; i != 3000; ++i) {
+	did += (i % 97 == 0) ? 200 + i : i % 3 + 1;
+	Xapian::Document doc;
+	doc.add_term("t", (i % 41 == 0) ? 1000 + i : i % 5 + 1);
+	db.replace_document(did, doc);
+    }
+}
+
+/// Check next() and skip_to() on the postlist for "t" agree.
+static void
+check_postlistskipto1(const Xapian::Database & db)
+{
+    vector<pair<Xapian::docid, Xapian::termcount>> postings;
+    for (Xapian::PostingIterator p = db.postlist_begin("t");
+	 p != db.postlist_end("t"); ++p) {
+	postings.push_back(make_pair(*p, p.get_wdf()));
+    }
+    TEST_EQUAL(postings.size(), 3000);
+
+    Xapian::docid last = postings.back().first;
+    for (Xapian::docid step : { 1, 7, 63, 64, 65, 500, 4000 }) {
+	Xapian::PostingIterator p = db.postlist_begin("t");
+	auto i = postings.begin();
+	for (Xapian::docid target = 1; target <= last + 1; target += step) {
+	    p.skip_to(target);
+	    while (i != postings.end() && i->first < target) ++i;
+	    if (i == postings.end()) {
+		TEST(p == db.postlist_end("t"));
+		break;
+	    }
+	    TEST(p != db.postlist_end("t"));
+	    TEST_EQUAL(*p, i->first);
+	    TEST_EQUAL(p.get_wdf(), i->second);
+	}
+    }
+}
+
+/// Check next() and skip_to() on posting lists spanning many chunks.
+DEFINE_TESTCASE(postlistskipto1, generated) {
+    Xapian::Database db = get_database("postlistskipto1",
+				       make_postlistskipto1_db);
+    check_postlistskipto1(db);
+    return true;
+}
+
+/// Check next() and skip_to() on remote postlists spanning many windows.
+DEFINE_TESTCASE(postlistskipto2, remote && writable) {
+    Xapian::WritableDatabase db = get_writable_database();
+    make_postlistskipto1_db(db, string());
+    db.commit();
+    check_postlistskipto1(db);
+    return true;
+}
+
+/// Check two databases have the same posting lists and document lengths.
+static void
+check_same_postings(const Xapian::Database & db,
+		    const Xapian::Database & model)
+{
+    TEST_EQUAL(db.get_doccount(), model.get_doccount());
+    TEST_EQUAL(db.get_lastdocid(), model.get_lastdocid());
+    Xapian::TermIterator t = db.allterms_begin();
+    Xapian::TermIterator m = model.allterms_begin();
+    for ( ; m != model.allterms_end(); ++t, ++m) {
+	TEST(t != db.allterms_end());
+	TEST_EQUAL(*t, *m);
+	const string & term = *m;
+	TEST_EQUAL(db.get_termfreq(term), model.get_termfreq(term));
+	TEST_EQUAL(db.get_collection_freq(term),
+		   model.get_collection_freq(term));
+	vector<pair<Xapian::docid, Xapian::termcount>> postings;
+	Xapian::PostingIterator p = db.postlist_begin(term);
+	for (Xapian::PostingIterator q = model.postlist_begin(term);
+	     q != model.postlist_end(term); ++p, ++q) {
+	    TEST(p != db.postlist_end(term));
+	    TEST_EQUAL(*p, *q);
+	    TEST_EQUAL(p.get_wdf(), q.get_wdf());
+	    TEST_EQUAL(p.get_doclength(), q.get_doclength());
+	    postings.push_back(make_pair(*q, q.get_wdf()));
+	}
+	TEST(p == db.postlist_end(term));
+
+	Xapian::docid last = postings.back().first;
+	for (Xapian::docid step : { 1, 3, 127, 128, 129, 1000 }) {
+	    p = db.postlist_begin(term);
+	    auto i = postings.begin();
+	    for (Xapian::docid target = 1; target <= last + 1; target += step) {
+		p.skip_to(target);
+		while (i != postings.end() && i->first < target) ++i;
+		if (i == postings.end()) {
+		    TEST(p == db.postlist_end(term));
+		    break;
+		}
+		TEST(p != db.postlist_end(term));
+		TEST_EQUAL(*p, i->first);
+		TEST_EQUAL(p.get_wdf(), i->second);
+	    }
+	}
+    }
+    TEST(t == db.allterms_end());
+}
+
+/// Make the same changes to a database and a model of it.
+static void
+change_packedpostlists1_db(Xapian::WritableDatabase & db,
+			   Xapian::WritableDatabase & model,
+			   Xapian::docid step, Xapian::termcount wdf_mod)
+{
+    for (Xapian::docid did = 5; did < 8000; did += step) {
+	if (did % 3 == 0) {
+	    try {
+		model.delete_document(did);
+	    } catch (const Xapian::DocNotFoundError &) {
+		continue;
+	    }
+	    db.delete_document(did);
+	} else {
+	    Xapian::Document doc;
+	    doc.add_term("t", did % wdf_mod + 1);
+	    doc.add_term("u", did % 4 + 1);
+	    model.replace_document(did, doc);
+	    db.replace_document(did, doc);
+	}
+    }
+    for (int i = 0; i != 500; ++i) {
+	Xapian::Document doc;
+	doc.add_term("t", i % 7 + 1);
+	if (i % 2) doc.add_term("v", 100000 + i);
+	model.add_document(doc);
+	db.add_document(doc);
+    }
+    model.commit();
+    db.commit();
+}
+
+/// Check reading and updating posting lists in the packed chunk format.
+DEFINE_TESTCASE(packedpostlists1, glass) {
+    const string & path =
+	get_named_writable_database_path("packedpostlists1");
+    const string & outpath =
+	get_named_writable_database_path("packedpostlists1out");
+    Xapian::WritableDatabase model(string(), Xapian::DB_BACKEND_INMEMORY);
+    {
+	// Start with chunks in the original format.
+	Xapian::WritableDatabase db(path,
+				    Xapian::DB_CREATE_OR_OVERWRITE |
+				    Xapian::DB_BACKEND_GLASS);
+	make_postlistskipto1_db(db, string());
+	make_postlistskipto1_db(model, string());
+	db.commit();
+    }
+    TEST_EQUAL(Xapian::Database::check(path, 0, &tout), 0);
+
+    // Compact that with the flag to give a database with only packed chunks.
+    rm_rf(outpath);
+    Xapian::Database(path).compact(outpath,
+				   Xapian::DBCOMPACT_PACKED_POSTLISTS |
+				   Xapian::DBCOMPACT_NO_RENUMBER);
+    TEST_EQUAL(Xapian::Database::check(outpath, 0, &tout), 0);
+    check_same_postings(Xapian::Database(outpath), model);
+    check_postlistskipto1(Xapian::Database(outpath));
+
+    {
+	// Changes made with the flag are written as packed chunks, so the
+	// modified posting lists end up with a mix of the two formats.
+	Xapian::WritableDatabase db(path,
+				    Xapian::DB_OPEN |
+				    Xapian::DB_PACKED_POSTLISTS);
+	change_packedpostlists1_db(db, model, 11, 13);
+	check_same_postings(db, model);
+    }
+    TEST_EQUAL(Xapian::Database::check(path, 0, &tout), 0);
+
+    {
+	// The database is marked, so new chunks are still packed without the
+	// flag.
+	Xapian::WritableDatabase db(path, Xapian::DB_OPEN);
+	change_packedpostlists1_db(db, model, 17, 5);
+	check_same_postings(db, model);
+    }
+    TEST_EQUAL(Xapian::Database::check(path, 0, &tout), 0);
+    check_same_postings(Xapian::Database(path), model);
+
+    // Compacting a marked database keeps the output packed.
+    rm_rf(outpath);
+    Xapian::Database(path).compact(outpath, Xapian::DBCOMPACT_NO_RENUMBER);
+    TEST_EQUAL(Xapian::Database::check(outpath, 0, &tout), 0);
+    check_same_postings(Xapian::Database(outpath), model);
+    return true;
+}
@@ -29,6 +29,7 @@
 #include <fstream>
 #include <map>
 #include <string>
+#include <utility>
 #include <vector>
 #include "safesysstat.h" // For mkdir().
 #include "safeunistd.h" // For sleep().
@@ -1080,6 +1081,40 @@ DEFINE_TESTCASE(allterms6, backend) {
     return true;
 }
 
+/// Test Database::get_completions().
+DEFINE_TESTCASE(getcompletions1, backend) {
+    Xapian::Database db(get_database("apitest_simpledata"));
+    Xapian::Database db2;
+    db2.add_database(get_database("apitest_simpledata"));
+    db2.add_database(get_database("apitest_simpledata"));
+    static const char * const prefixes[] = { "t", "th", "w", "", "absent" };
+    static const Xapian::termcount ns[] = { 0, 1, 3, 100 };
+    for (auto prefix : prefixes) {
+	// The most frequent terms first, then in ascending order.
+	vector<pair<int, string>> expect;
+	for (Xapian::TermIterator t = db.allterms_begin(prefix);
+	     t != db.allterms_end(prefix); ++t) {
+	    expect.push_back(make_pair(-int(t.get_termfreq()), *t));
+	}
+	sort(expect.begin(), expect.end());
+	for (auto n : ns) {
+	    Xapian::TermIterator t = db.get_completions(prefix, n);
+	    Xapian::TermIterator t2 = db2.get_completions(prefix, n);
+	    for (size_t i = 0; i != expect.size() && i != n; ++i) {
+		TEST(t != Xapian::TermIterator());
+		TEST_EQUAL(*t, expect[i].second);
+		++t;
+		TEST(t2 != Xapian::TermIterator());
+		TEST_EQUAL(*t2, expect[i].second);
+		++t2;
+	    }
+	    TEST(t == Xapian::TermIterator());
+	    TEST(t2 == Xapian::TermIterator());
+	}
+    }
+    return true;
+}
+
 // test that searching for a term with a special characters in it works
 DEFINE_TESTCASE(specialterms1, backend) {
     Xapian::Enquire enquire(get_database("apitest_space"));
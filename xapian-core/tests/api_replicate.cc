@@ -4,6 +4,7 @@
  * Copyright 2009,2010,2011,2012,2013,2014,2015,2016 Olly Betts
  * Copyright 2010 Richard Boulton
  * Copyright 2011 Dan Colish
+ * Copyright 2026 The Xapian contributors
  *
  * This program is free software; you can redistribute it and/or
  * modify it under the terms of the GNU General Public License as
@@ -30,6 +31,7 @@
 
 #include "apitest.h"
 #include "dbcheck.h"
+#include "envvarsetter.h"
 #include "fd.h"
 #include "filetests.h"
 #include "safedirent.h"
@@ -37,6 +39,7 @@
 #include "safefcntl.h"
 #include "safesysstat.h"
 #include "safeunistd.h"
+#include "str.h"
 #include "testsuite.h"
 #include "testutils.h"
 #include "unixcmds.h"
@@ -45,6 +48,7 @@
 
 #include <cstdlib>
 #include <string>
+#include <vector>
 
 #include <stdlib.h> // For setenv() or putenv()
 
@@ -99,6 +103,23 @@ static void do_write(int fd, const char * p, size_t n)
     }
 }
 
+// Read the whole of a file.
+static string
+read_file(const string & path)
+{
+    FD fd(open(path.c_str(), O_RDONLY | O_BINARY));
+    if (fd == -1) {
+	FAIL_TEST("Open failed (when reading '" + path + "')");
+    }
+    string result;
+    char buf[1024];
+    size_t n;
+    while ((n = do_read(fd, buf, sizeof(buf))) != 0) {
+	result.append(buf, n);
+    }
+    return result;
+}
+
 // Make a truncated copy of a file.
 static off_t
 truncated_copy(const string & srcpath, const string & destpath, off_t tocopy)
@@ -140,7 +161,8 @@ get_changeset(const string & changesetpath,
 	      int expected_changesets,
 	      int expected_fullcopies,
 	      bool expected_changed,
-	      bool full_copy = false)
+	      bool full_copy = false,
+	      bool block_deltas = false)
 {
     FD fd(open(changesetpath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0666));
     if (fd == -1) {
@@ -149,7 +171,8 @@ get_changeset(const string & changesetpath,
     }
     Xapian::ReplicationInfo info1;
     master.write_changesets_to_fd(fd,
-				  full_copy ? "" : replica.get_revision_info(),
+				  full_copy ? "" :
+				  replica.get_revision_info(block_deltas),
 				  &info1);
 
     TEST_EQUAL(info1.changeset_count, expected_changesets);
@@ -202,14 +225,16 @@ replicate(Xapian::DatabaseMaster & master,
 	  int expected_changesets,
 	  int expected_fullcopies,
 	  bool expected_changed,
-	  bool full_copy = false)
+	  bool full_copy = false,
+	  bool block_deltas = false)
 {
     string changesetpath = tempdir + "/changeset";
     get_changeset(changesetpath, master, replica,
 		  expected_changesets,
 		  expected_fullcopies,
 		  expected_changed,
-		  full_copy);
+		  full_copy,
+		  block_deltas);
     return apply_changeset(changesetpath, replica,
 			   expected_changesets,
 			   expected_fullcopies,
@@ -909,3 +934,390 @@ DEFINE_TESTCASE(replicate7, replicas) {
     rmtmpdir(tempdir);
     return true;
 }
+
+/// Test applying changesets with several writer threads.
+DEFINE_TESTCASE(replicate8, replicas) {
+    UNSET_MAX_CHANGESETS_AFTERWARDS;
+    string tempdir = ".replicatmp";
+    mktmpdir(tempdir);
+    string masterpath = get_named_writable_database_path("master");
+
+    set_max_changesets(10);
+    EnvVarSetter threads("XAPIAN_REPLICATION_THREADS", "3");
+
+    Xapian::WritableDatabase orig(get_named_writable_database("master"));
+    Xapian::DatabaseMaster master(masterpath);
+    string replicapath = tempdir + "/replica";
+    {
+	Xapian::DatabaseReplica replica(replicapath);
+
+	Xapian::Document doc1;
+	doc1.set_data(string("doc1"));
+	doc1.add_posting("doc", 1);
+	doc1.add_posting("one", 1);
+	orig.add_document(doc1);
+	orig.commit();
+
+	// Full copy.
+	TEST_EQUAL(replicate(master, replica, tempdir, 0, 1, true), 1);
+	check_equal_dbs(masterpath, replicapath);
+
+	// Make changes which touch every table, and enough of them that each
+	// changeset contains many blocks.
+	for (int c = 0; c != 3; ++c) {
+	    for (int i = 0; i != 500; ++i) {
+		Xapian::Document doc;
+		doc.set_data("data " + str(c) + " " + str(i));
+		for (Xapian::termpos pos = 1; pos != 20; ++pos) {
+		    doc.add_posting("t" + str((i * pos) % 97), pos);
+		}
+		doc.add_value(0, str(i));
+		orig.add_document(doc);
+	    }
+	    orig.add_spelling("word" + str(c));
+	    orig.add_synonym("word", "synonym" + str(c));
+	    orig.set_metadata("key" + str(c), "value");
+	    orig.commit();
+	}
+
+	TEST_EQUAL(replicate(master, replica, tempdir, 3, 0, true), 4);
+	check_equal_dbs(masterpath, replicapath);
+	{
+	    Xapian::Database dbcopy(replicapath);
+	    TEST_EQUAL(orig.get_uuid(), dbcopy.get_uuid());
+	    TEST_EQUAL(dbcopy.get_spelling_suggestion("wrd1"), "word1");
+	    TEST_EQUAL(dbcopy.get_metadata("key2"), "value");
+	    Xapian::TermIterator s = dbcopy.synonyms_begin("word");
+	    TEST(s != dbcopy.synonyms_end("word"));
+	    TEST_EQUAL(*s, "synonym0");
+	}
+
+	// We need this inner scope to we close the replica before we remove
+	// the temporary directory on Windows.
+    }
+
+    rmtmpdir(tempdir);
+    return true;
+}
+
+/// Test sending a full copy as the blocks which differ from the replica.
+DEFINE_TESTCASE(replicate9, replicas) {
+    // Chert sends a full copy instead of block checksums.
+    SKIP_TEST_FOR_BACKEND("chert");
+    UNSET_MAX_CHANGESETS_AFTERWARDS;
+    string tempdir = ".replicatmp";
+    mktmpdir(tempdir);
+    string masterpath = get_named_writable_database_path("master");
+
+    // Don't keep changesets, so that each update needs a full copy.
+    set_max_changesets(0);
+
+    Xapian::WritableDatabase orig(get_named_writable_database("master"));
+    Xapian::DatabaseMaster master(masterpath);
+    string replicapath = tempdir + "/replica";
+    {
+	Xapian::DatabaseReplica replica(replicapath);
+
+	for (int i = 0; i != 2000; ++i) {
+	    Xapian::Document doc;
+	    doc.set_data("data " + str(i));
+	    for (Xapian::termpos pos = 1; pos != 20; ++pos) {
+		doc.add_posting("t" + str((i * pos) % 97), pos);
+	    }
+	    orig.add_document(doc);
+	}
+	orig.commit();
+
+	string changesetpath = tempdir + "/changeset";
+	TEST_EQUAL(replicate(master, replica, tempdir, 0, 1, true), 1);
+	check_equal_dbs(masterpath, replicapath);
+	off_t full_size = get_file_size(changesetpath);
+	TEST(!replica.delta_copy_pending());
+
+	// Make a small change.
+	Xapian::Document doc;
+	doc.set_data("new");
+	doc.add_posting("new", 1);
+	orig.add_document(doc);
+	orig.commit();
+
+	// The master sends checksums of its blocks instead of a full copy.
+	TEST_EQUAL(replicate(master, replica, tempdir, 0, 0, false, false, true),
+		   1);
+	TEST(replica.delta_copy_pending());
+	off_t checksums_size = get_file_size(changesetpath);
+
+	// If the master changes, it sends new checksums.
+	doc.set_data("newer");
+	orig.add_document(doc);
+	orig.commit();
+	TEST_EQUAL(replicate(master, replica, tempdir, 0, 0, false, false, true),
+		   1);
+	TEST(replica.delta_copy_pending());
+
+	// Now the master sends the blocks which differ.
+	TEST_EQUAL(replicate(master, replica, tempdir, 0, 1, true, false, true),
+		   1);
+	TEST(!replica.delta_copy_pending());
+	off_t delta_size = get_file_size(changesetpath);
+	tout << "full copy " << full_size << " bytes, checksums "
+	     << checksums_size << " bytes, delta " << delta_size << " bytes"
+	     << endl;
+	TEST_REL(checksums_size * 20, <, full_size);
+	// Most of the blocks should be unchanged.
+	TEST_REL(delta_size * 4, <, full_size);
+	check_equal_dbs(masterpath, replicapath);
+	{
+	    Xapian::Database dbcopy(replicapath);
+	    TEST_EQUAL(orig.get_uuid(), dbcopy.get_uuid());
+	    TEST_EQUAL(dbcopy.get_doccount(), 2002);
+	}
+
+	// Once the copy is live, a full copy starts with checksums again.
+	orig.add_document(doc);
+	orig.commit();
+	TEST_EQUAL(replicate(master, replica, tempdir, 0, 0, false, false, true),
+		   1);
+	TEST(replica.delta_copy_pending());
+	TEST_EQUAL(replicate(master, replica, tempdir, 0, 1, true, false, true),
+		   1);
+	check_equal_dbs(masterpath, replicapath);
+
+	// We need this inner scope to we close the replica before we remove
+	// the temporary directory on Windows.
+    }
+
+    rmtmpdir(tempdir);
+    return true;
+}
+
+/// Test a replica gives up on block deltas if the master keeps changing.
+DEFINE_TESTCASE(replicate10, replicas) {
+    SKIP_TEST_FOR_BACKEND("chert");
+    UNSET_MAX_CHANGESETS_AFTERWARDS;
+    string tempdir = ".replicatmp";
+    mktmpdir(tempdir);
+    string masterpath = get_named_writable_database_path("master");
+
+    set_max_changesets(0);
+
+    Xapian::WritableDatabase orig(get_named_writable_database("master"));
+    Xapian::DatabaseMaster master(masterpath);
+    string replicapath = tempdir + "/replica";
+    {
+	Xapian::DatabaseReplica replica(replicapath);
+
+	Xapian::Document doc;
+	doc.set_data("data");
+	doc.add_term("term");
+	orig.add_document(doc);
+	orig.commit();
+	TEST_EQUAL(replicate(master, replica, tempdir, 0, 1, true), 1);
+
+	// Each time the replica asks for the blocks it needs, the master has
+	// changed, so it gets sent new checksums.
+	for (int i = 0; i != 3; ++i) {
+	    orig.add_document(doc);
+	    orig.commit();
+	    TEST_EQUAL(replicate(master, replica, tempdir, 0, 0, false, false,
+				 true), 1);
+	    TEST(replica.delta_copy_pending());
+	}
+
+	// Then it asks for a full copy.
+	orig.add_document(doc);
+	orig.commit();
+	TEST_EQUAL(replicate(master, replica, tempdir, 0, 1, true, false, true),
+		   1);
+	TEST(!replica.delta_copy_pending());
+	check_equal_dbs(masterpath, replicapath);
+
+	// We need this inner scope to we close the replica before we remove
+	// the temporary directory on Windows.
+    }
+
+    rmtmpdir(tempdir);
+    return true;
+}
+
+/// Test replicating without using sendfile() or splice().
+DEFINE_TESTCASE(replicate11, replicas) {
+    UNSET_MAX_CHANGESETS_AFTERWARDS;
+    string tempdir = ".replicatmp";
+    mktmpdir(tempdir);
+    string masterpath = get_named_writable_database_path("master");
+
+    set_max_changesets(10);
+
+    Xapian::WritableDatabase orig(get_named_writable_database("master"));
+    Xapian::DatabaseMaster master(masterpath);
+    string replicapath = tempdir + "/replica";
+    {
+	Xapian::DatabaseReplica replica(replicapath);
+
+	// Make the tables big enough to need many chunks.
+	for (int i = 0; i != 1000; ++i) {
+	    Xapian::Document doc;
+	    doc.set_data("data " + str(i));
+	    for (Xapian::termpos pos = 1; pos != 20; ++pos) {
+		doc.add_posting("t" + str((i * pos) % 97), pos);
+	    }
+	    orig.add_document(doc);
+	}
+	orig.commit();
+
+	string changesetpath = tempdir + "/changeset";
+	get_changeset(changesetpath, master, replica, 0, 1, true);
+	string zero_copy_data = read_file(changesetpath);
+
+	// The read() and write() fallback should send exactly the same data,
+	// and the replica should receive it the same way too.
+	EnvVarSetter no_zero_copy("XAPIAN_NO_ZERO_COPY", "1");
+	get_changeset(changesetpath, master, replica, 0, 1, true);
+	TEST(read_file(changesetpath) == zero_copy_data);
+	TEST_EQUAL(apply_changeset(changesetpath, replica, 0, 1, true), 1);
+	check_equal_dbs(masterpath, replicapath);
+
+	for (int c = 0; c != 2; ++c) {
+	    for (int i = 0; i != 500; ++i) {
+		Xapian::Document doc;
+		doc.set_data("more " + str(c) + " " + str(i));
+		doc.add_posting("t" + str(i % 97), 1);
+		orig.add_document(doc);
+	    }
+	    orig.commit();
+	}
+	TEST_EQUAL(replicate(master, replica, tempdir, 2, 0, true), 3);
+	check_equal_dbs(masterpath, replicapath);
+
+	// We need this inner scope to we close the replica before we remove
+	// the temporary directory on Windows.
+    }
+
+    rmtmpdir(tempdir);
+    return true;
+}
+
+/// Fetches the parts of a database copy in reverse order through files.
+class TestPartFetcher : public Xapian::ReplicaPartFetcher {
+    Xapian::DatabaseMaster & master;
+
+    string partpath;
+
+  public:
+    /// Number of parts fetched.
+    int count;
+
+    /// If set, a document is added to this before fetching the parts.
+    Xapian::WritableDatabase * modify_db;
+
+    TestPartFetcher(Xapian::DatabaseMaster & master_, const string & tempdir)
+	: Xapian::ReplicaPartFetcher(8192), master(master_),
+	  partpath(tempdir + "/part"), count(0), modify_db(NULL) { }
+
+    void fetch_parts(Xapian::DatabaseReplica & replica,
+		     const vector<string> & requests) {
+	if (modify_db) {
+	    Xapian::Document doc;
+	    doc.set_data("late");
+	    doc.add_term("late");
+	    modify_db->add_document(doc);
+	    modify_db->commit();
+	}
+	for (auto i = requests.rbegin(); i != requests.rend(); ++i) {
+	    {
+		FD fd(open(partpath.c_str(),
+			   O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0666));
+		if (fd == -1) {
+		    FAIL_TEST("Open failed (when creating '" + partpath + "')");
+		}
+		master.write_file_part_to_fd(fd, *i);
+	    }
+	    FD fd(open(partpath.c_str(), O_RDONLY | O_BINARY));
+	    if (fd == -1) {
+		FAIL_TEST("Open failed (when reading '" + partpath + "')");
+	    }
+	    replica.apply_file_part_from_fd(fd);
+	    ++count;
+	}
+    }
+};
+
+static void
+write_changesets_in_parts(const string & changesetpath,
+			  Xapian::DatabaseMaster & master)
+{
+    FD fd(open(changesetpath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0666));
+    if (fd == -1) {
+	FAIL_TEST("Open failed (when creating a new changeset file at '"
+		  + changesetpath + "')");
+    }
+    Xapian::ReplicationInfo info;
+    master.write_changesets_to_fd(fd, "", &info, true);
+    TEST_EQUAL(info.fullcopy_count, 1);
+}
+
+/// Test fetching the table files of a database copy in parts.
+DEFINE_TESTCASE(replicate12, replicas) {
+    SKIP_TEST_FOR_BACKEND("chert");
+    UNSET_MAX_CHANGESETS_AFTERWARDS;
+    string tempdir = ".replicatmp";
+    mktmpdir(tempdir);
+    string masterpath = get_named_writable_database_path("master");
+
+    set_max_changesets(10);
+
+    Xapian::WritableDatabase orig(get_named_writable_database("master"));
+    Xapian::DatabaseMaster master(masterpath);
+    string replicapath = tempdir + "/replica";
+    string changesetpath = tempdir + "/changeset";
+    {
+	Xapian::DatabaseReplica replica(replicapath);
+
+	// Make the tables big enough to need several parts.
+	for (int i = 0; i != 1000; ++i) {
+	    Xapian::Document doc;
+	    doc.set_data("data " + str(i));
+	    for (Xapian::termpos pos = 1; pos != 20; ++pos) {
+		doc.add_posting("t" + str((i * pos) % 97), pos);
+	    }
+	    orig.add_document(doc);
+	}
+	orig.commit();
+
+	// Without a part fetcher, the replica can't apply the copy.
+	write_changesets_in_parts(changesetpath, master);
+	{
+	    FD fd(open(changesetpath.c_str(), O_RDONLY | O_BINARY));
+	    replica.set_read_fd(fd);
+	    TEST_EXCEPTION(Xapian::InvalidOperationError,
+			   replica.apply_next_changeset(NULL, 0));
+	}
+
+	TestPartFetcher fetcher(master, tempdir);
+	replica.set_part_fetcher(&fetcher);
+	write_changesets_in_parts(changesetpath, master);
+	TEST_EQUAL(apply_changeset(changesetpath, replica, 0, 1, true), 1);
+	TEST_REL(fetcher.count, >, 5);
+	check_equal_dbs(masterpath, replicapath);
+
+	// If the master changes while the parts are fetched, the copy
+	// mustn't be made live until the replica catches up.
+	fetcher.count = 0;
+	fetcher.modify_db = &orig;
+	write_changesets_in_parts(changesetpath, master);
+	TEST_EQUAL(apply_changeset(changesetpath, replica, 0, 1, false), 1);
+	TEST_REL(fetcher.count, >, 5);
+	fetcher.modify_db = NULL;
+	TEST_EQUAL(Xapian::Database(replicapath).get_doccount(), 1000);
+	TEST_EQUAL(replicate(master, replica, tempdir, 1, 0, true), 2);
+	check_equal_dbs(masterpath, replicapath);
+	TEST_EQUAL(Xapian::Database(replicapath).get_doccount(), 1001);
+
+	// We need this inner scope to we close the replica before we remove
+	// the temporary directory on Windows.
+    }
+
+    rmtmpdir(tempdir);
+    return true;
+}
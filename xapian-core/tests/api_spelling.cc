@@ -3,6 +3,7 @@
  */
 /* Copyright (C) 2007,2008,2009,2010,2011 Olly Betts
  * Copyright (C) 2007 Lemur Consulting Ltd
+ * Copyright (C) 2026 The Xapian contributors
  *
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -314,3 +315,124 @@ DEFINE_TESTCASE(spell8, spelling) {
 
     return true;
 }
+
+/// Feature test for Xapian::DB_SPELLING_INDEX.
+DEFINE_TESTCASE(spellindex1, glass) {
+    const string & path = get_named_writable_database_path("spellindex1");
+    {
+	// Start without the index, so that it has to be built from the
+	// existing words.
+	Xapian::WritableDatabase db = get_named_writable_database("spellindex1");
+	db.add_spelling("hello");
+	db.add_spelling("cell", 2);
+	db.add_spelling("word");
+	db.add_spelling("h\xc3\xb6hle");
+	db.commit();
+    }
+
+    Xapian::WritableDatabase db(path, Xapian::DB_SPELLING_INDEX);
+    db.add_spelling("skinking", 2);
+    db.add_spelling("stinking");
+    // Added and removed in the same batch as the index gets built.
+    db.remove_spelling("word");
+    TEST_EQUAL(db.get_spelling_suggestion("helo"), "hello");
+    TEST_EQUAL(db.get_spelling_suggestion("wrod"), "");
+    TEST_EQUAL(db.get_spelling_suggestion("skinkin"), "skinking");
+    db.commit();
+
+    Xapian::Database dbr(path);
+    TEST_EQUAL(dbr.get_spelling_suggestion("helo"), "hello");
+    TEST_EQUAL(dbr.get_spelling_suggestion("hhle", 1), "h\xc3\xb6hle");
+    TEST_EQUAL(dbr.get_spelling_suggestion("\xf0\xa8\xa8\x8f\xc3\xb6le", 2),
+	       "h\xc3\xb6hle");
+    TEST_EQUAL(dbr.get_spelling_suggestion("stinkin", 1), "stinking");
+    // More edits than the index handles, so the trigrams get used.
+    TEST_EQUAL(dbr.get_spelling_suggestion("scimkin", 3), "skinking");
+    TEST_EQUAL(dbr.get_spelling_suggestion("wrod"), "");
+
+    // The index is maintained without the flag once it exists.
+    db.close();
+    db = Xapian::WritableDatabase(path);
+    db.remove_spelling("hello");
+    db.add_spelling("word");
+    db.commit();
+    TEST(dbr.reopen());
+    TEST_EQUAL(dbr.get_spelling_suggestion("helo"), "cell");
+    TEST_EQUAL(dbr.get_spelling_suggestion("wrod"), "word");
+
+    // Only words should be returned by the spelling wordlist.
+    Xapian::termcount count = 0;
+    for (Xapian::TermIterator t = dbr.spellings_begin();
+	 t != dbr.spellings_end(); ++t) {
+	++count;
+    }
+    TEST_EQUAL(count, 5);
+
+    // Check the index survives compaction.
+    string out = get_named_writable_database_path("spellindex1out");
+    dbr.compact(out);
+    Xapian::Database dbc(out);
+    TEST_EQUAL(dbc.get_spelling_suggestion("helo"), "cell");
+    TEST_EQUAL(dbc.get_spelling_suggestion("wrod"), "word");
+    TEST_EQUAL(dbc.get_spelling_suggestion("skinkin"), "skinking");
+
+    return true;
+}
+
+/// Check when compaction keeps the Xapian::DB_SPELLING_INDEX index.
+DEFINE_TESTCASE(spellindex2, glass) {
+    const string & path = get_named_writable_database_path("spellindex2");
+    {
+	Xapian::WritableDatabase db(path,
+				    Xapian::DB_CREATE_OR_OVERWRITE |
+				    Xapian::DB_BACKEND_GLASS |
+				    Xapian::DB_SPELLING_INDEX);
+	db.add_spelling("abcd");
+	db.commit();
+    }
+    // The index is needed to find a word two transpositions away.
+    TEST_EQUAL(Xapian::Database(path).get_spelling_suggestion("bcad", 2),
+	       "abcd");
+
+    // Inputs without any words don't stop the index being kept, whether
+    // they never had any words or have had them all removed.
+    Xapian::WritableDatabase nowords =
+	get_named_writable_database("spellindex2nowords");
+    Xapian::Document doc;
+    doc.add_term("term");
+    nowords.add_document(doc);
+    nowords.commit();
+    Xapian::WritableDatabase removed =
+	get_named_writable_database("spellindex2removed");
+    removed.add_spelling("word");
+    removed.commit();
+    removed.remove_spelling("word");
+    removed.commit();
+    {
+	Xapian::Database in(path);
+	in.add_database(nowords);
+	in.add_database(removed);
+	string out = get_named_writable_database_path("spellindex2out");
+	in.compact(out);
+	Xapian::Database dbc(out);
+	TEST_EQUAL(dbc.get_spelling_suggestion("bcad", 2), "abcd");
+    }
+
+    // An input with words but no index means the index is dropped.
+    Xapian::WritableDatabase words =
+	get_named_writable_database("spellindex2words");
+    words.add_spelling("word");
+    words.commit();
+    {
+	Xapian::Database in(path);
+	in.add_database(words);
+	string out = get_named_writable_database_path("spellindex2out2");
+	in.compact(out);
+	Xapian::Database dbc(out);
+	TEST_EQUAL(dbc.get_spelling_suggestion("bcad", 2), "");
+	TEST_EQUAL(dbc.get_spelling_suggestion("wrod"), "word");
+	TEST_EQUAL(dbc.get_spelling_suggestion("abc"), "abcd");
+    }
+
+    return true;
+}
@@ -2,6 +2,7 @@
  * @brief Test the stemming API
  */
 /* Copyright (C) 2010,2012 Olly Betts
+ * Copyright (C) 2026 The Xapian contributors
  *
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -87,3 +88,80 @@ DEFINE_TESTCASE(stemlangs2, !backend) {
     }
     return true;
 }
+
+class CountingStemImpl : public Xapian::StemImplementation {
+  public:
+    int calls;
+
+    CountingStemImpl() : calls(0) { }
+
+    string operator()(const string & word) {
+	++calls;
+	return word.substr(0, 3);
+    }
+
+    string get_description() const {
+	return "CountingStem()";
+    }
+};
+
+/// Test Stem::set_cache_size().
+DEFINE_TESTCASE(stemcache1, !backend) {
+    CountingStemImpl * impl = new CountingStemImpl;
+    Xapian::Stem st(impl);
+    Xapian::Stem uncached(st);
+    st.set_cache_size(2);
+    TEST_EQUAL(st.get_description(), "Xapian::Stem(CountingStem())");
+
+    TEST_EQUAL(st("food"), "foo");
+    TEST_EQUAL(st("food"), "foo");
+    TEST_EQUAL(st(""), "");
+    TEST_EQUAL(impl->calls, 1);
+
+    // Copies made before the cache was set up don't use it.
+    TEST_EQUAL(uncached("food"), "foo");
+    TEST_EQUAL(impl->calls, 2);
+
+    // Copies made afterwards share it.
+    Xapian::Stem copy(st);
+    TEST_EQUAL(copy("food"), "foo");
+    TEST_EQUAL(impl->calls, 2);
+
+    // Changing the size makes a new cache.
+    copy.set_cache_size(100);
+    TEST_EQUAL(copy("food"), "foo");
+    TEST_EQUAL(copy("food"), "foo");
+    TEST_EQUAL(impl->calls, 3);
+    TEST_EQUAL(st("food"), "foo");
+    TEST_EQUAL(impl->calls, 3);
+
+    st.set_cache_size(0);
+    TEST_EQUAL(st("food"), "foo");
+    TEST_EQUAL(impl->calls, 4);
+    TEST_EQUAL(st.get_description(), "Xapian::Stem(CountingStem())");
+
+    // A small cache still gives the right answers when words collide.
+    Xapian::Stem english("english");
+    Xapian::Stem english_cached("english");
+    english_cached.set_cache_size(3);
+    static const char * const words[] = {
+	"loved", "loving", "cats", "running", "loved", "runs", "cats",
+	"generously", "loving", "generously", "running"
+    };
+    for (auto word : words) {
+	TEST_EQUAL(english_cached(word), english(word));
+    }
+
+    // Check that TermGenerator uses the cache.
+    Xapian::TermGenerator termgen;
+    Xapian::Document doc;
+    termgen.set_document(doc);
+    impl->calls = 0;
+    copy.set_cache_size(10);
+    termgen.set_stemmer(copy);
+    termgen.index_text("food food foods food");
+    TEST_EQUAL(impl->calls, 2);
+    TEST_EQUAL(doc.termlist_count(), 3);
+
+    return true;
+}
@@ -40,10 +40,13 @@
 #include "apitest.h"
 
 #include "safeunistd.h"
+#include <algorithm>
 #include <cmath>
 #include <cstdlib>
 #include <map>
 #include <string>
+#include <utility>
+#include <vector>
 
 using namespace std;
 
@@ -2045,3 +2048,300 @@ DEFINE_TESTCASE(modifyvalues1, writable) {
 
     return true;
 }
+
+/// Check that changes are flushed once they use enough memory.
+DEFINE_TESTCASE(flushmemory1, chert || glass) {
+    Xapian::WritableDatabase db = get_writable_database();
+    db.set_flush_memory(1024 * 1024);
+
+    Xapian::Document small;
+    small.add_term("small");
+    db.add_document(small);
+    Xapian::Database dbr = get_writable_database_as_database();
+    TEST_EQUAL(dbr.get_doccount(), 0);
+
+    // Buffering the postings for this document needs more than 1MB.
+    Xapian::Document big;
+    for (int i = 0; i != 50000; ++i) {
+	big.add_term("T" + str(i));
+    }
+    db.add_document(big);
+    dbr.reopen();
+    TEST_EQUAL(dbr.get_doccount(), 2);
+
+    // Without a memory limit, we're back to flushing every 10000 documents
+    // (unless XAPIAN_FLUSH_THRESHOLD is set).
+    db.set_flush_memory(0);
+    db.add_document(big);
+    dbr.reopen();
+    TEST_EQUAL(dbr.get_doccount(), 2);
+    db.commit();
+    dbr.reopen();
+    TEST_EQUAL(dbr.get_doccount(), 3);
+
+    return true;
+}
+
+/// Check buffered postlist changes made in descending docid order.
+DEFINE_TESTCASE(unsortedpostings1, writable) {
+    Xapian::WritableDatabase db = get_writable_database();
+    for (Xapian::docid did = 10; did != 0; --did) {
+	Xapian::Document doc;
+	doc.add_term("all");
+	doc.add_term("wdf", did);
+	if (did % 2) doc.add_term("odd");
+	db.replace_document(did, doc);
+    }
+    // Change some of the same documents again, also out of order.
+    for (Xapian::docid did = 9; did > 1; did -= 3) {
+	Xapian::Document doc;
+	doc.add_term("all");
+	doc.add_term("wdf", did + 100);
+	db.replace_document(did, doc);
+    }
+    db.delete_document(5);
+    db.commit();
+
+    TEST_EQUAL(db.get_doccount(), 9);
+    TEST_EQUAL(db.get_termfreq("all"), 9);
+    TEST_EQUAL(db.get_termfreq("odd"), 2);
+    Xapian::docid prev = 0;
+    for (Xapian::PostingIterator p = db.postlist_begin("wdf");
+	 p != db.postlist_end("wdf"); ++p) {
+	Xapian::docid did = *p;
+	TEST_REL(did,>,prev);
+	TEST_NOT_EQUAL(did, 5);
+	bool changed = (did <= 9 && (9 - did) % 3 == 0 && did > 1);
+	TEST_EQUAL(p.get_wdf(), changed ? did + 100 : did);
+	prev = did;
+    }
+    TEST_EQUAL(prev, 10);
+    return true;
+}
+
+/// Check the terms from @a db's allterms list match those from @a ref.
+static void
+compare_allterms(const Xapian::Database & db, const Xapian::Database & ref,
+		 const string & prefix)
+{
+    Xapian::TermIterator t = db.allterms_begin(prefix);
+    Xapian::TermIterator r = ref.allterms_begin(prefix);
+    while (r != ref.allterms_end(prefix)) {
+	TEST(t != db.allterms_end(prefix));
+	TEST_EQUAL(*t, *r);
+	TEST_EQUAL(t.get_termfreq(), r.get_termfreq());
+	++t;
+	++r;
+    }
+    TEST(t == db.allterms_end(prefix));
+}
+
+static void
+add_termdict_docs(Xapian::WritableDatabase & db, int first, int last)
+{
+    for (int i = first; i != last; ++i) {
+	Xapian::Document doc;
+	doc.add_term("all", 2);
+	doc.add_term("mod" + str(i % 7));
+	doc.add_term("term" + str(i));
+	doc.add_boolean_term("Q" + str(i));
+	db.add_document(doc);
+    }
+}
+
+// Test the optional term dictionary.
+DEFINE_TESTCASE(termdict1, glass) {
+    const string & path = get_named_writable_database_path("termdict1");
+    {
+	// Start without the dictionary, so that it has to be built from the
+	// existing terms.
+	Xapian::WritableDatabase db = get_named_writable_database("termdict1");
+	add_termdict_docs(db, 0, 500);
+	db.commit();
+    }
+    Xapian::WritableDatabase ref = get_named_writable_database("termdict1ref");
+    add_termdict_docs(ref, 0, 600);
+    ref.commit();
+
+    Xapian::WritableDatabase db(path, Xapian::DB_TERM_DICTIONARY);
+    add_termdict_docs(db, 500, 600);
+    db.commit();
+    compare_allterms(db, ref, "");
+    compare_allterms(db, ref, "term4");
+    compare_allterms(db, ref, "nosuchprefix");
+
+    // The dictionary is maintained without the flag once it exists, and
+    // uncommitted changes should be reflected.
+    db.close();
+    db = Xapian::WritableDatabase(path);
+    for (Xapian::docid did = 1; did <= 50; ++did) {
+	db.delete_document(did);
+	ref.delete_document(did);
+    }
+    Xapian::Document doc;
+    doc.add_term("mod3", 5);
+    doc.add_term("term55a");
+    db.replace_document(100, doc);
+    ref.replace_document(100, doc);
+    compare_allterms(db, ref, "");
+    compare_allterms(db, ref, "term5");
+    db.commit();
+    ref.commit();
+
+    Xapian::Database dbr(path);
+    compare_allterms(dbr, ref, "");
+    compare_allterms(dbr, ref, "mod");
+    compare_allterms(dbr, ref, "term1");
+    compare_allterms(dbr, ref, "term49");
+
+    Xapian::TermIterator t = dbr.allterms_begin("term");
+    t.skip_to("term55");
+    TEST(t != dbr.allterms_end("term"));
+    TEST_EQUAL(*t, "term55");
+    ++t;
+    TEST_EQUAL(*t, "term550");
+    t.skip_to("term55a");
+    TEST_EQUAL(*t, "term55a");
+    t.skip_to("zzz");
+    TEST(t == dbr.allterms_end("term"));
+
+    // Wildcard expansion picks the most frequent terms using the
+    // dictionary.
+    Xapian::Query q(Xapian::Query::OP_WILDCARD, "mod", 2,
+		    Xapian::Query::WILDCARD_LIMIT_MOST_FREQUENT);
+    Xapian::Enquire enq(dbr);
+    enq.set_query(q);
+    Xapian::Enquire enq_ref(ref);
+    enq_ref.set_query(q);
+    Xapian::MSet mset = enq.get_mset(0, 1000);
+    TEST_EQUAL(mset.size(), enq_ref.get_mset(0, 1000).size());
+    TEST_EQUAL(mset.size(), dbr.get_termfreq("mod2") + dbr.get_termfreq("mod3"));
+
+    TEST_EQUAL(Xapian::Database::check(path, 0, &tout), 0);
+
+    // Check the dictionary survives compaction.
+    string out = get_named_writable_database_path("termdict1out");
+    dbr.compact(out);
+    Xapian::Database dbc(out);
+    compare_allterms(dbc, ref, "");
+    compare_allterms(dbc, ref, "term5");
+    TEST_EQUAL(Xapian::Database::check(out, 0, &tout), 0);
+
+    return true;
+}
+
+/// Check get_completions() against the terms in @a ref.
+static void
+check_completions(const Xapian::Database & db, const Xapian::Database & ref,
+		  const string & prefix, Xapian::termcount n)
+{
+    vector<pair<Xapian::doccount, string>> expect;
+    for (Xapian::TermIterator t = ref.allterms_begin(prefix);
+	 t != ref.allterms_end(prefix); ++t) {
+	// Negate the termfreq so the most frequent terms sort first.
+	expect.push_back(make_pair(-int(t.get_termfreq()), *t));
+    }
+    sort(expect.begin(), expect.end());
+    if (expect.size() > n) expect.resize(n);
+
+    tout << "prefix '" << prefix << "', n = " << n << endl;
+    Xapian::TermIterator t = db.get_completions(prefix, n);
+    for (size_t i = 0; i != expect.size(); ++i) {
+	TEST(t != Xapian::TermIterator());
+	TEST_EQUAL(*t, expect[i].second);
+	++t;
+    }
+    TEST(t == Xapian::TermIterator());
+}
+
+static void
+check_all_completions(const Xapian::Database & db,
+		      const Xapian::Database & ref)
+{
+    static const char * const prefixes[] = {
+	"w", "w1", "w12", "w123", "w1234", "x", "x5", "", "nosuch"
+    };
+    static const Xapian::termcount ns[] = { 0, 1, 10, 100, 150, 200 };
+    for (auto prefix : prefixes) {
+	for (auto n : ns) {
+	    check_completions(db, ref, prefix, n);
+	}
+    }
+}
+
+static void
+add_completions_docs(Xapian::WritableDatabase & db, int first, int last)
+{
+    for (int i = first; i != last; ++i) {
+	Xapian::Document doc;
+	doc.add_term("w" + str(i % 400));
+	doc.add_term("w" + str(i % 37));
+	doc.add_term("x" + str(i));
+	db.add_document(doc);
+    }
+}
+
+// Test the optional precomputed completions.
+DEFINE_TESTCASE(completions1, glass) {
+    const string & path = get_named_writable_database_path("completions1");
+    {
+	// Start without the completions, so that they have to be built from
+	// the existing terms.
+	Xapian::WritableDatabase db =
+	    get_named_writable_database("completions1");
+	add_completions_docs(db, 0, 600);
+	db.commit();
+    }
+    Xapian::WritableDatabase ref =
+	get_named_writable_database("completions1ref");
+    add_completions_docs(ref, 0, 800);
+    ref.commit();
+
+    Xapian::WritableDatabase db(path, Xapian::DB_COMPLETIONS);
+    add_completions_docs(db, 600, 800);
+    db.commit();
+    check_all_completions(db, ref);
+
+    // The completions are maintained without the flag once they exist.
+    // Deleting documents makes terms drop out of the stored lists, so some
+    // need to be rebuilt.
+    db.close();
+    db = Xapian::WritableDatabase(path);
+    for (Xapian::docid did = 1; did <= 800; did += 3) {
+	db.delete_document(did);
+	ref.delete_document(did);
+    }
+    Xapian::Document doc;
+    doc.add_term("w1new", 1000);
+    doc.add_term("w12");
+    db.replace_document(5, doc);
+    ref.replace_document(5, doc);
+    // Uncommitted changes should be reflected.
+    check_completions(db, ref, "w1", 10);
+    check_completions(db, ref, "w", 100);
+    db.commit();
+    ref.commit();
+
+    Xapian::Database dbr(path);
+    check_all_completions(dbr, ref);
+
+    // Partial terms are expanded to the most frequent completions.
+    Xapian::QueryParser qp;
+    qp.set_database(dbr);
+    Xapian::Enquire enq(dbr);
+    enq.set_query(qp.parse_query("w1", Xapian::QueryParser::FLAG_PARTIAL));
+    Xapian::Enquire enq_ref(ref);
+    enq_ref.set_query(qp.parse_query("w1", Xapian::QueryParser::FLAG_PARTIAL));
+    TEST_EQUAL(enq.get_mset(0, 1000).size(), enq_ref.get_mset(0, 1000).size());
+
+    TEST_EQUAL(Xapian::Database::check(path, 0, &tout), 0);
+
+    // Check the completions survive compaction.
+    string out = get_named_writable_database_path("completions1out");
+    dbr.compact(out);
+    Xapian::Database dbc(out);
+    check_all_completions(dbc, ref);
+    TEST_EQUAL(Xapian::Database::check(out, 0, &tout), 0);
+
+    return true;
+}
@@ -108,6 +108,20 @@ get_remote_database(const string &dbname, unsigned int timeout)
     return backendmanager->get_remote_database(dbnames, timeout);
 }
 
+int
+start_threaded_remote_server(const string &dbname, unsigned n_threads)
+{
+    vector<string> dbnames;
+    dbnames.push_back(dbname);
+    return backendmanager->start_threaded_remote_server(dbnames, n_threads);
+}
+
+int
+start_threaded_remote_server_for_wdb(unsigned n_threads)
+{
+    return backendmanager->start_threaded_remote_server_for_wdb(n_threads);
+}
+
 Xapian::Database
 get_writable_database_as_database()
 {
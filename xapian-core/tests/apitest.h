@@ -51,6 +51,14 @@ std::string get_named_writable_database_path(const std::string &name);
 
 Xapian::Database get_remote_database(const std::string &db, unsigned timeout);
 
+/// Start a remote server using a pool of threads, and return its port.
+int start_threaded_remote_server(const std::string &db, unsigned n_threads);
+
+/** Start a remote server using a pool of threads for the last opened
+ *  WritableDatabase, and return its port.
+ */
+int start_threaded_remote_server_for_wdb(unsigned n_threads);
+
 Xapian::Database get_writable_database_as_database();
 
 Xapian::WritableDatabase get_writable_database_again();
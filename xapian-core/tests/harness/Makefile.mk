@@ -13,6 +13,7 @@ noinst_HEADERS +=\
 	harness/backendmanager_remotetcp.h\
 	harness/backendmanager_singlefile.h\
 	harness/cputimer.h\
+	harness/envvarsetter.h\
 	harness/fdtracker.h\
 	harness/index_utils.h\
 	harness/unixcmds.h\
@@ -26,6 +27,7 @@ testharness_sources =\
 	harness/backendmanager.cc\
 	harness/backendmanager_multi.cc\
 	harness/cputimer.cc\
+	harness/envvarsetter.cc\
 	harness/fdtracker.cc\
 	harness/index_utils.cc\
 	harness/scalability.cc\
@@ -318,6 +318,24 @@ BackendManager::get_remote_database(const vector<string> &, unsigned int)
     throw Xapian::InvalidOperationError(msg);
 }
 
+int
+BackendManager::start_threaded_remote_server(const vector<string> &, unsigned)
+{
+    string msg = "Backend ";
+    msg += get_dbtype();
+    msg += " doesn't support start_threaded_remote_server()";
+    throw Xapian::InvalidOperationError(msg);
+}
+
+int
+BackendManager::start_threaded_remote_server_for_wdb(unsigned)
+{
+    string msg = "Backend ";
+    msg += get_dbtype();
+    msg += " doesn't support start_threaded_remote_server_for_wdb()";
+    throw Xapian::InvalidOperationError(msg);
+}
+
 Xapian::Database
 BackendManager::get_writable_database_as_database()
 {
@@ -179,6 +179,23 @@ class BackendManager {
     /// Get a remote database instance with the specified timeout.
     virtual Xapian::Database get_remote_database(const std::vector<std::string> & files, unsigned int timeout);
 
+    /** Start a remote server which serves connections with a pool of threads.
+     *
+     *  Unlike the other remote servers the testsuite starts, this one accepts
+     *  any number of connections, so several clients can use it at once.
+     *
+     *  @return	The TCP port on localhost which the server listens on.
+     */
+    virtual int start_threaded_remote_server(const std::vector<std::string> & files,
+					     unsigned n_threads);
+
+    /** Start a remote server using a pool of threads for the last opened
+     *  WritableDatabase.
+     *
+     *  @return	The TCP port on localhost which the server listens on.
+     */
+    virtual int start_threaded_remote_server_for_wdb(unsigned n_threads);
+
     /// Create a Database object for the last opened WritableDatabase.
     virtual Xapian::Database get_writable_database_as_database();
 
@@ -76,6 +76,8 @@ using namespace std;
 struct pid_fd {
     pid_t pid;
     int fd;
+    // Does the server need to be told to exit by clean_up()?
+    bool persistent;
 };
 
 static pid_fd pid_to_fd[16];
@@ -104,7 +106,7 @@ on_SIGCHLD(int /*sig*/)
 }
 
 static int
-launch_xapian_tcpsrv(const string & args)
+launch_xapian_tcpsrv(const string & args, bool one_shot = true)
 {
     int port = DEFAULT_PORT;
 
@@ -112,7 +114,9 @@ launch_xapian_tcpsrv(const string & args)
     // if xapian-tcpsrv doesn't start listening successfully.
     signal(SIGCHLD, SIG_DFL);
 try_next_port:
-    string cmd = XAPIAN_TCPSRV " --one-shot --interface " LOCALHOST " --port ";
+    string cmd = XAPIAN_TCPSRV;
+    if (one_shot) cmd += " --one-shot";
+    cmd += " --interface " LOCALHOST " --port ";
     cmd += str(port);
     cmd += " ";
     cmd += args;
@@ -215,6 +219,7 @@ try_next_port:
 	if (pid_to_fd[i].pid == 0) {
 	    pid_to_fd[i].fd = tracked_fd;
 	    pid_to_fd[i].pid = child;
+	    pid_to_fd[i].persistent = !one_shot;
 	    break;
 	}
     }
@@ -383,6 +388,35 @@ BackendManagerRemoteTcp::get_writable_database_again()
     return Xapian::Remote::open_writable(LOCALHOST, port);
 }
 
+int
+BackendManagerRemoteTcp::start_threaded_remote_server(const vector<string> & files,
+						      unsigned n_threads)
+{
+#ifdef HAVE_FORK
+    string args = "--threads ";
+    args += str(n_threads);
+    args += ' ';
+    args += get_remote_database_args(files, 300000);
+    return launch_xapian_tcpsrv(args, false);
+#else
+    return BackendManager::start_threaded_remote_server(files, n_threads);
+#endif
+}
+
+int
+BackendManagerRemoteTcp::start_threaded_remote_server_for_wdb(unsigned n_threads)
+{
+#ifdef HAVE_FORK
+    string args = "--threads ";
+    args += str(n_threads);
+    args += ' ';
+    args += get_writable_database_as_database_args();
+    return launch_xapian_tcpsrv(args, false);
+#else
+    return BackendManager::start_threaded_remote_server_for_wdb(n_threads);
+#endif
+}
+
 void
 BackendManagerRemoteTcp::clean_up()
 {
@@ -391,6 +425,8 @@ BackendManagerRemoteTcp::clean_up()
     for (unsigned i = 0; i < sizeof(pid_to_fd) / sizeof(pid_fd); ++i) {
 	pid_t child = pid_to_fd[i].pid;
 	if (child) {
+	    // A server which isn't one-shot won't exit by itself.
+	    if (pid_to_fd[i].persistent) kill(child, SIGTERM);
 	    int status;
 	    while (waitpid(child, &status, 0) == -1 && errno == EINTR) { }
 	    // Other possible error from waitpid is ECHILD, which it seems can
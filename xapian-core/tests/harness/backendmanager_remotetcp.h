@@ -64,6 +64,15 @@ class BackendManagerRemoteTcp : public BackendManagerRemote {
     /// Create a WritableDatabase object for the last opened WritableDatabase.
     Xapian::WritableDatabase get_writable_database_again();
 
+    /// Start a server which uses a pool of threads, returning its port.
+    int start_threaded_remote_server(const std::vector<std::string> & files,
+				     unsigned n_threads);
+
+    /** Start a server which uses a pool of threads for the last opened
+     *  WritableDatabase, returning its port.
+     */
+    int start_threaded_remote_server_for_wdb(unsigned n_threads);
+
     /// Called after each test, to perform any necessary cleanup.
     void clean_up();
 };
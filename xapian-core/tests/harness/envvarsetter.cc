@@ -0,0 +1,87 @@
+/** @file envvarsetter.cc
+ * @brief Set an environment variable for the lifetime of an object.
+ */
+/* Copyright (C) 2026 The Xapian contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include <config.h>
+
+#include "envvarsetter.h"
+
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+
+static void
+set_env(const string & name, const string & value)
+{
+#ifdef HAVE__PUTENV_S
+    _putenv_s(name.c_str(), value.c_str());
+#elif defined HAVE_SETENV
+    setenv(name.c_str(), value.c_str(), 1);
+#else
+    // The string passed to putenv() becomes part of the environment, so it
+    // has to stay allocated.
+    string setting = name;
+    setting += '=';
+    setting += value;
+    char * buf = new char[setting.size() + 1];
+    memcpy(buf, setting.c_str(), setting.size() + 1);
+    putenv(buf);
+#endif
+}
+
+static void
+unset_env(const string & name)
+{
+#ifdef HAVE__PUTENV_S
+    // Setting an empty value removes the variable.
+    _putenv_s(name.c_str(), "");
+#elif defined HAVE_SETENV
+    unsetenv(name.c_str());
+#else
+    // The closest we can portably get is an empty value.
+    set_env(name, string());
+#endif
+}
+
+EnvVarSetter::EnvVarSetter(const string & name_, const string & value)
+    : name(name_), was_set(false)
+{
+    const char * p = getenv(name.c_str());
+    if (p) {
+	old_value = p;
+	was_set = true;
+    }
+    set(value);
+}
+
+void
+EnvVarSetter::set(const string & value)
+{
+    set_env(name, value);
+}
+
+EnvVarSetter::~EnvVarSetter()
+{
+    if (was_set) {
+	set_env(name, old_value);
+    } else {
+	unset_env(name);
+    }
+}
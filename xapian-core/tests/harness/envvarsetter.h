@@ -0,0 +1,56 @@
+/** @file envvarsetter.h
+ * @brief Set an environment variable for the lifetime of an object.
+ */
+/* Copyright (C) 2026 The Xapian contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef XAPIAN_INCLUDED_ENVVARSETTER_H
+#define XAPIAN_INCLUDED_ENVVARSETTER_H
+
+#include <string>
+
+/** Set an environment variable, and restore its old value on destruction.
+ *
+ *  Many tuning settings are read from the environment, so this allows a
+ *  testcase to change one without affecting the testcases which run after
+ *  it, even if it fails.
+ */
+class EnvVarSetter {
+    std::string name;
+
+    std::string old_value;
+
+    bool was_set;
+
+    /// Don't allow copying.
+    EnvVarSetter(const EnvVarSetter &);
+
+    /// Don't allow assignment.
+    void operator=(const EnvVarSetter &);
+
+  public:
+    /// Set environment variable @a name_ to @a value.
+    EnvVarSetter(const std::string & name_, const std::string & value);
+
+    /// Set the environment variable to @a value.
+    void set(const std::string & value);
+
+    /// Restore the environment variable's old value.
+    ~EnvVarSetter();
+};
+
+#endif // XAPIAN_INCLUDED_ENVVARSETTER_H
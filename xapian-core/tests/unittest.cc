@@ -22,9 +22,11 @@
 
 #include <config.h>
 
+#include <algorithm>
 #include <cfloat>
 #include <cstring>
 #include <iostream>
+#include <vector>
 
 #define XAPIAN_UNITTEST
 static const char * unittest_assertion_failed = NULL;
@@ -69,11 +71,15 @@ using namespace std;
 #include "../common/errno_to_string.cc"
 #include "../common/fileutils.cc"
 #include "../common/serialise-double.cc"
+#include "../common/sha1.cc"
 #include "../common/str.cc"
 #include "../net/length.cc"
 #include "../net/serialise-error.cc"
 #include "../api/error.cc"
+#include "../api/editdistance.cc"
 #include "../api/sortable-serialise.cc"
+#include "../backends/glass/glass_blockcache.cc"
+#include "../backends/glass/glass_packedchunk.cc"
 
 // Stub replacement, which doesn't deal with escaping or producing valid UTF-8.
 // The full implementation needs Xapian::Utf8Iterator and
@@ -546,6 +552,300 @@ static bool test_strbool1()
     return true;
 }
 
+static bool test_glassblockcache1()
+{
+    const unsigned BLOCK_SIZE = 2048;
+    GlassBlockCache cache;
+    cache.set_max_size(0);
+    TEST(!cache.enabled());
+
+    GlassBlockCache::FileId file;
+    file.dev = 1;
+    file.ino = 42;
+    memcpy(file.uuid, "0123456789abcdef", 16);
+    byte block[BLOCK_SIZE], out[BLOCK_SIZE];
+    memset(block, 'x', BLOCK_SIZE);
+
+    // Nothing is cached while the cache is disabled.
+    cache.insert(GlassBlockCache::Key(file, 1, 7), block, BLOCK_SIZE);
+    TEST(!cache.lookup(GlassBlockCache::Key(file, 1, 7), out, BLOCK_SIZE));
+    TEST_EQUAL(cache.get_size(), 0);
+
+    cache.set_max_size(1024 * 1024);
+    TEST(cache.enabled());
+    cache.reset_stats();
+    for (uint4 n = 0; n < 10; ++n) {
+	block[0] = byte(n);
+	cache.insert(GlassBlockCache::Key(file, 1, n), block, BLOCK_SIZE);
+    }
+    for (uint4 n = 0; n < 10; ++n) {
+	TEST(cache.lookup(GlassBlockCache::Key(file, 1, n), out, BLOCK_SIZE));
+	TEST_EQUAL(out[0], byte(n));
+	TEST(memcmp(block + 1, out + 1, BLOCK_SIZE - 1) == 0);
+    }
+    // A different revision, file or offset shouldn't match.
+    TEST(!cache.lookup(GlassBlockCache::Key(file, 2, 0), out, BLOCK_SIZE));
+    GlassBlockCache::FileId other_file = file;
+    other_file.ino = 43;
+    TEST(!cache.lookup(GlassBlockCache::Key(other_file, 1, 0), out, BLOCK_SIZE));
+    other_file = file;
+    other_file.offset = 8192;
+    TEST(!cache.lookup(GlassBlockCache::Key(other_file, 1, 0), out, BLOCK_SIZE));
+    // A new database reusing the inode will have a different UUID.
+    other_file = file;
+    other_file.uuid[0] = 'X';
+    TEST(!cache.lookup(GlassBlockCache::Key(other_file, 1, 0), out, BLOCK_SIZE));
+    TEST_EQUAL(cache.get_hits(), 10);
+    TEST_EQUAL(cache.get_misses(), 4);
+
+    // Check the memory limit is respected, and that the most recently used
+    // blocks are kept.
+    const size_t limit = 64 * 1024;
+    cache.set_max_size(limit);
+    TEST_REL(cache.get_size(),<=,limit);
+    for (uint4 n = 0; n < 1000; ++n) {
+	cache.insert(GlassBlockCache::Key(file, 3, n), block, BLOCK_SIZE);
+	TEST_REL(cache.get_size(),<=,limit);
+	TEST(cache.lookup(GlassBlockCache::Key(file, 3, n), out, BLOCK_SIZE));
+    }
+    TEST_REL(cache.get_size(),>,0);
+
+    cache.set_max_size(0);
+    TEST_EQUAL(cache.get_size(), 0);
+    return true;
+}
+
+static bool test_glasspackedchunk1()
+{
+    // Check a range of chunk lengths, including ones which end at and just
+    // after block boundaries, and values needing 1 to 4 bytes.
+    static const unsigned lengths[] = { 1, 2, 5, 127, 128, 129, 300, 1000 };
+    for (unsigned n : lengths) {
+	vector<Xapian::docid> dids;
+	vector<Xapian::termcount> wdfs;
+	Xapian::docid did = 7;
+	for (unsigned i = 0; i != n; ++i) {
+	    dids.push_back(did);
+	    wdfs.push_back(i % 5 == 0 ? 0 : (i * 2654435761u) >> (8 * (i % 4)));
+	    did += 1 + ((i * 40503u) % 70000 >> (8 * (i % 3)));
+	    if (i % 97 == 3) did += 0x1000000;
+	}
+	string chunk = "header";
+	TEST(Glass::encode_packed_chunk(chunk, dids, wdfs));
+	TEST_EQUAL(chunk.substr(0, 6), "header");
+
+	vector<Xapian::docid> out_dids(1, 1);
+	vector<Xapian::termcount> out_wdfs(1, 1);
+	const char * start = chunk.data() + 6;
+	const char * end = chunk.data() + chunk.size();
+	TEST(Glass::decode_packed_chunk(start, end, dids[0],
+					 out_dids, out_wdfs));
+	// The decoded entries should be appended.
+	TEST_EQUAL(out_dids.size(), n + 1);
+	TEST(equal(dids.begin(), dids.end(), out_dids.begin() + 1));
+	TEST(equal(wdfs.begin(), wdfs.end(), out_wdfs.begin() + 1));
+
+	// Trailing junk or a truncated chunk should be spotted.
+	chunk += 'x';
+	start = chunk.data() + 6;
+	end = chunk.data() + chunk.size();
+	out_dids.clear();
+	out_wdfs.clear();
+	TEST(!Glass::decode_packed_chunk(start, end, dids[0],
+					  out_dids, out_wdfs));
+	--end;
+	for (size_t len = 0; len < size_t(end - start); len += 7) {
+	    out_dids.clear();
+	    out_wdfs.clear();
+	    TEST(!Glass::decode_packed_chunk(start, start + len, dids[0],
+					      out_dids, out_wdfs));
+	}
+    }
+    return true;
+}
+
+/// Check the SIMD stream-VByte decoders give the same results as the scalar.
+static bool test_glasspackedchunk2()
+{
+#ifdef HAVE_X86_SIMD_TARGETS
+    const unsigned N = 203;
+    uint4 values[N];
+    for (unsigned i = 0; i != N; ++i) {
+	values[i] = (i * 2654435761u) >> (8 * (i % 4));
+    }
+    string s;
+    encode_values(s, values, N);
+    // Pad so the vector decoders have room to load whole registers.
+    s.append(32, '\0');
+    const unsigned char * ctrl =
+	reinterpret_cast<const unsigned char *>(s.data());
+    const char * data = s.data() + (N + 3) / 4;
+    const char * end = s.data() + s.size();
+    const char * data_end = end - 32;
+
+    uint4 expected[N], out[N];
+    for (unsigned n = 0; n <= N; n += (n < 20 ? 1 : 17)) {
+	for (int delta = 0; delta != 2; ++delta) {
+	    const char * e;
+	    if (delta) {
+		e = decode_scalar<true>(ctrl, data, end, n, expected, 42u);
+	    } else {
+		e = decode_scalar<false>(ctrl, data, end, n, expected, 0u);
+	    }
+	    TEST(e != NULL);
+	    if (n == N) TEST_EQUAL(e, data_end);
+	    if (__builtin_cpu_supports("ssse3")) {
+		memset(out, 0, sizeof(out));
+		const char * r = delta ?
+		    decode_ssse3<true>(ctrl, data, end, n, out, 42) :
+		    decode_ssse3<false>(ctrl, data, end, n, out, 0);
+		TEST_EQUAL(r, e);
+		TEST(memcmp(out, expected, n * sizeof(uint4)) == 0);
+	    }
+	    if (__builtin_cpu_supports("avx2")) {
+		memset(out, 0, sizeof(out));
+		const char * r = delta ?
+		    decode_avx2<true>(ctrl, data, end, n, out, 42) :
+		    decode_avx2<false>(ctrl, data, end, n, out, 0);
+		TEST_EQUAL(r, e);
+		TEST(memcmp(out, expected, n * sizeof(uint4)) == 0);
+	    }
+	}
+    }
+    // Without the padding the vector decoders must not read past the end.
+    if (__builtin_cpu_supports("avx2")) {
+	TEST_EQUAL(decode_avx2<false>(ctrl, data, data_end, N, out, 0),
+		   data_end);
+	TEST(memcmp(out, values, sizeof(values)) == 0);
+	TEST(decode_avx2<false>(ctrl, data, data_end - 1, N, out, 0) == NULL);
+    }
+    return true;
+#else
+    SKIP_TEST("No x86 SIMD support");
+#endif
+}
+
+/// Simple dynamic programming edit distance to check against.
+static int
+naive_edit_distance(const vector<unsigned> & a, const vector<unsigned> & b)
+{
+    vector<vector<int> > d(a.size() + 1, vector<int>(b.size() + 1));
+    for (size_t i = 0; i <= a.size(); ++i) d[i][0] = int(i);
+    for (size_t j = 0; j <= b.size(); ++j) d[0][j] = int(j);
+    for (size_t i = 1; i <= a.size(); ++i) {
+	for (size_t j = 1; j <= b.size(); ++j) {
+	    int cost = (a[i - 1] != b[j - 1]);
+	    d[i][j] = min(min(d[i - 1][j], d[i][j - 1]) + 1,
+			  d[i - 1][j - 1] + cost);
+	    if (i > 1 && j > 1 && a[i - 1] == b[j - 2] && a[i - 2] == b[j - 1])
+		d[i][j] = min(d[i][j], d[i - 2][j - 2] + 1);
+	}
+    }
+    return d[a.size()][b.size()];
+}
+
+static bool test_editdistance1()
+{
+    static const struct { const char * a; const char * b; int d; } cases[] = {
+	{ "", "", 0 },
+	{ "", "abc", 3 },
+	{ "abc", "", 3 },
+	{ "hello", "hello", 0 },
+	{ "hello", "helo", 1 },
+	{ "wrod", "word", 1 },
+	{ "abcd", "badc", 2 },
+	{ "kitten", "sitting", 3 },
+	{ "ca", "abc", 3 },
+	{ NULL, NULL, 0 }
+    };
+    for (size_t i = 0; cases[i].a; ++i) {
+	vector<unsigned> a(cases[i].a, cases[i].a + strlen(cases[i].a));
+	vector<unsigned> b(cases[i].b, cases[i].b + strlen(cases[i].b));
+	EditDistanceCalculator calc(a.data(), int(a.size()));
+	TEST_EQUAL(calc(b.data(), int(b.size()), 10), cases[i].d);
+	TEST_EQUAL(edit_distance_unsigned(a.data(), int(a.size()),
+					  b.data(), int(b.size()), 10),
+		   cases[i].d);
+    }
+
+    // Compare both algorithms with the naive one on pseudo-random strings
+    // over a small alphabet, including some targets too long for the
+    // bit-parallel algorithm and some characters outside the BMP.
+    unsigned seed = 42;
+    for (int n = 0; n < 20000; ++n) {
+	vector<unsigned> a, b;
+	seed = seed * 1103515245 + 12345;
+	size_t len_a = (seed >> 16) % (n % 10 ? 12 : 80);
+	seed = seed * 1103515245 + 12345;
+	size_t len_b = (seed >> 16) % 12;
+	for (size_t i = 0; i != len_a + len_b; ++i) {
+	    seed = seed * 1103515245 + 12345;
+	    unsigned ch = 'a' + (seed >> 16) % 4;
+	    if ((seed >> 8) % 16 == 0) ch += 128 * 0x10000;
+	    (i < len_a ? a : b).push_back(ch);
+	}
+	int max_distance = n % 5;
+	int expect = naive_edit_distance(a, b);
+	EditDistanceCalculator calc(a.data(), int(a.size()));
+	int result = calc(b.data(), int(b.size()), max_distance);
+	if (expect <= max_distance) {
+	    TEST_EQUAL(result, expect);
+	} else {
+	    TEST_REL(result,>,max_distance);
+	}
+	result = edit_distance_unsigned(a.data(), int(a.size()),
+					b.data(), int(b.size()), max_distance);
+	if (expect <= max_distance) {
+	    TEST_EQUAL(result, expect);
+	} else {
+	    TEST_REL(result,>,max_distance);
+	}
+    }
+    return true;
+}
+
+/// Get the SHA-1 digest of @a data in hex.
+static string
+sha1_hex(const string & data, size_t piece)
+{
+    SHA1 sha1;
+    for (size_t i = 0; i < data.size(); i += piece) {
+	sha1.update(data.data() + i, min(piece, data.size() - i));
+    }
+    string digest;
+    sha1.append_digest(digest);
+    string result;
+    for (unsigned char ch : digest) {
+	result += "0123456789abcdef"[ch >> 4];
+	result += "0123456789abcdef"[ch & 0x0f];
+    }
+    return result;
+}
+
+static bool test_sha1()
+{
+    // Test vectors from FIPS 180-2 and RFC 3174.
+    static const struct { const char * data; const char * digest; } cases[] = {
+	{ "", "da39a3ee5e6b4b0d3255bfef95601890afd80709" },
+	{ "abc", "a9993e364706816aba3e25717850c26c9cd0d89d" },
+	{ "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+	  "84983e441c3bd26ebaae4aa1f95129e5e54670f1" },
+	{ NULL, NULL }
+    };
+    for (size_t i = 0; cases[i].data; ++i) {
+	// Add the data in pieces of various sizes.
+	for (size_t piece = 1; piece <= 64; piece *= 4) {
+	    TEST_EQUAL(sha1_hex(cases[i].data, piece), cases[i].digest);
+	}
+    }
+    string a_million(1000000, 'a');
+    TEST_EQUAL(sha1_hex(a_million, 1000),
+	       "34aa973cd4c4daa4f61eeb2bdbad27316534016f");
+    TEST_EQUAL(sha1_hex(a_million, a_million.size()),
+	       "34aa973cd4c4daa4f61eeb2bdbad27316534016f");
+    return true;
+}
+
 static const test_desc tests[] = {
     TESTCASE(simple_exceptions_work1),
     TESTCASE(class_exceptions_work1),
@@ -560,6 +860,11 @@ static const test_desc tests[] = {
     TESTCASE(sortableserialise1),
     TESTCASE(tostring1),
     TESTCASE(strbool1),
+    TESTCASE(glassblockcache1),
+    TESTCASE(glasspackedchunk1),
+    TESTCASE(glasspackedchunk2),
+    TESTCASE(editdistance1),
+    TESTCASE(sha1),
     END_OF_TESTCASES
 };
 
@@ -177,6 +177,15 @@ double
 BM25Weight::get_maxpart() const
 {
     LOGCALL(WTCALC, double, "BM25Weight::get_maxpart", NO_ARGS);
+    RETURN(get_maxpart_for_wdf(get_wdf_upper_bound()));
+}
+
+double
+BM25Weight::get_maxpart_for_wdf(Xapian::termcount wdf_max) const
+{
+    LOGCALL(WTCALC, double, "BM25Weight::get_maxpart_for_wdf", wdf_max);
+    wdf_max = min(wdf_max, get_wdf_upper_bound());
+    if (wdf_max == 0) RETURN(0.0);
     double denom = param_k1;
     if (param_k1 != 0.0) {
 	if (param_b != 0.0) {
@@ -189,14 +198,14 @@ BM25Weight::get_maxpart() const
 	    // better bound can be found by simply evaluating at
 	    // doclen=doclen_min and wdf=wdf_max.
 	    Xapian::doclength normlen_lb =
-		 max(max(get_wdf_upper_bound(), get_doclength_lower_bound()) * len_factor, param_min_normlen);
+		 max(max(wdf_max, get_doclength_lower_bound()) * len_factor, param_min_normlen);
 	    denom *= (normlen_lb * param_b + (1 - param_b));
 	}
     }
-    double wdf_max = get_wdf_upper_bound();
-    denom += wdf_max;
+    double wdf_double = wdf_max;
+    denom += wdf_double;
     AssertRel(denom,>,0);
-    RETURN(termweight * (wdf_max / denom));
+    RETURN(termweight * (wdf_double / denom));
 }
 
 /* The BM25 formula gives:
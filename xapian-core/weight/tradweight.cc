@@ -157,6 +157,16 @@ TradWeight::get_maxpart() const
     return termweight * (wdf_max / (doclen_lb * len_factor + wdf_max));
 }
 
+double
+TradWeight::get_maxpart_for_wdf(Xapian::termcount wdf_max) const
+{
+    wdf_max = min(wdf_max, get_wdf_upper_bound());
+    if (wdf_max == 0) return 0.0;
+    double wdf_double = wdf_max;
+    Xapian::termcount doclen_lb = get_doclength_lower_bound();
+    return termweight * (wdf_double / (doclen_lb * len_factor + wdf_double));
+}
+
 double
 TradWeight::get_sumextra(Xapian::termcount, Xapian::termcount) const
 {
@@ -45,6 +45,8 @@ TermFreqs::get_description() const {
     desc += str(collfreq);
     desc += ", max_part=";
     desc += str(max_part);
+    desc += ", wdf_upper_bound=";
+    desc += str(wdf_upper_bound);
     desc += ")";
     return desc;
 }
@@ -94,6 +96,11 @@ Weight::Internal::accumulate_stats(const Xapian::Database::Internal &subdb,
 	TermFreqs & tf = termfreqs[term];
 	tf.termfreq += sub_tf;
 	tf.collfreq += sub_cf;
+	if (want_wdf_upper_bounds && sub_cf) {
+	    Xapian::termcount sub_wdf_ub = subdb.get_wdf_upper_bound(term);
+	    if (sub_wdf_ub > tf.wdf_upper_bound)
+		tf.wdf_upper_bound = sub_wdf_ub;
+	}
     }
 
     const set<Xapian::docid> & items(rset.internal->get_items());
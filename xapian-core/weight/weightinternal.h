@@ -40,22 +40,30 @@ struct TermFreqs {
     Xapian::doccount reltermfreq;
     Xapian::termcount collfreq;
     double max_part;
+    /// An upper bound on the wdf of the term in any document.
+    Xapian::termcount wdf_upper_bound;
 
-    TermFreqs() : termfreq(0), reltermfreq(0), collfreq(0), max_part(0.0) {}
+    TermFreqs()
+	: termfreq(0), reltermfreq(0), collfreq(0), max_part(0.0),
+	  wdf_upper_bound(0) {}
     TermFreqs(Xapian::doccount termfreq_,
 	      Xapian::doccount reltermfreq_,
 	      Xapian::termcount collfreq_,
-	      double max_part_ = 0.0)
+	      double max_part_ = 0.0,
+	      Xapian::termcount wdf_upper_bound_ = 0)
 	: termfreq(termfreq_),
 	  reltermfreq(reltermfreq_),
 	  collfreq(collfreq_),
-	  max_part(max_part_) {}
+	  max_part(max_part_),
+	  wdf_upper_bound(wdf_upper_bound_) {}
 
     void operator +=(const TermFreqs & other) {
 	termfreq += other.termfreq;
 	reltermfreq += other.reltermfreq;
 	collfreq += other.collfreq;
 	max_part += other.max_part;
+	if (other.wdf_upper_bound > wdf_upper_bound)
+	    wdf_upper_bound = other.wdf_upper_bound;
     }
 
     /// Return a std::string describing this object.
@@ -98,6 +106,13 @@ class Weight::Internal {
      */
     bool have_max_part;
 
+    /** Should accumulate_stats() find an upper bound on the wdf of each term?
+     *
+     *  This is only needed for statistics which a remote server is going to
+     *  send to the client, so it's off by default.
+     */
+    bool want_wdf_upper_bounds;
+
     /** Database to get the bounds on doclength and wdf from. */
     Xapian::Database db;
 
@@ -114,7 +129,8 @@ class Weight::Internal {
 	  subdbs(0), finalised(false),
 #endif
 	  total_length(0), collection_size(0), rset_size(0),
-	  total_term_count(0), have_max_part(false) { }
+	  total_term_count(0), have_max_part(false),
+	  want_wdf_upper_bounds(false) { }
 
     /** Add in the supplied statistics from a sub-database.
      *